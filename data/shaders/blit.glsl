@@ -21,9 +21,18 @@ varying highp   vec2        v_tex_pos;
 attribute highp     vec3    a_pos;
 attribute mediump   vec2    a_tex_pos;
 
+#ifdef STATIC
+// Static quads are in their own frame.  u_rot converts them to the
+// observed frame, and u_rot2 to the view frame.
+uniform highp mat3 u_rot;
+uniform highp mat3 u_rot2;
+#endif
+
 void main()
 {
-#ifdef PROJ
+#ifdef STATIC
+    gl_Position = proj(u_rot2 * (u_rot * a_pos));
+#elif defined(PROJ)
     gl_Position = proj(a_pos);
 #else
     gl_Position = vec4(a_pos, 1.0);
@@ -22,12 +22,25 @@ varying lowp    vec4        v_color;
 attribute highp   vec4       a_pos;
 attribute highp   vec3       a_sky_pos;
 
+#ifdef STATIC
+// Same as in mesh.glsl.
+uniform highp mat3 u_rot;
+uniform highp mat3 u_rot2;
+#endif
+
 void main()
 {
+#ifdef STATIC
+    // The static quads are already in the sky frame.
+    highp vec3 sky_pos = a_pos.xyz;
+    gl_Position = proj(u_rot2 * (u_rot * a_pos.xyz));
+#else
+    highp vec3 sky_pos = a_sky_pos;
     gl_Position = proj(a_pos.xyz);
+#endif
     const lowp float height = 0.2;
     const lowp float alpha = 0.15;
-    lowp float d = smoothstep(height, 0.0, abs(a_sky_pos.z));
+    lowp float d = smoothstep(height, 0.0, abs(sky_pos.z));
     v_color = u_color;
     v_color.a *= alpha * d;
 }
@@ -14,12 +14,58 @@ varying   lowp    vec4 v_color;
 #includes "projections.glsl"
 
 attribute highp   vec3 a_pos;
+#ifndef STATIC
 attribute lowp    vec4 a_color;
+#endif
+
+#ifdef STATIC
+// Static meshes are in their own frame.  u_rot converts them to the
+// observed frame (before refraction), and u_rot2 to the view frame.
+uniform highp mat3 u_rot;
+uniform highp mat3 u_rot2;
+uniform lowp  vec4 u_color;
+#endif
+
+#ifdef REFRACTION
+uniform highp vec2 u_refraction; // Pressure (mbar) and temperature (deg C).
+
+// Same as the refraction function in src/algos/refraction.c.
+highp vec3 refraction(highp vec3 v)
+{
+    const highp float DD2R = 0.017453292519943295;
+    const highp float MIN_ALT = -3.54;
+    const highp float TRANSITION = 1.46;
+    highp float alt, p, r;
+
+    if (v.z < sin((MIN_ALT - TRANSITION) * DD2R)) return v;
+    alt = asin(v.z) / DD2R;
+    p = 1.02 * u_refraction.x / 1010.0 * 283.0 /
+        (273.0 + u_refraction.y) / 60.0;
+    if (alt > MIN_ALT) {
+        r = p / tan((alt + 10.3 / (alt + 5.11)) * DD2R) + 0.0019279;
+        alt = min(alt + r, 90.0);
+    } else {
+        r = p / tan((MIN_ALT + 10.3 / (MIN_ALT + 5.11)) * DD2R) + 0.0019279;
+        alt += r * (alt - (MIN_ALT - TRANSITION)) / TRANSITION;
+    }
+    v.z = sin(alt * DD2R);
+    return normalize(v);
+}
+#endif
 
 void main()
 {
+#ifdef STATIC
+    highp vec3 pos = u_rot * a_pos;
+#ifdef REFRACTION
+    pos = refraction(pos);
+#endif
+    gl_Position = proj(u_rot2 * pos);
+    v_color = u_color;
+#else
     gl_Position = proj(a_pos);
     v_color = a_color;
+#endif
 }
 
 #endif
@@ -254,6 +254,48 @@ int orbit_compute_pv(
         double od,        // variation of o in time (rad/day).
         double wd);       // variation of w in time (rad/day).
 
+/*
+ * Type: orbit_elements_t
+ * Kepler orbit elements used by <orbit_compute_pv_batch>.
+ *
+ * Using the perihelion distance instead of the semi major axis allows to
+ * represent all the orbits, including the parabolic ones.
+ */
+typedef struct orbit_elements {
+    double d;   // Epoch of the mean anomaly (MJD).
+    double i;   // Inclination (rad).
+    double o;   // Longitude of the Ascending Node (rad).
+    double w;   // Argument of Perihelion (rad).
+    double q;   // Perihelion distance.
+    double e;   // Eccentricity.
+    double n;   // Daily motion (rad/day), 0 to compute it from q and e.
+    double ma;  // Mean anomaly at epoch (rad).
+} orbit_elements_t;
+
+/*
+ * Function: orbit_compute_pv_batch
+ * Compute positions and speeds of several bodies from orbit elements.
+ *
+ * Contrary to <orbit_compute_pv>, this supports elliptic, near parabolic
+ * and hyperbolic orbits, and solves the Kepler equation with a fixed
+ * number of iterations, processing the bodies by blocks so that the loops
+ * can be vectorized.  For comets we can use the perihelion passage time as
+ * epoch, with a mean anomaly of zero.
+ *
+ * Parameters:
+ *   mjd    - Time of the positions (MJD).
+ *   k      - Square root of the gravitational parameter of the central
+ *            body, in AU^(3/2)/day.  For the sun this is the Gaussian
+ *            gravitational constant 0.01720209895.
+ *   nb     - Number of bodies.
+ *   elems  - Orbit elements of the bodies.
+ *   pos    - Get the computed positions.
+ *   speed  - Get the computed speeds (can be NULL).
+ */
+void orbit_compute_pv_batch(double mjd, double k, int nb,
+                            const struct orbit_elements *elems,
+                            double (*pos)[3], double (*speed)[3]);
+
 /*
  * Function: orbit_elements_from_pv
  * Compute Kepler orbit element from a body positon and speed.
@@ -7,10 +7,23 @@
  * repository.
  */
 
+#include "algos.h"
+
 #include <assert.h>
 #include <math.h>
 #define PI (3.141592653589793238462643)
 
+// Number of bodies processed together by orbit_compute_pv_batch.
+#define BATCH_SIZE 64
+
+// Fixed number of iterations of the batch hyperbolic Kepler equation
+// solver.  With the starting value we use, this is enough to reach double
+// precision for all the eccentricities and mean anomalies.
+#define KEPLER_HYPERBOLIC_ITER 9
+
+// Eccentricity distance to 1 under which we use the near parabolic algo.
+#define NEAR_PARABOLIC 0.02
+
 static void vec3_cross(const double a[3], const double b[3], double out[3])
 {
     double tmp[3];
@@ -128,6 +141,168 @@ int orbit_compute_pv(
     return 0;
 }
 
+// Number of Halley iterations needed to solve the elliptic Kepler equation
+// to double precision for eccentricities up to a given value.
+static int kepler_elliptic_iter(double e)
+{
+    return e <= 0.5 ? 2 : e <= 0.9 ? 3 : 4;
+}
+
+// Solve the elliptic Kepler equation (E - e sin(E) = M) with Halley's
+// method, using a fixed number of iterations so that the batch loop has
+// no data dependent branches.
+static inline double kepler_elliptic(double m, double e, int iter)
+{
+    double x, f, fp, s;
+    int k;
+    m = remainder(m, 2.0 * PI);
+    x = m + e * sin(m) * (1.0 + e * cos(m));
+    for (k = 0; k < iter; k++) {
+        s = e * sin(x);
+        f = x - s - m;
+        fp = 1.0 - e * cos(x);
+        x -= f / (fp - 0.5 * f * s / fp);
+    }
+    return x;
+}
+
+// Solve the hyperbolic Kepler equation (e sinh(H) - H = M) with Newton's
+// method.
+static inline double kepler_hyperbolic(double m, double e)
+{
+    double x;
+    int k;
+    x = (m < 0 ? -1 : 1) * log(2.0 * fabs(m) / e + 1.8);
+    for (k = 0; k < KEPLER_HYPERBOLIC_ITER; k++)
+        x -= (e * sinh(x) - x - m) / (e * cosh(x) - 1.0);
+    return x;
+}
+
+// Compute true anomaly for near parabolic orbits, from the time since
+// perihelion.  Algo from http://stjarnhimlen.se/comp/tutorial.html
+static inline double near_parabolic(double dt, double q, double e, double k)
+{
+    double a, b, w, f, a1, a2, a3, c, g, w2;
+    a = 0.75 * dt * k * sqrt((1.0 + e) / (q * q * q));
+    b = sqrt(1.0 + a * a);
+    w = cbrt(b + a) - cbrt(b - a);
+    w2 = w * w;
+    f = (1.0 - e) / (1.0 + e);
+    a1 = 2.0 / 3 + 2.0 / 5 * w2;
+    a2 = 7.0 / 5 + 33.0 / 35 * w2 + 37.0 / 175 * w2 * w2;
+    a3 = w2 * (432.0 / 175 + 956.0 / 1125 * w2 + 84.0 / 1575 * w2 * w2);
+    c = w2 / (1.0 + w2);
+    g = f * c * c;
+    w = w * (1.0 + f * c * (a1 + a2 * g + a3 * g * g));
+    return 2.0 * atan(w);
+}
+
+/*
+ * Function: orbit_compute_pv_batch
+ * Compute positions and speeds of several bodies from orbit elements.
+ */
+void orbit_compute_pv_batch(double mjd, double k, int nb,
+                            const orbit_elements_t *elems,
+                            double (*pos)[3], double (*speed)[3])
+{
+    int i, j, n, iter, type[BATCH_SIZE];
+    // Mean anomalies, and positions and speeds in the orbit plane, with
+    // the x axis pointing to the perihelion.
+    double m[BATCH_SIZE], mm[BATCH_SIZE], a[BATCH_SIZE];
+    double x[BATCH_SIZE], y[BATCH_SIZE], vx[BATCH_SIZE], vy[BATCH_SIZE];
+    double e, b, dt, an, sa, ca, v, r, f, p[3], q[3], cw, sw, co, so, ci, si;
+    const orbit_elements_t *el;
+    enum {ELLIPTIC, NEAR_PARABOLIC_, HYPERBOLIC};
+
+    for (i = 0; i < nb; i += BATCH_SIZE) {
+        n = nb - i < BATCH_SIZE ? nb - i : BATCH_SIZE;
+
+        // Compute the mean anomalies.
+        iter = 0;
+        for (j = 0; j < n; j++) {
+            el = &elems[i + j];
+            e = el->e;
+            dt = mjd - el->d;
+            type[j] = fabs(e - 1.0) < NEAR_PARABOLIC ? NEAR_PARABOLIC_ :
+                      e < 1.0 ? ELLIPTIC : HYPERBOLIC;
+            a[j] = (e == 1.0) ? 0 : el->q / (1.0 - e);
+            mm[j] = el->n ?: (a[j] ? k / sqrt(fabs(a[j] * a[j] * a[j])) : 0);
+            // For near parabolic orbits we store the time since perihelion.
+            if (type[j] == NEAR_PARABOLIC_)
+                m[j] = dt + (mm[j] ? el->ma / mm[j] : 0);
+            else
+                m[j] = mm[j] * dt + el->ma;
+            if (type[j] == ELLIPTIC && kepler_elliptic_iter(e) > iter)
+                iter = kepler_elliptic_iter(e);
+        }
+
+        // Solve the Kepler equations.  The elliptic case is the most
+        // common, so we keep it in its own loop, using the same number of
+        // iterations for all the orbits of the block.
+        for (j = 0; j < n; j++) {
+            if (type[j] != ELLIPTIC) continue;
+            e = elems[i + j].e;
+            an = kepler_elliptic(m[j], e, iter);
+            sa = sin(an);
+            ca = cos(an);
+            b = a[j] * sqrt(1.0 - e * e);
+            f = mm[j] / (1.0 - e * ca);
+            x[j] = a[j] * (ca - e);
+            y[j] = b * sa;
+            vx[j] = -a[j] * sa * f;
+            vy[j] = b * ca * f;
+        }
+        for (j = 0; j < n; j++) {
+            if (type[j] == ELLIPTIC) continue;
+            el = &elems[i + j];
+            e = el->e;
+            if (type[j] == HYPERBOLIC) {
+                an = kepler_hyperbolic(m[j], e);
+                sa = sinh(an);
+                ca = cosh(an);
+                b = -a[j] * sqrt(e * e - 1.0);
+                f = mm[j] / (e * ca - 1.0);
+                x[j] = a[j] * (ca - e);
+                y[j] = b * sa;
+                vx[j] = a[j] * sa * f;
+                vy[j] = b * ca * f;
+            } else {
+                v = near_parabolic(m[j], el->q, e, k);
+                r = el->q * (1.0 + e) / (1.0 + e * cos(v));
+                f = k / sqrt(el->q * (1.0 + e));
+                x[j] = r * cos(v);
+                y[j] = r * sin(v);
+                vx[j] = -f * sin(v);
+                vy[j] = f * (e + cos(v));
+            }
+        }
+
+        // Rotate into the ecliptic frame.
+        for (j = 0; j < n; j++) {
+            el = &elems[i + j];
+            cw = cos(el->w);
+            sw = sin(el->w);
+            co = cos(el->o);
+            so = sin(el->o);
+            ci = cos(el->i);
+            si = sin(el->i);
+            p[0] = cw * co - sw * so * ci;
+            p[1] = cw * so + sw * co * ci;
+            p[2] = sw * si;
+            q[0] = -sw * co - cw * so * ci;
+            q[1] = -sw * so + cw * co * ci;
+            q[2] = cw * si;
+            pos[i + j][0] = x[j] * p[0] + y[j] * q[0];
+            pos[i + j][1] = x[j] * p[1] + y[j] * q[1];
+            pos[i + j][2] = x[j] * p[2] + y[j] * q[2];
+            if (!speed) continue;
+            speed[i + j][0] = vx[j] * p[0] + vy[j] * q[0];
+            speed[i + j][1] = vx[j] * p[1] + vy[j] * q[1];
+            speed[i + j][2] = vx[j] * p[2] + vy[j] * q[2];
+        }
+    }
+}
+
 /*
  * Function: orbit_elements_from_pv
  * Compute Kepler orbit element from a body positon and speed.
@@ -232,3 +407,125 @@ int orbit_elements_from_pv(const double p[3], const double v[3], double mu,
 
     return 0;
 }
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "log.h"
+#include "system.h"
+#include "tests.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define GAUSS_K 0.01720209895
+
+static double dist3(const double a[3], const double b[3])
+{
+    double d[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    return vec3_norm(d);
+}
+
+// Simple deterministic random generator, in [0, 1).
+static double rand01(uint32_t *seed)
+{
+    *seed = *seed * 1664525 + 1013904223;
+    return (*seed >> 8) / (double)(1 << 24);
+}
+
+static void random_elements(uint32_t *seed, double max_e,
+                            orbit_elements_t *el)
+{
+    double a = 0.5 + rand01(seed) * 50;
+    el->e = rand01(seed) * max_e;
+    el->d = 50000 + rand01(seed) * 1000;
+    el->i = rand01(seed) * PI;
+    el->o = rand01(seed) * 2 * PI;
+    el->w = rand01(seed) * 2 * PI;
+    el->ma = rand01(seed) * 2 * PI;
+    el->q = a * (1.0 - el->e);
+    el->n = GAUSS_K / sqrt(a * a * a);
+}
+
+static void test_orbit_batch(void)
+{
+    int i;
+    uint32_t seed = 1;
+    double a, n, ps[3], vs[3], p[3], v[3], r, vv;
+    orbit_elements_t el[256];
+    double pos[256][3], speed[256][3];
+
+    // Elliptic orbits against the scalar function.
+    for (i = 0; i < 256; i++) random_elements(&seed, 0.9, &el[i]);
+    orbit_compute_pv_batch(60000, GAUSS_K, 256, el, pos, speed);
+    for (i = 0; i < 256; i++) {
+        a = el[i].q / (1.0 - el[i].e);
+        orbit_compute_pv(1e-12, 60000, ps, vs, el[i].d, el[i].i, el[i].o,
+                         el[i].w, a, el[i].n, el[i].e, el[i].ma, 0, 0);
+        assert(dist3(pos[i], ps) < 1e-9 * a);
+        assert(dist3(speed[i], vs) < 1e-12);
+    }
+
+    // Near parabolic orbit close to perihelion against the scalar
+    // function, using the mean anomaly epoch at perihelion.
+    el[0] = (orbit_elements_t) {
+        .d = 60000, .i = 0.3, .o = 1, .w = 2, .q = 1, .e = 0.99};
+    a = el[0].q / (1.0 - el[0].e);
+    n = GAUSS_K / sqrt(a * a * a);
+    for (i = -100; i <= 100; i += 10) {
+        orbit_compute_pv_batch(60000 + i, GAUSS_K, 1, el, &p, NULL);
+        orbit_compute_pv(1e-12, 60000 + i, ps, NULL, 60000, 0.3, 1, 2,
+                         a, n, 0.99, 0, 0, 0);
+        assert(dist3(p, ps) < 1e-5);
+    }
+
+    // Hyperbolic orbit: check the energy conservation.
+    el[0] = (orbit_elements_t) {.d = 60000, .i = 0.5, .q = 2, .e = 1.5};
+    a = el[0].q / (1.0 - el[0].e);
+    for (i = -1000; i <= 1000; i += 100) {
+        orbit_compute_pv_batch(60000 + i, GAUSS_K, 1, el, &p, &v);
+        r = vec3_norm(p);
+        vv = vec3_norm2(v);
+        test_float(vv, GAUSS_K * GAUSS_K * (2 / r - 1 / a), 1e-15);
+    }
+}
+
+static void bench_orbit_batch(void)
+{
+    const int nb = 1000000;
+    int i, k;
+    uint32_t seed = 1;
+    double t, a, p[3];
+    orbit_elements_t *el = malloc(nb * sizeof(*el));
+    double (*pos)[3] = malloc(nb * sizeof(*pos));
+
+    for (i = 0; i < nb; i++) random_elements(&seed, 0.5, &el[i]);
+
+    // Scalar version, with the fast approximation and with iterations.
+    for (k = 0; k < 2; k++) {
+        t = sys_get_unix_time();
+        for (i = 0; i < nb; i++) {
+            a = el[i].q / (1.0 - el[i].e);
+            orbit_compute_pv(k ? 1e-10 : 0, 60000, p, NULL,
+                             el[i].d, el[i].i, el[i].o, el[i].w, a,
+                             el[i].n, el[i].e, el[i].ma, 0, 0);
+        }
+        LOG_I("orbit_compute_pv (precision %g): %.0f ms", k ? 1e-10 : 0,
+              (sys_get_unix_time() - t) * 1000);
+    }
+
+    t = sys_get_unix_time();
+    orbit_compute_pv_batch(60000, GAUSS_K, nb, el, pos, NULL);
+    LOG_I("orbit_compute_pv_batch: %.0f ms",
+          (sys_get_unix_time() - t) * 1000);
+
+    free(el);
+    free(pos);
+}
+
+TEST_REGISTER(NULL, test_orbit_batch, TEST_AUTO);
+TEST_REGISTER(NULL, bench_orbit_batch, 0);
+
+#endif
@@ -268,12 +268,13 @@ void asset_release(const char *url)
  * Set a global function to handle special urls.
  *
  * The hook function will be called for each new requests, and will bypass
- * the normal query, except if the return code is set to -1.
+ * the normal query, except if the return code is set to -1.  Pass a NULL
+ * function to remove the hook.
  */
 void asset_set_hook(void *user,
         void *(*fn)(void *user, const char *url, int *size, int *code))
 {
-    assert(!g_hook.fn);
+    assert(!g_hook.fn || !fn);
     g_hook.user = user;
     g_hook.fn = fn;
 }
@@ -8,6 +8,7 @@
  */
 
 #include "swe.h"
+#include "name_index.h"
 #include "algos/utctt.h"
 #include "navigation.h"
 #include "render.h"
@@ -50,6 +51,49 @@ static json_value *core_fn_progressbars(obj_t *obj, const attribute_t *attr,
     return ret;
 }
 
+// Set/Get the maximum size in bytes of the renderer uv map grids cache.
+static json_value *core_fn_grid_cache_size(obj_t *obj, const attribute_t *attr,
+                                           const json_value *args)
+{
+    int size, max_size, hits, misses;
+    if (args && args->u.array.length) {
+        args_get(args, TYPE_INT, &size);
+        render_set_grid_cache_size(core->rend, size);
+    }
+    render_get_grid_cache_stats(core->rend, &size, &max_size, &hits, &misses);
+    return args_value_new(TYPE_INT, max_size);
+}
+
+// Set/Get the directory of the hips tiles snapshots.  An empty string
+// disables them.
+static json_value *core_fn_snapshot_dir(obj_t *obj, const attribute_t *attr,
+                                        const json_value *args)
+{
+    char dir[1024];
+    if (args && args->u.array.length) {
+        args_get(args, TYPE_STRING, dir);
+        hips_set_snapshot_dir(*dir ? dir : NULL);
+    }
+    return args_value_new(TYPE_STRING, hips_get_snapshot_dir());
+}
+
+// Usage statistics of the renderer uv map grids cache.
+static json_value *core_fn_grid_cache_stats(obj_t *obj, const attribute_t *attr,
+                                            const json_value *args)
+{
+    int size, max_size, hits, misses;
+    json_value *ret;
+    render_get_grid_cache_stats(core->rend, &size, &max_size, &hits, &misses);
+    ret = json_object_new(0);
+    json_object_push(ret, "size", json_integer_new(size));
+    json_object_push(ret, "max_size", json_integer_new(max_size));
+    json_object_push(ret, "hits", json_integer_new(hits));
+    json_object_push(ret, "misses", json_integer_new(misses));
+    json_object_push(ret, "hit_rate", json_double_new(
+                     hits + misses ? (double)hits / (hits + misses) : 0));
+    return ret;
+}
+
 EMSCRIPTEN_KEEPALIVE
 obj_t *core_get_module(const char *id)
 {
@@ -257,9 +301,15 @@ void core_init(double win_w, double win_h, double pixel_scale)
 void core_release(void)
 {
     obj_t *module;
+    hips_save_snapshots();
+    // The index keeps pointers to the modules and references to some of
+    // their objects.
+    name_index_clear();
     DL_FOREACH(core->obj.children, module) {
         if (module->klass->del) module->klass->del(module);
     }
+    free(core->point_lut);
+    core->point_lut = NULL;
 }
 
 /*
@@ -365,6 +415,35 @@ static bool is_below_horizon_hidden(void)
     return direction[2] >= 0;
 }
 
+/*
+ * Lookup table of the points radius and luminance for a given mag.
+ *
+ * During the rendering the result of <core_get_point_for_mag> only depends
+ * on the mag, so core_render computes it for regularly spaced mags, and
+ * the modules interpolate with <point_lut_get>.
+ */
+#define POINT_LUT_MAG_MIN -30.0
+#define POINT_LUT_STEP 0.05
+#define POINT_LUT_SIZE 1200
+
+// Constraints applied by core_get_point_for_mag.
+enum {
+    POINT_SKIPPED       = 1 << 0,
+    POINT_RADIUS_MIN    = 1 << 1,
+    POINT_RADIUS_MAX    = 1 << 2,
+    POINT_LUMINANCE_MAX = 1 << 3,
+};
+
+typedef struct {
+    int         flags;
+    double      radius;
+    double      luminance;
+} point_lut_entry_t;
+
+struct point_lut {
+    point_lut_entry_t   entries[POINT_LUT_SIZE];
+};
+
 // Get point for mag without any radius lower limit.
 static void core_get_point_for_mag_(
         double mag, double *radius, double *luminance)
@@ -387,27 +466,15 @@ static void core_get_point_for_mag_(
     if (luminance) *luminance = clamp(ld, 0, 1);
 }
 
-
-/*
- * Function: core_get_point_for_mag
- * Compute a point radius and luminosity from a observed magnitude.
- *
- * The function is almost linear, but when the points get too small,
- * I make the curve go to zero faster, so that the bright stars get a
- * higher contrast.  Also for very small points, we use a minimum radius
- * and instead lower the luminance.
- *
- * Parameters:
- *   mag       - The observed magnitude.
- *   radius    - Output radius in window pixels.
- *   luminance - Output luminance from 0 to 1, gamma corrected.  Ignored if
- *               set to NULL.
- */
-bool core_get_point_for_mag(double mag, double *radius, double *luminance)
+// Compute the point for a mag, also returning the constraints that have
+// been applied to the result (POINT_ flags).
+static bool get_point_for_mag(double mag, double *radius, double *luminance,
+                              int *flags)
 {
     double ld, r;
     double r_min = core->min_point_radius;
     const double r_skip = core->skip_point_radius;
+    int f = 0;
 
     // Fix aliasing on low res screen
     if (r_min * core->win_pixels_scale < 1.0)
@@ -420,6 +487,7 @@ bool core_get_point_for_mag(double mag, double *radius, double *luminance)
     if (r < r_skip) {
         *radius = 0;
         if (luminance) *luminance = 0;
+        if (flags) *flags = POINT_SKIPPED;
         return false;
     }
 
@@ -427,14 +495,79 @@ bool core_get_point_for_mag(double mag, double *radius, double *luminance)
     if (r > 0 && r < r_min) {
         ld *= pow((r - r_skip) / (r_min - r_skip), 2);
         r = r_min;
+        f |= POINT_RADIUS_MIN;
     }
 
     ld = pow(ld, 1 / 2.2); // Gama correction.
     // Saturate radius after a certain point.
     // XXX: make it smooth.
+    if (r >= core->max_point_radius) f |= POINT_RADIUS_MAX;
+    if (ld >= 1) f |= POINT_LUMINANCE_MAX;
     r = fmin(r, core->max_point_radius);
     *radius = r;
     if (luminance) *luminance = clamp(ld, 0, 1);
+    if (flags) *flags = f;
+    return true;
+}
+
+// Compute all the entries of the table with the current core settings.
+static void point_lut_update(point_lut_t *lut)
+{
+    int i;
+    point_lut_entry_t *e;
+    for (i = 0; i < POINT_LUT_SIZE; i++) {
+        e = &lut->entries[i];
+        get_point_for_mag(POINT_LUT_MAG_MIN + i * POINT_LUT_STEP,
+                          &e->radius, &e->luminance, &e->flags);
+    }
+}
+
+/*
+ * Function: core_get_point_for_mag
+ * Compute a point radius and luminosity from a observed magnitude.
+ *
+ * The function is almost linear, but when the points get too small,
+ * I make the curve go to zero faster, so that the bright stars get a
+ * higher contrast.  Also for very small points, we use a minimum radius
+ * and instead lower the luminance.
+ *
+ * Parameters:
+ *   mag       - The observed magnitude.
+ *   radius    - Output radius in window pixels.
+ *   luminance - Output luminance from 0 to 1, gamma corrected.  Ignored if
+ *               set to NULL.
+ */
+bool core_get_point_for_mag(double mag, double *radius, double *luminance)
+{
+    return get_point_for_mag(mag, radius, luminance, NULL);
+}
+
+/*
+ * The interval where the two entries around the mag don't have the same
+ * constraints use the exact function, since the curve is not smooth there.
+ */
+bool point_lut_get(const point_lut_t *lut, double mag,
+                   double *radius, double *luminance)
+{
+    const point_lut_entry_t *a, *b;
+    double x = (mag - POINT_LUT_MAG_MIN) / POINT_LUT_STEP, t;
+    int i;
+
+    if (!lut || !(x >= 0 && x < POINT_LUT_SIZE - 1)) // Also for NAN.
+        return get_point_for_mag(mag, radius, luminance, NULL);
+    i = (int)x;
+    a = &lut->entries[i];
+    b = &lut->entries[i + 1];
+    t = x - i;
+    if (a->flags != b->flags)
+        return get_point_for_mag(mag, radius, luminance, NULL);
+    if (a->flags & POINT_SKIPPED) {
+        *radius = 0;
+        if (luminance) *luminance = 0;
+        return false;
+    }
+    *radius = mix(a->radius, b->radius, t);
+    if (luminance) *luminance = mix(a->luminance, b->luminance, t);
     return true;
 }
 
@@ -516,7 +649,6 @@ static void render_proj_markers(const painter_t *painter_)
     }
 }
 
-
 EMSCRIPTEN_KEEPALIVE
 int core_render(double win_w, double win_h, double pixel_scale)
 {
@@ -549,6 +681,9 @@ int core_render(double win_w, double win_h, double pixel_scale)
     if (!core->rend)
         core->rend = render_create();
     labels_reset();
+    hips_new_frame();
+    if (!core->point_lut) core->point_lut = calloc(1, sizeof(*core->point_lut));
+    point_lut_update(core->point_lut);
 
     painter_t painter = {
         .rend = core->rend,
@@ -560,6 +695,7 @@ int core_render(double win_w, double win_h, double pixel_scale)
         .hints_limit_mag = hints_vmag,
         .hard_limit_mag = core->display_limit_mag,
         .points_halo = 7.0,
+        .point_lut = core->point_lut,
         .color = {1.0, 1.0, 1.0, 1.0},
         .contrast = 1.0,
         .lines.width = 1.0,
@@ -1001,13 +1137,43 @@ EMSCRIPTEN_KEEPALIVE
 obj_t *core_search(const char *query)
 {
     obj_t *module, *ret = NULL;
+
+    ret = name_index_search(query);
+    if (ret) return ret;
+    // Not in the index, list all the objects of the modules that don't
+    // use the index.
     DL_FOREACH(core->obj.children, module) {
+        if (name_index_has_module(module)) continue;
         module_list_objs(module, NAN, 0, NULL, USER_PASS((void*)query, &ret),
                          on_search);
+        if (ret) break;
     }
     return ret;
 }
 
+static int on_prefix(void *user, const char *dsgn)
+{
+    json_value *list = USER_GET(user, 0);
+    const int *max_nb = USER_GET(user, 1);
+    json_array_push(list, json_string_new(dsgn));
+    return list->u.array.length >= *max_nb;
+}
+
+EMSCRIPTEN_KEEPALIVE
+char *core_search_prefix(const char *prefix, int max_nb)
+{
+    json_value *list;
+    char *ret;
+
+    list = json_array_new(0);
+    if (max_nb > 0)
+        name_index_list_prefix(prefix, USER_PASS(list, &max_nb), on_prefix);
+    ret = calloc(1, json_measure(list));
+    json_serialize(ret, list);
+    json_builder_free(list);
+    return ret;
+}
+
 static obj_klass_t core_klass = {
     .id = "core",
     .size = sizeof(core_t),
@@ -1020,6 +1186,9 @@ static obj_klass_t core_klass = {
         PROPERTY(selection, TYPE_OBJ, MEMBER(core_t, selection)),
         PROPERTY(lock, TYPE_OBJ, MEMBER(core_t, target.lock)),
         PROPERTY(progressbars, TYPE_JSON, .fn = core_fn_progressbars),
+        PROPERTY(grid_cache_size, TYPE_INT, .fn = core_fn_grid_cache_size),
+        PROPERTY(grid_cache_stats, TYPE_JSON, .fn = core_fn_grid_cache_stats),
+        PROPERTY(snapshot_dir, TYPE_STRING, .fn = core_fn_snapshot_dir),
         PROPERTY(fps, TYPE_INT, MEMBER(core_t, fps.avg)),
         PROPERTY(clicks, TYPE_INT, MEMBER(core_t, clicks)),
         PROPERTY(zoom, TYPE_FLOAT, MEMBER(core_t, zoom)),
@@ -1094,6 +1263,24 @@ static void test_basic(void)
     obj_release(obj);
 }
 
+static void test_search_prefix(void)
+{
+    obj_t module = {.ref = 1};
+    char *ret;
+
+    name_index_add(&module, NULL, 1, "NAME Test Prefix B");
+    name_index_add(&module, NULL, 2, "NAME Test Prefix A");
+    name_index_add(&module, NULL, 3, "NAME Test Prefix C");
+    ret = core_search_prefix("name test prefix", 2);
+    assert(strcmp(ret, "[ \"NAME Test Prefix A\", "
+                       "\"NAME Test Prefix B\" ]") == 0);
+    free(ret);
+    ret = core_search_prefix("NAME Test Prefix D", 10);
+    assert(strcmp(ret, "[]") == 0);
+    free(ret);
+    name_index_clear();
+}
+
 static void test_info(void)
 {
     obj_t *obj;
@@ -1104,9 +1291,59 @@ static void test_info(void)
     obj_get_info(obj, core->observer, INFO_VMAG, &vmag);
 }
 
+// Check the error of the point lookup table against the exact function.
+static void test_point_lut(void)
+{
+    double mag, r1, r2, l1, l2;
+    bool v1, v2;
+    point_lut_t *lut = calloc(1, sizeof(*lut));
+
+    core_update();
+    point_lut_update(lut);
+    for (mag = -10; mag < 25; mag += 0.0037) {
+        v1 = core_get_point_for_mag(mag, &r1, &l1);
+        v2 = point_lut_get(lut, mag, &r2, &l2);
+        assert(v1 == v2);
+        assert(fabs(r1 - r2) <= 1e-3 * r1);
+        assert(fabs(l1 - l2) <= 0.5 / 255); // Half a 8 bits color level.
+    }
+    free(lut);
+}
+
+// Simulate the stars rendering inner loop.
+static void bench_point_lut(void)
+{
+    const int nb = 1000000;
+    int i, pass;
+    double t, size, luminance, color[3], tot = 0;
+    float *vmags = malloc(nb * sizeof(*vmags));
+    point_lut_t *lut = calloc(1, sizeof(*lut));
+
+    for (i = 0; i < nb; i++)
+        vmags[i] = 2.0 + 10.0 * i / nb + (rand() % 100) * 0.0001;
+    for (pass = 0; pass < 2; pass++) {
+        t = sys_get_unix_time();
+        // Include the table update, as done at each frame.
+        if (pass == 1) point_lut_update(lut);
+        for (i = 0; i < nb; i++) {
+            point_lut_get(pass ? lut : NULL, vmags[i], &size, &luminance);
+            bv_to_rgb(0.5, color);
+            tot += size * luminance * color[0];
+        }
+        LOG_I("%s: %.1f ns/star", pass ? "lut" : "exact",
+              (sys_get_unix_time() - t) * 1e9 / nb);
+    }
+    free(lut);
+    free(vmags);
+    (void)tot;
+}
+
 TEST_REGISTER(NULL, test_core, TEST_AUTO);
 TEST_REGISTER(NULL, test_vec, TEST_AUTO);
 TEST_REGISTER(NULL, test_basic, TEST_AUTO);
+TEST_REGISTER(NULL, test_search_prefix, TEST_AUTO);
 TEST_REGISTER(NULL, test_info, TEST_AUTO);
+TEST_REGISTER(NULL, test_point_lut, TEST_AUTO);
+TEST_REGISTER(NULL, bench_point_lut, 0);
 
 #endif
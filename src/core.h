@@ -75,6 +75,7 @@ struct core
     double          center_hints_mag_offset;
 
     tonemapper_t    tonemapper;
+    point_lut_t     *point_lut; // Rebuilt at each frame by core_render.
     bool            fast_adaptation; // True if eye adaptation is fast
     double          tonemapper_p;
     double          lwmax; // Max visible luminance.
@@ -295,6 +296,21 @@ void core_report_luminance_in_fov(double lum, bool fast_adaptation);
  */
 bool core_get_point_for_mag(double mag, double *radius, double *luminance);
 
+/*
+ * Function: point_lut_get
+ * Same as <core_get_point_for_mag>, using the lookup table that the core
+ * builds at each frame, once the tonemapper got updated.
+ *
+ * The values are linearly interpolated between 0.05 mag steps.  If lut is
+ * NULL, or the mag is not in the table range, we use the exact function.
+ * The modules get the table of the current frame from the painter.
+ *
+ * There is no equivalent table for the stars colors, since <bv_to_rgb> is
+ * already a lookup in a 128 entries table.
+ */
+bool point_lut_get(const point_lut_t *lut, double mag,
+                   double *radius, double *luminance);
+
 /*
  * Function: core_get_hints_mag_offset
  * Return the global adjustment offset to apply to the label threshold
@@ -561,6 +577,22 @@ obj_t *core_get_planet(int horizons_id);
  */
 obj_t *core_search(const char *dsgns);
 
+/*
+ * Function: core_search_prefix
+ * List the indexed designations starting with a given prefix
+ *
+ * Used to autocomplete a search.  Only the objects in the name index are
+ * listed, see <name_index_list_prefix>.
+ *
+ * Parameters:
+ *   prefix - A designation prefix.
+ *   max_nb - Max number of designations returned.
+ *
+ * Return:
+ *   A newly allocated json array of designations.  Caller should delete it.
+ */
+char *core_search_prefix(const char *prefix, int max_nb);
+
 // Just for convenience: horizons ids for a few common bodies.
 enum {
     PLANET_SUN = 10,
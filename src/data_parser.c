@@ -0,0 +1,124 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "data_parser.h"
+#include "system.h"
+#include "utils/utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Default max time spent parsing per update (sec).
+#define PARSE_BUDGET 0.008
+
+// Number of lines or records read between two time checks.
+#define CHUNK_SIZE 256
+
+void data_parser_start(data_parser_t *parser)
+{
+    parser->start = sys_get_unix_time();
+    parser->count = 0;
+}
+
+// Check if we still have time to read one more line or record.
+static bool in_budget(data_parser_t *parser)
+{
+    double budget = parser->budget ?: PARSE_BUDGET;
+    // We always read at least one chunk per update.
+    if (!parser->count || parser->count % CHUNK_SIZE) return true;
+    return sys_get_unix_time() - parser->start <= budget;
+}
+
+bool data_parser_next_line(data_parser_t *parser, const char *data, int size)
+{
+    if (parser->done || !in_budget(parser)) return false;
+    if (!iter_lines(data, size, &parser->line, &parser->len)) {
+        parser->done = true;
+        return false;
+    }
+    parser->idx++;
+    parser->count++;
+    return true;
+}
+
+bool data_parser_next_record(data_parser_t *parser, int nb)
+{
+    if (parser->done || !in_budget(parser)) return false;
+    if (parser->idx >= nb) {
+        parser->done = true;
+        return false;
+    }
+    parser->idx++;
+    parser->count++;
+    return true;
+}
+
+void data_parser_release(data_parser_t *parser)
+{
+    free(parser->data);
+    memset(parser, 0, sizeof(*parser));
+}
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+#include <assert.h>
+#include <stdio.h>
+
+static void test_data_parser(void)
+{
+    // A negative budget is always exceeded, even if the clock didn't
+    // change, so that we read exactly one chunk per update.
+    data_parser_t parser = {.budget = -1};
+    char *data, *p;
+    int i, n, nb_updates;
+    const int nb = 1000;
+
+    p = data = malloc(nb * 8);
+    for (i = 0; i < nb; i++)
+        p += sprintf(p, "%d\n", i);
+
+    // We only read one chunk per update, and resume where we stopped.
+    for (nb_updates = 0; !parser.done; nb_updates++) {
+        data_parser_start(&parser);
+        for (n = 0; data_parser_next_line(&parser, data, p - data); n++) {
+            assert(atoi(parser.line) == parser.idx - 1);
+            assert(parser.len == snprintf(NULL, 0, "%d", parser.idx - 1));
+        }
+        assert(n == CHUNK_SIZE || parser.done);
+    }
+    assert(parser.idx == nb && nb_updates == 4);
+    data_parser_start(&parser);
+    assert(!data_parser_next_line(&parser, data, p - data));
+
+    // The owned data is released with the parser.
+    parser = (data_parser_t){.data = data, .size = p - data};
+    data_parser_start(&parser);
+    while (data_parser_next_line(&parser, parser.data, parser.size)) {}
+    assert(parser.done && parser.idx == nb);
+    data_parser_release(&parser);
+    assert(!parser.data && !parser.done && !parser.idx);
+
+    // Records.
+    parser.budget = -1;
+    for (nb_updates = 0; !parser.done; nb_updates++) {
+        data_parser_start(&parser);
+        for (n = 0; data_parser_next_record(&parser, 600); n++)
+            assert(parser.idx - 1 == nb_updates * CHUNK_SIZE + n);
+    }
+    assert(parser.idx == 600 && nb_updates == 3);
+    data_parser_release(&parser);
+}
+
+TEST_REGISTER(NULL, test_data_parser, TEST_AUTO);
+
+#endif
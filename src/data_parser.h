@@ -0,0 +1,101 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef DATA_PARSER_H
+#define DATA_PARSER_H
+
+#include <stdbool.h>
+
+/*
+ * File: data_parser.h
+ * Incremental parsing of large source data.
+ *
+ * Some modules source data (like the MPCORB file) take too long to parse
+ * in a single frame.  A data parser lets them iterate over the lines or
+ * records of the data a bit at each update, resuming where they stopped,
+ * without spending more than a given time per update.
+ *
+ * Typical use, in the module update function:
+ *
+ *   data_parser_start(&parser);
+ *   while (data_parser_next_line(&parser, data, size)) {
+ *       // Parse parser.line.
+ *   }
+ *   if (!parser.done) return 0; // Continue at the next update.
+ */
+
+/*
+ * Type: data_parser_t
+ * State of an incremental parsing.
+ *
+ * Attributes:
+ *   data   - Data owned by the parser (for example uncompressed data),
+ *            freed by <data_parser_release>.  Can be NULL.
+ *   size   - Size of the owned data.
+ *   line   - Current line, set by <data_parser_next_line>.
+ *   len    - Length of the current line.
+ *   idx    - Number of lines or records read so far.
+ *   done   - Set once all the data has been read.
+ *   budget - Max time (sec) spent per update.  If zero, use the default
+ *            value of 8 ms.
+ */
+typedef struct data_parser {
+    char        *data;
+    int         size;
+    const char  *line;
+    int         len;
+    int         idx;
+    bool        done;
+    double      budget;
+
+    // Private attributes.
+    double      start;  // Start time of the current update.
+    int         count;  // Lines or records read in the current update.
+} data_parser_t;
+
+/*
+ * Function: data_parser_start
+ * Must be called at the start of each update, before reading the data.
+ */
+void data_parser_start(data_parser_t *parser);
+
+/*
+ * Function: data_parser_next_line
+ * Read the next line of the data, if we didn't run out of time.
+ *
+ * Parameters:
+ *   parser - A data parser.
+ *   data   - The parsed data, the same at each call.
+ *   size   - Size of the data.
+ *
+ * Return:
+ *   true if a new line has been read into parser->line.  Once all the data
+ *   has been read, return false and set parser->done.
+ */
+bool data_parser_next_line(data_parser_t *parser, const char *data, int size);
+
+/*
+ * Function: data_parser_next_record
+ * Same as <data_parser_next_line> for data made of a list of records.
+ *
+ * On success the index of the record to parse is parser->idx - 1.
+ *
+ * Parameters:
+ *   parser - A data parser.
+ *   nb     - Total number of records.
+ */
+bool data_parser_next_record(data_parser_t *parser, int nb);
+
+/*
+ * Function: data_parser_release
+ * Release the owned data, and reset the parser.
+ */
+void data_parser_release(data_parser_t *parser);
+
+#endif // DATA_PARSER_H
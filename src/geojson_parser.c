@@ -411,6 +411,22 @@ error:
     return -1;
 }
 
+/*
+ * Function: geojson_parse_properties
+ * Parse the properties of a feature, setting the default values for the
+ * missing ones.
+ */
+int geojson_parse_properties(const json_value *data,
+                             geojson_feature_properties_t *props)
+{
+    vec3_set(props->fill, 1, 1, 1);
+    vec3_set(props->stroke, 1, 1, 1);
+    props->stroke_width = 1;
+    props->stroke_opacity = 1;
+    props->fill_opacity = 0.5;
+    return parse_properties(data, props);
+}
+
 /*
  * Function: parse_feature
  * Parse a single geojson feature.
@@ -456,13 +472,9 @@ static int parse_feature(const json_value *data, geojson_feature_t *feature)
         ERROR("Unknown geojson type: %s", type);
     }
 
-    vec3_set(feature->properties.fill, 1, 1, 1);
-    vec3_set(feature->properties.stroke, 1, 1, 1);
-    feature->properties.stroke_width = 1;
-    feature->properties.stroke_opacity = 1;
-    feature->properties.fill_opacity = 0.5;
     properties = json_get_attr(data, "properties", json_object);
-    if (parse_properties(properties, &feature->properties)) goto error;
+    if (geojson_parse_properties(properties, &feature->properties))
+        goto error;
 
     return 0;
 error:
@@ -160,6 +160,16 @@ typedef struct geojson {
  */
 geojson_t *geojson_parse(const json_value *data);
 
+/*
+ * Function: geojson_parse_properties
+ * Parse the properties object of a single feature.
+ *
+ * The missing properties are set to their default values.  The title, if
+ * any, is allocated and should be freed by the caller.
+ */
+int geojson_parse_properties(const json_value *data,
+                             geojson_feature_properties_t *props);
+
 /*
  * Function: geojson_delete
  * Delete a geojson_t instance created with <geojson_parse>.
@@ -9,17 +9,38 @@
 
 #include "swe.h"
 #include "ini.h"
+#include "utils/ktx.h"
+#include <limits.h>
+#include <sched.h>
 #include <string.h>
 #include <zlib.h> // For crc32.
 
+#ifndef __EMSCRIPTEN__
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
 // Should be good enough...
 #define URL_MAX_SIZE 4096
 
-// Size of the cache allocated to all the hips tiles.
+// Total size of the tiles caches of all the surveys.  Each survey has its
+// own caches, so that they can use different eviction scores, but they all
+// draw from those global budgets.
 // Note: we get into trouble if the tiles visible on screen actually use
 // more space than that.  We could use a more clever cache that can grow
 // past its limit if the items are still in use!
 #define CACHE_SIZE (256 * (1 << 20))
+#define COLD_CACHE_SIZE (64 * (1 << 20))
+
+// Time (sec) without new parsed tiles after which we save the snapshot of
+// a survey.
+#define SNAPSHOT_IDLE_DELAY 10.0
+
+// Max number of bytes of decoded images we upload to the GPU per frame.
+// At least one image is always uploaded, even if it is bigger.
+#define UPLOAD_BUDGET (4 * (1 << 20))
 
 // Flags of the tiles:
 enum {
@@ -51,8 +72,7 @@ struct tile {
     struct {
         worker_t worker;
         tile_t *tile;
-        void *data;
-        int size;
+        struct cold_data *src;
         int cost;
     } *loader;
 };
@@ -67,24 +87,80 @@ typedef struct {
     int         pix;
 } tile_key_t;
 
+/*
+ * Type: trace_entry_t
+ * Loading timeline of a tile, see <hips_set_trace>.
+ */
+typedef struct {
+    UT_hash_handle  hh;
+    tile_key_t      key;
+    double          requested;
+    double          done;
+    int             code;
+} trace_entry_t;
+
+struct hips_trace {
+    double          start;
+    trace_entry_t   *entries;
+};
+
+/*
+ * Type: cold_data_t
+ * Source data of a tile stored in the cold cache.
+ */
+typedef struct cold_data {
+    int         size;
+    uint8_t     data[];
+} cold_data_t;
+
 /*
  * Type: img_tile_t
  * type data for images surveys.
+ *
+ * If format is set, img contains block compressed data of the given
+ * <KTX_FORMATS> format instead of the decoded image.
  */
 typedef struct {
     void        *img;
     int         w, h, bpp;
+    int         format;
+    int         size; // Size of the compressed data.
     texture_t   *tex;
 } img_tile_t;
 
-// Gobal cache for all the tiles.
-static cache_t *g_cache = NULL;
+// Bytes we can still upload to the GPU during the current frame.
+static int g_upload_budget = UPLOAD_BUDGET;
 
 
 static void *create_img_tile(
         void *user, int order, int pix, const void *src, int size,
         int *cost, int *transparency);
 static int delete_img_tile(void *tile);
+static void snapshot_open(hips_t *hips);
+static void snapshot_close(hips_t *hips);
+static int hips_save_snapshot(hips_t *hips);
+static int tile_wait_loader(void *user, void *data);
+
+// Budgets shared by the tiles caches of all the surveys.
+static cache_budget_t *g_cache_budget = NULL;
+static cache_budget_t *g_cold_cache_budget = NULL;
+
+/*
+ * Type: orphan_t
+ * Tile data still in use when its survey got deleted.  We keep it until
+ * the survey delete_tile function accepts to delete it.
+ */
+typedef struct orphan orphan_t;
+struct orphan {
+    orphan_t    *next;
+    void        *data;
+    int         (*delete_tile)(void *data);
+};
+static orphan_t *g_orphans = NULL;
+
+// Directory of the tiles snapshots, and list of surveys supporting them.
+static char *g_snapshot_dir = NULL;
+static hips_t *g_snapshot_surveys = NULL;
 
 hips_t *hips_create(const char *url, double release_date,
                     const hips_settings_t *settings)
@@ -105,6 +181,10 @@ hips_t *hips_create(const char *url, double release_date,
     hips->release_date = release_date;
     hips->frame = FRAME_ASTROM;
     hips->hash = crc32(0, (const void*)url, strlen(url));
+    if (settings->dump_tile && settings->load_tile) {
+        DL_APPEND(g_snapshot_surveys, hips);
+        snapshot_open(hips);
+    }
     return hips;
 }
 
@@ -115,10 +195,22 @@ void hips_delete(hips_t *hips)
     hips->ref--;
     assert(hips->ref >= 0);
     if (hips->ref > 0) return;
+    if (hips->settings.dump_tile && hips->settings.load_tile)
+        DL_DELETE(g_snapshot_surveys, hips);
+    snapshot_close(hips);
+    hips_set_trace(hips, false);
+    // The tiles loaders use the survey settings.
+    if (hips->cache) cache_foreach(hips->cache, NULL, tile_wait_loader);
+    // Delete the cold cache first so that the evicted tiles don't touch it.
+    cache_delete(hips->cold_cache);
+    hips->cold_cache = NULL;
+    cache_delete(hips->cache);
     free(hips->url);
     free(hips->service_url);
-    for (i = 0; i < 12; i++)
+    for (i = 0; i < 12; i++) {
         texture_release(hips->allsky.textures[i]);
+        free(hips->allsky.faces[i]);
+    }
     json_builder_free(hips->properties);
     free(hips);
 }
@@ -128,6 +220,70 @@ void hips_set_frame(hips_t *hips, int frame)
     hips->frame = frame;
 }
 
+void hips_set_parallel_fetch(hips_t *hips, bool value)
+{
+    hips->parallel_fetch = value;
+}
+
+void hips_set_trace(hips_t *hips, bool enabled)
+{
+    trace_entry_t *entry, *tmp;
+    if (hips->trace) {
+        HASH_ITER(hh, hips->trace->entries, entry, tmp) {
+            HASH_DEL(hips->trace->entries, entry);
+            free(entry);
+        }
+        free(hips->trace);
+        hips->trace = NULL;
+    }
+    if (!enabled) return;
+    hips->trace = calloc(1, sizeof(*hips->trace));
+    hips->trace->start = sys_get_unix_time();
+}
+
+json_value *hips_get_trace(const hips_t *hips)
+{
+    json_value *ret = json_array_new(0), *val;
+    const trace_entry_t *entry;
+    if (!hips->trace) return ret;
+    for (entry = hips->trace->entries; entry; entry = entry->hh.next) {
+        val = json_array_new(5);
+        json_array_push(val, json_integer_new(entry->key.order));
+        json_array_push(val, json_integer_new(entry->key.pix));
+        json_array_push(val, json_double_new(entry->requested));
+        json_array_push(val, entry->code ? json_double_new(entry->done) :
+                                           json_null_new());
+        json_array_push(val, json_integer_new(entry->code));
+        json_array_push(ret, val);
+    }
+    return ret;
+}
+
+/*
+ * Record a tile event in the survey trace, if enabled.  A zero code means
+ * that we started to look for the tile, anything else that it is done.
+ */
+static void trace_tile(hips_t *hips, int order, int pix, int code)
+{
+    tile_key_t key = {hips->hash, order, pix};
+    trace_entry_t *entry;
+    double t;
+
+    if (!hips->trace) return;
+    t = sys_get_unix_time() - hips->trace->start;
+    HASH_FIND(hh, hips->trace->entries, &key, sizeof(key), entry);
+    if (!entry) {
+        entry = calloc(1, sizeof(*entry));
+        entry->key = key;
+        entry->requested = t;
+        HASH_ADD(hh, hips->trace->entries, key, sizeof(key), entry);
+    }
+    if (code && !entry->code) {
+        entry->done = t;
+        entry->code = code;
+    }
+}
+
 // Get the url for a given file in the survey.
 // Automatically add ?v=<release_date> for online surveys.
 static const char *get_url_for(const hips_t *hips, char *buf, int len,
@@ -160,7 +316,7 @@ static int property_handler(void* user, const char* section,
                             const char* name, const char* value)
 {
     hips_t *hips = user;
-    double version;
+    double version, date;
 
     json_object_push(hips->properties, name, json_string_new(value));
     if (strcmp(name, "hips_order") == 0)
@@ -169,18 +325,34 @@ static int property_handler(void* user, const char* section,
         hips->order_min = atoi(value);
     if (strcmp(name, "hips_tile_width") == 0)
         hips->tile_width = atoi(value);
-    if (strcmp(name, "hips_release_date") == 0)
-        hips->release_date = hips_parse_date(value);
+    if (strcmp(name, "hips_release_date") == 0) {
+        date = hips_parse_date(value);
+        if (date != hips->release_date) {
+            hips->release_date = date;
+            // The snapshot is only valid for a given release date.
+            if (hips->snapshot) snapshot_open(hips);
+        }
+    }
     if (strcmp(name, "hips_tile_format") == 0) {
-             if (strstr(value, "webp")) hips->ext = "webp";
+        // Prefer pre-transcoded compressed tiles if available.
+             if (strstr(value, "ktx"))  hips->ext = "ktx";
+        else if (strstr(value, "webp")) hips->ext = "webp";
         else if (strstr(value, "jpeg")) hips->ext = "jpg";
         else if (strstr(value, "png"))  hips->ext = "png";
+        else if (strstr(value, "gjb"))  hips->ext = "gjb";
         else if (strstr(value, "eph"))  {
             hips->ext = "eph";
             hips->allsky.not_available = true;
         } else if (!hips->ext || !strstr(value, hips->ext)) {
             LOG_W("Unknown hips format: %s", value);
         }
+        // The allsky is never a ktx file, use the best image format.
+        if (strcmp(hips->ext, "ktx") == 0) {
+                 if (strstr(value, "webp")) hips->allsky.ext = "webp";
+            else if (strstr(value, "jpeg")) hips->allsky.ext = "jpg";
+            else if (strstr(value, "png"))  hips->allsky.ext = "png";
+            else hips->allsky.not_available = true;
+        }
     }
 
     /* Starting from version 1.4, hips format doesn't have allsky texture.
@@ -223,22 +395,92 @@ static int parse_properties(hips_t *hips)
 }
 
 
+static int del_cold_data(void *data)
+{
+    free(data);
+    return 0;
+}
+
+static cold_data_t *cold_data_create(const void *data, int size)
+{
+    cold_data_t *cold = malloc(sizeof(*cold) + size);
+    cold->size = size;
+    memcpy(cold->data, data, size);
+    return cold;
+}
+
+/*
+ * Add the source data of a tile to the cold cache, unless we already have
+ * it.  The cache takes ownership of the data.
+ */
+static void cold_cache_add(hips_t *hips, const tile_key_t *key,
+                           cold_data_t *cold)
+{
+    if (cache_get(hips->cold_cache, key, sizeof(*key))) {
+        free(cold);
+        return;
+    }
+    cache_add(hips->cold_cache, key, sizeof(*key), cold, cold->size,
+              del_cold_data);
+}
+
+// Block until the tile loader, if any, is done.
+static int tile_wait_loader(void *user, void *data)
+{
+    tile_t *tile = data;
+    while (tile->loader && worker_is_running(&tile->loader->worker))
+        sched_yield();
+    return 0;
+}
+
 // Used by the cache.
 static int del_tile(void *data)
 {
     tile_t *tile = data;
-    // XXX: why the worker_is_running?
+    hips_t *hips = tile->hips;
+    tile_key_t key = {hips->hash, tile->pos.order, tile->pos.pix};
+    orphan_t *orphan;
+
+    // The loader thread still uses the tile.
     if (tile->loader && worker_is_running(&tile->loader->worker))
         return CACHE_KEEP;
-    if (tile->data) {
-        if (tile->hips->settings.delete_tile(tile->data) == CACHE_KEEP)
-            return CACHE_KEEP;
+    if (tile->data &&
+            hips->settings.delete_tile(tile->data) == CACHE_KEEP) {
+        if (hips->ref) return CACHE_KEEP;
+        // The survey is getting deleted, so the cache won't try again.
+        orphan = calloc(1, sizeof(*orphan));
+        orphan->data = tile->data;
+        orphan->delete_tile = hips->settings.delete_tile;
+        LL_PREPEND(g_orphans, orphan);
+    }
+    if (tile->loader) {
+        free(tile->loader->src);
+        free(tile->loader);
     }
-    hips_delete(tile->hips);
+    // The source data is already in the cold cache, since we added it when
+    // the tile got loaded.  Move it on top so that it stays there longer
+    // than the sources of the tiles still in the hot cache.
+    if (hips->cold_cache) cache_get(hips->cold_cache, &key, sizeof(key));
+    hips->stats.evictions++;
     free(tile);
     return 0;
 }
 
+/*
+ * Eviction score of the tiles: we first evict the tiles far from the last
+ * rendered view, and the tiles of high order.
+ */
+static double tile_evict_score(const void *data)
+{
+    const tile_t *tile = data;
+    double pos[3], sep = 0;
+    if (!vec3_is_zero(tile->hips->view)) {
+        healpix_pix2vec(1 << tile->pos.order, tile->pos.pix, pos);
+        sep = vec3_sep(tile->hips->view, pos);
+    }
+    return sep + 0.25 * tile->pos.order;
+}
+
 static bool img_is_transparent(
         const uint8_t *img, int img_w, int img_h, int bpp,
         int x, int y, int w, int h)
@@ -349,12 +591,46 @@ void hips_iter_push_children(hips_iterator_t *iter, int order, int pix)
 }
 
 
+void hips_new_frame(void)
+{
+    orphan_t *orphan, *tmp;
+    hips_t *hips;
+    double time;
+
+    g_upload_budget = UPLOAD_BUDGET;
+    if (g_snapshot_dir) {
+        time = sys_get_unix_time();
+        DL_FOREACH(g_snapshot_surveys, hips) {
+            if (!hips->snapshot_changed) continue;
+            if (time - hips->snapshot_changed < SNAPSHOT_IDLE_DELAY)
+                continue;
+            hips_save_snapshot(hips);
+            hips->snapshot_changed = 0;
+        }
+    }
+    LL_FOREACH_SAFE(g_orphans, orphan, tmp) {
+        if (orphan->delete_tile(orphan->data) == CACHE_KEEP) continue;
+        LL_DELETE(g_orphans, orphan);
+        free(orphan);
+    }
+}
+
+// Check if we can still upload an image of the given size to the GPU
+// during this frame, and if so remove it from the budget.
+static bool upload_budget_take(int size)
+{
+    if (g_upload_budget <= 0) return false;
+    g_upload_budget -= size;
+    return true;
+}
+
 /*
  * Function: hips_get_tile_texture
  * Get the texture for a given hips tile.
  *
  * The algorithm is more or less:
- *   - If the tile is loaded, return its texture.
+ *   - If the tile is loaded, return its texture.  Decoded tiles are only
+ *     uploaded to the GPU if the frame upload budget allows it.
  *   - If not, try to use a parent tile as a fallback.
  *   - If no parent is loaded, but we have an allsky image, use it.
  *   - If all else failed, return NULL.  In that case the UV and projection
@@ -379,7 +655,7 @@ texture_t *hips_get_tile_texture(
         bool *loading_complete)
 {
     bool loading_complete_;
-    int code, x, y, nbw;
+    int code, size;
     img_tile_t *tile = NULL;
     texture_t *tex;
 
@@ -398,9 +674,17 @@ texture_t *hips_get_tile_texture(
     }
 
     // Create texture if needed.
-    if (tile && tile->img && !tile->tex) {
-        tile->tex = texture_from_data(tile->img, tile->w, tile->h, tile->bpp,
-                                      0, 0, tile->w, tile->h, 0);
+    if (    tile && tile->img && !tile->tex &&
+            upload_budget_take(tile->format ? tile->size :
+                               tile->w * tile->h * tile->bpp)) {
+        if (tile->format) {
+            tile->tex = texture_from_compressed(tile->format, tile->img,
+                                                tile->size, tile->w, tile->h);
+        } else {
+            tile->tex = texture_from_data(tile->img, tile->w, tile->h,
+                                          tile->bpp, 0, 0, tile->w, tile->h,
+                                          0);
+        }
         free(tile->img);
         tile->img = NULL;
     }
@@ -412,16 +696,17 @@ texture_t *hips_get_tile_texture(
 
     // Return the allsky texture if the tile is not ready yet.  Only do
     // it for level 0 allsky for the moment.
-    if (!tile && order == 0 && hips->allsky.data) {
-        if (!hips->allsky.textures[pix]) {
-            nbw = (int)sqrt(12 * (1 << (2 * hips->order_min)));
-            x = (pix % nbw) * hips->allsky.w / nbw;
-            y = (pix / nbw) * hips->allsky.w / nbw;
+    if (!tile && order == 0 && hips->allsky.loaded) {
+        size = hips->allsky.face_size;
+        if (    !hips->allsky.textures[pix] && hips->allsky.faces[pix] &&
+                upload_budget_take(size * size * hips->allsky.bpp)) {
             hips->allsky.textures[pix] = texture_from_data(
-                    hips->allsky.data, hips->allsky.w, hips->allsky.h,
-                    hips->allsky.bpp,
-                    x, y, hips->allsky.w / nbw, hips->allsky.w / nbw, 0);
+                    hips->allsky.faces[pix], size, size, hips->allsky.bpp,
+                    0, 0, size, size, 0);
+            free(hips->allsky.faces[pix]);
+            hips->allsky.faces[pix] = NULL;
         }
+        if (!hips->allsky.textures[pix]) return NULL;
         if (flags & HIPS_FORCE_USE_ALLSKY) *loading_complete = true;
         return hips->allsky.textures[pix];
     }
@@ -481,6 +766,11 @@ int hips_render(hips_t *hips, const painter_t *painter,
     if (painter->color[3] == 0.0) return 0;
     if (!hips_is_ready(hips)) return 0;
 
+    // Remember the view direction for the cache eviction.  Only makes sense
+    // for surveys rendered in the sky.
+    if (!transf)
+        vec3_copy(painter->clip_info[hips->frame].bounding_cap, hips->view);
+
     render_order = hips_get_render_order(hips, painter);
     // Clamp the render order into physically possible range.
     render_order = clamp(render_order, hips->order_min, hips->order);
@@ -529,13 +819,53 @@ void hips_set_label(hips_t *hips, const char* label)
     asprintf(&hips->label, "%s", label);
 }
 
+/*
+ * Cut a decoded order zero allsky image into the twelve pixels images, so
+ * that the render thread only has to upload them.  Return false if the
+ * image size doesn't match an allsky image.
+ */
+static bool allsky_cut(typeof(((hips_t*)0)->allsky) *allsky,
+                       const uint8_t *data, int w, int h, int bpp)
+{
+    int i, pix, x, y, size;
+    // Number of pixels per row in an order zero allsky image.
+    const int nbw = (int)sqrt(12);
+
+    size = w / nbw;
+    if (size <= 0 || h < size * ((12 + nbw - 1) / nbw) || bpp < 1 ||
+            bpp > 4 || size > 1 << 14) {
+        LOG_W("Wrong allsky image size: %dx%dx%d", w, h, bpp);
+        return false;
+    }
+    for (pix = 0; pix < 12; pix++) {
+        x = (pix % nbw) * size;
+        y = (pix / nbw) * size;
+        allsky->faces[pix] = malloc(size * size * bpp);
+        for (i = 0; i < size; i++) {
+            memcpy(allsky->faces[pix] + i * size * bpp,
+                   data + ((y + i) * w + x) * bpp, size * bpp);
+        }
+    }
+    allsky->face_size = size;
+    allsky->bpp = bpp;
+    allsky->loaded = true;
+    return true;
+}
+
 static int load_allsky_worker(worker_t *worker)
 {
     typeof(((hips_t*)0)->allsky) *allsky = (void*)worker;
-    allsky->data = img_read_from_mem(allsky->src_data, allsky->size,
-            &allsky->w, &allsky->h, &allsky->bpp);
+    uint8_t *data;
+    int w, h, bpp = 0;
+
+    data = img_read_from_mem(allsky->src_data, allsky->size, &w, &h, &bpp);
     free(allsky->src_data);
     allsky->src_data = NULL;
+    if (!data) return 0;
+    // If the image is wrong, the allsky is not loaded, and hips_update
+    // marks it as not available.
+    allsky_cut(allsky, data, w, h, bpp);
+    free(data);
     return 0;
 }
 
@@ -558,10 +888,11 @@ bool hips_update(hips_t *hips)
     // Get the allsky before anything else if available.
     // Only for level zero allsky images.  We don't use the other ones.
     if (!hips->allsky.worker.fn &&
-            !hips->allsky.not_available && !hips->allsky.data &&
+            !hips->allsky.not_available && !hips->allsky.loaded &&
             hips->order_min == 0) {
         snprintf(url, sizeof(url), "%s/Norder%d/Allsky.%s?v=%d",
-                 hips->service_url, hips->order_min, hips->ext,
+                 hips->service_url, hips->order_min,
+                 hips->allsky.ext ?: hips->ext,
                  (int)hips->release_date);
         data = asset_get_data2(url, ASSET_USED_ONCE, &size, &code);
         if (!code) return false;
@@ -579,7 +910,7 @@ bool hips_update(hips_t *hips)
     if (hips->allsky.worker.fn) {
         if (!worker_iter(&hips->allsky.worker)) return false;
         hips_delete(hips); // Release ref from worker.
-        if (!hips->allsky.data) hips->allsky.not_available = true;
+        if (!hips->allsky.loaded) hips->allsky.not_available = true;
         hips->allsky.worker.fn = NULL;
     }
 
@@ -650,17 +981,441 @@ static int load_tile_worker(worker_t *worker)
     hips_t *hips = tile->hips;
     tile->data = hips->settings.create_tile(
                     hips->settings.user, tile->pos.order, tile->pos.pix,
-                    loader->data, loader->size, &loader->cost, &transparency);
+                    loader->src->data, loader->src->size, &loader->cost,
+                    &transparency);
     if (!tile->data) tile->flags |= TILE_LOAD_ERROR;
     tile->flags |= (transparency * TILE_NO_CHILD_0);
-    free(loader->data);
     return 0;
 }
 
+/******** Snapshots *******************************************************/
+
+/*
+ * The snapshot file of a survey contains a header, followed by a table of
+ * entries sorted by order and pix, and then the dumped tiles data.  All
+ * values are in the native endianness, since the file is only meant to be
+ * used on the machine that created it.
+ */
+
+#define SNAPSHOT_VERSION 2
+
+typedef struct {
+    char        magic[8]; // "SWESNAP"
+    uint32_t    version;  // SNAPSHOT_VERSION.
+    uint32_t    tile_version; // Survey settings snapshot_version.
+    uint32_t    nb;       // Number of entries.
+    uint32_t    crc;      // crc32 of the entries table.
+    double      release_date; // Survey release date.
+} snapshot_header_t;
+
+typedef struct {
+    int32_t     order;
+    int32_t     pix;
+    int32_t     transparency;
+    int32_t     size;
+    uint64_t    offset;
+    uint32_t    crc;      // crc32 of the tile data.
+    uint32_t    pad;
+} snapshot_entry_t;
+
+struct hips_snapshot {
+    void                    *data; // Mapped file, or NULL if no snapshot.
+    size_t                  size;
+    const snapshot_header_t *header;
+    const snapshot_entry_t  *entries;
+};
+
+static void get_snapshot_path(const hips_t *hips, char *buf, int len)
+{
+    snprintf(buf, len, "%s/%08x.snap", g_snapshot_dir, hips->hash);
+}
+
+void hips_set_snapshot_dir(const char *dir)
+{
+    hips_t *hips;
+    free(g_snapshot_dir);
+    g_snapshot_dir = dir ? strdup(dir) : NULL;
+    DL_FOREACH(g_snapshot_surveys, hips)
+        snapshot_open(hips);
+}
+
+const char *hips_get_snapshot_dir(void)
+{
+    return g_snapshot_dir;
+}
+
+static void snapshot_close(hips_t *hips)
+{
+    if (!hips->snapshot) return;
+#ifndef __EMSCRIPTEN__
+    if (hips->snapshot->data)
+        munmap(hips->snapshot->data, hips->snapshot->size);
+#endif
+    free(hips->snapshot);
+    hips->snapshot = NULL;
+}
+
+// Map the snapshot file of a survey, replacing the current one if any.
+static void snapshot_open(hips_t *hips)
+{
+    struct hips_snapshot *snap;
+    const snapshot_header_t *header;
+    size_t table_size;
+
+    snapshot_close(hips);
+    if (!g_snapshot_dir) return;
+    snap = hips->snapshot = calloc(1, sizeof(*snap));
+#ifndef __EMSCRIPTEN__
+    char path[1024];
+    struct stat st;
+    int fd;
+
+    get_snapshot_path(hips, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if (fd == -1) return;
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(*header)) {
+        snap->size = st.st_size;
+        snap->data = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (snap->data == MAP_FAILED) snap->data = NULL;
+    }
+    close(fd);
+    if (!snap->data) return;
+
+    header = snap->data;
+    table_size = header->nb * sizeof(*snap->entries);
+    if (    memcmp(header->magic, "SWESNAP", 8) != 0 ||
+            header->version != SNAPSHOT_VERSION ||
+            header->tile_version != hips->settings.snapshot_version ||
+            header->release_date != hips->release_date ||
+            sizeof(*header) + table_size > snap->size ||
+            crc32(0, snap->data + sizeof(*header), table_size) !=
+                header->crc) {
+        LOG_W("Ignore invalid snapshot %s", path);
+        munmap(snap->data, snap->size);
+        snap->data = NULL;
+        return;
+    }
+    snap->header = header;
+    snap->entries = snap->data + sizeof(*header);
+#endif
+}
+
+static int snapshot_entry_cmp(const void *a, const void *b)
+{
+    const snapshot_entry_t *x = a, *y = b;
+    return cmp(x->order, y->order) ?: cmp(x->pix, y->pix);
+}
+
+/*
+ * Restore a tile from the survey snapshot if it is in it, and add it to the
+ * cache.
+ */
+static tile_t *snapshot_get_tile(hips_t *hips, int order, int pix)
+{
+    const snapshot_entry_t *entry;
+    const snapshot_entry_t ref = {.order = order, .pix = pix};
+    const void *data;
+    tile_t *tile;
+    tile_key_t key = {hips->hash, order, pix};
+    int cost = 0;
+
+    if (!hips->snapshot || !hips->snapshot->data) return NULL;
+    entry = bsearch(&ref, hips->snapshot->entries, hips->snapshot->header->nb,
+                    sizeof(ref), snapshot_entry_cmp);
+    if (!entry) return NULL;
+    if (entry->offset + entry->size > hips->snapshot->size) return NULL;
+    data = hips->snapshot->data + entry->offset;
+    if (crc32(0, data, entry->size) != entry->crc) {
+        LOG_W("Wrong checksum in snapshot for tile %d/%d", order, pix);
+        return NULL;
+    }
+
+    tile = calloc(1, sizeof(*tile));
+    tile->pos.order = order;
+    tile->pos.pix = pix;
+    tile->hips = hips;
+    tile->data = hips->settings.load_tile(hips->settings.user, order, pix,
+                                          data, entry->size, &cost);
+    if (!tile->data) {
+        free(tile);
+        return NULL;
+    }
+    tile->flags |= entry->transparency * TILE_NO_CHILD_0;
+    cache_add(hips->cache, &key, sizeof(key), tile, sizeof(*tile) + cost,
+              del_tile);
+    hips->stats.snapshot_hits++;
+    return tile;
+}
+
+typedef struct {
+    hips_t              *hips;
+    int                 nb;
+    int                 allocated;
+    snapshot_entry_t    *entries;
+    void                **datas;
+} snapshot_builder_t;
+
+static int snapshot_add_tile(void *user, void *data)
+{
+    snapshot_builder_t *builder = user;
+    hips_t *hips = builder->hips;
+    tile_t *tile = data;
+    snapshot_entry_t *entry;
+    void *dump;
+    int size;
+
+    if (!tile->data || tile->loader) return 0;
+    dump = hips->settings.dump_tile(hips->settings.user, tile->data, &size);
+    if (!dump) return 0;
+    if (builder->nb >= builder->allocated) {
+        builder->allocated = builder->allocated ? builder->allocated * 2 : 16;
+        builder->entries = realloc(builder->entries,
+                builder->allocated * sizeof(*builder->entries));
+        builder->datas = realloc(builder->datas,
+                builder->allocated * sizeof(*builder->datas));
+    }
+    entry = &builder->entries[builder->nb];
+    *entry = (snapshot_entry_t) {
+        .order = tile->pos.order,
+        .pix = tile->pos.pix,
+        .transparency = (tile->flags & TILE_NO_CHILD_ALL) / TILE_NO_CHILD_0,
+        .size = size,
+        .crc = crc32(0, dump, size),
+    };
+    // Store the data index in the offset until we sort the entries.
+    entry->offset = builder->nb;
+    builder->datas[builder->nb++] = dump;
+    return 0;
+}
+
+static int hips_save_snapshot(hips_t *hips)
+{
+#ifndef __EMSCRIPTEN__
+    snapshot_builder_t builder = {.hips = hips};
+    snapshot_header_t header = {
+        .magic = "SWESNAP",
+        .version = SNAPSHOT_VERSION,
+        .tile_version = hips->settings.snapshot_version,
+        .release_date = hips->release_date,
+    };
+    char path[1024], tmp_path[1100];
+    uint64_t offset;
+    FILE *file;
+    int i, ret = 0;
+    void **datas;
+
+    if (!hips->cache) return 0;
+    cache_foreach(hips->cache, &builder, snapshot_add_tile);
+    if (!builder.nb) return 0;
+    qsort(builder.entries, builder.nb, sizeof(*builder.entries),
+          snapshot_entry_cmp);
+    // Put back the data in the same order as the entries.
+    datas = calloc(builder.nb, sizeof(*datas));
+    offset = sizeof(header) + builder.nb * sizeof(*builder.entries);
+    for (i = 0; i < builder.nb; i++) {
+        datas[i] = builder.datas[builder.entries[i].offset];
+        builder.entries[i].offset = offset;
+        offset += builder.entries[i].size;
+    }
+    header.nb = builder.nb;
+    header.crc = crc32(0, (void*)builder.entries,
+                       builder.nb * sizeof(*builder.entries));
+
+    // Write into a temporary file first, so that a mapped snapshot is
+    // never modified.
+    get_snapshot_path(hips, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        LOG_E("Cannot write snapshot %s", tmp_path);
+        ret = -1;
+        goto end;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(builder.entries, sizeof(*builder.entries), builder.nb, file);
+    for (i = 0; i < builder.nb; i++)
+        fwrite(datas[i], builder.entries[i].size, 1, file);
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        LOG_E("Cannot write snapshot %s", path);
+        ret = -1;
+        goto end;
+    }
+    // Map the new file, so that we can restore the tiles we evict.
+    snapshot_open(hips);
+
+end:
+    for (i = 0; i < builder.nb; i++) free(datas[i]);
+    free(datas);
+    free(builder.datas);
+    free(builder.entries);
+    return ret;
+#else
+    return 0;
+#endif
+}
+
+int hips_save_snapshots(void)
+{
+    hips_t *hips;
+    int ret = 0;
+    if (!g_snapshot_dir) return 0;
+    DL_FOREACH(g_snapshot_surveys, hips) {
+        if (hips_save_snapshot(hips)) ret = -1;
+    }
+    return ret;
+}
+
+/*
+ * Size of a string, or of a '\0' separated list, including the final '\0'.
+ * Return -1 if it doesn't end within max bytes.
+ */
+static int dump_string_size(const char *str, int max, bool is_list)
+{
+    int n = 0, len;
+    do {
+        len = strnlen(str + n, max - n);
+        if (len == max - n) return -1;
+        n += len + 1;
+    } while (is_list && len);
+    return n;
+}
+
+// Return a pointer to a string field of an object.
+static char **dump_string_field(void *obj, const hips_dump_string_t *str)
+{
+    return (char**)((uint8_t*)obj + str->offset);
+}
+
+void *hips_dump_objs(const void *header, int header_size,
+                     const void *objs, int nb, int obj_size,
+                     const hips_dump_string_t *strings, int *size)
+{
+    const hips_dump_string_t *str;
+    int i, n, strings_size = 0;
+    int32_t nb32 = nb;
+    uint8_t *ret, *items, *buf, *p;
+    char **field, type[4];
+    obj_t *obj;
+
+    for (i = 0; i < nb; i++) {
+        for (str = strings; str->offset; str++) {
+            field = dump_string_field((uint8_t*)objs + i * obj_size, str);
+            if (*field)
+                strings_size += dump_string_size(*field, INT_MAX, str->is_list);
+        }
+    }
+    *size = header_size + sizeof(nb32) + nb * obj_size + strings_size;
+    ret = calloc(1, *size);
+    memcpy(ret, header, header_size);
+    memcpy(ret + header_size, &nb32, sizeof(nb32));
+    items = ret + header_size + sizeof(nb32);
+    memcpy(items, objs, nb * obj_size);
+    buf = p = items + nb * obj_size;
+    for (i = 0; i < nb; i++) {
+        obj = (obj_t*)(items + i * obj_size);
+        memcpy(type, obj->type, 4);
+        memset(obj, 0, sizeof(*obj));
+        memcpy(obj->type, type, 4);
+        for (str = strings; str->offset; str++) {
+            field = dump_string_field(obj, str);
+            if (!*field) continue;
+            n = dump_string_size(*field, INT_MAX, str->is_list);
+            memcpy(p, *field, n);
+            // Plus one so that NULL stays zero.
+            *field = (char*)(intptr_t)(p - buf + 1);
+            p += n;
+        }
+    }
+    return ret;
+}
+
+int hips_load_objs(const void *data, int size,
+                   void *header, int header_size, int obj_size,
+                   const hips_dump_string_t *strings, obj_klass_t *klass,
+                   void **objs, int *nb)
+{
+    const hips_dump_string_t *str;
+    const char *buf;
+    int i, n, strings_size;
+    int32_t nb32;
+    intptr_t offset;
+    uint8_t *items;
+    char **field;
+    obj_t *obj;
+
+    if (size < header_size + (int)sizeof(nb32)) return -1;
+    memcpy(&nb32, data + header_size, sizeof(nb32));
+    if (    nb32 < 0 ||
+            nb32 > (size - header_size - (int)sizeof(nb32)) / obj_size)
+        return -1;
+    items = calloc(nb32 ?: 1, obj_size);
+    memcpy(items, data + header_size + sizeof(nb32), nb32 * obj_size);
+    buf = data + header_size + sizeof(nb32) + nb32 * obj_size;
+    strings_size = size - (buf - (const char*)data);
+
+    // Check all the strings before we allocate any of them.
+    for (i = 0; i < nb32; i++) {
+        for (str = strings; str->offset; str++) {
+            offset = (intptr_t)*dump_string_field(items + i * obj_size, str);
+            if (!offset) continue;
+            if (    offset < 1 || offset > strings_size ||
+                    dump_string_size(buf + offset - 1,
+                                     strings_size - offset + 1,
+                                     str->is_list) < 0) {
+                free(items);
+                return -1;
+            }
+        }
+    }
+    for (i = 0; i < nb32; i++) {
+        obj = (obj_t*)(items + i * obj_size);
+        obj->ref = 1;
+        obj->klass = klass;
+        for (str = strings; str->offset; str++) {
+            field = dump_string_field(obj, str);
+            offset = (intptr_t)*field;
+            if (!offset) continue;
+            n = dump_string_size(buf + offset - 1, strings_size - offset + 1,
+                                 str->is_list);
+            *field = malloc(n);
+            memcpy(*field, buf + offset - 1, n);
+        }
+    }
+    memcpy(header, data, header_size);
+    *objs = items;
+    *nb = nb32;
+    return 0;
+}
+
+
+/*
+ * Check the children masks of the loaded ancestors of a tile, when its
+ * parent is not loaded yet.  Return false if none of them is loaded, or if
+ * one of them tells that the tile doesn't exist.
+ */
+static bool ancestors_may_have_tile(hips_t *hips, int order, int pix)
+{
+    tile_key_t key = {hips->hash};
+    const tile_t *tile;
+    bool ret = false;
+    int child;
+
+    for (key.order = order - 2; key.order >= hips->order_min; key.order--) {
+        key.pix = pix >> (2 * (order - key.order));
+        tile = cache_get(hips->cache, &key, sizeof(key));
+        if (!tile || tile->loader) continue;
+        child = (pix >> (2 * (order - key.order - 1))) % 4;
+        if (tile->flags & (TILE_NO_CHILD_0 << child)) return false;
+        ret = true;
+    }
+    return ret;
+}
+
 static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
                               int *code)
 {
     const void *data;
+    cold_data_t *cold = NULL;
     int size, parent_code, asset_flags, cost = 0, transparency = 0;
     char url[URL_MAX_SIZE];
     tile_t *tile, *parent;
@@ -669,17 +1424,35 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     assert(order >= 0);
     *code = 0;
 
-    if (!g_cache) g_cache = cache_create(CACHE_SIZE, 1);
-    tile = cache_get(g_cache, &key, sizeof(key));
+    if (!hips->cache) {
+        if (!g_cache_budget) {
+            g_cache_budget = cache_budget_create(CACHE_SIZE);
+            g_cold_cache_budget = cache_budget_create(COLD_CACHE_SIZE);
+        }
+        hips->cache = cache_create(hips->settings.cache_size ?: CACHE_SIZE, 1);
+        cache_set_evict_score(hips->cache, tile_evict_score);
+        cache_set_budget(hips->cache, g_cache_budget);
+        hips->cold_cache = cache_create(
+                hips->settings.cold_cache_size ?: COLD_CACHE_SIZE, 1);
+        cache_set_budget(hips->cold_cache, g_cold_cache_budget);
+    }
+    tile = cache_get(hips->cache, &key, sizeof(key));
 
     // Got a tile but it is still loading.
     if (tile && tile->loader) {
         if (!worker_iter(&tile->loader->worker)) return NULL;
-        cache_set_cost(g_cache, &key, sizeof(key), tile->loader->cost);
+        if (!(tile->flags & TILE_LOAD_ERROR))
+            cold_cache_add(hips, &key, tile->loader->src);
+        else
+            free(tile->loader->src);
+        cache_set_cost(hips->cache, &key, sizeof(key),
+                       sizeof(*tile) + tile->loader->cost);
         free(tile->loader);
         tile->loader = NULL;
+        trace_tile(hips, order, pix, 200);
     }
     if (tile) {
+        hips->stats.hits++;
         *code = 200;
         return tile;
     }
@@ -695,26 +1468,51 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     // Skip if we already know that this tile doesn't exists.
     if (order > hips->order_min) {
         parent = hips_get_tile_(hips, order - 1, pix / 4, flags, &parent_code);
-        if (!parent) {
+        // Always get parent first, unless we can request both at the
+        // same time.
+        if (!parent && !(hips->parallel_fetch && parent_code == 0 &&
+                         ancestors_may_have_tile(hips, order, pix))) {
             *code = parent_code;
-            return NULL; // Always get parent first.
+            return NULL;
         }
-        if (parent->flags & (TILE_NO_CHILD_0 << (pix % 4))) {
+        if (parent && (parent->flags & (TILE_NO_CHILD_0 << (pix % 4)))) {
             *code = 404;
             return NULL;
         }
     }
+    hips->stats.misses++;
+    trace_tile(hips, order, pix, 0);
+
+    // Restore the tile from the snapshot if possible.
+    tile = snapshot_get_tile(hips, order, pix);
+    if (tile) {
+        *code = 200;
+        trace_tile(hips, order, pix, 200);
+        return tile;
+    }
+
     get_url_for(hips, url, sizeof(url), "Norder%d/Dir%d/Npix%d.%s",
                 order, (pix / 10000) * 10000, pix, hips->ext);
-    asset_flags = ASSET_ACCEPT_404;
-    if (order > 0 && !(flags & HIPS_NO_DELAY))
-        asset_flags |= ASSET_DELAY;
-    data = asset_get_data2(url, asset_flags, &size, code);
-    if (!(*code)) return NULL; // Still loading the file.
+
+    // Reuse the source data from the cold cache if we still have it.
+    cold = cache_get(hips->cold_cache, &key, sizeof(key));
+    if (cold) {
+        hips->stats.cold_hits++;
+        data = cold->data;
+        size = cold->size;
+        *code = 200;
+    } else {
+        asset_flags = ASSET_ACCEPT_404;
+        if (order > 0 && !(flags & HIPS_NO_DELAY))
+            asset_flags |= ASSET_DELAY;
+        data = asset_get_data2(url, asset_flags, &size, code);
+        if (!(*code)) return NULL; // Still loading the file.
+    }
 
     // If the tile doesn't exists, mark it in the parent tile so that we
     // won't have to search for it again.
     if ((*code) / 100 == 4) {
+        trace_tile(hips, order, pix, *code);
         if (order > hips->order_min) {
             parent = hips_get_tile_(hips, order - 1, pix / 4, flags,
                                     &parent_code);
@@ -735,9 +1533,9 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     tile->pos.order = order;
     tile->pos.pix = pix;
     tile->hips = hips;
-    hips->ref++;
-    cache_add(g_cache, &key, sizeof(key), tile, sizeof(*tile) + cost,
+    cache_add(hips->cache, &key, sizeof(key), tile, sizeof(*tile) + cost,
               del_tile);
+    if (hips->snapshot) hips->snapshot_changed = sys_get_unix_time();
 
     if (!(flags & HIPS_LOAD_IN_THREAD)) {
         tile->data = hips->settings.create_tile(
@@ -748,15 +1546,19 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
             LOG_W("Cannot parse tile %s", url);
             tile->flags |= TILE_LOAD_ERROR;
         }
-        asset_release(url);
+        cache_set_cost(hips->cache, &key, sizeof(key), sizeof(*tile) + cost);
+        if (!cold) {
+            if (tile->data)
+                cold_cache_add(hips, &key, cold_data_create(data, size));
+            asset_release(url);
+        }
+        trace_tile(hips, order, pix, 200);
     } else {
         tile->loader = calloc(1, sizeof(*tile->loader));
         worker_init(&tile->loader->worker, load_tile_worker);
-        tile->loader->data = malloc(size);
-        tile->loader->size = size;
+        tile->loader->src = cold_data_create(data, size);
         tile->loader->tile = tile;
-        memcpy(tile->loader->data, data, size);
-        asset_release(url);
+        if (!cold) asset_release(url);
         *code = 0;
         return NULL;
     }
@@ -780,6 +1582,7 @@ static void *create_img_tile(
     void *img;
     int i, w, h, bpp = 0;
     img_tile_t *tile;
+    ktx_t ktx;
 
     // Special case for allsky tiles!  Just return an empty image tile.
     if (order == -1) {
@@ -787,6 +1590,25 @@ static void *create_img_tile(
         return tile;
     }
 
+    // Compressed tiles are kept as is until we upload them.  We don't know
+    // the transparency in that case.
+    if (ktx_is_ktx(data, size)) {
+        if (ktx_parse(data, size, &ktx)) {
+            LOG_W("Unsupported ktx tile");
+            return NULL;
+        }
+        tile = calloc(1, sizeof(*tile));
+        tile->img = malloc(ktx.size);
+        memcpy(tile->img, ktx.data, ktx.size);
+        tile->w = ktx.w;
+        tile->h = ktx.h;
+        tile->bpp = 3;
+        tile->format = ktx.format;
+        tile->size = ktx.size;
+        *cost = ktx.size;
+        return tile;
+    }
+
     img = img_read_from_mem(data, size, &w, &h, &bpp);
     if (!img) {
         LOG_W("Cannot parse img");
@@ -835,3 +1657,520 @@ double hips_parse_date(const char *str)
     eraDtf2d("UTC", iy, im, id, ihr, imn, 0, &d1, &d2);
     return d1 - DJM0 + d2;
 }
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+/*
+ * Fake survey served by an asset hook, where every tile takes a fixed
+ * number of frames to arrive, to simulate the requests latency.
+ */
+typedef struct {
+    UT_hash_handle  hh;
+    char            url[128];
+    int             frame; // Frame of the first request.
+} test_request_t;
+
+static struct {
+    test_request_t  *requests;
+    int             frame;
+    int             latency; // In frames.
+    int             nb_downloads;
+} g_test;
+
+static void *test_hook(void *user, const char *url, int *size, int *code)
+{
+    const char *props = "hips_order = 9\nhips_order_min = 3\n"
+                        "hips_version = 1.4\n";
+    test_request_t *req;
+
+    if (!str_startswith(url, "test://hips/")) {
+        *code = -1;
+        return NULL;
+    }
+    *code = 200;
+    if (str_endswith(url, "/properties")) {
+        *size = strlen(props);
+        return strdup(props);
+    }
+    HASH_FIND_STR(g_test.requests, url, req);
+    if (!req) {
+        req = calloc(1, sizeof(*req));
+        snprintf(req->url, sizeof(req->url), "%s", url);
+        req->frame = g_test.frame;
+        HASH_ADD_STR(g_test.requests, url, req);
+    }
+    if (g_test.frame - req->frame < g_test.latency) {
+        *code = 0;
+        return NULL;
+    }
+    g_test.nb_downloads++;
+    *size = 4;
+    return strdup("img");
+}
+
+static void *test_create_tile(void *user, int order, int pix, const void *src,
+                              int size, int *cost, int *transparency)
+{
+    // The first child of the order 3 tiles doesn't exist.
+    if (order == 3) *transparency = 1;
+    return calloc(1, 1);
+}
+
+static int test_delete_tile(void *tile)
+{
+    free(tile);
+    return 0;
+}
+
+static void test_clear_requests(void)
+{
+    test_request_t *req, *tmp;
+    HASH_ITER(hh, g_test.requests, req, tmp) {
+        HASH_DEL(g_test.requests, req);
+        free(req);
+    }
+}
+
+/*
+ * Simulate a zoom from 60° to 0.5° fov: the order 3 tile is already
+ * loaded, and we want all the order 8 tiles of an order 6 tile (about
+ * 0.9°).  Return the number of frames needed to load them.
+ */
+static int test_zoom(bool parallel, int latency, bool realtime,
+                     json_value **trace)
+{
+    const hips_settings_t settings = {
+        .create_tile = test_create_tile,
+        .delete_tile = test_delete_tile,
+    };
+    hips_t *hips = hips_create("test://hips", 0, &settings);
+    const int pix3 = 100, pix6 = ((pix3 * 4 + 1) * 4 + 2) * 4 + 3;
+    int i, code, nb, frame;
+
+    g_test.frame = 0;
+    g_test.latency = latency;
+    hips_set_parallel_fetch(hips, parallel);
+    while (!hips_get_tile(hips, 3, pix3, HIPS_NO_DELAY, &code))
+        g_test.frame++;
+
+    hips_set_trace(hips, true);
+    frame = g_test.frame;
+    do {
+        for (i = 0, nb = 0; i < 16; i++) {
+            if (hips_get_tile(hips, 8, pix6 * 16 + i, HIPS_NO_DELAY, &code))
+                nb++;
+        }
+        g_test.frame++;
+        if (realtime) usleep(1000000 / 60);
+    } while (nb < 16);
+    frame = g_test.frame - frame;
+
+    // The tiles of the first child of the order 3 tile are never requested.
+    assert(!hips_get_tile(hips, 9, (pix3 * 4) << 10, HIPS_NO_DELAY, &code));
+    assert(code == 404);
+
+    if (trace) *trace = hips_get_trace(hips);
+    hips_delete(hips);
+    test_clear_requests();
+    return frame;
+}
+
+static void test_hips_tile_format(void)
+{
+    hips_t *hips = hips_create("test://format", 0, NULL);
+    hips->properties = json_object_new(0);
+    ini_parse_string("hips_tile_format = ktx webp", property_handler, hips);
+    // The allsky still uses a regular image.
+    assert(strcmp(hips->ext, "ktx") == 0);
+    assert(strcmp(hips->allsky.ext, "webp") == 0);
+    ini_parse_string("hips_tile_format = ktx", property_handler, hips);
+    assert(hips->allsky.not_available);
+    hips_delete(hips);
+}
+
+static void test_hips_staged_upload(void)
+{
+    typeof(((hips_t*)0)->allsky) allsky = {};
+    const int size = 4, w = 3 * size, h = 4 * size;
+    uint8_t *img = malloc(w * h);
+    int i;
+    bool r;
+
+    // Each allsky pixel gets cut into its own image.
+    for (i = 0; i < w * h; i++)
+        img[i] = (i / w / size) * 3 + (i % w) / size;
+    r = allsky_cut(&allsky, img, w, h, 1);
+    assert(r && allsky.loaded && allsky.face_size == size);
+    for (i = 0; i < 12; i++) {
+        assert(allsky.faces[i][0] == i);
+        assert(allsky.faces[i][size * size - 1] == i);
+        free(allsky.faces[i]);
+    }
+    // Wrong images are rejected.
+    memset(&allsky, 0, sizeof(allsky));
+    r = allsky_cut(&allsky, img, w, size, 1);
+    assert(!r);
+    r = allsky_cut(&allsky, img, 2, h, 1);
+    assert(!r);
+    r = allsky_cut(&allsky, img, w, h, 5);
+    assert(!r && !allsky.loaded && !allsky.faces[0]);
+    free(img);
+
+    // At least one image is uploaded per frame, even if it is bigger than
+    // the budget.
+    hips_new_frame();
+    r = upload_budget_take(UPLOAD_BUDGET * 2);
+    assert(r);
+    r = upload_budget_take(1);
+    assert(!r);
+    hips_new_frame();
+    r = upload_budget_take(UPLOAD_BUDGET / 2);
+    assert(r);
+    r = upload_budget_take(UPLOAD_BUDGET / 2);
+    assert(r);
+    r = upload_budget_take(1);
+    assert(!r);
+    hips_new_frame();
+}
+
+static void test_hips_cache(void)
+{
+    const hips_settings_t settings = {
+        .create_tile = test_create_tile,
+        .delete_tile = test_delete_tile,
+    };
+    hips_t *hips = hips_create("test://hips", 0, &settings);
+    const int tile_size = sizeof(tile_t) + 1;
+    const void *tile;
+    int pix, code, nb;
+
+    asset_set_hook(NULL, test_hook);
+    g_test.latency = 0;
+    g_test.nb_downloads = 0;
+    // Room for four tiles, without grace period.
+    hips->cache = cache_create(4 * tile_size, 0);
+    cache_set_evict_score(hips->cache, tile_evict_score);
+    hips->cold_cache = cache_create(1024, 0);
+    healpix_pix2vec(1 << 3, 0, hips->view);
+
+    for (pix = 0; pix < 12; pix++) {
+        while (!hips_get_tile(hips, 3, pix, HIPS_NO_DELAY, &code))
+            assert(code == 0);
+    }
+    assert(g_test.nb_downloads == 12);
+    nb = hips->stats.evictions;
+    assert(nb >= 8);
+
+    // The evicted tiles are parsed again from the cold cache.
+    cache_set_max_size(hips->cache, 12 * tile_size);
+    for (pix = 0; pix < 12; pix++) {
+        tile = hips_get_tile(hips, 3, pix, HIPS_NO_DELAY, &code);
+        assert(tile);
+    }
+    assert(hips->stats.cold_hits == nb);
+    assert(g_test.nb_downloads == 12);
+
+    // The tiles far from the view are evicted first.  The first call only
+    // starts the grace period of the tiles.
+    cache_set_max_size(hips->cache, 2 * tile_size);
+    cache_set_max_size(hips->cache, 2 * tile_size);
+    tile = hips_get_tile(hips, 3, 0, HIPS_CACHED_ONLY, &code);
+    assert(tile);
+    for (pix = 1; pix < 12; pix++) {
+        tile = hips_get_tile(hips, 3, pix, HIPS_CACHED_ONLY, &code);
+        assert(!tile);
+    }
+
+    hips_delete(hips);
+    asset_set_hook(NULL, NULL);
+    test_clear_requests();
+}
+
+// Number of tiles that test_keep_tile refuses to delete.
+static int g_test_kept = 0;
+
+static int test_keep_tile(void *tile)
+{
+    if (g_test_kept) return CACHE_KEEP;
+    free(tile);
+    return 0;
+}
+
+static void test_hips_cache_budget(void)
+{
+    const hips_settings_t settings = {
+        .create_tile = test_create_tile,
+        .delete_tile = test_keep_tile,
+    };
+    hips_t *a = hips_create("test://hips/a", 0, &settings);
+    hips_t *b = hips_create("test://hips/b", 0, &settings);
+    cache_budget_t *budget;
+    const int tile_size = sizeof(tile_t);
+    int pix, code;
+
+    asset_set_hook(NULL, test_hook);
+    g_test.latency = 0;
+    // The two surveys share a budget of six tiles, without grace period.
+    budget = cache_budget_create(6 * tile_size);
+    a->cache = cache_create(12 * tile_size, 0);
+    b->cache = cache_create(12 * tile_size, 0);
+    cache_set_budget(a->cache, budget);
+    cache_set_budget(b->cache, budget);
+    a->cold_cache = cache_create(1024, 0);
+    b->cold_cache = cache_create(1024, 0);
+    for (pix = 0; pix < 5; pix++) {
+        while (!hips_get_tile(a, 3, pix, HIPS_NO_DELAY, &code))
+            assert(code == 0);
+    }
+    assert(cache_get_current_size(a->cache) == 5 * tile_size);
+    // The tiles of the largest cache get evicted first.
+    for (pix = 0; pix < 3; pix++) {
+        while (!hips_get_tile(b, 3, pix, HIPS_NO_DELAY, &code))
+            assert(code == 0);
+    }
+    assert(cache_get_current_size(b->cache) == 3 * tile_size);
+    assert(cache_get_current_size(a->cache) < 3 * tile_size);
+
+    // The tiles still in use when the survey is deleted are only deleted
+    // once they are not used anymore.
+    g_test_kept = 1;
+    hips_delete(a);
+    assert(g_orphans);
+    hips_new_frame();
+    assert(g_orphans);
+    g_test_kept = 0;
+    hips_new_frame();
+    assert(!g_orphans);
+
+    hips_delete(b);
+    cache_budget_delete(budget);
+    asset_set_hook(NULL, NULL);
+    test_clear_requests();
+}
+
+typedef struct {
+    obj_t   obj;
+    int     value;
+    char    *name;
+    char    *names;
+} test_obj_t;
+
+typedef struct {
+    int         nb;
+    test_obj_t  *objs;
+} test_tile_t;
+
+static const hips_dump_string_t TEST_STRINGS[] = {
+    {offsetof(test_obj_t, name)},
+    {offsetof(test_obj_t, names), true},
+    {}
+};
+
+static void *test_objs_create_tile(
+        void *user, int order, int pix, const void *src, int size,
+        int *cost, int *transparency)
+{
+    test_tile_t *tile = calloc(1, sizeof(*tile));
+    tile->nb = 2;
+    tile->objs = calloc(tile->nb, sizeof(*tile->objs));
+    memcpy(tile->objs[0].obj.type, "Star", 4);
+    tile->objs[0].value = pix;
+    tile->objs[0].name = strdup("a");
+    tile->objs[0].names = malloc(6);
+    memcpy(tile->objs[0].names, "x\0yz\0", 6);
+    tile->objs[1].value = order;
+    return tile;
+}
+
+static int test_objs_delete_tile(void *tile_)
+{
+    test_tile_t *tile = tile_;
+    int i;
+    for (i = 0; i < tile->nb; i++) {
+        free(tile->objs[i].name);
+        free(tile->objs[i].names);
+    }
+    free(tile->objs);
+    free(tile);
+    return 0;
+}
+
+static void *test_objs_dump_tile(void *user, const void *tile_, int *size)
+{
+    const test_tile_t *tile = tile_;
+    return hips_dump_objs(tile, sizeof(*tile), tile->objs, tile->nb,
+                          sizeof(test_obj_t), TEST_STRINGS, size);
+}
+
+static void *test_objs_load_tile(void *user, int order, int pix,
+                                 const void *data, int size, int *cost)
+{
+    test_tile_t *tile = calloc(1, sizeof(*tile));
+    if (hips_load_objs(data, size, tile, sizeof(*tile), sizeof(test_obj_t),
+                       TEST_STRINGS, NULL, (void**)&tile->objs, &tile->nb)) {
+        free(tile);
+        return NULL;
+    }
+    return tile;
+}
+
+static void test_objs_check_tile(const test_tile_t *tile, int order, int pix)
+{
+    assert(tile->nb == 2);
+    assert(memcmp(tile->objs[0].obj.type, "Star", 4) == 0);
+    assert(tile->objs[0].value == pix && tile->objs[1].value == order);
+    assert(strcmp(tile->objs[0].name, "a") == 0);
+    assert(memcmp(tile->objs[0].names, "x\0yz\0", 6) == 0);
+    assert(!tile->objs[1].name && !tile->objs[1].names);
+}
+
+// Load a tile from a new survey, and return how it was obtained.
+static int test_snapshot_get_tile(double release_date, int pix)
+{
+    const hips_settings_t settings = {
+        .create_tile = test_objs_create_tile,
+        .delete_tile = test_objs_delete_tile,
+        .dump_tile = test_objs_dump_tile,
+        .load_tile = test_objs_load_tile,
+        .snapshot_version = 1,
+    };
+    hips_t *hips = hips_create("test://hips", release_date, &settings);
+    test_tile_t *tile;
+    int code, ret;
+
+    while (!(tile = hips_get_tile(hips, 3, pix, HIPS_NO_DELAY, &code)))
+        assert(code == 0);
+    test_objs_check_tile(tile, 3, pix);
+    ret = hips->stats.snapshot_hits;
+    // The snapshot is saved once the survey got idle.
+    if (!ret) {
+        hips_new_frame();
+        assert(hips->snapshot_changed);
+        hips->snapshot_changed -= SNAPSHOT_IDLE_DELAY;
+        hips_new_frame();
+        assert(!hips->snapshot_changed);
+    }
+    assert(hips_save_snapshots() == 0);
+    hips_delete(hips);
+    return ret;
+}
+
+static void test_hips_snapshot(void)
+{
+    test_tile_t *tile, loaded;
+    void *data;
+    int size, nb = 0;
+    char dir[] = "/tmp/swe-snapshot-XXXXXX", path[1024];
+    hips_t hips = {.hash = crc32(0, (void*)"test://hips", 11)};
+
+    // Dump and load round trip.
+    tile = test_objs_create_tile(NULL, 3, 10, NULL, 0, NULL, NULL);
+    data = test_objs_dump_tile(NULL, tile, &size);
+    assert(hips_load_objs(data, size, &loaded, sizeof(loaded),
+                          sizeof(test_obj_t), TEST_STRINGS, NULL,
+                          (void**)&loaded.objs, &loaded.nb) == 0);
+    test_objs_check_tile(&loaded, 3, 10);
+    assert(loaded.objs[0].obj.ref == 1);
+    test_objs_delete_tile(tile);
+    tile = calloc(1, sizeof(*tile));
+    *tile = loaded;
+    test_objs_delete_tile(tile);
+    // Truncated data is rejected.
+    assert(hips_load_objs(data, size - 1, &loaded, sizeof(loaded),
+                          sizeof(test_obj_t), TEST_STRINGS, NULL,
+                          (void**)&loaded.objs, &loaded.nb) == -1);
+    assert(hips_load_objs(data, sizeof(loaded) + 8, &loaded, sizeof(loaded),
+                          sizeof(test_obj_t), TEST_STRINGS, NULL,
+                          (void**)&loaded.objs, &loaded.nb) == -1);
+    free(data);
+
+#ifndef __EMSCRIPTEN__
+    // Snapshot of a survey, only used by the surveys with the same release
+    // date.
+    asset_set_hook(NULL, test_hook);
+    g_test.latency = 0;
+    g_test.nb_downloads = 0;
+    assert(mkdtemp(dir));
+    hips_set_snapshot_dir(dir);
+    assert(strcmp(hips_get_snapshot_dir(), dir) == 0);
+    nb += test_snapshot_get_tile(1, 5);
+    assert(g_test.nb_downloads == 1 && nb == 0);
+    nb += test_snapshot_get_tile(1, 5);
+    assert(g_test.nb_downloads == 1 && nb == 1);
+    nb += test_snapshot_get_tile(2, 5);
+    assert(g_test.nb_downloads == 2 && nb == 1);
+    nb += test_snapshot_get_tile(2, 5);
+    assert(g_test.nb_downloads == 2 && nb == 2);
+
+    get_snapshot_path(&hips, path, sizeof(path));
+    unlink(path);
+    rmdir(dir);
+    hips_set_snapshot_dir(NULL);
+    asset_set_hook(NULL, NULL);
+    test_clear_requests();
+#endif
+}
+
+static void test_hips_parallel_fetch(void)
+{
+    json_value *trace;
+    int i, serial, parallel;
+    bool found = false;
+
+    asset_set_hook(NULL, test_hook);
+    serial = test_zoom(false, 5, false, NULL);
+    parallel = test_zoom(true, 5, false, &trace);
+    asset_set_hook(NULL, NULL);
+
+    // Orders 4 to 8 one after the other, or all at once.
+    assert(serial == 5 * 5 + 1);
+    assert(parallel == 5 + 1);
+    for (i = 0; i < trace->u.array.length; i++) {
+        // [order, pix, requested, done, code]
+        assert(trace->u.array.values[i]->u.array.values[4]->u.integer == 200);
+        if (trace->u.array.values[i]->u.array.values[0]->u.integer == 9)
+            found = true;
+    }
+    assert(trace->u.array.length == 3 + 4 + 16 && !found);
+    json_builder_free(trace);
+}
+
+static void bench_hips_parallel_fetch(void)
+{
+    json_value *trace, *v;
+    int i, j;
+    double t;
+    const char *mode[] = {"Serial", "Parallel"};
+
+    // 60 fps, with 100 ms requests latency.
+    asset_set_hook(NULL, test_hook);
+    for (i = 0; i < 2; i++) {
+        test_zoom(i, 6, true, &trace);
+        LOG_I("%s fetch timeline (order, pix, requested, done):", mode[i]);
+        for (j = 0, t = 0; j < trace->u.array.length; j++) {
+            v = trace->u.array.values[j];
+            t = fmax(t, v->u.array.values[3]->u.dbl);
+            LOG_I("  %d %d %4.0f ms %4.0f ms",
+                  (int)v->u.array.values[0]->u.integer,
+                  (int)v->u.array.values[1]->u.integer,
+                  v->u.array.values[2]->u.dbl * 1000,
+                  v->u.array.values[3]->u.dbl * 1000);
+        }
+        LOG_I("%s fetch: full resolution after %.0f ms", mode[i], t * 1000);
+        json_builder_free(trace);
+    }
+    asset_set_hook(NULL, NULL);
+}
+
+TEST_REGISTER(NULL, test_hips_tile_format, TEST_AUTO);
+TEST_REGISTER(NULL, test_hips_staged_upload, TEST_AUTO);
+TEST_REGISTER(NULL, test_hips_cache, TEST_AUTO);
+TEST_REGISTER(NULL, test_hips_cache_budget, TEST_AUTO);
+TEST_REGISTER(NULL, test_hips_snapshot, TEST_AUTO);
+TEST_REGISTER(NULL, test_hips_parallel_fetch, TEST_AUTO);
+TEST_REGISTER(NULL, bench_hips_parallel_fetch, 0);
+
+#endif
@@ -56,6 +56,17 @@ typedef struct hips_settings {
     int (*delete_tile)(void *tile);
     const char *ext; // If set, force the files extension.
     void *user;
+    // If set, override the default tiles caches budgets (in bytes).
+    int cache_size;
+    int cold_cache_size;
+    // Optional functions to save and restore the parsed tiles to the on-disk
+    // snapshot, see <hips_set_snapshot_dir>.  dump_tile returns a newly
+    // allocated buffer.  snapshot_version must be changed every time the
+    // dumped data layout changes.
+    void *(*dump_tile)(void *user, const void *tile, int *size);
+    void *(*load_tile)(void *user, int order, int pix, const void *data,
+                       int size, int *cost);
+    int snapshot_version;
 } hips_settings_t;
 
 
@@ -70,13 +81,17 @@ struct hips {
     uint32_t    hash; // Hash of the url.
 
     // Stores the allsky image if available.
-    // We only do it for order zero allsky.
+    // We only do it for order zero allsky.  The worker decodes the image
+    // and cuts it into the twelve pixels images, that are then uploaded
+    // to the GPU and released once the texture is created.
     struct {
         worker_t    worker; // Worker to load the image in a thread.
+        const char  *ext; // If set, overrides the survey extension.
         bool        not_available;
+        bool        loaded;    // Set once the image has been decoded.
         uint8_t     *src_data; // Encoded image data (png, webp...)
-        uint8_t     *data;     // RGB[A] image data.
-        int         w, h, bpp, size;
+        uint8_t     *faces[12]; // RGB[A] data of each pixel, until uploaded.
+        int         face_size, bpp, size;
         texture_t   *textures[12];
     }           allsky;
 
@@ -89,6 +104,35 @@ struct hips {
     // The settings as passed in the create function.
     hips_settings_t settings;
     int ref; // Ref counting of hips survey.
+
+    // Tiles caches of the survey.  The hot cache contains the parsed tiles,
+    // and the cold cache the source data of the loaded tiles, favoring the
+    // evicted ones, so that we can parse them again without downloading
+    // them.
+    cache_t     *cache;
+    cache_t     *cold_cache;
+    // Last rendered view direction in the survey frame, used to evict the
+    // tiles far from the view first.
+    double      view[3];
+    // Request the tiles without waiting for their parents, see
+    // <hips_set_parallel_fetch>.
+    bool        parallel_fetch;
+    // Tiles loading timeline, see <hips_set_trace>.
+    struct hips_trace *trace;
+
+    // Mmapped on-disk snapshot of the parsed tiles.
+    struct hips_snapshot *snapshot;
+    hips_t      *next, *prev; // List of surveys supporting snapshots.
+    // Time we last parsed a tile since the snapshot got saved, or zero.
+    double      snapshot_changed;
+
+    struct {
+        int     snapshot_hits; // Tiles restored from the snapshot.
+        int     hits;       // Tiles found in the hot cache.
+        int     misses;     // Tiles not found in the hot cache.
+        int     cold_hits;  // Tiles parsed again from the cold cache.
+        int     evictions;  // Tiles evicted from the hot cache.
+    } stats;
 };
 
 
@@ -257,6 +301,43 @@ texture_t *hips_get_tile_texture(
  */
 void hips_set_frame(hips_t *hips, int frame);
 
+/*
+ * Function: hips_set_parallel_fetch
+ * Allow to request the tiles before their parent is loaded.
+ *
+ * By default we only request a tile once its parent is loaded, so that we
+ * can use the parent children mask to skip the tiles that don't exist.
+ * This makes the time to reach a deep tile proportional to its order.
+ * With this mode, as soon as one ancestor of a tile is loaded and doesn't
+ * exclude it, the tile is requested at the same time as its missing
+ * ancestors.
+ *
+ * Parameters:
+ *   hips  - A hips survey.
+ *   value - Enable or disable the mode.
+ */
+void hips_set_parallel_fetch(hips_t *hips, bool value);
+
+/*
+ * Function: hips_set_trace
+ * Enable or disable the recording of the tiles loading timeline.
+ *
+ * Enabling the trace resets it.  See <hips_get_trace>.
+ */
+void hips_set_trace(hips_t *hips, bool enabled);
+
+/*
+ * Function: hips_get_trace
+ * Return the recorded tiles loading timeline.
+ *
+ * Return:
+ *   A json array with one [order, pix, requested, done, code] array per
+ *   tile, in request order.  The times are in seconds since the trace was
+ *   enabled, done is null if the tile is still loading.  The returned
+ *   value needs to be freed with json_builder_free.
+ */
+json_value *hips_get_trace(const hips_t *hips);
+
 /*
  * Function: hips_set_label
  * Set the label for a hips survey
@@ -306,6 +387,113 @@ int hips_get_render_order_planet(const hips_t *hips, const painter_t *painter,
 int hips_render(hips_t *hips, const painter_t *painter,
                 const double transf[4][4], int split_order);
 
+/*
+ * Function: hips_new_frame
+ * Must be called once at the start of each frame.
+ *
+ * This resets the budget of bytes of decoded tiles we can upload to the GPU
+ * per frame, so that bursts of tiles arrivals don't spike the frame time.
+ * It also deletes the tiles of deleted surveys that were still in use, and
+ * saves the snapshots of the surveys that got idle, see
+ * <hips_set_snapshot_dir>.
+ */
+void hips_new_frame(void);
+
+/*
+ * Function: hips_set_snapshot_dir
+ * Enable the on-disk snapshots of parsed tiles.
+ *
+ * Surveys that support it (with the dump_tile and load_tile settings) will
+ * first look for their tiles in a snapshot file in this directory, before
+ * downloading and parsing them.  The snapshot files are memory mapped, and
+ * are versioned and checksummed so that we never use invalid data.
+ *
+ * The snapshot of a survey is opened when it is created, and saved again
+ * once we didn't parse any new tile for a few seconds.
+ *
+ * This is not supported with emscripten.
+ *
+ * Parameters:
+ *   dir    - Directory of the snapshot files, or NULL to disable them.
+ */
+void hips_set_snapshot_dir(const char *dir);
+
+/*
+ * Function: hips_get_snapshot_dir
+ * Return the directory of the snapshot files, or NULL if disabled.
+ */
+const char *hips_get_snapshot_dir(void);
+
+/*
+ * Function: hips_save_snapshots
+ * Save the currently cached tiles of all the surveys to their snapshot.
+ *
+ * Return:
+ *   0 on success, or a negative value in case of error.
+ */
+int hips_save_snapshots(void);
+
+/*
+ * Type: hips_dump_string_t
+ * String field of the objects dumped with <hips_dump_objs>.
+ */
+typedef struct {
+    int     offset;  // Offset of the char pointer in the object struct.
+    bool    is_list; // Set for '\0' separated lists ended by an empty string.
+} hips_dump_string_t;
+
+/*
+ * Function: hips_dump_objs
+ * Helper to implement the dump_tile setting for tiles made of a header
+ * and an array of objects.
+ *
+ * The objects are dumped in their memory layout, with only the type of
+ * their obj_t base, and their string fields replaced by offsets into a
+ * strings buffer that follows them.
+ *
+ * Parameters:
+ *   header      - Tile header, dumped first.
+ *   header_size - Size of the tile header.
+ *   objs        - Array of objects, that all start with an obj_t.
+ *   nb          - Number of objects.
+ *   obj_size    - Size of the objects.
+ *   strings     - String fields of the objects, ended by a zero offset.
+ *   size        - Get the size of the returned data.
+ *
+ * Return:
+ *   A newly allocated buffer.
+ */
+void *hips_dump_objs(const void *header, int header_size,
+                     const void *objs, int nb, int obj_size,
+                     const hips_dump_string_t *strings, int *size);
+
+/*
+ * Function: hips_load_objs
+ * Restore a tile dumped with <hips_dump_objs>.
+ *
+ * The header is copied as it was dumped, and the objects get a new array
+ * with their own copies of the strings, a single reference and the given
+ * klass.
+ *
+ * Parameters:
+ *   data        - Dumped data.
+ *   size        - Size of the dumped data.
+ *   header      - Get the tile header.
+ *   header_size - Size of the tile header.
+ *   obj_size    - Size of the objects.
+ *   strings     - String fields of the objects, as passed to the dump.
+ *   klass       - Klass of the objects.
+ *   objs        - Get the newly allocated array of objects.
+ *   nb          - Get the number of objects.
+ *
+ * Return:
+ *   0 on success, or -1 if the data is not valid.
+ */
+int hips_load_objs(const void *data, int size,
+                   void *header, int header_size, int obj_size,
+                   const hips_dump_string_t *strings, obj_klass_t *klass,
+                   void **objs, int *nb);
+
 /*
  * Function: hips_parse_date
  * Parse a date in the format supported for HiPS property files
@@ -16,8 +16,41 @@ function fillColorPtr(color, ptr) {
   Module._geojson_set_color_ptr_(ptr, color[0], color[1], color[2], color[3])
 }
 
-function fillBoolPtr(value, ptr) {
-  Module._geojson_set_bool_ptr_(ptr, value);
+// Flags of the features, as in geojson.c.
+const FEATURE_HIDDEN = 1 << 0;
+const FEATURE_BLINK = 1 << 1;
+
+/*
+ * Create a batch filter function, to be passed to the 'filter_batch'
+ * attribute.  The engine calls it once for all the features of a geojson
+ * or survey tile, with the arrays of the features colors and flags, so
+ * that we don't cross the wasm/js boundary for each feature.
+ *
+ * The filter callback gets the tile pointer and the feature index, and
+ * returns a dict of values:
+ *
+ *      fill    - Array of 4 float values.
+ *      stroke  - Array of 4 float values.
+ *      blink   - Boolean
+ *      hidden  - Boolean
+ */
+function addBatchFilterFunction(filter) {
+  return Module.addFunction(
+      function(img, nb, fillPtr, strokePtr, flagsPtr) {
+    for (let i = 0; i < nb; i++) {
+      const r = filter(img, i);
+      if (r.fill)
+        Module.HEAPF32.set(r.fill.slice(0, 4), (fillPtr >> 2) + i * 4);
+      if (r.stroke)
+        Module.HEAPF32.set(r.stroke.slice(0, 4), (strokePtr >> 2) + i * 4);
+      let flags = Module.HEAPU8[flagsPtr + i];
+      if (r.hidden !== undefined)
+        flags = r.hidden ? (flags | FEATURE_HIDDEN) : (flags & ~FEATURE_HIDDEN);
+      if (r.blink !== undefined)
+        flags = r.blink ? (flags | FEATURE_BLINK) : (flags & ~FEATURE_BLINK);
+      Module.HEAPU8[flagsPtr + i] = flags;
+    }
+  }, 'viiiii');
 }
 
 /*
@@ -128,16 +161,10 @@ Module['onGeojsonObj'] = function(obj) {
   Object.defineProperty(obj, 'filter', {
     set: function(filter) {
       if (filterFn) Module.removeFunction(filterFn);
-      filterFn = Module.addFunction(
-          function(img, id, fillPtr, strokePtr, blinkPtr, hiddenPtr) {
-        const r = filter(id);
-        if (r.fill) fillColorPtr(r.fill, fillPtr);
-        if (r.stroke) fillColorPtr(r.stroke, strokePtr);
-        if (r.stroke) fillColorPtr(r.stroke, strokePtr);
-        if (r.blink !== undefined) fillBoolPtr(r.blink, blinkPtr);
-        if (r.hidden !== undefined) fillBoolPtr(r.hidden, hiddenPtr);
-      }, 'viiiiii');
-      obj._call('filter', filterFn);
+      filterFn = addBatchFilterFunction(function(img, id) {
+        return filter(id);
+      });
+      obj._call('filter_batch', filterFn);
     }
   });
 
@@ -210,16 +237,10 @@ Module['onGeojsonSurveyObj'] = function(obj) {
   Object.defineProperty(obj, 'filter', {
     set: function(filter) {
       if (obj._filterFn) Module.removeFunction(obj._filterFn);
-      obj._filterFn = Module.addFunction(
-          function(img, id, fillPtr, strokePtr, blinkPtr, hiddenPtr) {
-        let features = g_tiles[img];
-        const r = filter(features[id]);
-        if (r.fill) fillColorPtr(r.fill, fillPtr);
-        if (r.stroke) fillColorPtr(r.stroke, strokePtr);
-        if (r.blink !== undefined) fillBoolPtr(r.blink, blinkPtr);
-        if (r.hidden !== undefined) fillBoolPtr(r.hidden, hiddenPtr);
-      }, 'viiiiii');
-      obj._call('filter', obj._filterFn);
+      obj._filterFn = addBatchFilterFunction(function(img, id) {
+        return filter(g_tiles[img][id]);
+      });
+      obj._call('filter_batch', obj._filterFn);
     }
   });
   obj.queryRenderedFeatures = function(point) {
@@ -12,6 +12,8 @@ Module.afterInit(function() {
   var obj_call_json_str = Module.cwrap('obj_call_json_str',
     'number', ['number', 'string', 'string']);
   var core_search = Module.cwrap('core_search', 'number', ['string']);
+  var core_search_prefix = Module.cwrap('core_search_prefix', 'number',
+    ['string', 'number']);
   var obj_get_id = Module.cwrap('obj_get_id', 'string', ['number']);
   var module_add = Module.cwrap('module_add', null, ['number', 'number']);
   var module_remove = Module.cwrap('module_remove', null, ['number', 'number']);
@@ -344,6 +346,20 @@ Module.afterInit(function() {
     return obj ? new SweObj(obj) : null;
   };
 
+  // Return the designations of the indexed objects starting with a given
+  // prefix, to autocomplete a search.
+  //
+  // Inputs:
+  //  prefix    String
+  //  maxNb     Max number of designations returned (default to 10).
+  Module['searchPrefix'] = function(prefix, maxNb) {
+    assert(typeof(prefix) == 'string')
+    var cret = core_search_prefix(prefix, maxNb || 10)
+    var ret = Module.UTF8ToString(cret)
+    Module._free(cret)
+    return JSON.parse(ret)
+  };
+
   Module['change'] = function(callback, context) {
     g_listeners.push({
       'obj': null,
@@ -13,6 +13,10 @@
 
 #include <float.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Number of buffers (re)allocations, used by the tests.
+static int g_nb_allocs = 0;
 
 // Test if a shape in clipping coordinates is clipped or not.
 static bool is_clipped(int n, double (*pos)[4])
@@ -65,18 +69,29 @@ static void line_get_normal(const double (*line)[3], int size, int i,
 
 line_mesh_t *line_to_mesh(const double (*line)[3],
                           const double (*win)[3],
-                          int size, double width)
+                          int size, double width, line_mesh_t *mesh)
 {
     int i, k;
     double n[2], v[2], length = 0;
-    line_mesh_t *mesh = calloc(1, sizeof(*mesh));
 
     assert(size >= 2);
+    if (!mesh) mesh = calloc(1, sizeof(*mesh));
 
     mesh->verts_count = size * 2;
-    mesh->verts = calloc(mesh->verts_count, sizeof(*mesh->verts));
+    if (mesh->verts_count > mesh->verts_allocated) {
+        mesh->verts_allocated = mesh->verts_count;
+        free(mesh->verts);
+        mesh->verts = malloc(mesh->verts_allocated * sizeof(*mesh->verts));
+        g_nb_allocs++;
+    }
     mesh->indices_count = 6 * (size - 1);
-    mesh->indices = calloc(mesh->indices_count, sizeof(*mesh->indices));
+    if (mesh->indices_count > mesh->indices_allocated) {
+        mesh->indices_allocated = mesh->indices_count;
+        free(mesh->indices);
+        mesh->indices = malloc(mesh->indices_allocated *
+                               sizeof(*mesh->indices));
+        g_nb_allocs++;
+    }
 
     // Compute all vertices.
     for (i = 0; i < size; i++) {
@@ -118,18 +133,30 @@ static double line_point_dist(const double a[2], const double b[2],
     return fabs(vec2_cross(ap, u)) / vec2_norm(u);
 }
 
-static void line_push_point(double (**pos)[3], double (**win)[3],
-                            const double p[3], const double w[3],
-                            int *size, int *allocated)
+void line_buffer_reserve(line_buffer_t *buf, int size)
 {
-    if (*size <= *allocated) {
-        *allocated += 4;
-        *pos = realloc(*pos, *allocated * sizeof(**pos));
-        *win = realloc(*win, *allocated * sizeof(**win));
-    }
-    memcpy((*pos)[*size], p, sizeof(**pos));
-    memcpy((*win)[*size], w, sizeof(**win));
-    (*size)++;
+    if (size <= buf->allocated) return;
+    buf->allocated = buf->allocated * 2 ?: 64;
+    if (buf->allocated < size) buf->allocated = size;
+    buf->pos = realloc(buf->pos, buf->allocated * sizeof(*buf->pos));
+    buf->win = realloc(buf->win, buf->allocated * sizeof(*buf->win));
+    g_nb_allocs++;
+}
+
+void line_buffer_release(line_buffer_t *buf)
+{
+    free(buf->pos);
+    free(buf->win);
+    memset(buf, 0, sizeof(*buf));
+}
+
+static void line_push_point(line_buffer_t *buf,
+                            const double p[3], const double w[3])
+{
+    line_buffer_reserve(buf, buf->size + 1);
+    memcpy(buf->pos[buf->size], p, sizeof(*buf->pos));
+    memcpy(buf->win[buf->size], w, sizeof(*buf->win));
+    buf->size++;
 }
 
 static void clip_to_win(const projection_t *proj,
@@ -146,10 +173,7 @@ static void clip_to_win(const projection_t *proj,
 static void line_tesselate_(void (*func)(void *user, double t, double pos[3]),
                             const projection_t *proj,
                             void *user, double t0, double t1,
-                            double (**out_pos)[3],
-                            double (**out_win)[3],
-                            int level, int min_level,
-                            int *size, int *allocated)
+                            line_buffer_t *out, int level, int min_level)
 {
     double p0[3], p1[3], pm[3], c[3][4], w0[3], w1[3], wm[3], tm;
     double max_dist = 0.5;
@@ -177,46 +201,91 @@ static void line_tesselate_(void (*func)(void *user, double t, double pos[3]),
     if (    clipped || level > max_level ||
             line_point_dist(w0, w1, wm) < max_dist)
     {
-        line_push_point(out_pos, out_win, p1, w1, size, allocated);
+        line_push_point(out, p1, w1);
         return;
     }
 
 split:
-    line_tesselate_(func, proj, user, t0, tm, out_pos, out_win, level + 1,
-                    min_level, size, allocated);
-    line_tesselate_(func, proj, user, tm, t1, out_pos, out_win, level + 1,
-                    min_level, size, allocated);
+    line_tesselate_(func, proj, user, t0, tm, out, level + 1, min_level);
+    line_tesselate_(func, proj, user, tm, t1, out, level + 1, min_level);
 }
 
 
 int line_tesselate(void (*func)(void *user, double t, double pos[3]),
                    const projection_t *proj,
                    void *user, int split,
-                   double (**out_pos)[3],
-                   double (**out_win)[3])
+                   line_buffer_t *out)
 {
-    int i, allocated = 0, size = 0, min_level;
+    int i, min_level;
     double pos[3], win[3];
-    *out_pos = NULL;
-    *out_win = NULL;
 
+    out->size = 0;
     if (split > 0) {
-        size = split + 1;
-        *out_pos = calloc(size, sizeof(**out_pos));
-        *out_win = calloc(size, sizeof(**out_win));
-        for (i = 0; i < size; i++) {
+        line_buffer_reserve(out, split + 1);
+        for (i = 0; i < split + 1; i++) {
             func(user, (double)i / split, pos);
             project_to_win(proj, pos, win);
-            vec3_copy(pos, (*out_pos)[i]);
-            vec3_copy(win, (*out_win)[i]);
+            line_push_point(out, pos, win);
         }
     } else {
         min_level = -split;
         func(user, 0, pos);
         project_to_win(proj, pos, win);
-        line_push_point(out_pos, out_win, pos, win, &size, &allocated);
-        line_tesselate_(func, proj, user, 0, 1, out_pos, out_win, 0,
-                        min_level, &size, &allocated);
+        line_push_point(out, pos, win);
+        line_tesselate_(func, proj, user, 0, 1, out, 0, min_level);
     }
-    return size;
+    return out->size;
 }
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+
+#include <math.h>
+
+static void test_circle(void *user, double t, double pos[3])
+{
+    const double *r = user;
+    pos[0] = *r * cos(t * 2 * M_PI);
+    pos[1] = *r * sin(t * 2 * M_PI);
+    pos[2] = -1;
+}
+
+// Check that we don't allocate memory anymore once the buffers are big
+// enough.
+static void test_line_allocs(void)
+{
+    projection_t proj;
+    line_buffer_t buf = {};
+    line_mesh_t *mesh = NULL;
+    double r = 0.5;
+    int i, size, nb_allocs;
+
+    projection_init(&proj, PROJ_STEREOGRAPHIC, 90 * M_PI / 180, 800, 600);
+    size = line_tesselate(test_circle, &proj, &r, -4, &buf);
+    assert(size > 16);
+    mesh = line_to_mesh((const double (*)[3])buf.pos,
+                        (const double (*)[3])buf.win, size, 10, mesh);
+    assert(mesh->verts_count == size * 2);
+
+    nb_allocs = g_nb_allocs;
+    for (i = 0; i < 1000; i++) {
+        r = 0.1 + 0.4 * (i % 10) / 10.0;
+        size = line_tesselate(test_circle, &proj, &r, (i % 2) ? -4 : 16,
+                              &buf);
+        assert(size > 0 && size <= buf.allocated);
+        mesh = line_to_mesh((const double (*)[3])buf.pos,
+                            (const double (*)[3])buf.win, size, 10, mesh);
+    }
+    assert(g_nb_allocs == nb_allocs);
+
+    line_mesh_delete(mesh);
+    line_buffer_release(&buf);
+}
+
+TEST_REGISTER(NULL, test_line_allocs, TEST_AUTO);
+
+#endif
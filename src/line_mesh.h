@@ -35,8 +35,26 @@ typedef struct line_mesh
     uint16_t *indices;
     int indices_count;
     int verts_count;
+    int indices_allocated;
+    int verts_allocated;
 } line_mesh_t;
 
+/*
+ * Struct: line_buffer_t
+ * Points of a tesselated line.
+ *
+ * The buffer can be reused for several calls to <line_tesselate>, so that
+ * we only allocate memory when a line has more points than all the
+ * previous ones.
+ */
+typedef struct line_buffer
+{
+    double (*pos)[3];   // View coordinates.
+    double (*win)[3];   // Window coordinates.
+    int size;
+    int allocated;
+} line_buffer_t;
+
 /*
  * Function: line_to_mesh
  * Convert a line with a width into a quad mesh.
@@ -46,14 +64,15 @@ typedef struct line_mesh
  *   win    - Pre projected window coordinates.
  *   size   - Number of points in the line array.
  *   width  - width of the line.
+ *   mesh   - A mesh to reuse, or NULL to create a new one.
  *
  * Return:
- *   A new <line_mesh_t> instance, that should be released with
+ *   The <line_mesh_t> instance, that should be released with
  *   <line_mesh_delete>.
  */
 line_mesh_t *line_to_mesh(const double (*line)[3],
                           const double (*win)[3],
-                          int size, double width);
+                          int size, double width, line_mesh_t *mesh);
 
 /*
  * Function: line_mesh_delete
@@ -61,6 +80,18 @@ line_mesh_t *line_to_mesh(const double (*line)[3],
  */
 void line_mesh_delete(line_mesh_t *mesh);
 
+/*
+ * Function: line_buffer_reserve
+ * Make sure a line buffer can hold a given number of points.
+ */
+void line_buffer_reserve(line_buffer_t *buf, int size);
+
+/*
+ * Function: line_buffer_release
+ * Free the memory used by a line buffer.
+ */
+void line_buffer_release(line_buffer_t *buf);
+
 /*
  * Function: line_tesselate
  * Cut a parametric line into a list of points.
@@ -73,17 +104,15 @@ void line_mesh_delete(line_mesh_t *mesh);
  *   split  - Number of segments requested in the output.  If < 0 use
  *            an adaptive algorithm, where -split is the minimum level
  *            of split.
- *   out_pos - Allocated out line points in view coordinates.
- *   out_win - Allocated out line points in windows coordinates.
+ *   out    - Buffer that receives the line points, in view and window
+ *            coordinates.  Its previous content is replaced.
  *
  * Return:
- *   The number of points in the line, or -1 in case or error (and out is not
- *   set).
+ *   The number of points in the line, or -1 in case or error.
  */
 int line_tesselate(void (*func)(void *user, double t, double pos[3]),
                    const projection_t *proj,
                    void *user, int split,
-                   double (**out_pos)[3],
-                   double (**out_win)[3]);
+                   line_buffer_t *out);
 
 #endif // LINE_MESH_H
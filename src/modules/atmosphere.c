@@ -17,14 +17,33 @@
  */
 
 /*
- * Type: atmosphere_t
- * Atmosphere module struct.
+ * The atmosphere is rendered on the healpix tiles of order GRID_ORDER, each
+ * split into a GRID_SPLIT x GRID_SPLIT grid.  Since this grid is fixed in the
+ * observed frame, we can cache the luminance of all its vertices, and only
+ * recompute it when the sun or moon moved by more than CACHE_MAX_SEP, or
+ * their magnitude changed by more than CACHE_MAX_DMAG.
  */
-typedef struct atmosphere {
-    obj_t           obj;
-    fader_t         visible;
-    double          turbidity;
-} atmosphere_t;
+#define GRID_ORDER 1
+#define GRID_SPLIT 4 // Adhoc split value to look good while not being too slow.
+#define GRID_NB_TILES (12 << (2 * GRID_ORDER))
+#define GRID_NB_VERTICES ((GRID_SPLIT + 1) * (GRID_SPLIT + 1))
+
+#define CACHE_MAX_SEP (0.01 * DD2R)
+#define CACHE_MAX_DMAG 0.01
+
+// All the parameters the atmosphere rendering depends on.
+typedef struct {
+    double sun_pos[3];
+    double moon_pos[3];
+    double sun_vmag;
+    double moon_vmag;
+    double turbidity;
+    double bortle_index;
+    double latitude;
+    double altitude;
+    int    year;
+    int    month;
+} render_params_t;
 
 // All the precomputed data
 typedef struct {
@@ -43,17 +62,45 @@ typedef struct {
 
     double light_pollution_lum;
 
-    // Updated during rendering.
-    double sum_lum;
-    double max_lum;
-    int    nb_lum;
-
     // Cos Maximum distance between 2 points of the grid on which the atmosphere
     // is rendered. It is used to avoid aliasing in fast varying regions of the
     // atmosphere, like near moon border.
     float cos_grid_angular_step;
 } render_data_t;
 
+// Render data and luminance of the grid vertices, computed for a given set
+// of parameters.
+typedef struct {
+    bool            valid;
+    render_params_t params;
+    render_data_t   data;
+    float           pos[GRID_NB_TILES][GRID_NB_VERTICES][3];
+    float           lum[GRID_NB_TILES][GRID_NB_VERTICES];
+} lum_cache_t;
+
+// Rendering state passed to compute_lum.
+typedef struct {
+    const lum_cache_t *cache;
+    int    tile;   // Index of the tile being rendered.
+    int    vertex; // Index of the next vertex in the tile grid.
+
+    // Luminance statistics for eye adaptation.
+    double sum_lum;
+    double max_lum;
+    int    nb_lum;
+} render_state_t;
+
+/*
+ * Type: atmosphere_t
+ * Atmosphere module struct.
+ */
+typedef struct atmosphere {
+    obj_t           obj;
+    fader_t         visible;
+    double          turbidity;
+    lum_cache_t     cache;
+} atmosphere_t;
+
 static double F2(const double *lam, double cos_theta,
                  double gamma, double cos_gamma)
 {
@@ -66,15 +113,16 @@ static double F(const double *lam , double theta, double gamma)
     return F2(lam, cos(theta), gamma, cos(gamma));
 }
 
-static render_data_t prepare_render_data(
-        const double sun_pos[3], double sun_vmag,
-        const double moon_pos[3], double moon_vmag,
-        double T, double bortle_index)
+static render_data_t prepare_render_data(const render_params_t *params)
 {
     render_data_t data = {};
     double thetaS;
     double zx, zy;
     const double base_sun_vmag = -26.74;
+    const double *sun_pos = params->sun_pos;
+    const double *moon_pos = params->moon_pos;
+    const double T = params->turbidity;
+    const double zenith[3] = {0, 0, 1};
 
     assert(vec3_is_normalized(sun_pos));
     assert(vec3_is_normalized(moon_pos));
@@ -119,9 +167,21 @@ static render_data_t prepare_render_data(
 
     // Compute factor due to solar eclipse.
     // I am using an ad-hoc formula to make it look OK here.
-    data.eclipse_factor = pow(10, (base_sun_vmag - sun_vmag) / 2.512 * 1.1);
+    data.eclipse_factor = pow(10, (base_sun_vmag - params->sun_vmag) /
+                              2.512 * 1.1);
+
+    data.light_pollution_lum = fmax(0., 0.0004 *
+                                    pow(params->bortle_index - 1, 2.1));
+
+    skybrightness_prepare(&data.skybrightness, params->year, params->month,
+                          params->moon_vmag,
+                          params->latitude, params->altitude,
+                          15, 40,
+                          vec3_sep(moon_pos, zenith),
+                          vec3_sep(sun_pos, zenith));
 
-    data.light_pollution_lum = fmax(0., 0.0004 * pow(bortle_index - 1, 2.1));
+    // This is quite ad-hoc as in reality we are using a HIPS grid
+    data.cos_grid_angular_step = cos(15. * DD2R);
     return data;
 }
 
@@ -148,25 +208,31 @@ static void mjd2gcal(double mjd, int *year, int *month)
     #undef FIX
 }
 
-static void prepare_skybrightness(
-        skybrightness_t *sb, const painter_t *painter,
-        const double sun_pos[3], const double moon_pos[3], double moon_vmag)
+static void get_render_params(const atmosphere_t *atm,
+                              const observer_t *obs, render_params_t *params)
 {
-    int year, month;
-    const observer_t *obs = painter->obs;
-    const double zenith[3] = {0, 0, 1};
-    mjd2gcal(obs->utc, &year, &month);
-    skybrightness_prepare(sb, year, month,
-                          moon_vmag,
-                          obs->phi, obs->hm,
-                          15, 40,
-                          vec3_sep(moon_pos, zenith),
-                          vec3_sep(sun_pos, zenith));
+    obj_t *sun, *moon;
+    double sun_pos[4], moon_pos[4];
+
+    sun = core_get_planet(PLANET_SUN);
+    moon = core_get_planet(PLANET_MOON);
+    assert(sun);
+    assert(moon);
+    obj_get_pos(sun, obs, FRAME_OBSERVED, sun_pos);
+    obj_get_pos(moon, obs, FRAME_OBSERVED, moon_pos);
+    vec3_normalize(sun_pos, params->sun_pos);
+    vec3_normalize(moon_pos, params->moon_pos);
+    obj_get_info(sun, obs, INFO_VMAG, &params->sun_vmag);
+    obj_get_info(moon, obs, INFO_VMAG, &params->moon_vmag);
+    params->turbidity = atm->turbidity;
+    params->bortle_index = core->bortle_index;
+    params->latitude = obs->phi;
+    params->altitude = obs->hm;
+    mjd2gcal(obs->utc, &params->year, &params->month);
 }
 
-static float compute_lum(void *user, const float pos[3])
+static float get_lum(const render_data_t *d, const float pos[3])
 {
-    render_data_t *d = user;
     double p[3] = {pos[0], pos[1], pos[2]};
     const double zenith[3] = {0, 0, 1};
     float lum;
@@ -179,16 +245,105 @@ static float compute_lum(void *user, const float pos[3])
     lum *= d->eclipse_factor;
 
     lum += d->light_pollution_lum;
+    return lum;
+}
+
+/*
+ * Function: cache_is_valid
+ * Check if the cached luminance can be used for a given set of parameters.
+ */
+static bool cache_is_valid(const lum_cache_t *cache,
+                           const render_params_t *params)
+{
+    const render_params_t *c = &cache->params;
+    const double cos_max_sep = cos(CACHE_MAX_SEP);
+    if (!cache->valid) return false;
+    return vec3_dot(c->sun_pos, params->sun_pos) >= cos_max_sep &&
+           vec3_dot(c->moon_pos, params->moon_pos) >= cos_max_sep &&
+           fabs(c->sun_vmag - params->sun_vmag) <= CACHE_MAX_DMAG &&
+           fabs(c->moon_vmag - params->moon_vmag) <= CACHE_MAX_DMAG &&
+           c->turbidity == params->turbidity &&
+           c->bortle_index == params->bortle_index &&
+           c->latitude == params->latitude &&
+           c->altitude == params->altitude &&
+           c->year == params->year &&
+           c->month == params->month;
+}
+
+/*
+ * Function: cache_update
+ * Recompute the render data and the grid luminance if the parameters
+ * changed too much since the last call.
+ */
+static void cache_update(lum_cache_t *cache, const render_params_t *params)
+{
+    int t, i, j;
+    const int nb = GRID_NB_TILES * GRID_NB_VERTICES;
+    uv_map_t map;
+    double grid[GRID_NB_VERTICES][4], p[3];
+    float *cos_moon, *cos_sun, *cos_zenith, *lum;
+    const float (*pos)[3];
+    const render_data_t *d;
+
+    if (cache_is_valid(cache, params)) return;
+    if (!cache->valid) {
+        for (t = 0; t < GRID_NB_TILES; t++) {
+            uv_map_init_healpix(&map, GRID_ORDER, t, true, true);
+            uv_map_grid(&map, GRID_SPLIT, grid, NULL);
+            for (i = 0; i < GRID_NB_VERTICES; i++)
+                for (j = 0; j < 3; j++)
+                    cache->pos[t][i][j] = grid[i][j];
+        }
+    }
+    cache->params = *params;
+    cache->data = prepare_render_data(params);
+    d = &cache->data;
+
+    // Same as get_lum, but for all the vertices at once.
+    cos_moon = malloc(3 * nb * sizeof(*cos_moon));
+    cos_sun = cos_moon + nb;
+    cos_zenith = cos_sun + nb;
+    pos = cache->pos[0];
+    for (i = 0; i < nb; i++) {
+        vec3_set(p, pos[i][0], pos[i][1], fabs(pos[i][2]));
+        cos_moon[i] = fmin(vec3_dot(p, d->moon_pos), d->cos_grid_angular_step);
+        cos_sun[i] = fmin(vec3_dot(p, d->sun_pos), d->cos_grid_angular_step);
+        cos_zenith[i] = p[2];
+    }
+    lum = cache->lum[0];
+    skybrightness_get_luminance_batch(&d->skybrightness, nb, cos_moon,
+                                      cos_sun, cos_zenith, lum, NULL, NULL);
+    for (i = 0; i < nb; i++)
+        lum[i] = lum[i] * d->eclipse_factor + d->light_pollution_lum;
+    free(cos_moon);
+    cache->valid = true;
+}
+
+static float compute_lum(void *user, const float pos[3])
+{
+    render_state_t *s = user;
+    const lum_cache_t *cache = s->cache;
+    const render_data_t *d = &cache->data;
+    int i = s->vertex++;
+    float lum;
+
+    // The vertices should come in the same order as in the cache, but
+    // in case they don't we fall back to the direct computation.
+    if (s->tile >= 0 && i < GRID_NB_VERTICES &&
+            memcmp(cache->pos[s->tile][i], pos, sizeof(float[3])) == 0)
+        lum = cache->lum[s->tile][i];
+    else
+        lum = get_lum(d, pos);
 
     // Update luminance sum for eye adaptation.
     // If we are below horizon use the precomputed landscape luminance.
     if (pos[2] > 0) {
-        d->sum_lum += lum;
-        d->nb_lum++;
-        d->max_lum = fmax(d->max_lum, lum);
+        s->sum_lum += lum;
+        s->nb_lum++;
+        s->max_lum = fmax(s->max_lum, lum);
     }
     else {
-        d->max_lum = fmax(d->max_lum, d->landscape_lum);
+        s->max_lum = fmax(s->max_lum, d->landscape_lum);
     }
     return lum;
 }
@@ -199,84 +354,68 @@ static int atmosphere_update(obj_t *obj, double dt)
     return fader_update(&atm->visible, dt);
 }
 
-static void render_tile(const atmosphere_t *atm, const painter_t *painter,
+static void render_tile(const painter_t *painter, render_state_t *state,
                         int order, int pix)
 {
-    int split, i;
+    int i;
     uv_map_t map;
 
     if (painter_is_healpix_clipped(painter, FRAME_OBSERVED, order, pix))
         return;
-    if (order < 1) {
+    if (order < GRID_ORDER) {
         for (i = 0; i < 4; i++)
-            render_tile(atm, painter, order + 1, pix * 4 + i);
+            render_tile(painter, state, order + 1, pix * 4 + i);
         return;
     }
-    split = 4; // Adhoc split value to look good while not being too slow.
+    state->tile = pix;
+    state->vertex = 0;
     uv_map_init_healpix(&map, order, pix, true, true);
-    paint_quad(painter, FRAME_OBSERVED, &map, split);
+    paint_quad(painter, FRAME_OBSERVED, &map, GRID_SPLIT);
 }
 
 static int atmosphere_render(obj_t *obj, const painter_t *painter_)
 {
-    const atmosphere_t *atm = (const atmosphere_t*)obj;
-    obj_t *sun, *moon;
-    double sun_pos[4], moon_pos[4], sun_vmag, moon_vmag;
-    render_data_t data;
+    atmosphere_t *atm = (atmosphere_t*)obj;
+    render_params_t params;
+    const render_data_t *data;
+    render_state_t state = {.cache = &atm->cache};
     int i;
     painter_t painter = *painter_;
     core->lwsky_average = 0.0001;
-    const observer_t *obs = painter.obs;
 
     if (atm->visible.value == 0.0) return 0;
-    sun = core_get_planet(PLANET_SUN);
-    moon = core_get_planet(PLANET_MOON);
-    assert(sun);
-    assert(moon);
-    obj_get_pos(sun, painter.obs, FRAME_OBSERVED, sun_pos);
-    obj_get_pos(moon, painter.obs, FRAME_OBSERVED, moon_pos);
-    vec3_normalize(sun_pos, sun_pos);
-    vec3_normalize(moon_pos, moon_pos);
-    obj_get_info(sun, obs, INFO_VMAG, &sun_vmag);
-    obj_get_info(moon, obs, INFO_VMAG, &moon_vmag);
-
-    // XXX: this could be cached!
-    data = prepare_render_data(sun_pos, sun_vmag, moon_pos, moon_vmag,
-                               atm->turbidity, core->bortle_index);
-    // This is quite ad-hoc as in reality we are using a HIPS grid
-    data.cos_grid_angular_step = cos(15. * DD2R);
-    prepare_skybrightness(&data.skybrightness,
-            &painter, sun_pos, moon_pos, moon_vmag);
+    get_render_params(atm, painter.obs, &params);
+    cache_update(&atm->cache, &params);
+    data = &atm->cache.data;
 
     // Set the shader attributes.
-    painter.atm.p[0]  = data.Px[0];
-    painter.atm.p[1]  = data.Px[1];
-    painter.atm.p[2]  = data.Px[2];
-    painter.atm.p[3]  = data.Px[3];
-    painter.atm.p[4]  = data.Px[4];
-    painter.atm.p[5]  = data.kx;
-
-    painter.atm.p[6]  = data.Py[0];
-    painter.atm.p[7]  = data.Py[1];
-    painter.atm.p[8]  = data.Py[2];
-    painter.atm.p[9]  = data.Py[3];
-    painter.atm.p[10] = data.Py[4];
-    painter.atm.p[11] = data.ky;
-
-    vec3_to_float(sun_pos, painter.atm.sun);
+    painter.atm.p[0]  = data->Px[0];
+    painter.atm.p[1]  = data->Px[1];
+    painter.atm.p[2]  = data->Px[2];
+    painter.atm.p[3]  = data->Px[3];
+    painter.atm.p[4]  = data->Px[4];
+    painter.atm.p[5]  = data->kx;
+
+    painter.atm.p[6]  = data->Py[0];
+    painter.atm.p[7]  = data->Py[1];
+    painter.atm.p[8]  = data->Py[2];
+    painter.atm.p[9]  = data->Py[3];
+    painter.atm.p[10] = data->Py[4];
+    painter.atm.p[11] = data->ky;
+
+    vec3_to_float(data->sun_pos, painter.atm.sun);
     painter.atm.compute_lum = compute_lum;
-    painter.atm.user = &data;
+    painter.atm.user = &state;
     painter.flags |= PAINTER_ADD | PAINTER_ATMOSPHERE_SHADER;
     painter.color[3] = atm->visible.value;
 
-    data.max_lum = 0;
     for (i = 0; i < 12; i++) {
-        render_tile(atm, &painter, 0, i);
+        render_tile(&painter, &state, 0, i);
     }
 
-    core_report_luminance_in_fov(data.max_lum, true);
-    if (data.nb_lum)
-        core->lwsky_average = data.sum_lum / data.nb_lum;
+    core_report_luminance_in_fov(state.max_lum, true);
+    if (state.nb_lum)
+        core->lwsky_average = state.sum_lum / state.nb_lum;
     return 0;
 }
 
@@ -317,3 +456,88 @@ static obj_klass_t atmosphere_klass = {
     },
 };
 OBJ_REGISTER(atmosphere_klass)
+
+
+/******* TESTS **********************************************************/
+#if COMPILE_TESTS
+
+static void test_rotate_params(render_params_t *params, double angle)
+{
+    double rot[3][3];
+    mat3_set_identity(rot);
+    mat3_rz(angle, rot, rot);
+    mat3_mul_vec3(rot, params->sun_pos, params->sun_pos);
+    mat3_mul_vec3(rot, params->moon_pos, params->moon_pos);
+}
+
+static void test_atmosphere_cache(void)
+{
+    int t, i, nb = 0;
+    float lum, direct, max_err = 0;
+    render_data_t data;
+    lum_cache_t *cache = calloc(1, sizeof(*cache));
+    render_state_t state = {.cache = cache};
+    // Sun 6 deg below the horizon: the luminance changes fast with the sun
+    // altitude.
+    render_params_t params = {
+        .sun_pos = {cos(-6 * DD2R), 0, sin(-6 * DD2R)},
+        .moon_pos = {0, cos(30 * DD2R), sin(30 * DD2R)},
+        .sun_vmag = -26.74,
+        .moon_vmag = -10,
+        .turbidity = 0.96,
+        .bortle_index = 3,
+        .latitude = 45 * DD2R,
+        .altitude = 100,
+        .year = 2023,
+        .month = 5,
+    };
+
+    // The cached luminance is the same as the direct one, up to the
+    // precision of the batch computation.
+    cache_update(cache, &params);
+    data = prepare_render_data(&params);
+    for (t = 0; t < GRID_NB_TILES; t++) {
+        state.tile = t;
+        state.vertex = 0;
+        for (i = 0; i < GRID_NB_VERTICES; i++) {
+            lum = compute_lum(&state, cache->pos[t][i]);
+            direct = get_lum(&data, cache->pos[t][i]);
+            assert(fabs(lum - direct) / direct < 1e-3);
+        }
+    }
+    assert(state.nb_lum > 0 && state.max_lum > 0);
+
+    // Vertices not in the grid order fall back to the direct computation.
+    state.tile = 0;
+    state.vertex = 1;
+    lum = compute_lum(&state, cache->pos[1][0]);
+    assert(lum == get_lum(&data, cache->pos[1][0]));
+
+    // Small moves within the tolerance reuse the cache with a small error.
+    test_rotate_params(&params, CACHE_MAX_SEP * 0.9);
+    assert(cache_is_valid(cache, &params));
+    data = prepare_render_data(&params);
+    for (t = 0; t < GRID_NB_TILES; t++) {
+        for (i = 0; i < GRID_NB_VERTICES; i++) {
+            if (cache->pos[t][i][2] < 0) continue;
+            direct = get_lum(&data, cache->pos[t][i]);
+            max_err = fmax(max_err, fabs(cache->lum[t][i] - direct) / direct);
+            nb++;
+        }
+    }
+    assert(nb > 0);
+    assert(max_err < 0.02);
+
+    // Larger moves, or other parameters changes, recompute the cache.
+    test_rotate_params(&params, CACHE_MAX_SEP * 0.5);
+    assert(!cache_is_valid(cache, &params));
+    cache_update(cache, &params);
+    assert(cache_is_valid(cache, &params));
+    params.bortle_index = 5;
+    assert(!cache_is_valid(cache, &params));
+    free(cache);
+}
+
+TEST_REGISTER(NULL, test_atmosphere_cache, TEST_AUTO);
+
+#endif
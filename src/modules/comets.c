@@ -9,6 +9,9 @@
 
 #include "swe.h"
 #include "mpc.h"
+#include "data_parser.h"
+#include "name_index.h"
+#include "sweep.h"
 #include <regex.h>
 
 // J2000 ecliptic to ICRF rotation matrix.
@@ -73,6 +76,13 @@ typedef struct {
     obj_t   obj;
     char    *source_url;
     bool    parsed; // Set to true once the data has been parsed.
+    // State of the incremental parsing of the source data.
+    struct {
+        data_parser_t input; // Owns the uncompressed data for jsonl sources.
+        int         nb_err;
+        int         nb;
+        double      last_epoch;
+    } parser;
     regex_t search_reg;
     bool    visible;
     // Hints/labels magnitude offset
@@ -81,6 +91,15 @@ typedef struct {
 
     comet_t *render_current;
     comet_t *visibles; // Linked list of currently visible comets.
+
+    // Positions and magnitudes of all the comets, indexed as in sweep_objs.
+    // We hold a reference to each comet of sweep_objs, and rebuild it when
+    // the generation of the comets list changes.
+    sweep_t sweep;
+    comet_t **sweep_objs;
+    int     sweep_nb;
+    int     sweep_generation;
+    int     generation; // Bumped each time we add or remove comets.
 } comets_t;
 
 // Static instance.
@@ -160,28 +179,46 @@ static int comet_init(obj_t *obj, json_value *args)
     return 0;
 }
 
-static int load_data_mpc(comets_t *comets, const char *data, int size,
-                         double *last_epoch)
+// Check for historical comets, where we change the h and g values
+// around a peak date.  Only support Neowise for the moment.
+static void comet_setup_history(comet_t *comet)
+{
+    if (strcmp(comet->name, "C/2020 F3 (NEOWISE)") == 0) {
+        comet->history = (typeof(comet->history)) {
+            .time = date2mjd(2020, 7, 3),
+            .duration = 30,
+            .peak_vmag = 1,
+            .h = 7.5,
+            .g = 5.2,
+        };
+    }
+}
+
+/*
+ * Parse MPC comets data, resuming from the last call.
+ * Return true once all the data has been parsed.
+ */
+static bool load_data_mpc(comets_t *comets, const char *data, int size)
 {
     comet_t *comet;
-    int num, nb_err = 0, len, line_idx = 0, r, nb;
+    int num, r;
     double peri_time, peri_dist, e, peri, node, i, epoch, h, g;
-    const char *line = NULL;
     char orbit_type;
     char desgn[64];
-    obj_t *tmp;
+    typeof(comets->parser) *p = &comets->parser;
 
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
+    data_parser_start(&p->input);
+    while (data_parser_next_line(&p->input, data, size)) {
         r = mpc_parse_comet_line(
-                line, len, &num, &orbit_type, &peri_time, &peri_dist, &e,
-                &peri, &node, &i, &epoch, &h, &g, desgn);
+                p->input.line, p->input.len, &num, &orbit_type, &peri_time,
+                &peri_dist, &e, &peri, &node, &i, &epoch, &h, &g, desgn);
         if (r) {
-            nb_err++;
+            p->nb_err++;
             continue;
         }
 
         comet = (void*)module_add_new(&comets->obj, "mpc_comet", NULL);
+        comets->generation++;
         comet->num = num;
         comet->h = h;
         comet->g = g;
@@ -194,73 +231,42 @@ static int load_data_mpc(comets_t *comets, const char *data, int size,
         strncpy(comet->obj.type, orbit_type_to_otype(orbit_type), 4);
         snprintf(comet->name, sizeof(comet->name), "%s", desgn);
         comet->pvo[0][0] = NAN;
-        *last_epoch = fmax(epoch, *last_epoch);
-
-        // Check for historical comets, where we change the h and g values
-        // around a peak date.  Only support Neowise for the moment.
-        if (strcmp(desgn, "C/2020 F3 (NEOWISE)") == 0) {
-            comet->history = (typeof(comet->history)) {
-                .time = date2mjd(2020, 7, 3),
-                .duration = 30,
-                .peak_vmag = 1,
-                .h = 7.5,
-                .g = 5.2,
-            };
-        }
+        p->last_epoch = fmax(epoch, p->last_epoch);
+        comet_setup_history(comet);
+        name_index_add_obj(&comets->obj, &comet->obj, 0);
+        p->nb++;
     }
-
-    if (nb_err) {
-        LOG_W("Comet data got %d error lines.", nb_err);
-    }
-    DL_COUNT(comets->obj.children, tmp, nb);
-    return nb;
+    return p->input.done;
 }
 
-static int load_data_stel_jsonl(
-        const char *url, comets_t *comets, const char *data, int size,
-        double *last_epoch)
+/*
+ * Parse stellarium jsonl comets data, resuming from the last call.
+ * Return true once all the data has been parsed.
+ */
+static bool load_data_stel_jsonl(
+        const char *url, comets_t *comets, const char *data, int size)
 {
-    const char *line = NULL;
-    char *uncompressed_data;
     comet_t *comet;
-    int len, line_idx = 0, nb = 0;
     json_value *json;
+    typeof(comets->parser) *p = &comets->parser;
 
-    uncompressed_data = z_uncompress_gz(data, size, &size);
-    if (!uncompressed_data) {
-        LOG_E("Cannot uncompress gz file: %s", url);
-        return -1;
-    }
-    data = uncompressed_data;
-    *last_epoch = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        json = json_parse(line, len);
+    data_parser_start(&p->input);
+    while (data_parser_next_line(&p->input, data, size)) {
+        json = json_parse(p->input.line, p->input.len);
         if (!json) goto error;
         comet = (void*)module_add_new(&comets->obj, "mpc_comet", json);
+        comets->generation++;
         json_value_free(json);
         if (!comet) goto error;
-        *last_epoch = fmax(*last_epoch, comet->epoch);
-        nb++;
-
-        // Check for historical comets, where we change the h and g values
-        // around a peak date.  Only support Neowise for the moment.
-        if (strcmp(comet->name, "C/2020 F3 (NEOWISE)") == 0) {
-            comet->history = (typeof(comet->history)) {
-                .time = date2mjd(2020, 7, 3),
-                .duration = 30,
-                .peak_vmag = 1,
-                .h = 7.5,
-                .g = 5.2,
-            };
-        }
-
+        p->last_epoch = fmax(p->last_epoch, comet->epoch);
+        comet_setup_history(comet);
+        name_index_add_obj(&comets->obj, &comet->obj, 0);
+        p->nb++;
         continue;
 error:
-        LOG_E("Cannot create comet from %s:%d", url, line_idx);
+        LOG_E("Cannot create comet from %s:%d", url, p->input.idx);
     }
-    free(uncompressed_data);
-    return nb;
+    return p->input.done;
 }
 
 static void comet_get_h_g(const comet_t *comet, double tt, double *h, double *g)
@@ -279,40 +285,18 @@ static void comet_get_h_g(const comet_t *comet, double tt, double *h, double *g)
 
 static int comet_update(comet_t *comet, const observer_t *obs)
 {
-    double a, p, n, ph[2][3], pv[2][3], or, sr, b, v, w, r, o, u, i, h, g;
+    double ph[2][3], pv[2][3], or, sr, h, g;
     const double K = 0.01720209895; // AU, day
+    orbit_elements_t elems = {
+        .d = comet->orbit.d, // Perihelion time.
+        .i = comet->orbit.i,
+        .o = comet->orbit.o,
+        .w = comet->orbit.w,
+        .q = comet->orbit.q,
+        .e = comet->orbit.e,
+    };
 
-    // Position algo for elliptical comets.
-    if (comet->orbit.e < 0.98) {
-        // Mean distance.
-        a = comet->orbit.q / (1.0 - comet->orbit.e);
-        // Orbital period.
-        p = 2 * M_PI * sqrt(a * a * a) / K;
-        // Daily motion.
-        n = 2 * M_PI / p;
-
-        orbit_compute_pv(0.005 * DD2R,
-                         obs->tt, ph[0], NULL, comet->orbit.d, comet->orbit.i,
-                         comet->orbit.o, comet->orbit.w, a, n, comet->orbit.e,
-                         0, 0, 0);
-    } else {
-        // Algo for non elliptical orbits, taken from
-        // http://stjarnhimlen.se/comp/tutorial.html
-        // TODO: move into orbit_compute_pv directly somehow?
-        a = 1.5 * (obs->tt - comet->orbit.d) * K /
-                sqrt(2 * comet->orbit.q * comet->orbit.q * comet->orbit.q);
-        b = sqrt(1 + a * a);
-        w = pow(b + a, 1. / 3) - pow(b - a, 1. / 3);
-        v = 2 * atan(w);
-        r = comet->orbit.q * (1 + w * w);
-        // Compute position into the plane of the ecliptic.
-        o = comet->orbit.o;
-        u = v + comet->orbit.w;
-        i = comet->orbit.i;
-        ph[0][0] = r * (cos(o) * cos(u) - sin(o) * sin(u) * cos(i));
-        ph[0][1] = r * (sin(o) * cos(u) + cos(o) * sin(u) * cos(i));
-        ph[0][2] = r * (sin(u) * sin(i));
-    }
+    orbit_compute_pv_batch(obs->tt, K, 1, &elems, &ph[0], NULL);
 
     mat3_mul_vec3(ECLIPTIC_ROT, ph[0], ph[0]);
 
@@ -475,7 +459,7 @@ static int comet_render(obj_t *obj, const painter_t *painter)
         return 0;
 
     painter_project(painter, FRAME_ICRF, comet->pvo[0], false, false, win_pos);
-    core_get_point_for_mag(vmag, &size, &luminance);
+    point_lut_get(painter->point_lut, vmag, &size, &luminance);
 
     point = (point_t) {
         .pos = {win_pos[0], win_pos[1]},
@@ -504,19 +488,67 @@ static int comet_render(obj_t *obj, const painter_t *painter)
     return 1;
 }
 
+/*
+ * Compute the positions and magnitudes of the comets [start, end) for the
+ * sweep.  This can run in several threads at the same time, so we only work
+ * on copies of the comets.
+ */
+static void comets_sweep_compute(const sweep_t *sweep, const observer_t *obs,
+                                 int start, int end,
+                                 float (*pos)[3], float *vmag)
+{
+    const comets_t *comets = sweep->user;
+    comet_t comet;
+    int i;
+
+    for (i = start; i < end; i++) {
+        comet = *comets->sweep_objs[i];
+        comet_update(&comet, obs);
+        vec3_copy(comet.pvo[0], pos[i]);
+        vmag[i] = comet.vmag;
+    }
+}
+
 static int comets_init(obj_t *obj, json_value *args)
 {
     comets_t *comets = (comets_t*)obj;
     assert(!g_comets);
     g_comets = comets;
+    name_index_add_module(obj);
     comets->visible = true;
     comets->hints_visible = true;
     regcomp(&comets->search_reg,
             "(([PCXDAI])/([0-9]+) [A-Z].+)|([0-9]+[PCXDAI]/.+)",
             REG_EXTENDED);
+    comets->sweep.compute = comets_sweep_compute;
+    comets->sweep.user = comets;
+    comets->sweep.max_dt = 1.0 / 24;
     return 0;
 }
 
+static void release_sweep_objs(comets_t *comets)
+{
+    int i;
+    for (i = 0; i < comets->sweep_nb; i++)
+        obj_release(&comets->sweep_objs[i]->obj);
+    comets->sweep_nb = 0;
+}
+
+static void comets_del(obj_t *obj)
+{
+    comets_t *comets = (void*)obj;
+    // Release the partially parsed data if we didn't finish.
+    if (!comets->parsed && comets->source_url)
+        asset_release(comets->source_url);
+    data_parser_release(&comets->parser.input);
+    sweep_release(&comets->sweep);
+    release_sweep_objs(comets);
+    free(comets->sweep_objs);
+    free(comets->source_url);
+    regfree(&comets->search_reg);
+    if (g_comets == comets) g_comets = NULL;
+}
+
 static int comets_add_data_source(
         obj_t *obj, const char *url, const char *key)
 {
@@ -526,41 +558,94 @@ static int comets_add_data_source(
     return 0;
 }
 
+// Progress the sweep of all the comets.  If the list of comets changed,
+// restart the sweep with the new list.
+static void comets_update_sweep(comets_t *comets)
+{
+    comet_t *child;
+    int nb = 0;
+
+    for (   child = (void*)comets->obj.children; child;
+            child = (void*)child->obj.next)
+        nb++;
+    // Also catch the comets added or removed from outside the module.
+    if (nb != comets->sweep_nb) comets->generation++;
+    if (comets->sweep_generation != comets->generation) {
+        sweep_restart(&comets->sweep);
+        release_sweep_objs(comets);
+        comets->sweep_objs = realloc(comets->sweep_objs,
+                                     nb * sizeof(*comets->sweep_objs));
+        for (   child = (void*)comets->obj.children; child;
+                child = (void*)child->obj.next) {
+            obj_retain(&child->obj);
+            comets->sweep_objs[comets->sweep_nb++] = child;
+        }
+        comets->sweep_generation = comets->generation;
+    }
+    sweep_update(&comets->sweep, core->observer, comets->sweep_nb);
+}
+
 static int comets_update(obj_t *obj, double dt)
 {
-    int size, code, nb;
+    int size, code;
     const char *data;
     comets_t *comets = (void*)obj;
-    double last_epoch = 0;
+    typeof(comets->parser) *p = &comets->parser;
+    bool mpc, done;
     char buf[128];
 
-    if (comets->parsed || !comets->source_url)
+    if (comets->parsed || !comets->source_url) {
+        comets_update_sweep(comets);
         return 0;
+    }
 
-    data = asset_get_data2(comets->source_url, ASSET_USED_ONCE, &size, &code);
-    if (!code) return 0; // Still loading.
-    comets->parsed = true;
-    if (!data) {
-        LOG_E("Cannot load comets data: %s (%d)", comets->source_url, code);
-        return 0;
+    mpc = strstr(comets->source_url, ".txt");
+    if (p->input.data) {
+        data = p->input.data;
+        size = p->input.size;
+    } else {
+        // Note: the mpc asset is kept alive until we are done with the
+        // parsing.
+        data = asset_get_data2(comets->source_url, mpc ? 0 : ASSET_USED_ONCE,
+                               &size, &code);
+        if (!code) return 0; // Still loading.
+        if (!data) {
+            LOG_E("Cannot load comets data: %s (%d)", comets->source_url,
+                  code);
+            comets->parsed = true;
+            return 0;
+        }
+        if (!mpc) {
+            p->input.data = z_uncompress_gz(data, size, &p->input.size);
+            if (!p->input.data) {
+                LOG_E("Cannot uncompress gz file: %s", comets->source_url);
+                comets->parsed = true;
+                return 0;
+            }
+            data = p->input.data;
+            size = p->input.size;
+        }
     }
 
-    if (strstr(comets->source_url, ".txt"))
-        nb = load_data_mpc(comets, data, size, &last_epoch);
+    if (mpc)
+        done = load_data_mpc(comets, data, size);
     else
-        nb = load_data_stel_jsonl(comets->source_url, comets, data, size,
-                                  &last_epoch);
+        done = load_data_stel_jsonl(comets->source_url, comets, data, size);
+    progressbar_report(comets->source_url, "Comets",
+                       done ? size : p->input.line - data, size, -1);
+    if (!done) return 0;
 
-    LOG_I("Parsed %d comets (latest epoch: %s)", nb,
-          format_time(buf, last_epoch, 0, "YYYY-MM-DD"));
-    if (last_epoch < unix_to_mjd(sys_get_unix_time()) - 4)
-        LOG_W("Warning: comets data seems outdated.");
+    comets->parsed = true;
+    if (mpc) asset_release(comets->source_url);
+    data_parser_release(&p->input);
 
-    // Make sure the search work.
-    obj = core_search("NAME C/1995 O1 (Hale-Bopp)");
-    assert(obj && strcmp(obj->klass->id, "mpc_comet") == 0);
-    obj = core_search("NAME 1P/Halley");
-    assert(obj && strcmp(obj->klass->id, "mpc_comet") == 0);
+    if (p->nb_err) {
+        LOG_W("Comet data got %d error lines.", p->nb_err);
+    }
+    LOG_I("Parsed %d comets (latest epoch: %s)", p->nb,
+          format_time(buf, p->last_epoch, 0, "YYYY-MM-DD"));
+    if (p->last_epoch < unix_to_mjd(sys_get_unix_time()) - 4)
+        LOG_W("Warning: comets data seems outdated.");
     return 0;
 }
 
@@ -570,12 +655,47 @@ static void add_to_visible(comets_t *comets, comet_t *comet)
     DL_APPEND2(comets->visibles, comet, visible_prev, visible_next);
 }
 
+// Return the last sweep snapshot if it matches the current comets list.
+static const sweep_snapshot_t *comets_get_snapshot(const comets_t *comets)
+{
+    const sweep_snapshot_t *snap = sweep_get(&comets->sweep);
+    if (comets->sweep_generation != comets->generation) return NULL;
+    return (snap && snap->nb == comets->sweep_nb) ? snap : NULL;
+}
+
+// Render the comets that the last sweep snapshot flags as possibly visible.
+static void render_from_snapshot(comets_t *comets,
+                                 const sweep_snapshot_t *snap,
+                                 const painter_t *painter)
+{
+    int i, r;
+    double cap[4];
+    comet_t *comet;
+
+    for (i = 0; i < snap->nb; i++) {
+        comet = comets->sweep_objs[i];
+        if (comet->visible_prev) continue; // Already rendered.
+        if (!comet->obj.parent) continue; // Removed since the sweep.
+        if (snap->vmag[i] > painter->stars_limit_mag + 2.0 +
+                            comets->hints_mag_offset)
+            continue;
+        // Large margin, since the tails can cover a large part of the sky.
+        vec3_copy(snap->pos[i], cap);
+        vec3_normalize(cap, cap);
+        cap[3] = cos(45 * DD2R);
+        if (painter_is_cap_clipped(painter, FRAME_ICRF, cap)) continue;
+        r = comet_render(&comet->obj, painter);
+        if (r == 1) add_to_visible(comets, comet);
+    }
+}
+
 static int comets_render(obj_t *obj, const painter_t *painter)
 {
     comets_t *comets = (comets_t*)obj;
     int i, r;
     const int update_nb = 32;
     comet_t *child, *tmp;
+    const sweep_snapshot_t *snap;
 
     if (!comets->visible) return 0;
 
@@ -595,7 +715,15 @@ static int comets_render(obj_t *obj, const painter_t *painter)
         }
     }
 
-    // Then iter part of the full list as well.
+    // If we have a sweep snapshot, we directly know which comets might be
+    // visible.
+    snap = comets_get_snapshot(comets);
+    if (snap) {
+        render_from_snapshot(comets, snap, painter);
+        return 0;
+    }
+
+    // Otherwise iter part of the full list.
     child = comets->render_current ?: (void*)comets->obj.children;
     for (i = 0; child && i < update_nb; i++, child = (void*)child->obj.next) {
         if (child->visible_prev) continue; // Was already rendered.
@@ -607,6 +735,31 @@ static int comets_render(obj_t *obj, const painter_t *painter)
     return 0;
 }
 
+static int comets_list(const obj_t *obj,
+                       double max_mag, uint64_t hint, const char *source,
+                       void *user, int (*f)(void *user, obj_t *obj))
+{
+    const comets_t *comets = (const void*)obj;
+    const sweep_snapshot_t *snap = comets_get_snapshot(comets);
+    comet_t *child;
+    int i;
+
+    // Use the sweep magnitudes to skip the faint comets.
+    if (snap && !isnan(max_mag)) {
+        for (i = 0; i < snap->nb; i++) {
+            if (snap->vmag[i] > max_mag) continue;
+            if (!comets->sweep_objs[i]->obj.parent) continue;
+            if (f(user, &comets->sweep_objs[i]->obj)) break;
+        }
+        return 0;
+    }
+    for (   child = (void*)comets->obj.children; child;
+            child = (void*)child->obj.next) {
+        if (f(user, &child->obj)) break;
+    }
+    return 0;
+}
+
 /*
  * Meta class declarations.
  */
@@ -626,9 +779,11 @@ static obj_klass_t comets_klass = {
     .size           = sizeof(comets_t),
     .flags          = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE,
     .init           = comets_init,
+    .del            = comets_del,
     .add_data_source = comets_add_data_source,
     .update         = comets_update,
     .render         = comets_render,
+    .list           = comets_list,
     .render_order   = 20,
     .attributes     = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(comets_t, visible)),
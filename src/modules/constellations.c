@@ -664,8 +664,8 @@ static int render_lines(constellation_t *con, const painter_t *_painter,
         if (!con->lines.stars[i + 0] || !con->lines.stars[i + 1]) continue;
         obj_get_info(con->lines.stars[i + 0], obs, INFO_VMAG, &mag[0]);
         obj_get_info(con->lines.stars[i + 1], obs, INFO_VMAG, &mag[1]);
-        core_get_point_for_mag(mag[0], &radius[0], NULL);
-        core_get_point_for_mag(mag[1], &radius[1], NULL);
+        point_lut_get(painter.point_lut, mag[0], &radius[0], NULL);
+        point_lut_get(painter.point_lut, mag[1], &radius[1], NULL);
         radius[0] = core_get_apparent_angle_for_point(painter.proj, radius[0]);
         radius[1] = core_get_apparent_angle_for_point(painter.proj, radius[1]);
         // Add some space, using ad-hoc formula.
@@ -732,6 +732,7 @@ static int render_img(constellation_t *con, const painter_t *painter_,
     painter.color[3] *= (selected ? 0.6 : 0.3) * con->image_loaded_fader.value;
     mat3_copy(con->img.mat, map.mat);
     map.map = img_map;
+    map.key = crc32(0, (const void*)con->img.mat, sizeof(con->img.mat));
     painter_set_texture(&painter, PAINTER_TEX_COLOR, con->img.tex, NULL);
     paint_quad(&painter, FRAME_ICRF, &map, 4);
     return 0;
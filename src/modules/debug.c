@@ -93,11 +93,14 @@ static void show_target(const target_t *t)
 
 static void debug_gui(obj_t *obj, int location)
 {
-    int i;
+    int i, nb_tests, nb_saved;
     if (!DEFINED(SWE_GUI)) return;
     if (location == 0 && gui_tab("Tests")) {
         for (i = 0; i < ARRAY_SIZE(TARGETS); i++)
             show_target(&TARGETS[i]);
+        gui_separator();
+        painter_get_clip_stats(&nb_tests, &nb_saved);
+        gui_text("Healpix clip tests: %d (%d cached)", nb_tests, nb_saved);
         gui_tab_end();
     }
 }
@@ -10,6 +10,7 @@
 #include "swe.h"
 
 #include "designation.h"
+#include "name_index.h"
 #include "utstring.h"
 #include <regex.h>
 #include <zlib.h> // For crc32
@@ -57,6 +58,11 @@ typedef struct {
     float  vmag;
 } dso_t;
 
+// Tile flags.
+enum {
+    TILE_INDEXED    = 1 << 0, // Designations added to the name index.
+};
+
 /*
  * Type: tile_t
  * Custom tile structure for the dso HiPS survey.
@@ -377,11 +383,55 @@ static void *dsos_create_tile(void *user, int order, int pix,
     return tile;
 }
 
+/*
+ * Snapshot support.
+ *
+ * The tiles are dumped with hips_dump_objs, in the in-memory layout of
+ * tile_t and dso_t.  Any change to those structs invalidates the
+ * snapshots.
+ */
+#define SNAPSHOT_VERSION ((2 << 16) | (sizeof(dso_t) + sizeof(tile_t)))
+
+static const hips_dump_string_t DSO_STRINGS[] = {
+    {offsetof(dso_t, morpho)},
+    {offsetof(dso_t, names), true},
+    {}
+};
+
+static void *dsos_dump_tile(void *user, const void *tile_, int *size)
+{
+    const tile_t *tile = tile_;
+    return hips_dump_objs(tile, sizeof(*tile), tile->sources, tile->nb,
+                          sizeof(dso_t), DSO_STRINGS, size);
+}
+
+static void *dsos_load_tile(void *user, int order, int pix,
+                            const void *data, int size, int *cost)
+{
+    tile_t *tile = calloc(1, sizeof(*tile));
+    int i;
+
+    if (hips_load_objs(data, size, tile, sizeof(*tile), sizeof(dso_t),
+                       DSO_STRINGS, &dso_klass, (void**)&tile->sources,
+                       &tile->nb)) {
+        free(tile);
+        return NULL;
+    }
+    tile->flags = 0;
+    tile->sources_quick = calloc(tile->nb, sizeof(dso_clip_data_t));
+    for (i = 0; i < tile->nb; i++)
+        tile->sources_quick[i] = tile->sources[i].clip_data;
+    *cost = tile->nb * sizeof(*tile->sources);
+    return tile;
+}
+
 static int dsos_init(obj_t *obj, json_value *args)
 {
     dsos_t *dsos = (dsos_t*)obj;
     assert(!g_dsos);
     g_dsos = dsos;
+    // Not registered to the name index since only the loaded tiles are
+    // indexed (see stars.c).
     dsos->hints_visible = true;
     fader_init(&dsos->visible, true);
     regcomp(&dsos->search_reg, "(m|ngc|ic) *([0-9]+)",
@@ -393,7 +443,7 @@ static int dsos_init(obj_t *obj, json_value *args)
 static tile_t *get_tile(survey_t *survey, int order, int pix,
                         bool sync, int *code)
 {
-    int flags = 0;
+    int i, flags = 0;
     tile_t *tile;
     assert(code);
     if (!sync) flags |= HIPS_LOAD_IN_THREAD;
@@ -402,6 +452,15 @@ static tile_t *get_tile(survey_t *survey, int order, int pix,
         return NULL;
     }
     tile = hips_get_tile(survey->hips, order, pix, flags, code);
+    // Add the designations to the name index.  Only the default survey
+    // is searchable, and this has to be done in the main thread.
+    if (tile && !(tile->flags & TILE_INDEXED) && survey == g_dsos->surveys) {
+        for (i = 0; i < tile->nb; i++) {
+            name_index_add_obj(&g_dsos->obj, &tile->sources[i].obj,
+                               pix_to_nuniq(order, pix));
+        }
+        tile->flags |= TILE_INDEXED;
+    }
     return tile;
 }
 
@@ -738,6 +797,9 @@ static int dsos_add_data_source(obj_t *obj, const char *url, const char *key)
     hips_settings_t survey_settings = {
         .create_tile = dsos_create_tile,
         .delete_tile = del_tile,
+        .dump_tile = dsos_dump_tile,
+        .load_tile = dsos_load_tile,
+        .snapshot_version = SNAPSHOT_VERSION,
     };
     DL_COUNT(dsos->surveys, survey, idx);
     survey = calloc(1, sizeof(*survey));
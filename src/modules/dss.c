@@ -100,6 +100,8 @@ static int dss_add_data_source(obj_t *obj, const char *url, const char *key)
     dss_t *dss = (dss_t*)obj;
     hips_delete(dss->hips);
     dss->hips = hips_create(url, 0, NULL);
+    // The DSS covers the whole sky, and we often zoom deep into it.
+    hips_set_parallel_fetch(dss->hips, true);
     return 0;
 }
 
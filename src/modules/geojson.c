@@ -40,25 +40,68 @@ struct feature {
     bool        blink;
 };
 
+/*
+ * Bounding caps hierarchy of the features meshes, used to speed up the
+ * rendered features queries.  The nodes are stored in depth first order:
+ * the left child of an inner node is the next node.
+ */
+typedef struct {
+    double          cap[4];
+    const feature_t *feature;
+    const mesh_t    *mesh;
+    int             idx;    // Index of the feature in the image.
+} index_entry_t;
+
+typedef struct {
+    double          cap[4];
+    int             start;  // First entry of a leaf.
+    int             count;  // Number of entries, zero for inner nodes.
+    int             right;  // Index of the right child of inner nodes.
+} index_node_t;
+
 typedef void (*filter_fn_t)(const image_t *img, int idx,
                             float fill_color[4], float stroke_color[4],
                             bool *blink, bool *hidden);
 
+// Flags of the features used by the batch filters.
+enum {
+    FEATURE_HIDDEN  = 1 << 0,
+    FEATURE_BLINK   = 1 << 1,
+};
+
+typedef void (*filter_batch_fn_t)(const image_t *img, int nb,
+                                  float (*fill_colors)[4],
+                                  float (*stroke_colors)[4],
+                                  uint8_t *flags);
+
 /*
  * Struct: image_t
  * Represents a geojson document
  *
  * Attributes:
- *   filter - Function called for each feature.  Can set the fill and stroke
- *            color.  If it returns zero, then the feature is hidden.
+ *   filter       - Function called for each feature.  Can set the fill and
+ *                  stroke color.  If it returns zero, then the feature is
+ *                  hidden.
+ *   filter_batch - Same as filter, but called only once with the arrays of
+ *                  all the features colors and flags.  This avoids one call
+ *                  per feature when the filter is implemented in js.
  */
 struct image {
     obj_t       obj;
     feature_t   *features;
     int         frame;
     filter_fn_t filter;
+    filter_batch_fn_t filter_batch;
     int         filter_idx;
     double      z;      // For sorting inside a layer.
+    char        *src;   // Survey tile source, until passed to the callback.
+
+    struct {
+        index_node_t  *nodes;
+        index_entry_t *entries;
+        int           nb_nodes;
+        bool          dirty;
+    } index;
 };
 
 
@@ -71,9 +114,8 @@ typedef struct survey {
     double      min_fov;
     double      max_fov;
 
-    void        (*filter)(const image_t *img, int idx,
-                          float fill_color[4], float stroke_color[4],
-                          bool *blink, bool *hidden);
+    filter_fn_t filter;
+    filter_batch_fn_t filter_batch;
     int         filter_idx;
     double      z;      // For sorting inside a layer.
 } survey_t;
@@ -162,29 +204,38 @@ static void feature_add_geo(feature_t *feature, const geojson_geometry_t *geo,
     if (mesh) mesh_update_bounding_cap(mesh);
 }
 
-static void add_geojson_feature(image_t *image,
-                                const geojson_feature_t *geo_feature)
+static feature_t *image_add_feature(
+        image_t *image, const geojson_feature_properties_t *props)
 {
     feature_t *feature;
 
     feature = (void*)obj_create("geojson-feature", NULL);
     feature->frame = image->frame;
 
-    vec3_copy(geo_feature->properties.fill, feature->fill_color);
-    vec3_copy(geo_feature->properties.stroke, feature->stroke_color);
-    feature->fill_color[3] = geo_feature->properties.fill_opacity;
-    feature->stroke_color[3] = geo_feature->properties.stroke_opacity;
-    feature->stroke_width = geo_feature->properties.stroke_width;
-    feature->stroke_glow = geo_feature->properties.stroke_glow;
-    if (geo_feature->properties.title)
-        feature->title = strdup(geo_feature->properties.title);
-    feature->text_anchor = geo_feature->properties.text_anchor;
-    feature->text_size = geo_feature->properties.text_size;
-    feature->text_rotate = geo_feature->properties.text_rotate;
-    vec2_copy(geo_feature->properties.text_offset, feature->text_offset);
+    vec3_copy(props->fill, feature->fill_color);
+    vec3_copy(props->stroke, feature->stroke_color);
+    feature->fill_color[3] = props->fill_opacity;
+    feature->stroke_color[3] = props->stroke_opacity;
+    feature->stroke_width = props->stroke_width;
+    feature->stroke_glow = props->stroke_glow;
+    if (props->title)
+        feature->title = strdup(props->title);
+    feature->text_anchor = props->text_anchor;
+    feature->text_size = props->text_size;
+    feature->text_rotate = props->text_rotate;
+    vec2_copy(props->text_offset, feature->text_offset);
 
-    feature_add_geo(feature, &geo_feature->geometry, feature->stroke_glow);
     DL_APPEND(image->features, feature);
+    image->index.dirty = true;
+    return feature;
+}
+
+static void add_geojson_feature(image_t *image,
+                                const geojson_feature_t *geo_feature)
+{
+    feature_t *feature;
+    feature = image_add_feature(image, &geo_feature->properties);
+    feature_add_geo(feature, &geo_feature->geometry, feature->stroke_glow);
 }
 
 static void feature_del(obj_t *obj)
@@ -216,13 +267,6 @@ static int feature_get_info(const obj_t *obj, const observer_t *obs,
     }
 }
 
-// Use to optimize the js code so that we don't use the slow _setValue.
-EMSCRIPTEN_KEEPALIVE
-void geojson_set_bool_ptr_(bool *ptr, bool value)
-{
-    *ptr = value;
-}
-
 // Use to optimize the js code so that we don't use the slow _setValue.
 EMSCRIPTEN_KEEPALIVE
 void geojson_set_color_ptr_(float *ptr, float r, float g, float b, float a)
@@ -244,12 +288,51 @@ void geojson_remove_all_features(image_t *image)
         DL_DELETE(image->features, feature);
         obj_release(&feature->obj);
     }
+    free(image->index.nodes);
+    free(image->index.entries);
+    memset(&image->index, 0, sizeof(image->index));
+}
+
+static void apply_filter_batch(image_t *image)
+{
+    feature_t *feature;
+    int i, nb;
+    float (*fill)[4], (*stroke)[4];
+    uint8_t *flags;
+
+    DL_COUNT(image->features, feature, nb);
+    if (!nb) return;
+    fill = malloc(nb * sizeof(*fill));
+    stroke = malloc(nb * sizeof(*stroke));
+    flags = malloc(nb * sizeof(*flags));
+    for (feature = image->features, i = 0; feature;
+         feature = feature->next, i++) {
+        vec4_copy(feature->fill_color, fill[i]);
+        vec4_copy(feature->stroke_color, stroke[i]);
+        flags[i] = (feature->hidden ? FEATURE_HIDDEN : 0) |
+                   (feature->blink ? FEATURE_BLINK : 0);
+    }
+    image->filter_batch(image, nb, fill, stroke, flags);
+    for (feature = image->features, i = 0; feature;
+         feature = feature->next, i++) {
+        vec4_copy(fill[i], feature->fill_color);
+        vec4_copy(stroke[i], feature->stroke_color);
+        feature->hidden = flags[i] & FEATURE_HIDDEN;
+        feature->blink = flags[i] & FEATURE_BLINK;
+    }
+    free(fill);
+    free(stroke);
+    free(flags);
 }
 
 static void apply_filter(image_t *image)
 {
     feature_t *feature;
     int i = 0;
+    if (image->filter_batch) {
+        apply_filter_batch(image);
+        return;
+    }
     if (!image->filter) return;
     for (feature = image->features; feature; feature = feature->next, i++) {
         image->filter(image, i, feature->fill_color, feature->stroke_color,
@@ -257,6 +340,219 @@ static void apply_filter(image_t *image)
     }
 }
 
+// Max number of entries in the index leaves.
+#define INDEX_LEAF_SIZE 4
+
+static int idx_cmp(const void *a, const void *b)
+{
+    return cmp(*(const int*)a, *(const int*)b);
+}
+
+// Compute the smallest cap containing two caps.
+static void cap_merge(const double a[4], const double b[4], double out[4])
+{
+    double d, ra, rb, r, t;
+
+    d = vec3_sep(a, b);
+    ra = acos(clamp(a[3], -1, 1));
+    rb = acos(clamp(b[3], -1, 1));
+    if (d + rb <= ra) {
+        vec4_copy(a, out);
+        return;
+    }
+    if (d + ra <= rb) {
+        vec4_copy(b, out);
+        return;
+    }
+    r = (d + ra + rb) / 2;
+    if (r >= M_PI) {
+        vec4_set(out, 1, 0, 0, -1); // Full sphere.
+        return;
+    }
+    // Move the center of a toward b along the great circle.
+    t = r - ra;
+    vec3_mul(sin(d - t) / sin(d), a, out);
+    vec3_addk(out, b, sin(t) / sin(d), out);
+    vec3_normalize(out, out);
+    out[3] = cos(r + 1e-9); // Small margin for the rounding errors.
+}
+
+// Partially sort the entries along an axis, so that the entry k is at its
+// sorted position.
+static void entries_select(index_entry_t *entries, int nb, int k, int axis)
+{
+    int lo = 0, hi = nb - 1, i, j;
+    double pivot;
+    index_entry_t tmp;
+
+    while (lo < hi) {
+        pivot = entries[(lo + hi) / 2].cap[axis];
+        i = lo;
+        j = hi;
+        while (i <= j) {
+            while (entries[i].cap[axis] < pivot) i++;
+            while (entries[j].cap[axis] > pivot) j--;
+            if (i <= j) {
+                tmp = entries[i];
+                entries[i++] = entries[j];
+                entries[j--] = tmp;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+}
+
+static void index_build_node(image_t *image, int start, int end)
+{
+    int i, j, axis = 0, node, mid = (start + end) / 2;
+    double vmin[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+    double vmax[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    index_entry_t *entries = image->index.entries;
+    index_node_t *nodes;
+
+    node = image->index.nb_nodes++;
+    nodes = image->index.nodes;
+    if (end - start <= INDEX_LEAF_SIZE) {
+        vec4_copy(entries[start].cap, nodes[node].cap);
+        for (i = start + 1; i < end; i++)
+            cap_merge(nodes[node].cap, entries[i].cap, nodes[node].cap);
+        nodes[node].start = start;
+        nodes[node].count = end - start;
+        return;
+    }
+
+    // Split the entries in two along the axis of largest extent.
+    for (i = start; i < end; i++) {
+        for (j = 0; j < 3; j++) {
+            vmin[j] = fmin(vmin[j], entries[i].cap[j]);
+            vmax[j] = fmax(vmax[j], entries[i].cap[j]);
+        }
+    }
+    for (i = 1; i < 3; i++) {
+        if (vmax[i] - vmin[i] > vmax[axis] - vmin[axis]) axis = i;
+    }
+    entries_select(entries + start, end - start, mid - start, axis);
+    index_build_node(image, start, mid);
+    nodes[node].right = image->index.nb_nodes;
+    index_build_node(image, mid, end);
+    cap_merge(nodes[node + 1].cap, nodes[nodes[node].right].cap,
+              nodes[node].cap);
+}
+
+/*
+ * Function: image_update_index
+ * Rebuild the image meshes bounding caps hierarchy if needed.
+ */
+static void image_update_index(image_t *image)
+{
+    int i = 0, nb = 0;
+    const feature_t *feature;
+    const mesh_t *mesh;
+    index_entry_t *entry;
+
+    if (!image->index.dirty) return;
+    image->index.dirty = false;
+    free(image->index.nodes);
+    free(image->index.entries);
+    image->index.nodes = NULL;
+    image->index.entries = NULL;
+    image->index.nb_nodes = 0;
+
+    for (feature = image->features; feature; feature = feature->next) {
+        DL_COUNT(feature->meshes, mesh, i);
+        nb += i;
+    }
+    if (!nb) return;
+    image->index.entries = calloc(nb, sizeof(*image->index.entries));
+    nb = 0;
+    for (feature = image->features, i = 0; feature;
+         feature = feature->next, i++) {
+        for (mesh = feature->meshes; mesh; mesh = mesh->next) {
+            if (!mesh->vertices_count) continue;
+            entry = &image->index.entries[nb++];
+            vec4_copy(mesh->bounding_cap, entry->cap);
+            entry->feature = feature;
+            entry->mesh = mesh;
+            entry->idx = i;
+        }
+    }
+    if (!nb) return;
+    // A binary tree with nb leaves has at most 2 * nb - 1 nodes.
+    image->index.nodes = calloc(2 * nb, sizeof(*image->index.nodes));
+    index_build_node(image, 0, nb);
+}
+
+/*
+ * Function: image_query
+ * List the visible features that have a mesh passing a test.
+ *
+ * Only the meshes whose bounding cap intersects the query cap are tested.
+ * The features are returned in the order of the image.
+ *
+ * Parameters:
+ *   image   - A geojson image.
+ *   cap     - Query cap.
+ *   test    - Test function called on each candidate mesh.
+ *   user    - User data passed to the test function.
+ *   max_ret - Max number of features returned.
+ *   tiles   - Optional output array filled with the image.
+ *   index   - Output array of features index.
+ *
+ * Return:
+ *   The number of features returned.
+ */
+static int image_query(const image_t *image_, const double cap[4],
+                       bool (*test)(const mesh_t *mesh, void *user),
+                       void *user, int max_ret, void **tiles, int *index)
+{
+    image_t *image = (image_t*)image_;
+    int stack[64], stack_size = 0, n, i, nb = 0, nb_hits = 0, allocated = 0;
+    int *hits = NULL;
+    const index_node_t *node;
+    const index_entry_t *entry;
+
+    if (max_ret <= 0) return 0;
+    image_update_index(image);
+    if (!image->index.nb_nodes) return 0;
+
+    stack[stack_size++] = 0;
+    while (stack_size) {
+        n = stack[--stack_size];
+        node = &image->index.nodes[n];
+        if (!cap_intersects_cap(cap, node->cap)) continue;
+        if (!node->count) {
+            assert(stack_size + 2 <= ARRAY_SIZE(stack));
+            stack[stack_size++] = node->right;
+            stack[stack_size++] = n + 1;
+            continue;
+        }
+        for (i = 0; i < node->count; i++) {
+            entry = &image->index.entries[node->start + i];
+            if (entry->feature->hidden) continue;
+            if (!cap_intersects_cap(cap, entry->cap)) continue;
+            if (!test(entry->mesh, user)) continue;
+            if (nb_hits >= allocated) {
+                allocated = allocated * 2 ?: 64;
+                hits = realloc(hits, allocated * sizeof(*hits));
+            }
+            hits[nb_hits++] = entry->idx;
+        }
+    }
+
+    // Sort the hits and remove the features with several matching meshes.
+    qsort(hits, nb_hits, sizeof(*hits), idx_cmp);
+    for (i = 0; i < nb_hits && nb < max_ret; i++) {
+        if (i && hits[i] == hits[i - 1]) continue;
+        index[nb] = hits[i];
+        if (tiles) tiles[nb] = (void*)image;
+        nb++;
+    }
+    free(hits);
+    return nb;
+}
+
 static json_value *data_fn(obj_t *obj, const attribute_t *attr,
                            const json_value *args)
 {
@@ -276,6 +572,7 @@ static json_value *data_fn(obj_t *obj, const attribute_t *attr,
     }
     geojson_delete(geojson);
     apply_filter(image);
+    image_update_index(image);
     return NULL;
 }
 
@@ -289,6 +586,22 @@ static json_value *filter_fn(obj_t *obj, const attribute_t *attr,
         return NULL;
     }
     image->filter = (void*)(intptr_t)(args->u.integer);
+    image->filter_batch = NULL;
+    apply_filter(image);
+    return NULL;
+}
+
+static json_value *filter_batch_fn(obj_t *obj, const attribute_t *attr,
+                                   const json_value *args)
+{
+    image_t *image = (void*)obj;
+    if (!args) return NULL;
+    if (args->type != json_integer) {
+        LOG_E("Wrong type for filter_batch attribute");
+        return NULL;
+    }
+    image->filter_batch = (void*)(intptr_t)(args->u.integer);
+    image->filter = NULL;
     apply_filter(image);
     return NULL;
 }
@@ -385,6 +698,7 @@ static void image_del(obj_t *obj)
 {
     image_t *image = (void*)obj;
     geojson_remove_all_features(image);
+    free(image->src);
 }
 
 // Special function for fast geojson parsing directly from js!
@@ -414,48 +728,82 @@ void geojson_add_poly_feature(image_t *image, int size, const double *data)
     add_geojson_feature(image, &feature);
 }
 
+static bool mesh_contains_pos(const mesh_t *mesh, void *user)
+{
+    const double *pos = user;
+    return mesh_contains_vec3(mesh, pos);
+}
+
 static int query_rendered_features_(
         const image_t *image, const double pos[3], int max_ret,
         void **tiles, int *index)
 {
-    int i = 0, nb = 0;
-    const feature_t *feature;
-    const mesh_t *mesh;
-
-    for (feature = image->features; feature; feature = feature->next, i++) {
-        if (nb >= max_ret) break;
-        if (feature->hidden) continue;
-        for (mesh = feature->meshes; mesh; mesh = mesh->next) {
-            if (mesh_contains_vec3(mesh, pos)) {
-                index[nb] = i;
-                if (tiles) tiles[nb] = (void*)image;
-                nb++;
-                break;
-            }
-        }
-    }
-    return nb;
+    double cap[4] = {pos[0], pos[1], pos[2], 1};
+    return image_query(image, cap, mesh_contains_pos, (void*)pos,
+                       max_ret, tiles, index);
 }
 
-static bool mesh_intersects_box(const mesh_t *mesh_, const painter_t *painter,
-                                const double box[2][2])
+typedef struct {
+    const painter_t *painter;
+    const double    (*box)[2];
+    double          (*verts)[3]; // Projected vertices buffer.
+    int             allocated;
+} box_query_t;
+
+static bool mesh_intersects_box(const mesh_t *mesh, void *user)
 {
-    mesh_t *mesh;
+    box_query_t *q = user;
+    mesh_t proj_mesh;
     int i;
     double p[4];
-    bool ret;
 
-    // Project the mesh vertices into screen coordinates.
-    mesh = mesh_copy(mesh_);
+    // Project the mesh vertices into screen coordinates, reusing the
+    // same buffer for all the meshes of the query.
+    if (mesh->vertices_count > q->allocated) {
+        q->allocated = q->allocated * 2 ?: 256;
+        if (q->allocated < mesh->vertices_count)
+            q->allocated = mesh->vertices_count;
+        q->verts = realloc(q->verts, q->allocated * sizeof(*q->verts));
+    }
     for (i = 0; i < mesh->vertices_count; i++) {
         vec3_normalize(mesh->vertices[i], p);
-        convert_frame(painter->obs, FRAME_ICRF, FRAME_VIEW, true, p, p);
-        project_to_win(painter->proj, p, p);
-        vec2_copy(p, mesh->vertices[i]);
+        convert_frame(q->painter->obs, FRAME_ICRF, FRAME_VIEW, true, p, p);
+        project_to_win(q->painter->proj, p, p);
+        vec2_copy(p, q->verts[i]);
     }
-    ret = mesh_intersects_2d_box(mesh, box);
-    mesh_delete(mesh);
-    return ret;
+    proj_mesh = *mesh;
+    proj_mesh.vertices = q->verts;
+    return mesh_intersects_2d_box(&proj_mesh, q->box);
+}
+
+/*
+ * Compute a cap containing all the ICRF directions inside a window box.
+ * The box is sampled on a grid, with a margin to account for the
+ * curvature of the projection between the samples.
+ */
+static void get_box_cap(const painter_t *painter, const double box[2][2],
+                        double cap[4])
+{
+    const int n = 4; // Grid size.
+    int i, j;
+    double p[2], v[3], sep = 0;
+
+    vec2_mix(box[0], box[1], 0.5, p);
+    if (!painter_unproject(painter, FRAME_ICRF, p, cap)) goto full_sky;
+    for (i = 0; i <= n; i++)
+    for (j = 0; j <= n; j++) {
+        p[0] = mix(box[0][0], box[1][0], (double)i / n);
+        p[1] = mix(box[0][1], box[1][1], (double)j / n);
+        if (!painter_unproject(painter, FRAME_ICRF, p, v)) goto full_sky;
+        sep = fmax(sep, vec3_sep(cap, v));
+    }
+    sep = sep * 1.1 + 0.1 * DD2R;
+    if (sep >= M_PI) goto full_sky;
+    cap[3] = cos(sep);
+    return;
+
+full_sky:
+    vec4_set(cap, 1, 0, 0, -1);
 }
 
 static int query_rendered_features_box_(
@@ -463,22 +811,14 @@ static int query_rendered_features_box_(
         const double box[2][2], int max_ret,
         void **tiles, int *index)
 {
-    int i = 0, nb = 0;
-    const feature_t *feature;
-    const mesh_t *mesh;
-
-    for (feature = image->features; feature; feature = feature->next, i++) {
-        if (nb >= max_ret) break;
-        if (feature->hidden) continue;
-        for (mesh = feature->meshes; mesh; mesh = mesh->next) {
-            if (mesh_intersects_box(mesh, painter, box)) {
-                index[nb] = i;
-                if (tiles) tiles[nb] = (void*)image;
-                nb++;
-                break;
-            }
-        }
-    }
+    int nb;
+    double cap[4];
+    box_query_t q = {.painter = painter, .box = box};
+
+    get_box_cap(painter, box, cap);
+    nb = image_query(image, cap, mesh_intersects_box, &q, max_ret,
+                     tiles, index);
+    free(q.verts);
     return nb;
 }
 
@@ -518,17 +858,37 @@ void geojson_set_on_new_tile_callback(
     g_survey_on_new_tile = fn;
 }
 
-static void image_update_filter(image_t *image,
-                                filter_fn_t filter, int filter_idx)
+/*
+ * Apply the survey filter to a tile, unless it has already been applied.
+ */
+static void image_update_filter(image_t *image, const survey_t *survey)
 {
-    if (image->filter_idx == filter_idx) return;
-    image->filter = filter;
-    image->filter_idx = filter_idx;
+    if (image->filter_idx == survey->filter_idx) return;
+    image->filter = survey->filter;
+    image->filter_batch = survey->filter_batch;
+    image->filter_idx = survey->filter_idx;
     apply_filter(image);
 }
 
+/*
+ * Finish the setup of a loaded tile in the main thread.
+ */
+static void survey_link_tile(const survey_t *survey, image_t *tile)
+{
+    if (tile->src) {
+        if (g_survey_on_new_tile)
+            g_survey_on_new_tile(tile, tile->src);
+        free(tile->src);
+        tile->src = NULL;
+    }
+    image_update_filter(tile, survey);
+}
+
 /*
  * Iter all the visible tiles at the appropriate order.
+ *
+ * The tiles are loaded in a worker thread, so a tile can be NULL with a
+ * zero code for a few frames after its data arrived.
  */
 static bool survey_iter_visible_tiles(
         const survey_t *survey,
@@ -551,9 +911,9 @@ static bool survey_iter_visible_tiles(
             hips_iter_push_children(iter, *order, *pix);
             continue;
         }
-        *tile = hips_get_tile(hips, *order, *pix, HIPS_NO_DELAY, code);
-        if (*tile)
-            image_update_filter(*tile, survey->filter, survey->filter_idx);
+        *tile = hips_get_tile(hips, *order, *pix,
+                              HIPS_NO_DELAY | HIPS_LOAD_IN_THREAD, code);
+        if (*tile) survey_link_tile(survey, *tile);
         return true;
     }
 }
@@ -631,6 +991,229 @@ int geojson_survey_query_rendered_features(
     return nb;
 }
 
+/*
+ * Binary survey tiles format, as created by tools/make-geojson-tiles.py.
+ *
+ * All values are little endian.  The file starts with a header, followed
+ * by the properties table, and then the geometries.
+ *
+ * The properties table is a NUL terminated json document of the form
+ * {"features": [{"type": "Feature", "properties": {...}}, ...]}, without
+ * the geometries.  It is passed as is to the new tile callback.
+ *
+ * The geometries are a stream of LEB128 varints.  For each feature we have
+ * the number of geometries, and for each geometry its type, followed by:
+ *   GEOJSON_POLYGON:    number of rings, rings sizes, vertices, number of
+ *                       triangles indices, triangles indices.
+ *   GEOJSON_LINESTRING: number of vertices, vertices.
+ *   GEOJSON_POINT:      vertex.
+ * The vertices are lon/lat in units of 1e-6 deg, zigzag encoded as the
+ * delta from the previous vertex of the geometry.  The polygons rings are
+ * not closed, and already triangulated.
+ */
+#define BIN_TILE_VERSION 1
+
+typedef struct {
+    char        magic[4]; // 'GJBT'
+    uint32_t    version;
+    uint32_t    children_mask;
+    uint32_t    props_size; // Including the NUL char, zero if empty tile.
+} bin_tile_header_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool          error;
+} bin_reader_t;
+
+static uint32_t bin_read_varint(bin_reader_t *r)
+{
+    uint32_t v = 0;
+    int shift;
+    for (shift = 0; shift < 32; shift += 7) {
+        if (r->p >= r->end) break;
+        v |= (uint32_t)(*r->p & 0x7f) << shift;
+        if (!(*r->p++ & 0x80)) return v;
+    }
+    r->error = true;
+    return 0;
+}
+
+// Read a number of items, each of them using at least one byte.
+static int bin_read_size(bin_reader_t *r, int max)
+{
+    uint32_t v = bin_read_varint(r);
+    if (v > max || v > r->end - r->p) {
+        r->error = true;
+        return 0;
+    }
+    return v;
+}
+
+static void bin_read_vertices(bin_reader_t *r, int nb, double (*out)[2])
+{
+    int i, j;
+    uint32_t v;
+    int32_t q[2] = {0, 0};
+    for (i = 0; i < nb; i++) {
+        for (j = 0; j < 2; j++) {
+            v = bin_read_varint(r);
+            q[j] += (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+            out[i][j] = q[j] * 1e-6;
+        }
+    }
+}
+
+static mesh_t *bin_read_polygon(bin_reader_t *r)
+{
+    int i, nb_rings, size = 0, nb_indices;
+    uint32_t index;
+    int *rings_size;
+    double (*verts)[2];
+    uint16_t *indices;
+    mesh_t *mesh = NULL;
+
+    nb_rings = bin_read_size(r, 1024);
+    rings_size = calloc(nb_rings, sizeof(*rings_size));
+    for (i = 0; i < nb_rings; i++) {
+        rings_size[i] = bin_read_size(r, UINT16_MAX);
+        size += rings_size[i];
+    }
+    if (size > UINT16_MAX) r->error = true;
+    if (r->error) goto end;
+    verts = calloc(size, sizeof(*verts));
+    bin_read_vertices(r, size, verts);
+    nb_indices = bin_read_size(r, INT32_MAX);
+    indices = calloc(nb_indices, sizeof(*indices));
+    for (i = 0; i < nb_indices; i++) {
+        // Check the value before the conversion to 16 bits.
+        index = bin_read_varint(r);
+        if (index >= size) r->error = true;
+        indices[i] = index;
+    }
+    if (!r->error && nb_indices % 3 == 0) {
+        mesh = calloc(1, sizeof(*mesh));
+        mesh_add_poly_triangles_lonlat(mesh, nb_rings, rings_size,
+                                       (const void*)verts,
+                                       nb_indices, indices);
+    }
+    free(verts);
+    free(indices);
+end:
+    free(rings_size);
+    return mesh;
+}
+
+static int bin_read_feature_geometries(bin_reader_t *r, feature_t *feature)
+{
+    int i, nb, type, size;
+    mesh_t *mesh;
+    double (*verts)[2];
+
+    nb = bin_read_size(r, INT32_MAX);
+    for (i = 0; i < nb && !r->error; i++) {
+        mesh = NULL;
+        type = bin_read_varint(r);
+        switch (type) {
+        case GEOJSON_POLYGON:
+            mesh = bin_read_polygon(r);
+            break;
+        case GEOJSON_LINESTRING:
+            size = bin_read_size(r, UINT16_MAX);
+            if (r->error || size < 2) break;
+            verts = calloc(size, sizeof(*verts));
+            bin_read_vertices(r, size, verts);
+            mesh = calloc(1, sizeof(*mesh));
+            mesh_add_line_lonlat(mesh, size, (const void*)verts, false);
+            if (feature->stroke_glow && !feature->linestring.size) {
+                linestring2c(&(geojson_linestring_t) {
+                                .size = size, .coordinates = verts},
+                             feature);
+            }
+            free(verts);
+            break;
+        case GEOJSON_POINT:
+            verts = calloc(1, sizeof(*verts));
+            bin_read_vertices(r, 1, verts);
+            mesh = calloc(1, sizeof(*mesh));
+            mesh_add_point_lonlat(mesh, verts[0]);
+            free(verts);
+            break;
+        }
+        if (!mesh) {
+            r->error = true;
+            break;
+        }
+        mesh_update_bounding_cap(mesh);
+        DL_APPEND(feature->meshes, mesh);
+    }
+    return r->error ? -1 : 0;
+}
+
+static image_t *survey_create_bin_tile(const void *data, int size,
+                                       int *transparency)
+{
+    bin_tile_header_t header;
+    bin_reader_t reader;
+    const char *props;
+    json_value *jprops = NULL;
+    const json_value *jfeatures, *jfeature;
+    geojson_feature_properties_t feature_props;
+    feature_t *feature;
+    image_t *tile = NULL;
+    int i;
+
+    _Static_assert(sizeof(bin_tile_header_t) == 16, "");
+    if (size < sizeof(header)) goto error;
+    memcpy(&header, data, sizeof(header));
+    if (    header.version != BIN_TILE_VERSION ||
+            header.props_size > size - sizeof(header))
+        goto error;
+    *transparency = (~header.children_mask) & 15;
+    tile = (void*)obj_create("geojson", NULL);
+    if (!header.props_size) return tile; // Empty tile.
+
+    props = (const char*)data + sizeof(header);
+    if (props[header.props_size - 1] != '\0') goto error;
+    jprops = json_parse(props, header.props_size - 1);
+    jfeatures = json_get_attr(jprops, "features", json_array);
+    if (!jfeatures) goto error;
+
+    reader = (bin_reader_t) {
+        .p = (const uint8_t*)props + header.props_size,
+        .end = (const uint8_t*)data + size,
+    };
+    for (i = 0; i < jfeatures->u.array.length; i++) {
+        jfeature = jfeatures->u.array.values[i];
+        memset(&feature_props, 0, sizeof(feature_props));
+        geojson_parse_properties(
+                json_get_attr(jfeature, "properties", json_object),
+                &feature_props);
+        feature = image_add_feature(tile, &feature_props);
+        free(feature_props.title);
+        if (bin_read_feature_geometries(&reader, feature)) goto error;
+    }
+    json_value_free(jprops);
+
+    if (g_survey_on_new_tile) tile->src = strdup(props);
+    image_update_index(tile);
+    return tile;
+
+error:
+    LOG_E("Cannot parse binary geojson tile");
+    json_value_free(jprops);
+    if (tile) obj_release((obj_t*)tile);
+    return NULL;
+}
+
+/*
+ * Create a survey tile image from its geojson or binary data.
+ *
+ * This runs in a worker thread, so we only build the tile image here: the
+ * parsing, tessellation and index are done, and the main thread only has
+ * to apply the filter and call the new tile callback (see
+ * survey_link_tile).
+ */
 static void *survey_create_tile(
         void *user, int order, int pix, const void *data, int size,
         int *cost, int *transparency)
@@ -641,6 +1224,9 @@ static void *survey_create_tile(
     bool empty = false;
     image_t *tile;
 
+    if (size >= 4 && memcmp(data, "GJBT", 4) == 0)
+        return survey_create_bin_tile(data, size, transparency);
+
     jdata = json_parse_ex(&settings, data, size, NULL);
     if (!jdata) return NULL;
 
@@ -655,8 +1241,11 @@ static void *survey_create_tile(
     tile = (void*)obj_create("geojson", NULL);
     if (!empty) {
         obj_call_json((obj_t*)tile, "data", jdata);
-        if (g_survey_on_new_tile)
-            g_survey_on_new_tile(tile, data);
+        if (g_survey_on_new_tile) {
+            tile->src = malloc(size + 1);
+            memcpy(tile->src, data, size);
+            tile->src[size] = '\0';
+        }
     }
     json_builder_free(jdata);
 
@@ -748,7 +1337,7 @@ static int survey_render(obj_t *obj, const painter_t *painter)
 
     survey_load_allsky(survey);
     if (survey->allsky) {
-        image_update_filter(survey->allsky, survey->filter, survey->filter_idx);
+        image_update_filter(survey->allsky, survey);
         obj_render((obj_t*)survey->allsky, painter);
     }
 
@@ -767,10 +1356,11 @@ static int survey_render(obj_t *obj, const painter_t *painter)
     return 0;
 }
 
+static int g_survey_filter_idx = 1;
+
 static json_value *survey_filter_fn(obj_t *obj, const attribute_t *attr,
                                     const json_value *args)
 {
-    static int filter_idx = 1;
     survey_t *survey = (void*)obj;
     if (!args) return NULL;
     if (args->type != json_integer) {
@@ -778,10 +1368,334 @@ static json_value *survey_filter_fn(obj_t *obj, const attribute_t *attr,
         return NULL;
     }
     survey->filter = (void*)(intptr_t)(args->u.integer);
-    survey->filter_idx = filter_idx++;
+    survey->filter_batch = NULL;
+    survey->filter_idx = g_survey_filter_idx++;
+    return NULL;
+}
+
+static json_value *survey_filter_batch_fn(obj_t *obj,
+                                          const attribute_t *attr,
+                                          const json_value *args)
+{
+    survey_t *survey = (void*)obj;
+    if (!args) return NULL;
+    if (args->type != json_integer) {
+        LOG_E("Wrong type for filter_batch attribute");
+        return NULL;
+    }
+    survey->filter_batch = (void*)(intptr_t)(args->u.integer);
+    survey->filter = NULL;
+    survey->filter_idx = g_survey_filter_idx++;
     return NULL;
 }
 
+
+/******* TESTS **********************************************************/
+#if COMPILE_TESTS
+
+// Create a geojson image with random small square polygons.
+static image_t *test_create_image(int nb, double size)
+{
+    int i, len = 0, allocated = nb * 200 + 64;
+    char *str = malloc(allocated);
+    double lon, lat;
+    json_value *json;
+    image_t *image;
+
+    srand(1);
+    len += sprintf(str + len, "{\"type\": \"FeatureCollection\", "
+                              "\"features\": [");
+    for (i = 0; i < nb; i++) {
+        lon = rand() % 36000 / 100.0 - 180;
+        lat = rand() % 16000 / 100.0 - 80;
+        len += sprintf(str + len, "%s{\"type\": \"Feature\", "
+            "\"properties\": {}, \"geometry\": {\"type\": \"Polygon\", "
+            "\"coordinates\": [[[%g,%g],[%g,%g],[%g,%g],[%g,%g],[%g,%g]]]}}",
+            i ? "," : "", lon, lat, lon + size, lat, lon + size, lat + size,
+            lon, lat + size, lon, lat);
+    }
+    len += sprintf(str + len, "]}");
+    json = json_parse(str, len);
+    image = (void*)obj_create("geojson", NULL);
+    data_fn((obj_t*)image, NULL, json);
+    json_value_free(json);
+    free(str);
+    return image;
+}
+
+// Reference implementation testing all the features meshes.
+static int test_query_all(const image_t *image, const double cap[4],
+                          bool (*test)(const mesh_t *mesh, void *user),
+                          void *user, int max_ret, int *index)
+{
+    int i = 0, nb = 0;
+    const feature_t *feature;
+    const mesh_t *mesh;
+
+    for (feature = image->features; feature; feature = feature->next, i++) {
+        if (nb >= max_ret) break;
+        if (feature->hidden) continue;
+        for (mesh = feature->meshes; mesh; mesh = mesh->next) {
+            if (test(mesh, user)) {
+                index[nb++] = i;
+                break;
+            }
+        }
+    }
+    return nb;
+}
+
+static void test_query_painter(painter_t *painter, projection_t *proj)
+{
+    core_get_proj(proj);
+    *painter = (painter_t) {
+        .obs = core->observer,
+        .proj = proj,
+        .fb_size = {core->win_size[0] * core->win_pixels_scale,
+                    core->win_size[1] * core->win_pixels_scale},
+    };
+    painter_update_clip_info(painter);
+}
+
+static void test_geojson_query(void)
+{
+    image_t *image;
+    feature_t *feature;
+    painter_t painter;
+    projection_t proj;
+    int i, nb, nb_ref, index[64], index_ref[64], nb_found = 0;
+    double pos[3], box[2][2], cap[4];
+    box_query_t q = {.painter = &painter, .box = (const double (*)[2])box};
+
+    image = test_create_image(2000, 3);
+    feature = image->features->next;
+    feature->hidden = true;
+    srand(2);
+    for (i = 0; i < 1000; i++) {
+        vec3_set(pos, rand() % 1000 - 500, rand() % 1000 - 500,
+                      rand() % 1000 - 500);
+        vec3_normalize(pos, pos);
+        vec4_set(cap, pos[0], pos[1], pos[2], 1);
+        nb = query_rendered_features_(image, pos, 64, NULL, index);
+        nb_ref = test_query_all(image, cap, mesh_contains_pos, pos, 64,
+                                index_ref);
+        assert(nb == nb_ref);
+        assert(memcmp(index, index_ref, nb * sizeof(*index)) == 0);
+        nb_found += nb;
+    }
+    assert(nb_found > 0);
+    // The index gets updated when we add new features.
+    geojson_add_poly_feature(image, 4, (const double[]){
+        0, 89, 120, 89, 240, 89, 0, 89});
+    nb = query_rendered_features_(image, VEC(0, 0, 1), 64, NULL, index);
+    assert(nb == 1 && index[0] == 2000);
+
+    test_query_painter(&painter, &proj);
+    for (i = 0; i < 100; i++) {
+        box[0][0] = rand() % (int)painter.fb_size[0];
+        box[0][1] = rand() % (int)painter.fb_size[1];
+        box[1][0] = box[0][0] + rand() % 200;
+        box[1][1] = box[0][1] + rand() % 200;
+        nb = query_rendered_features_box_(&painter, image, box, 64,
+                                          NULL, index);
+        vec4_set(cap, 1, 0, 0, -1);
+        nb_ref = test_query_all(image, cap, mesh_intersects_box, &q, 64,
+                                index_ref);
+        assert(nb == nb_ref);
+        assert(memcmp(index, index_ref, nb * sizeof(*index)) == 0);
+    }
+    free(q.verts);
+    obj_release((obj_t*)image);
+}
+
+static void bench_geojson_query(void)
+{
+    const int nb = 50000, nb_queries = 10000;
+    image_t *image;
+    painter_t painter;
+    projection_t proj;
+    int i, n = 0, index[16];
+    double t, pos[3], box[2][2], cap[4] = {0, 0, 0, -1};
+    box_query_t q = {.painter = &painter, .box = (const double (*)[2])box};
+
+    t = sys_get_unix_time();
+    image = test_create_image(nb, 0.4);
+    LOG_I("Parse %d polygons: %.0f ms", nb,
+          (sys_get_unix_time() - t) * 1000);
+    image->index.dirty = true;
+    t = sys_get_unix_time();
+    image_update_index(image);
+    LOG_I("Build index: %.1f ms", (sys_get_unix_time() - t) * 1000);
+
+    srand(3);
+    t = sys_get_unix_time();
+    for (i = 0; i < nb_queries; i++) {
+        vec3_set(pos, rand() % 1000 - 500, rand() % 1000 - 500,
+                      rand() % 1000 - 500);
+        vec3_normalize(pos, pos);
+        n += query_rendered_features_(image, pos, 16, NULL, index);
+    }
+    LOG_I("%d point queries (%d results): %.3f ms per query", nb_queries, n,
+          (sys_get_unix_time() - t) * 1000 / nb_queries);
+    t = sys_get_unix_time();
+    for (i = 0; i < 100; i++) {
+        vec3_set(pos, rand() % 1000 - 500, rand() % 1000 - 500,
+                      rand() % 1000 - 500);
+        vec3_normalize(pos, pos);
+        test_query_all(image, cap, mesh_contains_pos, pos, 16, index);
+    }
+    LOG_I("Without index: %.3f ms per query",
+          (sys_get_unix_time() - t) * 1000 / 100);
+
+    test_query_painter(&painter, &proj);
+    t = sys_get_unix_time();
+    for (i = 0; i < 100; i++) {
+        box[0][0] = rand() % (int)painter.fb_size[0];
+        box[0][1] = rand() % (int)painter.fb_size[1];
+        box[1][0] = box[0][0] + 20;
+        box[1][1] = box[0][1] + 20;
+        query_rendered_features_box_(&painter, image, box, 16, NULL, index);
+    }
+    LOG_I("Box queries: %.3f ms per query",
+          (sys_get_unix_time() - t) * 1000 / 100);
+    t = sys_get_unix_time();
+    for (i = 0; i < 10; i++)
+        test_query_all(image, cap, mesh_intersects_box, &q, 16, index);
+    LOG_I("Without index: %.3f ms per query",
+          (sys_get_unix_time() - t) * 1000 / 10);
+    free(q.verts);
+    obj_release((obj_t*)image);
+}
+
+static int g_test_filter_calls;
+
+static void test_filter_batch_fn(const image_t *img, int nb,
+                                 float (*fill_colors)[4],
+                                 float (*stroke_colors)[4],
+                                 uint8_t *flags)
+{
+    int i;
+    g_test_filter_calls++;
+    for (i = 0; i < nb; i++) {
+        fill_colors[i][0] = i / (float)nb;
+        if (i % 2) flags[i] |= FEATURE_HIDDEN;
+    }
+}
+
+static void test_filter_batch(void)
+{
+    image_t *image;
+    const feature_t *feature;
+    json_value *fn;
+    survey_t survey = {.filter_batch = test_filter_batch_fn, .filter_idx = 1};
+    int i = 0;
+
+    image = test_create_image(100, 1);
+    g_test_filter_calls = 0;
+    fn = json_integer_new((intptr_t)test_filter_batch_fn);
+    obj_call_json((obj_t*)image, "filter_batch", fn);
+    json_builder_free(fn);
+    assert(g_test_filter_calls == 1);
+    for (feature = image->features; feature; feature = feature->next, i++) {
+        assert(feature->fill_color[0] == i / 100.f);
+        assert(feature->hidden == (i % 2));
+    }
+    // The survey filter is only applied once per tile.
+    image_update_filter(image, &survey);
+    image_update_filter(image, &survey);
+    assert(g_test_filter_calls == 2);
+    obj_release((obj_t*)image);
+}
+
+static void test_write_varint(uint8_t **p, uint32_t v)
+{
+    for (; v >= 0x80; v >>= 7) *(*p)++ = (v & 0x7f) | 0x80;
+    *(*p)++ = v;
+}
+
+// Create a binary tile with a triangle (10, 20), (11, 20), (10, 21), and a
+// point (-5, -5).  Return the size of the data.
+static int test_create_bin_tile(uint8_t *data, const char *props,
+                                uint32_t last_index)
+{
+    const int32_t verts[4][2] = {
+        {10000000, 20000000}, {11000000, 20000000}, {10000000, 21000000},
+        {-5000000, -5000000}};
+    uint8_t *p;
+    bin_tile_header_t header = {
+        .magic = "GJBT", .version = BIN_TILE_VERSION, .children_mask = 3,
+        .props_size = strlen(props) + 1};
+    int i, j, d;
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), props, header.props_size);
+    p = data + sizeof(header) + header.props_size;
+    test_write_varint(&p, 1);
+    test_write_varint(&p, GEOJSON_POLYGON);
+    test_write_varint(&p, 1);
+    test_write_varint(&p, 3);
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 2; j++) {
+            d = verts[i][j] - (i ? verts[i - 1][j] : 0);
+            test_write_varint(&p, ((uint32_t)d << 1) ^ (d >> 31));
+        }
+    }
+    test_write_varint(&p, 3);
+    for (i = 0; i < 3; i++) test_write_varint(&p, i < 2 ? i : last_index);
+    test_write_varint(&p, 1);
+    test_write_varint(&p, GEOJSON_POINT);
+    for (j = 0; j < 2; j++)
+        test_write_varint(&p, ((uint32_t)verts[3][j] << 1) ^
+                              (verts[3][j] >> 31));
+    return p - data;
+}
+
+static void test_bin_tile(void)
+{
+    const char *props = "{\"features\": ["
+        "{\"type\": \"Feature\", \"properties\": {\"title\": \"A\", "
+        "\"fill\": \"#ff0000\"}}, "
+        "{\"type\": \"Feature\", \"properties\": {}}]}";
+    uint8_t data[1024];
+    int size, transparency = 0, cost, index[4];
+    image_t *tile;
+    const feature_t *feature;
+    double pos[3];
+
+    size = test_create_bin_tile(data, props, 2);
+    tile = survey_create_tile(NULL, 0, 0, data, size,
+                              &cost, &transparency);
+    assert(tile && transparency == 12);
+    feature = tile->features;
+    assert(feature->meshes->triangles_count == 3);
+    assert(feature->meshes->lines_count == 6);
+    assert(strcmp(feature->title, "A") == 0);
+    assert(feature->fill_color[0] == 1 && feature->fill_color[1] == 0);
+    assert(feature->next->meshes->points_count == 1);
+    vec3_from_sphe(10.3 * DD2R, 20.3 * DD2R, pos);
+    assert(query_rendered_features_(tile, pos, 4, NULL, index) == 1);
+    assert(index[0] == 0);
+    obj_release((obj_t*)tile);
+
+    // Truncated data.
+    tile = survey_create_tile(NULL, 0, 0, data, size - 3,
+                              &cost, &transparency);
+    assert(!tile);
+
+    // Index out of range, that would be valid once truncated to 16 bits.
+    size = test_create_bin_tile(data, props, 65536 + 2);
+    tile = survey_create_tile(NULL, 0, 0, data, size,
+                              &cost, &transparency);
+    assert(!tile);
+}
+
+TEST_REGISTER(NULL, test_geojson_query, TEST_AUTO);
+TEST_REGISTER(NULL, test_bin_tile, TEST_AUTO);
+TEST_REGISTER(NULL, test_filter_batch, TEST_AUTO);
+TEST_REGISTER(NULL, bench_geojson_query, 0);
+
+#endif
+
 /*
  * Meta class declarations.
  */
@@ -804,6 +1718,7 @@ static obj_klass_t image_klass = {
         PROPERTY(data, TYPE_JSON, .fn = data_fn),
         PROPERTY(frame, TYPE_ENUM, MEMBER(image_t, frame)),
         PROPERTY(filter, TYPE_FUNC, .fn = filter_fn),
+        PROPERTY(filter_batch, TYPE_FUNC, .fn = filter_batch_fn),
         PROPERTY(z, TYPE_FLOAT, MEMBER(image_t, z)),
         {}
     },
@@ -817,6 +1732,7 @@ static obj_klass_t survey_klass = {
     .render         = survey_render,
     .attributes = (attribute_t[]) {
         PROPERTY(filter, TYPE_FUNC, .fn = survey_filter_fn),
+        PROPERTY(filter_batch, TYPE_FUNC, .fn = survey_filter_batch_fn),
         PROPERTY(z, TYPE_FLOAT, MEMBER(survey_t, z)),
         {}
     },
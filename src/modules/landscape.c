@@ -154,6 +154,9 @@ static int landscape_render(obj_t *obj, const painter_t *painter_)
 
     // Don't hide below horizon when we draw the horizon!
     painter.flags &= ~PAINTER_HIDE_BELOW_HORIZON;
+    // The landscape and fog tiles never move in the observed frame, so we
+    // can keep their buffers in GPU memory.
+    painter.flags |= PAINTER_STATIC;
 
     render_fog(&painter, lss->fog_visible.value);
 
@@ -155,6 +155,47 @@ struct lines {
     bool        visible;
 };
 
+typedef struct {
+    char        text[32];
+    double      pos[2];
+    double      angle;
+} line_label_t;
+
+/*
+ * Type: geometry_t
+ * The tesselated lines and labels of a line, in view and window
+ * coordinates, kept from one frame to the next.
+ *
+ * The geometry is only computed again when the projection changes, or
+ * when the rotation from the line frame to the view moved the points by
+ * more than MAX_ERROR pixels.  So for example the azimuthal grid is
+ * never recomputed as long as we don't move, and the equatorial grid is
+ * only recomputed every few seconds when the time runs.
+ */
+typedef struct {
+    bool            valid;
+    double          rot[3][3];  // Line frame to view rotation.
+    projection_t    proj;
+    double          refa;       // Refraction constants.
+    double          refb;
+
+    int             nb_points;
+    int             points_allocated;
+    double          (*pos)[3];
+    double          (*win)[3];
+
+    int             nb_lines;
+    int             lines_allocated;
+    int             *sizes;     // Number of points of each polyline.
+
+    int             nb_labels;
+    int             labels_allocated;
+    line_label_t    *labels;
+} geometry_t;
+
+// Max error in pixels we accept when we reuse the geometry.
+static const double MAX_ERROR = 0.25;
+
 typedef struct line line_t;
 struct line {
     obj_t           obj;
@@ -164,6 +205,7 @@ struct line {
     const char      *name;
     bool            grid;       // If true render the whole grid.
     double          color[4];
+    geometry_t      geometry;
 };
 
 static void hex_to_rgba(uint32_t v, double rgba[4])
@@ -336,6 +378,125 @@ static void spherical_project(
     mat3_mul_vec3(*rot, out, out);
 }
 
+static void geometry_add_line(void *user, const double (*pos)[3],
+                              const double (*win)[3], int size)
+{
+    geometry_t *geom = user;
+    int n = geom->nb_points + size;
+
+    if (size <= 1) return;
+    if (n > geom->points_allocated) {
+        geom->points_allocated = fmax(n, geom->points_allocated * 2);
+        geom->pos = realloc(geom->pos,
+                            geom->points_allocated * sizeof(*geom->pos));
+        geom->win = realloc(geom->win,
+                            geom->points_allocated * sizeof(*geom->win));
+    }
+    if (geom->nb_lines >= geom->lines_allocated) {
+        geom->lines_allocated = geom->lines_allocated * 2 ?: 64;
+        geom->sizes = realloc(geom->sizes,
+                              geom->lines_allocated * sizeof(*geom->sizes));
+    }
+    memcpy(geom->pos + geom->nb_points, pos, size * sizeof(*pos));
+    memcpy(geom->win + geom->nb_points, win, size * sizeof(*win));
+    geom->sizes[geom->nb_lines++] = size;
+    geom->nb_points = n;
+}
+
+static void geometry_add_label(geometry_t *geom, const char *text,
+                               const double pos[2], double angle)
+{
+    line_label_t *label;
+    if (geom->nb_labels >= geom->labels_allocated) {
+        geom->labels_allocated = geom->labels_allocated * 2 ?: 16;
+        geom->labels = realloc(geom->labels,
+                               geom->labels_allocated * sizeof(*label));
+    }
+    label = &geom->labels[geom->nb_labels++];
+    snprintf(label->text, sizeof(label->text), "%s", text);
+    vec2_copy(pos, label->pos);
+    label->angle = angle;
+}
+
+// Compute the rotation from a frame to the view frame.
+static void get_frame_rot(const observer_t *obs, int frame, double rot[3][3])
+{
+    int i;
+    for (i = 0; i < 3; i++) {
+        vec3_set(rot[i], i == 0, i == 1, i == 2);
+        convert_frame(obs, frame, FRAME_VIEW, true, rot[i], rot[i]);
+    }
+}
+
+static bool proj_equal(const projection_t *a, const projection_t *b)
+{
+    return a->klass == b->klass && a->fovy == b->fovy &&
+           a->flags == b->flags &&
+           memcmp(a->mat, b->mat, sizeof(a->mat)) == 0 &&
+           memcmp(a->window_size, b->window_size,
+                  sizeof(a->window_size)) == 0;
+}
+
+/*
+ * Check if we can still use the geometry, and if not reset it with the
+ * new view values.
+ */
+static bool geometry_update(geometry_t *geom, const painter_t *painter,
+                            int frame)
+{
+    double rot[3][3], err = 0;
+    const projection_t *proj = painter->proj;
+    int i;
+
+    get_frame_rot(painter->obs, frame, rot);
+    // Estimated max distance in pixels a point moved.  The factor 2 is
+    // for the projections that stretch the borders of the screen.
+    for (i = 0; i < 3; i++)
+        err = fmax(err, vec3_dist(rot[i], geom->rot[i]));
+    err *= 2 * proj->window_size[1] / proj->fovy;
+
+    if (    geom->valid && err < MAX_ERROR &&
+            proj_equal(proj, &geom->proj) &&
+            geom->refa == painter->obs->refa &&
+            geom->refb == painter->obs->refb)
+        return true;
+
+    memcpy(geom->rot, rot, sizeof(rot));
+    geom->proj = *proj;
+    geom->refa = painter->obs->refa;
+    geom->refb = painter->obs->refb;
+    geom->nb_points = 0;
+    geom->nb_lines = 0;
+    geom->nb_labels = 0;
+    geom->valid = true;
+    return false;
+}
+
+static void geometry_render(const geometry_t *geom, const line_t *line,
+                            const painter_t *painter_)
+{
+    int i, ofs = 0;
+    painter_t painter = *painter_;
+    const double text_size = 12;
+
+    for (i = 0; i < geom->nb_lines; i++) {
+        paint_tesselated_line(&painter, geom->sizes[i],
+                              (const double (*)[3])geom->pos + ofs,
+                              (const double (*)[3])geom->win + ofs);
+        ofs += geom->sizes[i];
+    }
+
+    painter.color[3] = line->visible.value;
+    // Hints the renderer that we can move the labels after the lines to
+    // optimize batching.
+    painter.flags |= PAINTER_ALLOW_REORDER;
+    for (i = 0; i < geom->nb_labels; i++) {
+        paint_text(&painter, geom->labels[i].text, geom->labels[i].pos, NULL,
+                   ALIGN_CENTER | ALIGN_MIDDLE, 0, text_size,
+                   geom->labels[i].angle);
+    }
+}
+
 /*
  * Function: render_label
  * Render the border label
@@ -348,7 +509,7 @@ static void spherical_project(
  */
 static void render_label(const double p[2], const double u[2],
                          const double v[2], const double uv[2],
-                         int dir, const line_t *line, int step,
+                         int dir, line_t *line, int step,
                          const painter_t *painter_)
 {
     char buf[32];
@@ -361,13 +522,8 @@ static void render_label(const double p[2], const double u[2],
     const double text_size = 12;
     painter_t painter = *painter_;
 
-    painter.color[3] = line->visible.value;
-
     // Give up if angle with screen is too acute.
     if (fabs(vec2_dot(u, v)) < 0.25) return;
-    // Hints the renderer that we can move the labels after the lines to
-    // optimize batching.
-    painter.flags |= PAINTER_ALLOW_REORDER;
 
     vec2_copy(u, n);
     if (vec2_dot(n, v) < 0) {
@@ -433,8 +589,7 @@ static void render_label(const double p[2], const double u[2],
     pos[0] += n3[0] * size[1] / 2;
     pos[1] += n3[1] * size[1] / 2;
 
-    paint_text(&painter, buf, pos, NULL, ALIGN_CENTER | ALIGN_MIDDLE, 0,
-               text_size, label_angle);
+    geometry_add_label(&line->geometry, buf, pos, label_angle);
 }
 
 /*
@@ -448,7 +603,7 @@ static void render_label(const double p[2], const double u[2],
  *   steps      - The target steps for the line rendering.
  */
 static void render_recursion(
-        const line_t *line, const painter_t *painter,
+        line_t *line, const painter_t *painter,
         const double rot[3][3],
         int level,
         const int splits[2],
@@ -516,7 +671,8 @@ static void render_recursion(
                 (uv_i[1] == 0 || uv_i[1] == splits[1] - 1))
             continue;
 
-        paint_line(painter, line->frame, lines + dir * 2, &map, 8, 0);
+        paint_line_tesselate(painter, line->frame, lines + dir * 2, &map,
+                             8, 0, &line->geometry, geometry_add_line);
         if (!line->format) continue;
         if (get_line_screen_intersection(
                     painter, line->frame, lines + dir * 2, &map, p, u, v)) {
@@ -663,7 +819,7 @@ static void antimeridian_map(const uv_map_t *uv,
 
 
 // Render the projection boundary.
-static int render_boundary(const painter_t *painter)
+static int render_boundary(line_t *line, const painter_t *painter)
 {
     const uv_map_t map = { .map = antimeridian_map };
     double lines[4][4] = {
@@ -672,15 +828,17 @@ static int render_boundary(const painter_t *painter)
     };
     if (!(painter->proj->flags & PROJ_HAS_DISCONTINUITY))
         return 0;
-    paint_line(painter, FRAME_VIEW, lines + 0, &map, 64, 0);
-    paint_line(painter, FRAME_VIEW, lines + 2, &map, 64, 0);
+    paint_line_tesselate(painter, FRAME_VIEW, lines + 0, &map, 64, 0,
+                         &line->geometry, geometry_add_line);
+    paint_line_tesselate(painter, FRAME_VIEW, lines + 2, &map, 64, 0,
+                         &line->geometry, geometry_add_line);
     return 0;
 }
 
 
 static int line_render(obj_t *obj, const painter_t *painter_)
 {
-    const line_t *line = (const line_t*)obj;
+    line_t *line = (line_t*)obj;
     double rot[3][3] = MAT3_IDENTITY;
     const step_t *steps[2];
     int splits[2] = {1, 1};
@@ -698,9 +856,14 @@ static int line_render(obj_t *obj, const painter_t *painter_)
     vec4_copy(line->color, painter.color);
     painter.color[3] *= line->visible.value;
 
+    // Reuse the geometry of the previous frames if possible.
+    if (geometry_update(&line->geometry, &painter, line->frame))
+        goto end;
+
     // The boundary line has its own code.
     if (strcmp(line->obj.id, "boundary") == 0) {
-        return render_boundary(&painter);
+        render_boundary(line, &painter);
+        goto end;
     }
 
     // Compute the number of divisions of the grid.
@@ -714,9 +877,21 @@ static int line_render(obj_t *obj, const painter_t *painter_)
     }
 
     render_recursion(line, &painter, rot, 0, splits, pos, steps, skip_half);
+
+end:
+    geometry_render(&line->geometry, line, &painter);
     return 0;
 }
 
+static void line_del(obj_t *obj)
+{
+    line_t *line = (line_t*)obj;
+    free(line->geometry.pos);
+    free(line->geometry.win);
+    free(line->geometry.sizes);
+    free(line->geometry.labels);
+}
+
 
 /*
  * Meta class declarations.
@@ -728,6 +903,7 @@ static obj_klass_t line_klass = {
     .flags = OBJ_IN_JSON_TREE,
     .update = line_update,
     .render = line_render,
+    .del = line_del,
     .attributes = (attribute_t[]) {
         PROPERTY(visible, TYPE_BOOL, MEMBER(line_t, visible.target)),
         PROPERTY(color, TYPE_V4, MEMBER(line_t, color)),
@@ -9,7 +9,10 @@
 
 #include "swe.h"
 #include "mpc.h"
+#include "data_parser.h"
 #include "designation.h"
+#include "name_index.h"
+#include "sweep.h"
 #include <zlib.h> // For crc32.
 
 // J2000 ecliptic to ICRF rotation matrix.
@@ -20,6 +23,9 @@ static const double ECLIPTIC_ROT[3][3] = {
     {-0.000000102070, -0.397776999444, 0.917482129915},
 };
 
+// Gaussian gravitational constant (AU^(3/2)/day).
+#define GAUSS_K 0.01720209895
+
 // Minor planets module
 
 typedef struct orbit_t {
@@ -48,6 +54,7 @@ struct mplanet {
     int         mpl_number; // Minor planet number if one has been assigned.
     char        model[64];  // Model name. e.g: '1_Ceres'
     bool        no_model;
+    int         idx;        // Index in the module orbits store, or -1.
 
     // Cached values.
     float       vmag;
@@ -57,6 +64,46 @@ struct mplanet {
     mplanet_t   *visible_next, *visible_prev;
 };
 
+/*
+ * Type: orbits_store_t
+ * Columnar storage of all the minor planets parsed from the MPC data.
+ *
+ * With the full MPCORB file we have more than a million bodies, so we
+ * don't create a mplanet_t object for each of them.  Instead the orbits are
+ * stored in contiguous arrays, and the objects are only created on demand
+ * (see <mplanets_get>), when they get rendered, listed or searched.
+ *
+ * Attributes:
+ *   d, i, o, w, a, n, e, m - The orbit elements, see orbit_t.
+ *   h, g       - Absolute magnitude and slope parameter.
+ *   number     - Minor planet number, zero if not assigned.
+ *   otype      - Index of the orbit type in ORBIT_TYPES.
+ *   name       - Offset of the name in the pool plus one, or zero.
+ *   desig      - Offset of the designation in the pool plus one, or zero.
+ *   objs       - The objects created so far, NULL if not created.
+ *   pool       - String pool for the names and designations.
+ */
+typedef struct {
+    int         nb;
+    int         allocated;
+    float       *d, *i, *o, *w, *a, *n, *e, *m;
+    float       *h, *g;
+    int         *number;
+    uint8_t     *otype;
+    int         *name;
+    int         *desig;
+    mplanet_t   **objs;
+    char        *pool;
+    int         pool_size;
+    int         pool_allocated;
+} orbits_store_t;
+
+// Number of one magnitude buckets used to sort the sweep snapshot planets,
+// starting at magnitude MAG_MIN.  The last one also gets all the fainter
+// planets.
+#define MAG_BUCKETS 32
+#define MAG_MIN -2
+
 /*
  * Type: mplanets_t
  * Minor planets module object
@@ -65,17 +112,33 @@ typedef struct mplanets {
     obj_t   obj;
     char    *source_url;
     bool    parsed; // Set to true once the data has been parsed.
+    // State of the incremental parsing of the source data.
+    struct {
+        data_parser_t input;
+        int         nb_err;
+        int         nb;
+    } parser;
     bool    visible;
     double hints_mag_offset; // Hints/labels magnitude offset
     bool   hints_visible;
 
-    mplanet_t *render_current;
+    orbits_store_t store;
+    int render_current; // Index in the store of the next planet to check.
+    sweep_t sweep;      // Positions and magnitudes of all the store planets.
+    // Indices of the sweep snapshot planets sorted by magnitude buckets,
+    // so that we only check the bright ones when rendering.
+    struct {
+        int     *idx;
+        int     start[MAG_BUCKETS + 1];
+    } mag_index;
     mplanet_t *visibles; // Linked list of currently visible minor planets.
 } mplanets_t;
 
 // Static instance.
 static mplanets_t *g_mplanets = NULL;
 
+static obj_klass_t mplanet_klass;
+
 static double mean3(double x, double y, double z)
 {
     return (x + y + z) / 3;
@@ -118,58 +181,186 @@ static const char *ORBIT_TYPES[] = {
 };
 
 
-static void load_data(mplanets_t *mplanets, const char *data, int size)
+// Add a string to the store pool, return its offset plus one, or zero for
+// empty strings.
+static int store_add_str(orbits_store_t *store, const char *str)
 {
-    const char *line = NULL;
-    int r, len, line_idx = 0, flags, orbit_type, number, nb_err, nb;
+    int len = strlen(str) + 1, ret;
+    if (len == 1) return 0;
+    if (store->pool_size + len > store->pool_allocated) {
+        store->pool_allocated = (store->pool_allocated + len) * 2;
+        store->pool = realloc(store->pool, store->pool_allocated);
+    }
+    memcpy(store->pool + store->pool_size, str, len);
+    ret = store->pool_size + 1;
+    store->pool_size += len;
+    return ret;
+}
+
+// Add a new entry in the store, return its index.
+static int store_add(orbits_store_t *store)
+{
+    int n;
+    if (store->nb == store->allocated) {
+        n = store->allocated = store->allocated ? store->allocated * 2 : 4096;
+#define GROW(p) p = realloc(p, n * sizeof(*p))
+        GROW(store->d); GROW(store->i); GROW(store->o); GROW(store->w);
+        GROW(store->a); GROW(store->n); GROW(store->e); GROW(store->m);
+        GROW(store->h); GROW(store->g); GROW(store->number);
+        GROW(store->otype); GROW(store->name); GROW(store->desig);
+        GROW(store->objs);
+#undef GROW
+    }
+    store->objs[store->nb] = NULL;
+    return store->nb++;
+}
+
+static void store_release(orbits_store_t *store)
+{
+    free(store->d); free(store->i); free(store->o); free(store->w);
+    free(store->a); free(store->n); free(store->e); free(store->m);
+    free(store->h); free(store->g); free(store->number);
+    free(store->otype); free(store->name); free(store->desig);
+    free(store->objs);
+    free(store->pool);
+    memset(store, 0, sizeof(*store));
+}
+
+// Memory used by the store, not counting the created objects.
+static size_t store_get_memory(const orbits_store_t *store)
+{
+    return store->allocated * (10 * sizeof(float) + sizeof(int) * 3 +
+                               sizeof(uint8_t) + sizeof(mplanet_t*)) +
+           store->pool_allocated;
+}
+
+static void store_get_elements(const orbits_store_t *store, int idx,
+                               orbit_elements_t *out)
+{
+    *out = (orbit_elements_t) {
+        .d = store->d[idx], .i = store->i[idx], .o = store->o[idx],
+        .w = store->w[idx], .q = store->a[idx] * (1.0 - store->e[idx]),
+        .e = store->e[idx], .n = store->n[idx], .ma = store->m[idx],
+    };
+}
+
+/*
+ * Set a minor planet object values from a store entry.
+ */
+static void mplanet_load(mplanet_t *mp, const orbits_store_t *store, int idx)
+{
+    mp->idx = idx;
+    mp->orbit = (orbit_t) {
+        .d = store->d[idx], .i = store->i[idx], .o = store->o[idx],
+        .w = store->w[idx], .a = store->a[idx], .n = store->n[idx],
+        .e = store->e[idx], .m = store->m[idx],
+    };
+    mp->h = store->h[idx];
+    mp->g = store->g[idx];
+    mp->mpl_number = store->number[idx];
+    strncpy(mp->obj.type, ORBIT_TYPES[store->otype[idx]], 4);
+    mp->name[0] = mp->desig[0] = mp->model[0] = '\0';
+    mp->no_model = false;
+    if (store->name[idx]) {
+        snprintf(mp->name, sizeof(mp->name), "%s",
+                 store->pool + store->name[idx] - 1);
+        snprintf(mp->model, sizeof(mp->model), "%d_%s",
+                 mp->mpl_number, mp->name);
+    }
+    if (store->desig[idx]) {
+        snprintf(mp->desig, sizeof(mp->desig), "%s",
+                 store->pool + store->desig[idx] - 1);
+    }
+}
+
+/*
+ * Function: mplanets_get
+ * Return the object of a given minor planet in the store.
+ *
+ * The object is created the first time we need it, and then stays in the
+ * module children.
+ */
+static mplanet_t *mplanets_get(mplanets_t *mps, int idx)
+{
+    mplanet_t *mp;
+    assert(idx >= 0 && idx < mps->store.nb);
+    if (mps->store.objs[idx]) return mps->store.objs[idx];
+    mp = (void*)module_add_new(&mps->obj, "asteroid", NULL);
+    mplanet_load(mp, &mps->store, idx);
+    mps->store.objs[idx] = mp;
+    return mp;
+}
+
+/*
+ * Parse the MPC data, resuming from the last call.
+ *
+ * We only spend a few milliseconds per call, so that the full
+ * MPCORB file doesn't freeze the rendering.  The bodies get added to the
+ * module as soon as they are parsed.
+ *
+ * Return true once all the data has been parsed.
+ */
+static bool load_data(mplanets_t *mplanets, const char *data, int size)
+{
+    int r, flags, orbit_type, number, idx;
     char desig[24], name[24];
     double h, g, m, w, o, i, e, n, a, epoch;
-    mplanet_t *mplanet;
-    obj_t *tmp;
-
-    line_idx = 0;
-    nb_err = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        if (len < 160) continue;
-        r = mpc_parse_line(line, len, &number, name, desig,
+    orbits_store_t *store = &mplanets->store;
+    mplanet_t mp = {.obj.klass = &mplanet_klass};
+    typeof(mplanets->parser) *p = &mplanets->parser;
+
+    data_parser_start(&p->input);
+    while (data_parser_next_line(&p->input, data, size)) {
+        if (p->input.len < 160) continue;
+        r = mpc_parse_line(p->input.line, p->input.len, &number, name, desig,
                            &h, &g, &epoch, &m, &w, &o, &i, &e,
                            &n, &a, &flags);
         if (r) {
-            nb_err++;
+            p->nb_err++;
             continue;
         }
-        mplanet = (void*)module_add_new(&mplanets->obj, "asteroid", NULL);
-        mplanet->orbit.d = epoch;
-        mplanet->orbit.m = m * DD2R;
-        mplanet->orbit.w = w * DD2R;
-        mplanet->orbit.o = o * DD2R;
-        mplanet->orbit.i = i * DD2R;
-        mplanet->orbit.e = e;
-        mplanet->orbit.n = n * DD2R;
-        mplanet->orbit.a = a;
-        mplanet->h = h;
-        mplanet->g = g;
-
+        idx = store_add(store);
+        store->d[idx] = epoch;
+        store->m[idx] = m * DD2R;
+        store->w[idx] = w * DD2R;
+        store->o[idx] = o * DD2R;
+        store->i[idx] = i * DD2R;
+        store->e[idx] = e;
+        store->n[idx] = n * DD2R;
+        store->a[idx] = a;
+        store->h[idx] = h;
+        store->g[idx] = g;
         orbit_type = flags & 0x3f;
-        strncpy(mplanet->obj.type, ORBIT_TYPES[orbit_type], 4);
-        mplanet->mpl_number = number;
-        if (name[0]) {
-            _Static_assert(sizeof(name) == sizeof(mplanet->name), "");
-            memcpy(mplanet->name, name, sizeof(name));
-            snprintf(mplanet->model, sizeof(mplanet->model), "%d_%s",
-                     mplanet->mpl_number, mplanet->name);
-        }
-        if (desig[0]) {
-            _Static_assert(sizeof(desig) == sizeof(mplanet->desig), "");
-            memcpy(mplanet->desig, desig, sizeof(desig));
-        }
+        store->otype[idx] = orbit_type < ARRAY_SIZE(ORBIT_TYPES) ?
+                            orbit_type : 0;
+        store->number[idx] = number;
+        store->name[idx] = store_add_str(store, name);
+        store->desig[idx] = store_add_str(store, desig);
+        // Index the designations, using the store index + 1 as hint.
+        mplanet_load(&mp, store, idx);
+        name_index_add_obj(&mplanets->obj, &mp.obj, idx + 1);
+        p->nb++;
     }
-    if (nb_err) {
-        LOG_W("Minor planet data got %d errors lines.", nb_err);
+    if (!p->input.done) return false;
+    if (p->nb_err) {
+        LOG_W("Minor planet data got %d errors lines.", p->nb_err);
     }
-    DL_COUNT(mplanets->obj.children, tmp, nb);
-    LOG_I("Parsed %d asteroids", nb);
+    LOG_I("Parsed %d asteroids (%d KB)", p->nb,
+          (int)(store_get_memory(store) / 1024));
+    return true;
+}
+
+static void mplanets_del(obj_t *obj)
+{
+    mplanets_t *mps = (void*)obj;
+    // We keep the asset alive until we are done with the parsing.
+    if (!mps->parsed && mps->source_url) asset_release(mps->source_url);
+    data_parser_release(&mps->parser.input);
+    sweep_release(&mps->sweep);
+    free(mps->mag_index.idx);
+    store_release(&mps->store);
+    free(mps->source_url);
+    if (g_mplanets == mps) g_mplanets = NULL;
 }
 
 static int mplanets_add_data_source(
@@ -188,6 +379,7 @@ static int mplanet_init(obj_t *obj, json_value *args)
     orbit_t *orbit = &mp->orbit;
     json_value *model, *names;
     int num = -1;
+    mp->idx = -1;
     model = json_get_attr(args, "model_data", json_object);
     if (model) {
         mp->h = json_get_attr_f(model, "H", 0);
@@ -215,14 +407,22 @@ static int mplanet_init(obj_t *obj, json_value *args)
     return 0;
 }
 
-static int mplanet_update(mplanet_t *mp, const observer_t *obs)
+static void orbit_get_elements(const orbit_t *orbit, orbit_elements_t *out)
 {
-    double pvh[2][3], pvo[2][3];
+    *out = (orbit_elements_t) {
+        .d = orbit->d, .i = orbit->i, .o = orbit->o, .w = orbit->w,
+        .q = orbit->a * (1.0 - orbit->e), .e = orbit->e,
+        .n = orbit->n, .ma = orbit->m,
+    };
+}
+
+// Set the planet position and magnitude from its heliocentric position
+// and speed in the ecliptic frame.
+static void mplanet_set_pvh(mplanet_t *mp, const observer_t *obs,
+                            double pvh[2][3])
+{
+    double pvo[2][3];
 
-    orbit_compute_pv(0, obs->tt, pvh[0], pvh[1],
-            mp->orbit.d, mp->orbit.i, mp->orbit.o, mp->orbit.w,
-            mp->orbit.a, mp->orbit.n, mp->orbit.e, mp->orbit.m,
-            0, 0);
     mat3_mul_vec3(ECLIPTIC_ROT, pvh[0], pvh[0]);
     mat3_mul_vec3(ECLIPTIC_ROT, pvh[1], pvh[1]);
     position_to_apparent(obs, ORIGIN_HELIOCENTRIC, false, pvh, pvo);
@@ -234,6 +434,16 @@ static int mplanet_update(mplanet_t *mp, const observer_t *obs)
     // Compute vmag using algo from
     // http://www.britastro.org/asteroids/dymock4.pdf
     mp->vmag = compute_magnitude(mp->h, mp->g, pvh[0], pvo[0]);
+}
+
+static int mplanet_update(mplanet_t *mp, const observer_t *obs)
+{
+    double pvh[2][3];
+    orbit_elements_t elems;
+
+    orbit_get_elements(&mp->orbit, &elems);
+    orbit_compute_pv_batch(obs->tt, GAUSS_K, 1, &elems, &pvh[0], &pvh[1]);
+    mplanet_set_pvh(mp, obs, pvh);
     return 0;
 }
 
@@ -311,7 +521,7 @@ static int mplanet_render(obj_t *obj, const painter_t *painter)
         return 0;
 
     painter_project(painter, FRAME_ICRF, pvo[0], false, false, win_pos);
-    core_get_point_for_mag(vmag, &size, &luminance);
+    point_lut_get(painter->point_lut, vmag, &size, &luminance);
 
     // Max possible model radius (using Ceres radius).
     max_radius = core_get_point_for_apparent_angle(painter->proj,
@@ -393,16 +603,85 @@ static json_value *mplanet_get_json_data(const obj_t *obj)
     return ret;
 }
 
+/*
+ * Compute the positions and magnitudes of the store planets [start, end)
+ * for the sweep.  This can run in several threads at the same time.
+ */
+static void mplanets_sweep_compute(const sweep_t *sweep,
+                                   const observer_t *obs, int start, int end,
+                                   float (*pos)[3], float *vmag)
+{
+    const mplanets_t *mps = sweep->user;
+    const orbits_store_t *store = &mps->store;
+    enum { batch_size = 64 };
+    orbit_elements_t elems[batch_size];
+    double p[batch_size][3], v[batch_size][3], pvh[2][3];
+    mplanet_t mp;
+    int i, j, nb;
+
+    for (i = start; i < end; i += nb) {
+        nb = end - i < batch_size ? end - i : batch_size;
+        for (j = 0; j < nb; j++)
+            store_get_elements(store, i + j, &elems[j]);
+        orbit_compute_pv_batch(obs->tt, GAUSS_K, nb, elems, p, v);
+        for (j = 0; j < nb; j++) {
+            vec3_copy(p[j], pvh[0]);
+            vec3_copy(v[j], pvh[1]);
+            mp.h = store->h[i + j];
+            mp.g = store->g[i + j];
+            mplanet_set_pvh(&mp, obs, pvh);
+            vec3_copy(mp.pvo[0], pos[i + j]);
+            vmag[i + j] = mp.vmag;
+        }
+    }
+}
+
 static int mplanets_init(obj_t *obj, json_value *args)
 {
     mplanets_t *mps = (void*)obj;
     assert(!g_mplanets);
     g_mplanets = mps;
+    name_index_add_module(obj);
     mps->visible = true;
     mps->hints_visible = true;
+    mps->sweep.compute = mplanets_sweep_compute;
+    mps->sweep.user = mps;
+    mps->sweep.max_dt = 1.0 / 24;
     return 0;
 }
 
+static int mag_bucket(float vmag)
+{
+    if (!(vmag < MAG_MIN + MAG_BUCKETS - 1)) return MAG_BUCKETS - 1; // NaN.
+    if (vmag < MAG_MIN) return 0;
+    return (int)floor(vmag) - MAG_MIN;
+}
+
+// Sort the indices of the new sweep snapshot planets by magnitude buckets.
+static void mag_index_update(mplanets_t *mps, const sweep_snapshot_t *snap)
+{
+    int i, b, *start = mps->mag_index.start;
+    int count[MAG_BUCKETS] = {0};
+
+    mps->mag_index.idx = realloc(mps->mag_index.idx,
+                                 snap->nb * sizeof(*mps->mag_index.idx));
+    for (i = 0; i < snap->nb; i++)
+        count[mag_bucket(snap->vmag[i])]++;
+    start[0] = 0;
+    for (b = 0; b < MAG_BUCKETS; b++)
+        start[b + 1] = start[b] + count[b];
+    memcpy(count, start, sizeof(count));
+    for (i = 0; i < snap->nb; i++)
+        mps->mag_index.idx[count[mag_bucket(snap->vmag[i])]++] = i;
+}
+
+// Return the last sweep snapshot if it matches the store.
+static const sweep_snapshot_t *mplanets_get_snapshot(const mplanets_t *mps)
+{
+    const sweep_snapshot_t *snap = sweep_get(&mps->sweep);
+    return (snap && snap->nb == mps->store.nb) ? snap : NULL;
+}
+
 static int mplanets_update(obj_t *obj, double dt)
 {
     int size, code;
@@ -412,13 +691,23 @@ static int mplanets_update(obj_t *obj, double dt)
     if (!mps->parsed && mps->source_url) {
         data = asset_get_data(mps->source_url, &size, &code);
         if (!code) return 0; // Still loading.
-        mps->parsed = true;
         if (!data) {
             LOG_W("Cannot read asteroids data: %s (%d)", mps->source_url, code);
+            mps->parsed = true;
             return 0;
         }
-        load_data(mps, data, size);
-        asset_release(mps->source_url);
+        // We keep the asset alive until we are done with the parsing.
+        mps->parsed = load_data(mps, data, size);
+        progressbar_report(mps->source_url, "Minor Planets",
+                           mps->parsed ? size :
+                                         mps->parser.input.line - data,
+                           size, -1);
+        if (mps->parsed) asset_release(mps->source_url);
+    }
+    // The store doesn't change anymore once parsed, so we can sweep it.
+    if (mps->parsed &&
+            sweep_update(&mps->sweep, core->observer, mps->store.nb)) {
+        mag_index_update(mps, sweep_get(&mps->sweep));
     }
     return 0;
 }
@@ -429,12 +718,62 @@ static void add_to_visible(mplanets_t *mps, mplanet_t *mplanet)
     DL_APPEND2(mps->visibles, mplanet, visible_prev, visible_next);
 }
 
+// Quick test to reject the minor planets that are too faint or not on
+// screen, before we create their objects.  The margin (rad) accounts for
+// the planet motion since the position was computed.
+static bool is_rejected(const double pos[3], double vmag, double margin,
+                        const painter_t *painter)
+{
+    double cap[4];
+    if (vmag > painter->stars_limit_mag + 1.4 + g_mplanets->hints_mag_offset)
+        return true;
+    vec3_normalize(pos, cap);
+    cap[3] = cos(margin);
+    return painter_is_cap_clipped(painter, FRAME_ICRF, cap);
+}
+
+static bool mplanet_is_rejected(const mplanet_t *mp, const painter_t *painter)
+{
+    return is_rejected(mp->pvo[0], mp->vmag, 1. / 60 * DD2R, painter);
+}
+
+// Render the store planets using the last sweep snapshot to skip the ones
+// that are not visible.
+static void render_from_snapshot(mplanets_t *mps,
+                                 const sweep_snapshot_t *snap,
+                                 const painter_t *painter)
+{
+    int i, j, r, last;
+    double pos[3], max_mag;
+    mplanet_t *child;
+
+    // Only check the buckets that can contain visible planets.
+    max_mag = painter->stars_limit_mag + 1.4 + mps->hints_mag_offset;
+    last = mag_bucket(max_mag);
+    for (j = 0; j < mps->mag_index.start[last + 1]; j++) {
+        i = mps->mag_index.idx[j];
+        if (snap->vmag[i] > max_mag) continue;
+        child = mps->store.objs[i];
+        if (child && child->visible_prev) continue; // Already rendered.
+        vec3_copy(snap->pos[i], pos);
+        // One degree margin since the snapshot can be up to one hour old.
+        if (is_rejected(pos, snap->vmag[i], 1.0 * DD2R, painter)) continue;
+        child = mplanets_get(mps, i);
+        r = mplanet_render(&child->obj, painter);
+        if (r == 1) add_to_visible(mps, child);
+    }
+}
+
 static int mplanets_render(obj_t *obj, const painter_t *painter)
 {
     mplanets_t *mps = (void*)obj;
-    int i, r;
-    const int update_nb = 32;
-    mplanet_t *child, *tmp;
+    int i, r, idx, nb;
+    enum { update_nb = 32 };
+    int idxs[update_nb];
+    orbit_elements_t elems[update_nb];
+    double pvh[update_nb][2][3], pos[update_nb][3], speed[update_nb][3];
+    mplanet_t *child, *tmp, mp;
+    const sweep_snapshot_t *snap;
 
     if (!mps->visible) return 0;
 
@@ -454,15 +793,46 @@ static int mplanets_render(obj_t *obj, const painter_t *painter)
         }
     }
 
-    // Then iter part of the full list as well.
-    for (   i = 0, child = mps->render_current ?: (void*)mps->obj.children;
-            child && i < update_nb;
-            i++, child = (void*)child->obj.next) {
+    // If we have a sweep snapshot, we directly know which planets of the
+    // store might be visible.
+    snap = mplanets_get_snapshot(mps);
+    if (snap) render_from_snapshot(mps, snap, painter);
+
+    // Otherwise iter part of the full store.  The positions of the planets
+    // that don't have an object yet are computed in a single batch.
+    for (i = 0, nb = 0; !snap && i < update_nb && i < mps->store.nb; i++) {
+        idx = mps->render_current++ % mps->store.nb;
+        child = mps->store.objs[idx];
+        if (!child) {
+            idxs[nb] = idx;
+            store_get_elements(&mps->store, idx, &elems[nb++]);
+            continue;
+        }
         if (child->visible_prev) continue; // Was already rendered.
         r = mplanet_render(&child->obj, painter);
         if (r == 1) add_to_visible(mps, child);
     }
-    mps->render_current = child;
+    mps->render_current %= mps->store.nb ?: 1;
+
+    orbit_compute_pv_batch(painter->obs->tt, GAUSS_K, nb, elems, pos, speed);
+    for (i = 0; i < nb; i++) {
+        vec3_copy(pos[i], pvh[i][0]);
+        vec3_copy(speed[i], pvh[i][1]);
+        mplanet_load(&mp, &mps->store, idxs[i]);
+        mplanet_set_pvh(&mp, painter->obs, pvh[i]);
+        if (mplanet_is_rejected(&mp, painter)) continue;
+        child = mplanets_get(mps, idxs[i]);
+        r = mplanet_render(&child->obj, painter);
+        if (r == 1) add_to_visible(mps, child);
+    }
+
+    // Also the planets not coming from the store.
+    for (   child = (void*)mps->obj.children; child;
+            child = (void*)child->obj.next) {
+        if (child->idx != -1 || child->visible_prev) continue;
+        r = mplanet_render(&child->obj, painter);
+        if (r == 1) add_to_visible(mps, child);
+    }
 
     return 0;
 }
@@ -493,6 +863,51 @@ static bool mplanets_is_point_occulted(
     return false;
 }
 
+static int mplanets_list(const obj_t *obj,
+                         double max_mag, uint64_t hint, const char *source,
+                         void *user, int (*f)(void *user, obj_t *obj))
+{
+    mplanets_t *mps = (void*)obj;
+    mplanet_t *child, *tmp = NULL;
+    const sweep_snapshot_t *snap = mplanets_get_snapshot(mps);
+    int i, r, start = 0, end = mps->store.nb;
+
+    // The hint is the store index + 1 (see load_data).
+    if (hint) {
+        start = hint - 1;
+        end = (hint <= mps->store.nb) ? hint : start;
+    }
+
+    for (   child = (void*)mps->obj.children; child && !hint;
+            child = (void*)child->obj.next) {
+        if (child->idx != -1) continue;
+        if (f(user, &child->obj)) return 0;
+    }
+
+    // For the planets that don't have an object yet we use a temporary
+    // one, that we only keep if the callback retained it.
+    for (i = start; i < end; i++) {
+        // Use the sweep magnitudes to skip the faint planets.
+        if (snap && !isnan(max_mag) && snap->vmag[i] > max_mag) continue;
+        if (mps->store.objs[i]) {
+            if (f(user, &mps->store.objs[i]->obj)) break;
+            continue;
+        }
+        if (!tmp) tmp = (void*)obj_create("asteroid", NULL);
+        mplanet_load(tmp, &mps->store, i);
+        r = f(user, &tmp->obj);
+        if (tmp->obj.ref > 1) {
+            module_add(&mps->obj, &tmp->obj);
+            obj_release(&tmp->obj);
+            mps->store.objs[i] = tmp;
+            tmp = NULL;
+        }
+        if (r) break;
+    }
+    if (tmp) obj_release(&tmp->obj);
+    return 0;
+}
+
 /*
  * Meta class declarations.
  */
@@ -514,9 +929,11 @@ static obj_klass_t mplanets_klass = {
     .size           = sizeof(mplanets_t),
     .flags          = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE,
     .init           = mplanets_init,
+    .del            = mplanets_del,
     .add_data_source    = mplanets_add_data_source,
     .update         = mplanets_update,
     .render         = mplanets_render,
+    .list           = mplanets_list,
     .is_point_occulted = mplanets_is_point_occulted,
     .render_order   = 20,
     .attributes = (attribute_t[]) {
@@ -112,6 +112,7 @@ static int photo_render(obj_t *obj, const painter_t *painter)
 
     map.transf = &photo->mat;
     map.map = photo_map;
+    map.key = 1; // The map function doesn't depend on the photo.
 
     if (!photo->render_shape) {
         painter_set_texture(&painter2, PAINTER_TEX_COLOR, photo->img, NULL);
@@ -734,6 +734,7 @@ static void render_rings(const planet_t *planet,
     }
 
     map.user = radii;
+    map.key = crc32(0, (const void*)radii, sizeof(radii));
     painter.planet.light_emit = NULL;
     painter.flags &= ~PAINTER_PLANET_SHADER;
     painter.flags |= PAINTER_RING_SHADER;
@@ -883,7 +884,7 @@ static void planet_render_hips(const planet_t *planet,
     render_order = hips_get_render_order_planet(hips, &painter, mat);
     // For extrem low resolution force using the allsky if available so that
     // we don't download too much data.
-    if (render_order < -4 && hips->allsky.data)
+    if (render_order < -4 && hips->allsky.loaded)
         flags |= HIPS_FORCE_USE_ALLSKY;
 
     // Clamp the render order into physically possible range.
@@ -1209,7 +1210,7 @@ static void planet_render(const planet_t *planet, const painter_t *painter_)
     r_scale = get_artificial_scale(planets, planet);
     if (planet->id == MOON) model_k = 4.0;
 
-    core_get_point_for_mag(vmag, &point_size, &point_luminance);
+    point_lut_get(painter.point_lut, vmag, &point_size, &point_luminance);
     point_r = core_get_apparent_angle_for_point(painter.proj, point_size * 2.0);
 
     // Compute max radius of the planet, taking into account the
@@ -9,7 +9,10 @@
 
 #include "swe.h"
 #include "sgp4.h"
+#include "sweep.h"
+#include "data_parser.h"
 #include "designation.h"
+#include "name_index.h"
 
 #define SATELLITE_DEFAULT_MAG 7.0
 /*
@@ -37,6 +40,9 @@ struct satellite {
 
     bool error; // Set if we got an error computing the position.
     json_value *data; // Data passed in the constructor.
+    // Names from the binary catalogue, '\0' separated and ending with an
+    // empty string.  Only set if the satellite doesn't have json data.
+    const char *names;
     double max_brightness; // Cached max_brightness value.
 
     // Linked list of currently visible on screen.
@@ -46,8 +52,17 @@ struct satellite {
 // Module class.
 typedef struct satellites {
     obj_t   obj;
-    char    *jsonl_url;   // jsonl file in noctuasky server format.
+    // jsonl file in noctuasky server format, or binary catalogue.
+    char    *source_url;
+    bool    source_binary;
     bool    loaded;
+    // State of the incremental parsing of the data.
+    struct {
+        data_parser_t input; // Owns the uncompressed data.
+        int         nb;
+        double      last_epoch;
+    } parser;
+    char    *names_pool; // Names of the binary catalogue satellites.
     int     update_pos; // Index of the position for iterative update.
     bool    visible;
     double  hints_mag_offset;
@@ -55,6 +70,15 @@ typedef struct satellites {
 
     satellite_t *render_current;
     satellite_t *visibles; // Linked list of currently visible satellites.
+
+    // Positions and magnitudes of all the satellites, indexed as in
+    // sweep_objs.  We hold a reference to each satellite of sweep_objs, and
+    // rebuild it when the generation of the satellites list changes.
+    sweep_t     sweep;
+    satellite_t **sweep_objs;
+    int         sweep_nb;
+    int         sweep_generation;
+    int         generation; // Bumped each time we add or remove satellites.
 } satellites_t;
 
 // Static instance.
@@ -65,84 +89,264 @@ static double max3(double x, double y, double z)
     return fmax(x, fmax(y, z));
 }
 
+static void satellites_sweep_compute(const sweep_t *sweep,
+                                     const observer_t *obs,
+                                     int start, int end,
+                                     float (*pos)[3], float *vmag);
+
 static int satellites_init(obj_t *obj, json_value *args)
 {
     satellites_t *sats = (void*)obj;
     assert(!g_satellites);
     g_satellites = sats;
+    name_index_add_module(obj);
     sats->visible = true;
     sats->hints_visible = true;
+    sats->sweep.compute = satellites_sweep_compute;
+    sats->sweep.user = sats;
+    // The satellites move fast, so we sweep every few seconds.
+    sats->sweep.max_dt = 5.0 / (24 * 60 * 60);
     return 0;
 }
 
+static void release_sweep_objs(satellites_t *sats)
+{
+    int i;
+    for (i = 0; i < sats->sweep_nb; i++)
+        obj_release(&sats->sweep_objs[i]->obj);
+    sats->sweep_nb = 0;
+}
+
+static void satellites_del(obj_t *obj)
+{
+    satellites_t *sats = (void*)obj;
+    // Release the partially parsed data if we didn't finish.
+    data_parser_release(&sats->parser.input);
+    sweep_release(&sats->sweep);
+    release_sweep_objs(sats);
+    free(sats->sweep_objs);
+    free(sats->source_url);
+    // The satellites pointing into the names pool are gone by now.
+    free(sats->names_pool);
+    if (g_satellites == sats) g_satellites = NULL;
+}
+
 static int satellites_add_data_source(
         obj_t *obj, const char *url, const char *key)
 {
     satellites_t *sats = (void*)obj;
-    if (strcmp(key, "jsonl/sat") != 0)
+    if (strcmp(key, "jsonl/sat") != 0 && strcmp(key, "bin/sat") != 0)
         return -1;
-    sats->jsonl_url = strdup(url);
+    sats->source_url = strdup(url);
+    sats->source_binary = strcmp(key, "bin/sat") == 0;
     return 0;
 }
 
-static int load_jsonl_data(satellites_t *sats, const char *data, int size,
-                           const char *url, double *last_epoch)
+/*
+ * Parse the uncompressed jsonl data, resuming from the last call.
+ * Return true once all the data has been parsed.
+ */
+static bool load_jsonl_data(satellites_t *sats, const char *url)
 {
-    const char *line = NULL;
-    int len, line_idx = 0, nb = 0;
-    char *uncompressed_data;
     json_value *json;
     satellite_t *sat;
+    typeof(sats->parser) *p = &sats->parser;
 
-    // XXX: should use a more robust gz uncompression function for external
-    // data.
-    uncompressed_data = z_uncompress_gz(data, size, &size);
-    if (!uncompressed_data) {
-        LOG_E("Cannot uncompress gz file: %s", url);
-        return -1;
-    }
-
-    data = uncompressed_data;
-
-    *last_epoch = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        json = json_parse(line, len);
+    data_parser_start(&p->input);
+    while (data_parser_next_line(&p->input, p->input.data, p->input.size)) {
+        json = json_parse(p->input.line, p->input.len);
         if (!json) goto error;
         sat = (void*)module_add_new(&sats->obj, "tle_satellite", json);
+        sats->generation++;
         json_value_free(json);
         if (!sat) goto error;
-        *last_epoch = fmax(*last_epoch, sgp4_get_satepoch(sat->elsetrec));
-        nb++;
+        name_index_add_obj(&sats->obj, &sat->obj, 0);
+        p->last_epoch = fmax(p->last_epoch,
+                             sgp4_get_satepoch(sat->elsetrec));
+        p->nb++;
         continue;
 error:
-        LOG_E("Cannot create sat from %s:%d", url, line_idx);
+        LOG_E("Cannot create sat from %s:%d", url, p->input.idx);
+    }
+    return p->input.done;
+}
+
+/*
+ * Binary satellites catalogue format, as created by
+ * tools/make-sat-catalog.py.
+ *
+ * All values are little endian.  The file starts with a header, followed
+ * by the fixed size records, and then the names pool.  The orbit elements
+ * are already parsed from the TLE and converted to the SGP4 units, so that
+ * we can directly initialize the SGP4 records.
+ */
+#define SAT_CATALOG_VERSION 1
+
+typedef struct {
+    char        magic[4]; // 'SATB'
+    uint32_t    version;
+    uint32_t    nb;
+    uint32_t    pool_size;
+} sat_catalog_header_t;
+
+typedef struct {
+    double      epoch[2]; // TLE epoch (JD split in two parts).
+    double      bstar, ndot, nddot, ecco, argpo, inclo, mo, no_kozai, nodeo;
+    double      launch_date; // UTC MJD, zero if unknown.
+    double      decay_date;  // UTC MJD, zero if unknown.
+    float       stdmag;      // NAN if unknown.
+    int32_t     number;      // NORAD number.
+    uint32_t    names;       // Offset of the names list in the pool.
+    uint32_t    types;       // Offset of the otypes list in the pool.
+} sat_catalog_record_t;
+
+static void satellite_load_record(satellite_t *sat,
+                                  const sat_catalog_record_t *rec,
+                                  const char *pool);
+
+/*
+ * Create the satellites from the binary catalogue data, resuming from the
+ * last call.  Return true once all the data has been parsed.
+ */
+static bool load_bin_data(satellites_t *sats, const char *url)
+{
+    sat_catalog_header_t header;
+    sat_catalog_record_t rec;
+    satellite_t *sat;
+    typeof(sats->parser) *p = &sats->parser;
+    const char *data = p->input.data;
+    int idx;
+
+    _Static_assert(sizeof(sat_catalog_header_t) == 16, "");
+    _Static_assert(sizeof(sat_catalog_record_t) == 120, "");
+    if (p->input.size < sizeof(header)) goto error;
+    memcpy(&header, data, sizeof(header));
+    if (    memcmp(header.magic, "SATB", 4) != 0 ||
+            header.version != SAT_CATALOG_VERSION ||
+            sizeof(header) + (int64_t)header.nb * sizeof(rec) +
+            header.pool_size != p->input.size)
+        goto error;
+
+    if (!sats->names_pool) {
+        sats->names_pool = malloc(header.pool_size + 1);
+        memcpy(sats->names_pool,
+               data + sizeof(header) + header.nb * sizeof(rec),
+               header.pool_size);
+        sats->names_pool[header.pool_size] = '\0';
+    }
+
+    data_parser_start(&p->input);
+    while (data_parser_next_record(&p->input, header.nb)) {
+        idx = p->input.idx - 1;
+        memcpy(&rec, data + sizeof(header) + idx * sizeof(rec), sizeof(rec));
+        if (rec.names >= header.pool_size || rec.types >= header.pool_size) {
+            LOG_E("Wrong satellite record in %s:%d", url, idx);
+            continue;
+        }
+        sat = (void*)module_add_new(&sats->obj, "tle_satellite", NULL);
+        sats->generation++;
+        satellite_load_record(sat, &rec, sats->names_pool);
+        name_index_add_obj(&sats->obj, &sat->obj, 0);
+        p->last_epoch = fmax(p->last_epoch,
+                             sgp4_get_satepoch(sat->elsetrec));
+        p->nb++;
+    }
+    return p->input.done;
+
+error:
+    LOG_E("Wrong satellites catalogue file: %s", url);
+    return true;
+}
+
+// Progress the sweep of all the satellites.  If the list of satellites
+// changed, restart the sweep with the new list.
+static void satellites_update_sweep(satellites_t *sats)
+{
+    satellite_t *child;
+    int nb = 0;
+
+    for (   child = (void*)sats->obj.children; child;
+            child = (void*)child->obj.next)
+        nb++;
+    // Also catch the satellites added or removed from outside the module.
+    if (nb != sats->sweep_nb) sats->generation++;
+    if (sats->sweep_generation != sats->generation) {
+        sweep_restart(&sats->sweep);
+        release_sweep_objs(sats);
+        sats->sweep_objs = realloc(sats->sweep_objs,
+                                   nb * sizeof(*sats->sweep_objs));
+        for (   child = (void*)sats->obj.children; child;
+                child = (void*)child->obj.next) {
+            obj_retain(&child->obj);
+            sats->sweep_objs[sats->sweep_nb++] = child;
+        }
+        sats->sweep_generation = sats->generation;
     }
+    sweep_update(&sats->sweep, core->observer, sats->sweep_nb);
+}
 
-    free(uncompressed_data);
-    return nb;
+// Return the last sweep snapshot if it matches the current satellites list.
+static const sweep_snapshot_t *satellites_get_snapshot(
+        const satellites_t *sats)
+{
+    const sweep_snapshot_t *snap = sweep_get(&sats->sweep);
+    if (sats->sweep_generation != sats->generation) return NULL;
+    return (snap && snap->nb == sats->sweep_nb) ? snap : NULL;
 }
 
 static int satellites_update(obj_t *obj, double dt)
 {
     satellites_t *sats = (satellites_t*)obj;
+    typeof(sats->parser) *p = &sats->parser;
     const char *data;
-    double last_epoch = 0;
-    int size, code, nb;
+    int size, code, progress;
     char buf[128];
 
-    if (sats->loaded) return 0;
-    if (!sats->jsonl_url) return 0;
+    if (sats->loaded || !sats->source_url) {
+        satellites_update_sweep(sats);
+        return 0;
+    }
 
-    data = asset_get_data2(sats->jsonl_url, ASSET_USED_ONCE, &size, &code);
-    if (!code) return 0; // Sill loading.
-    if (!data) return 0; // Got error;
-    nb = load_jsonl_data(sats, data, size, sats->jsonl_url, &last_epoch);
-    LOG_I("Parsed %d satellites (latest epoch: %s)", nb,
-          format_time(buf, last_epoch, 0, "YYYY-MM-DD"));
-    if (last_epoch < unix_to_mjd(sys_get_unix_time()) - 2)
+    if (!p->input.data) {
+        data = asset_get_data2(sats->source_url, ASSET_USED_ONCE, &size,
+                               &code);
+        if (!code) return 0; // Sill loading.
+        if (!data) return 0; // Got error;
+        if (sats->source_binary && size >= 2 && data[0] != '\x1f') {
+            // Uncompressed binary catalogue.
+            p->input.data = malloc(size);
+            memcpy(p->input.data, data, size);
+            p->input.size = size;
+        } else {
+            // XXX: should use a more robust gz uncompression function for
+            // external data.
+            p->input.data = z_uncompress_gz(data, size, &p->input.size);
+        }
+        if (!p->input.data) {
+            LOG_E("Cannot uncompress gz file: %s", sats->source_url);
+            sats->loaded = true;
+            return 0;
+        }
+    }
+
+    if (sats->source_binary) {
+        sats->loaded = load_bin_data(sats, sats->source_url);
+        progress = sizeof(sat_catalog_header_t) +
+                   p->input.idx * sizeof(sat_catalog_record_t);
+    } else {
+        sats->loaded = load_jsonl_data(sats, sats->source_url);
+        progress = p->input.line - p->input.data;
+    }
+    progressbar_report(sats->source_url, "Satellites",
+                       sats->loaded ? p->input.size : progress,
+                       p->input.size, -1);
+    if (!sats->loaded) return 0;
+
+    data_parser_release(&p->input);
+    LOG_I("Parsed %d satellites (latest epoch: %s)", p->nb,
+          format_time(buf, p->last_epoch, 0, "YYYY-MM-DD"));
+    if (p->last_epoch < unix_to_mjd(sys_get_unix_time()) - 2)
         LOG_W("Warning: satellites data seems outdated.");
-    sats->loaded = true;
     return 0;
 }
 
@@ -160,6 +364,8 @@ static int satellites_render(obj_t *obj, const painter_t *painter)
     int i, r;
     const int update_nb = 32;
     satellite_t *child, *tmp;
+    const sweep_snapshot_t *snap;
+    double limit_mag;
 
     if (!sats->visible) return false;
 
@@ -179,7 +385,26 @@ static int satellites_render(obj_t *obj, const painter_t *painter)
         }
     }
 
-    // Then iter part of the full list as well.
+    // If we have a sweep snapshot, only render the satellites that can be
+    // bright enough.  The satellites move too fast to also use the
+    // snapshot positions.
+    snap = satellites_get_snapshot(sats);
+    if (snap) {
+        limit_mag = fmax(painter->stars_limit_mag,
+                         painter->hints_limit_mag + sats->hints_mag_offset -
+                         2.5) + 1.0;
+        for (i = 0; i < snap->nb; i++) {
+            child = sats->sweep_objs[i];
+            if (child->visible_prev) continue; // Was already rendered.
+            if (!child->obj.parent) continue; // Removed since the sweep.
+            if (snap->vmag[i] > limit_mag && !child->model) continue;
+            r = satellite_render(&child->obj, painter);
+            if (r == 1) add_to_visible(sats, child);
+        }
+        return 0;
+    }
+
+    // Otherwise iter part of the full list.
     for (   i = 0, child = sats->render_current ?: (void*)sats->obj.children;
             child && i < update_nb;
             i++, child = (void*)child->obj.next) {
@@ -286,6 +511,19 @@ static const char *otype_from_json(const json_value *val, const char *base)
     return base;
 }
 
+/*
+ * Same as otype_from_json, but from a '\0' separated list of strings
+ * ending with an empty string.
+ */
+static const char *otype_from_list(const char *list, const char *base)
+{
+    for (; *list; list += strlen(list) + 1) {
+        if (otype_match(list, base))
+            return list;
+    }
+    return base;
+}
+
 /*
  * Parse a date of the form yyyy-mm-dd into a MJD value.
  */
@@ -308,6 +546,37 @@ error:
     return -1;
 }
 
+// Determine what 3d model to use.
+static void satellite_set_model(satellite_t *sat, const char *name)
+{
+    if (name && strncmp(name, "NAME STARLINK", 13) == 0)
+        sat->model = "Starlink";
+    if (sat->number == 25544) sat->model = "ISS";
+    if (sat->number == 20580) sat->model = "HST";
+}
+
+/*
+ * Return the name of index i of a satellite, or NULL if there are no more
+ * names.
+ */
+static const char *satellite_get_name(const satellite_t *sat, int i)
+{
+    const char *name;
+    json_value *names;
+
+    if (sat->names) {
+        for (name = sat->names; *name; name += strlen(name) + 1) {
+            if (i-- == 0) return name;
+        }
+        return NULL;
+    }
+    if (!sat->data) return NULL;
+    names = json_get_attr(sat->data, "names", json_array);
+    if (!names || i >= names->u.array.length) return NULL;
+    if (names->u.array.values[i]->type != json_string) return NULL;
+    return names->u.array.values[i]->u.string.ptr;
+}
+
 static int satellite_init(obj_t *obj, json_value *args)
 {
     // Support creating a satellite using noctuasky model data json values.
@@ -348,17 +617,33 @@ static int satellite_init(obj_t *obj, json_value *args)
 
         if (launch_date) parse_date(launch_date, &sat->launch_date);
         if (decay_date) parse_date(decay_date, &sat->decay_date);
-
-        // Determin what 3d model to use.
-        if (name && strncmp(name, "NAME STARLINK", 13) == 0)
-            sat->model = "Starlink";
-        if (sat->number == 25544) sat->model = "ISS";
-        if (sat->number == 20580) sat->model = "HST";
+        satellite_set_model(sat, name);
     }
 
     return 0;
 }
 
+/*
+ * Set a satellite values from a binary catalogue record.
+ */
+static void satellite_load_record(satellite_t *sat,
+                                  const sat_catalog_record_t *rec,
+                                  const char *pool)
+{
+    sat->elsetrec = sgp4_init_elements(
+            rec->number, rec->epoch, rec->bstar, rec->ndot, rec->nddot,
+            rec->ecco, rec->argpo, rec->inclo, rec->mo, rec->no_kozai,
+            rec->nodeo);
+    sat->number = rec->number;
+    sat->stdmag = isnan(rec->stdmag) ? SATELLITE_DEFAULT_MAG : rec->stdmag;
+    sat->launch_date = rec->launch_date;
+    sat->decay_date = rec->decay_date;
+    sat->names = pool + rec->names;
+    strncpy(sat->obj.type, otype_from_list(pool + rec->types, "Asa"), 4);
+    sat->max_brightness = compute_max_brightness(sat->elsetrec, sat->stdmag);
+    satellite_set_model(sat, *sat->names ? sat->names : NULL);
+}
+
 static void satellite_del(obj_t *obj)
 {
     satellite_t *sat = (satellite_t*)obj;
@@ -391,29 +676,20 @@ static bool satellite_is_operational(const satellite_t *sat, double utc)
 }
 
 /*
- * Update an individual satellite.
+ * Compute a satellite position and magnitude.
+ *
+ * This doesn't modify the orbit elements, so it can be called from several
+ * threads at the same time on copies of the same satellite.
+ *
+ * Return the SGP4 error code.
  */
-static int satellite_update(satellite_t *sat, const observer_t *obs)
+static int satellite_compute(satellite_t *sat, const observer_t *obs)
 {
     double pv[2][3];
-    char buf[128];
     int r;
 
-    if (sat->error) return 0;
-    assert(sat->elsetrec);
-    if (!satellite_is_operational(sat, obs->utc)) return 0;
-
-    // Orbit computation.
-    r = sgp4(sat->elsetrec, obs->utc, pv[0],  pv[1]);
-    if (r && r != 6) { // 6 = satellite decayed, don't log this case.
-        obj_get_name((obj_t*)sat, buf, sizeof(buf));
-        LOG_W("Satellite position error for %s (%d), err=%d",
-              buf, sat->number, r);
-    }
-    if (r) {
-        sat->error = true;
-        return 0;
-    }
+    r = sgp4_const(sat->elsetrec, obs->utc, pv[0],  pv[1]);
+    if (r) return r;
     assert(!isnan(pv[0][0]) && !isnan(pv[0][1]));
 
     vec3_mul(1000.0 * DM2AU, pv[0], pv[0]);
@@ -431,6 +707,56 @@ static int satellite_update(satellite_t *sat, const observer_t *obs)
     return 0;
 }
 
+/*
+ * Update an individual satellite.
+ */
+static int satellite_update(satellite_t *sat, const observer_t *obs)
+{
+    char buf[128];
+    int r;
+
+    if (sat->error) return 0;
+    assert(sat->elsetrec);
+    if (!satellite_is_operational(sat, obs->utc)) return 0;
+
+    r = satellite_compute(sat, obs);
+    if (r && r != 6) { // 6 = satellite decayed, don't log this case.
+        obj_get_name((obj_t*)sat, buf, sizeof(buf));
+        LOG_W("Satellite position error for %s (%d), err=%d",
+              buf, sat->number, r);
+    }
+    if (r) sat->error = true;
+    return 0;
+}
+
+/*
+ * Compute the positions and magnitudes of the satellites [start, end) for
+ * the sweep.  We work on copies of the satellites since this can run in
+ * several threads at the same time.  The satellites we cannot compute get
+ * an infinite magnitude.
+ */
+static void satellites_sweep_compute(const sweep_t *sweep,
+                                     const observer_t *obs,
+                                     int start, int end,
+                                     float (*pos)[3], float *vmag)
+{
+    const satellites_t *sats = sweep->user;
+    satellite_t sat;
+    int i;
+
+    for (i = start; i < end; i++) {
+        sat = *sats->sweep_objs[i];
+        if (    sat.error || !satellite_is_operational(&sat, obs->utc) ||
+                satellite_compute(&sat, obs)) {
+            vec3_set(pos[i], 0, 0, 0);
+            vmag[i] = INFINITY;
+            continue;
+        }
+        vec3_copy(sat.pvo[0], pos[i]);
+        vmag[i] = sat.vmag;
+    }
+}
+
 /*
  * Compute the rotation from ICRF to Local Vertical Local Horizontal
  * for 3d models rendering.
@@ -508,8 +834,21 @@ static int satellite_get_info(const obj_t *obj, const observer_t *obs, int info,
 static json_value *satellite_get_json_data(const obj_t *obj)
 {
     const satellite_t *sat = (const satellite_t*)obj;
-    json_value *ret;
+    json_value *ret, *model_data, *names;
+    const char *name;
+    int i;
+
     ret = sat->data ? json_copy(sat->data) : json_object_new(0);
+    // Satellites from the binary catalogue: only the values we have.
+    if (!sat->data && sat->names) {
+        model_data = json_object_push(ret, "model_data", json_object_new(0));
+        json_object_push(model_data, "norad_number",
+                         json_integer_new(sat->number));
+        json_object_push(model_data, "mag", json_double_new(sat->stdmag));
+        names = json_object_push(ret, "names", json_array_new(0));
+        for (i = 0; (name = satellite_get_name(sat, i)); i++)
+            json_array_push(names, json_string_new(name));
+    }
     if (painter_3d_model_exists(sat->model))
         json_object_push(ret, "can_orbit", json_boolean_new(true));
     return ret;
@@ -527,20 +866,15 @@ static bool satellite_get_short_name(const satellite_t *sat, bool selected,
                                      char *out, int size)
 {
     int i;
-    json_value *jnames;
     const char* name;
     char buf[256];
     int len, best_name_len = size;
 
     *out = '\0';
-    if (!sat->data) return false;
-    jnames = json_get_attr(sat->data, "names", json_array);
-    if (!jnames || jnames->u.array.length == 0) return false;
+    if (!satellite_get_name(sat, 0)) return false;
     if (selected) goto use_first_dsgn;
 
-    for (i = 0; i < jnames->u.array.length; ++i) {
-        if (jnames->u.array.values[i]->type != json_string) continue;
-        name = jnames->u.array.values[i]->u.string.ptr;
+    for (i = 0; (name = satellite_get_name(sat, i)); ++i) {
         if (strncmp(name, "NAME ", 5) != 0) continue;
         designation_cleanup(name, buf, sizeof(buf), DSGN_TRANSLATE);
         len = strlen(buf);
@@ -553,8 +887,7 @@ static bool satellite_get_short_name(const satellite_t *sat, bool selected,
     if (*out) return true;
 
 use_first_dsgn:
-    if (jnames->u.array.values[0]->type != json_string) return false;
-    name = jnames->u.array.values[0]->u.string.ptr;
+    name = satellite_get_name(sat, 0);
     designation_cleanup(name, out, size, DSGN_TRANSLATE);
     return true;
 }
@@ -642,7 +975,7 @@ static int satellite_render(obj_t *obj, const painter_t *painter_)
             vmag > painter.stars_limit_mag && vmag > hints_limit_mag)
         return 0;
 
-    core_get_point_for_mag(vmag, &size, &luminance);
+    point_lut_get(painter.point_lut, vmag, &size, &luminance);
 
     // Render model if possible.
     model_alpha = get_model_alpha(sat, &painter, &model_size);
@@ -695,22 +1028,15 @@ static void satellite_get_designations(
              const char *cat, const char *str))
 {
     const satellite_t *sat = (const satellite_t*)obj;
-    json_value *names;
-    char *name;
+    const char *name;
     int i;
     char buf[32];
 
-    if (!sat->data) goto fallback;
-    names = json_get_attr(sat->data, "names", json_array);
-    if (!names || names->u.array.length == 0) goto fallback;
-    for (i = 0; i < names->u.array.length; i++) {
-        if (names->u.array.values[i]->type != json_string) goto fallback;
-        name = names->u.array.values[i]->u.string.ptr;
+    for (i = 0; (name = satellite_get_name(sat, i)); i++)
         f(obj, user, NULL, name);
-    }
-    return;
+    if (i) return;
 
-fallback:
+    // Fallback if the satellite doesn't have any name.
     snprintf(buf, sizeof(buf), "%05d", sat->number);
     f(obj, user, "NORAD", buf);
 }
@@ -723,6 +1049,19 @@ static int satellites_list(const obj_t *obj,
     obj_t *child;
     satellite_t *sat;
     bool test_vmag = !isnan(max_mag);
+    const satellites_t *sats = (const void*)obj;
+    const sweep_snapshot_t *snap = satellites_get_snapshot(sats);
+    int i;
+
+    // With a sweep snapshot we can test the current magnitudes.
+    if (snap && test_vmag) {
+        for (i = 0; i < snap->nb; i++) {
+            if (snap->vmag[i] > max_mag) continue;
+            if (!sats->sweep_objs[i]->obj.parent) continue;
+            if (f(user, &sats->sweep_objs[i]->obj)) break;
+        }
+        return 0;
+    }
 
     DL_FOREACH(obj->children, child) {
         sat = (void*)child;
@@ -790,6 +1129,7 @@ static obj_klass_t satellites_klass = {
     .size           = sizeof(satellites_t),
     .flags          = OBJ_IN_JSON_TREE | OBJ_MODULE | OBJ_LISTABLE,
     .init           = satellites_init,
+    .del            = satellites_del,
     .add_data_source = satellites_add_data_source,
     .render_order   = 31, // After planets.
     .update         = satellites_update,
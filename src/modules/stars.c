@@ -12,6 +12,7 @@
 #include "hip.h"
 #include "designation.h"
 #include "ini.h"
+#include "name_index.h"
 
 #include <regex.h>
 #include <zlib.h>
@@ -69,6 +70,11 @@ struct stars {
 // Static instance.
 static stars_t *g_stars = NULL;
 
+// Tile flags.
+enum {
+    TILE_INDEXED    = 1 << 0, // Designations added to the name index.
+};
+
 /*
  * Type: tile_t
  * Custom tile structure for the stars hips survey.
@@ -82,6 +88,11 @@ typedef struct tile {
     star_t      *sources;
 } tile_t;
 
+static uint64_t pix_to_nuniq(int order, int pix)
+{
+    return pix + 4 * (1L << (2 * order));
+}
+
 static void nuniq_to_pix(uint64_t nuniq, int *order, int *pix)
 {
     *order = log2(nuniq / 4) / 2;
@@ -387,7 +398,7 @@ static int star_render(obj_t *obj, const painter_t *painter_)
     if (!painter_project(painter_, FRAME_ICRF, pvo[0], true, true, p))
         return 0;
 
-    if (!core_get_point_for_mag(star->vmag, &size, &luminance))
+    if (!point_lut_get(painter.point_lut, star->vmag, &size, &luminance))
         return 0;
     bv_to_rgb(isnan(star->bv) ? 0 : star->bv, color);
 
@@ -592,11 +603,51 @@ static void *stars_create_tile(
     return tile;
 }
 
+/*
+ * Snapshot support.
+ *
+ * The tiles are dumped with hips_dump_objs, in the in-memory layout of
+ * tile_t and star_t.  Any change to those structs invalidates the
+ * snapshots.
+ */
+#define SNAPSHOT_VERSION ((2 << 16) | (sizeof(star_t) + sizeof(tile_t)))
+
+static const hips_dump_string_t STAR_STRINGS[] = {
+    {offsetof(star_t, names), true},
+    {offsetof(star_t, sp_type)},
+    {}
+};
+
+static void *stars_dump_tile(void *user, const void *tile_, int *size)
+{
+    const tile_t *tile = tile_;
+    return hips_dump_objs(tile, sizeof(*tile), tile->sources, tile->nb,
+                          sizeof(star_t), STAR_STRINGS, size);
+}
+
+static void *stars_load_tile(void *user, int order, int pix,
+                             const void *data, int size, int *cost)
+{
+    tile_t *tile = calloc(1, sizeof(*tile));
+    if (hips_load_objs(data, size, tile, sizeof(*tile), sizeof(star_t),
+                       STAR_STRINGS, &star_klass, (void**)&tile->sources,
+                       &tile->nb)) {
+        free(tile);
+        return NULL;
+    }
+    tile->flags = 0;
+    *cost = tile->nb * sizeof(*tile->sources);
+    return tile;
+}
+
 static int stars_init(obj_t *obj, json_value *args)
 {
     stars_t *stars = (stars_t*)obj;
     assert(!g_stars);
     g_stars = stars;
+    // We don't register the module to the name index, since only the loaded
+    // tiles are indexed: core_search still lists our objects when a name is
+    // not found in the index.
     stars->visible = true;
     regcomp(&stars->search_reg, "(hip|gaia) *([0-9]+)",
             REG_EXTENDED | REG_ICASE);
@@ -629,7 +680,7 @@ static survey_t *get_survey(const stars_t *stars, const char *key)
 static tile_t *get_tile(survey_t *survey, int order, int pix,
                         bool sync, int *code)
 {
-    int flags = 0;
+    int i, flags = 0;
     tile_t *tile;
     assert(code);
     assert(survey);
@@ -639,6 +690,15 @@ static tile_t *get_tile(survey_t *survey, int order, int pix,
         return NULL;
     }
     tile = hips_get_tile(survey->hips, order, pix, flags, code);
+    // Add the designations to the name index.  Only the default survey
+    // is searchable, and this has to be done in the main thread.
+    if (tile && !(tile->flags & TILE_INDEXED) && survey == g_stars->surveys) {
+        for (i = 0; i < tile->nb; i++) {
+            name_index_add_obj(&g_stars->obj, &tile->sources[i].obj,
+                               pix_to_nuniq(order, pix));
+        }
+        tile->flags |= TILE_INDEXED;
+    }
     return tile;
 }
 
@@ -685,7 +745,7 @@ static int render_visitor(stars_t *stars, survey_t *survey,
         // star had the same vmag (often the case since we sort by vmag).
         if (s->vmag != vmag) {
             vmag = s->vmag;
-            core_get_point_for_mag(vmag, &size, &luminance);
+            point_lut_get(painter.point_lut, vmag, &size, &luminance);
         }
         if (size == 0.0 || luminance == 0.0)
             continue;
@@ -861,6 +921,9 @@ static int stars_add_data_source(obj_t *obj, const char *url, const char *key)
     hips_settings_t survey_settings = {
         .create_tile = stars_create_tile,
         .delete_tile = del_tile,
+        .dump_tile = stars_dump_tile,
+        .load_tile = stars_load_tile,
+        .snapshot_version = SNAPSHOT_VERSION,
     };
     int i, code;
     double release_date = 0;
@@ -0,0 +1,358 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "name_index.h"
+#include "swe.h"
+
+#include <strings.h>
+
+// Max number of modules we can register.
+#define MAX_MODULES 64
+
+// Max size of a designation.
+#define MAX_LEN 256
+
+typedef struct {
+    uint32_t    key;     // Offset of the designation in the pool.
+    uint16_t    module;  // Index of the module.
+    bool        is_obj;
+    union {
+        uint64_t    hint;
+        obj_t       *obj;
+    };
+} entry_t;
+
+static struct {
+    obj_t       *modules[MAX_MODULES];
+    bool        indexed[MAX_MODULES]; // Registered with add_module.
+    int         nb_modules;
+
+    // Sorted entries, followed by the pending ones.
+    entry_t     *entries;
+    int         nb;
+    int         sorted;
+    int         allocated;
+
+    char        *pool;
+    int         pool_size;
+    int         pool_allocated;
+} g_index = {};
+
+// Copy a designation, merging the consecutive spaces.
+static void normalize(const char *str, char *out, int size)
+{
+    int n = 0;
+    while (*str == ' ') str++;
+    for (; *str && n < size - 1; str++) {
+        if (*str == ' ' && (str[1] == ' ' || !str[1])) continue;
+        out[n++] = *str;
+    }
+    out[n] = '\0';
+}
+
+static int get_module(obj_t *module)
+{
+    int i;
+    for (i = 0; i < g_index.nb_modules; i++) {
+        if (g_index.modules[i] == module) return i;
+    }
+    assert(g_index.nb_modules < MAX_MODULES);
+    g_index.modules[g_index.nb_modules] = module;
+    return g_index.nb_modules++;
+}
+
+void name_index_add_module(obj_t *module)
+{
+    g_index.indexed[get_module(module)] = true;
+}
+
+bool name_index_has_module(const obj_t *module)
+{
+    int i;
+    for (i = 0; i < g_index.nb_modules; i++) {
+        if (g_index.modules[i] == module) return g_index.indexed[i];
+    }
+    return false;
+}
+
+void name_index_add(obj_t *module, obj_t *obj, uint64_t hint,
+                    const char *dsgn)
+{
+    char buf[MAX_LEN];
+    int len;
+    entry_t *e;
+
+    normalize(dsgn, buf, sizeof(buf));
+    if (!*buf) return;
+    len = strlen(buf) + 1;
+    if (g_index.pool_size + len > g_index.pool_allocated) {
+        g_index.pool_allocated = g_index.pool_allocated * 2 ?: 1 << 16;
+        g_index.pool = realloc(g_index.pool, g_index.pool_allocated);
+    }
+    memcpy(g_index.pool + g_index.pool_size, buf, len);
+
+    if (g_index.nb >= g_index.allocated) {
+        g_index.allocated = g_index.allocated * 2 ?: 1024;
+        g_index.entries = realloc(g_index.entries,
+                                  g_index.allocated * sizeof(*e));
+    }
+    e = &g_index.entries[g_index.nb++];
+    memset(e, 0, sizeof(*e));
+    e->key = g_index.pool_size;
+    e->module = get_module(module);
+    e->is_obj = obj != NULL;
+    if (obj)
+        e->obj = obj_retain(obj);
+    else
+        e->hint = hint;
+    g_index.pool_size += len;
+}
+
+static void on_designation(const obj_t *obj, void *user, const char *dsgn)
+{
+    obj_t *module = USER_GET(user, 0);
+    uint64_t *hint = USER_GET(user, 1);
+    name_index_add(module, *hint ? NULL : (obj_t*)obj, *hint, dsgn);
+}
+
+void name_index_add_obj(obj_t *module, obj_t *obj, uint64_t hint)
+{
+    obj_get_designations(obj, USER_PASS(module, &hint), on_designation);
+}
+
+static const char *entry_key(const entry_t *e)
+{
+    return g_index.pool + e->key;
+}
+
+static int entry_cmp(const void *a_, const void *b_)
+{
+    const entry_t *a = a_, *b = b_;
+    int r;
+    r = strcasecmp(entry_key(a), entry_key(b));
+    if (r) return r;
+    if (a->module != b->module) return cmp(a->module, b->module);
+    if (a->is_obj != b->is_obj) return cmp(a->is_obj, b->is_obj);
+    return cmp(a->hint, b->hint);
+}
+
+/*
+ * Merge the pending entries into the sorted ones, removing the duplicates
+ * (for example when a tile got loaded again).
+ */
+static void index_sort(void)
+{
+    entry_t *entries, *a, *a_end, *b, *b_end, *e;
+    int nb = 0;
+
+    if (g_index.sorted == g_index.nb) return;
+    qsort(g_index.entries + g_index.sorted, g_index.nb - g_index.sorted,
+          sizeof(entry_t), entry_cmp);
+    entries = malloc(g_index.allocated * sizeof(*entries));
+    a = g_index.entries;
+    a_end = b = g_index.entries + g_index.sorted;
+    b_end = g_index.entries + g_index.nb;
+    while (a < a_end || b < b_end) {
+        if (b == b_end || (a < a_end && entry_cmp(a, b) <= 0))
+            e = a++;
+        else
+            e = b++;
+        if (nb && entry_cmp(&entries[nb - 1], e) == 0) {
+            if (e->is_obj) obj_release(e->obj);
+            continue;
+        }
+        entries[nb++] = *e;
+    }
+    free(g_index.entries);
+    g_index.entries = entries;
+    g_index.nb = g_index.sorted = nb;
+}
+
+// Return the index of the first entry not smaller than a key, comparing
+// only the first n chars (or the full key if n is zero).
+static int lower_bound(const char *key, int n)
+{
+    int lo = 0, hi = g_index.sorted, mid, r;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (n)
+            r = strncasecmp(entry_key(&g_index.entries[mid]), key, n);
+        else
+            r = strcasecmp(entry_key(&g_index.entries[mid]), key);
+        if (r < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void on_obj_designation(const obj_t *obj, void *user,
+                               const char *dsgn)
+{
+    const char *query = USER_GET(user, 0);
+    obj_t **result = USER_GET(user, 1);
+    char buf[MAX_LEN];
+    if (*result) return;
+    normalize(dsgn, buf, sizeof(buf));
+    if (strcasecmp(query, buf) == 0) *result = obj_retain((obj_t*)obj);
+}
+
+static int on_obj(void *user, obj_t *obj)
+{
+    obj_t **result = USER_GET(user, 1);
+    obj_get_designations(obj, user, on_obj_designation);
+    return (*result) ? 1 : 0;
+}
+
+obj_t *name_index_search(const char *query)
+{
+    char buf[MAX_LEN];
+    int i;
+    const entry_t *e;
+    obj_t *ret = NULL;
+
+    normalize(query, buf, sizeof(buf));
+    index_sort();
+    for (i = lower_bound(buf, 0); i < g_index.nb; i++) {
+        e = &g_index.entries[i];
+        if (strcasecmp(entry_key(e), buf) != 0) break;
+        if (e->is_obj) return obj_retain(e->obj);
+        module_list_objs(g_index.modules[e->module], NAN, e->hint, NULL,
+                         USER_PASS(buf, &ret), on_obj);
+        if (ret) return ret;
+    }
+    return NULL;
+}
+
+int name_index_list_prefix(const char *prefix, void *user,
+                           int (*f)(void *user, const char *dsgn))
+{
+    char buf[MAX_LEN];
+    int i, n, nb = 0;
+    const char *key, *last = NULL;
+
+    normalize(prefix, buf, sizeof(buf));
+    n = strlen(buf);
+    index_sort();
+    for (i = n ? lower_bound(buf, n) : 0; i < g_index.nb; i++) {
+        key = entry_key(&g_index.entries[i]);
+        if (strncasecmp(key, buf, n) != 0) break;
+        // Several objects can share the same designation.
+        if (last && strcmp(last, key) == 0) continue;
+        last = key;
+        nb++;
+        if (f(user, key)) break;
+    }
+    return nb;
+}
+
+void name_index_clear(void)
+{
+    int i;
+    for (i = 0; i < g_index.nb; i++) {
+        if (g_index.entries[i].is_obj)
+            obj_release(g_index.entries[i].obj);
+    }
+    free(g_index.entries);
+    free(g_index.pool);
+    memset(&g_index, 0, sizeof(g_index));
+}
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static int on_prefix(void *user, const char *dsgn)
+{
+    int *nb = user;
+    (*nb)++;
+    return 0;
+}
+
+static void test_name_index(void)
+{
+    obj_t module = {.ref = 1}, objs[3] = {{.ref = 1}, {.ref = 1}, {.ref = 1}};
+    obj_t *obj;
+    int nb = 0;
+
+    name_index_add_module(&module);
+    assert(name_index_has_module(&module));
+    name_index_add(&module, &objs[0], 0, "NAME Sirius");
+    name_index_add(&module, &objs[0], 0, "HIP 32349");
+    name_index_add(&module, &objs[1], 0, "NAME  Vega ");
+    name_index_add(&module, &objs[2], 0, "HIP 91262");
+    // Adding twice the same entry doesn't create a duplicate.
+    name_index_add(&module, &objs[0], 0, "NAME Sirius");
+
+    obj = name_index_search("name sirius");
+    assert(obj == &objs[0]);
+    obj_release(obj);
+    obj = name_index_search("NAME Vega");
+    assert(obj == &objs[1]);
+    obj_release(obj);
+    assert(!name_index_search("NAME Sirius B"));
+    assert(name_index_list_prefix("hip ", &nb, on_prefix) == 2);
+    assert(name_index_list_prefix("NAME", &nb, on_prefix) == 2);
+    assert(name_index_list_prefix("", &nb, on_prefix) == 4);
+    assert(objs[0].ref == 3);
+
+    name_index_clear();
+    assert(objs[0].ref == 1 && objs[1].ref == 1);
+}
+
+static void bench_name_index(void)
+{
+    const int nb = 1000000;
+    int i, n = 0;
+    char buf[64];
+    double t;
+    obj_t module = {.ref = 1}, *obj;
+    uint32_t seed = 1;
+
+    t = sys_get_unix_time();
+    for (i = 0; i < nb; i++) {
+        snprintf(buf, sizeof(buf), "GAIA %u", (unsigned)(i * 2654435761u));
+        name_index_add(&module, NULL, i + 1, buf);
+    }
+    LOG_I("Add %d designations: %.0f ms", nb,
+          (sys_get_unix_time() - t) * 1000);
+    t = sys_get_unix_time();
+    name_index_list_prefix("X", NULL, on_prefix); // Force the sort.
+    LOG_I("Sort: %.0f ms", (sys_get_unix_time() - t) * 1000);
+
+    t = sys_get_unix_time();
+    for (i = 0; i < nb; i++) {
+        seed = seed * 1103515245 + 12345;
+        snprintf(buf, sizeof(buf), "gaia %u",
+                 (unsigned)((seed % nb) * 2654435761u));
+        if (lower_bound(buf, 0) < g_index.nb) n++;
+    }
+    LOG_I("%d exact lookups: %.0f ms", nb, (sys_get_unix_time() - t) * 1000);
+
+    t = sys_get_unix_time();
+    n = 0;
+    for (i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "GAIA %d", i + 1000000);
+        name_index_list_prefix(buf, &n, on_prefix);
+    }
+    LOG_I("1000 prefix lookups (%d results): %.1f ms", n,
+          (sys_get_unix_time() - t) * 1000);
+
+    // Unknown designation: no module to list.
+    obj = name_index_search("NAME Unknown");
+    assert(!obj);
+    name_index_clear();
+}
+
+TEST_REGISTER(NULL, test_name_index, TEST_AUTO);
+TEST_REGISTER(NULL, bench_name_index, 0);
+
+#endif
@@ -0,0 +1,106 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * File: name_index.h
+ * Global index of the objects designations, used by <core_search>.
+ *
+ * The modules add the designations of their objects as they get loaded
+ * (catalogue parsed, new tile...).  Each designation points to a locator:
+ * either the object itself if it stays in memory, or the module and a
+ * hint value that <module_list_objs> can use to find the object back
+ * (for example a tile nuniq).
+ *
+ * The designations are kept in a sorted array, so that the exact and
+ * prefix lookups are O(log n).  The new designations are first appended
+ * to a pending list, that gets merged into the sorted array on the next
+ * lookup.  The comparisons are case insensitive, and the consecutive
+ * spaces are merged.
+ */
+
+typedef struct obj obj_t;
+
+/*
+ * Function: name_index_add_module
+ * Register a module whose objects are all added to the index.
+ *
+ * <core_search> falls back to listing all the objects of the modules that
+ * are not registered.
+ */
+void name_index_add_module(obj_t *module);
+
+/*
+ * Function: name_index_has_module
+ * Return whether a module has been registered with <name_index_add_module>.
+ */
+bool name_index_has_module(const obj_t *module);
+
+/*
+ * Function: name_index_add
+ * Add a designation to the index.
+ *
+ * Parameters:
+ *   module - The module of the object.
+ *   obj    - The object, or NULL to use the hint.  The index keeps a
+ *            reference to the object.
+ *   hint   - Hint passed to <module_list_objs> to find the object.
+ *   dsgn   - The designation.
+ */
+void name_index_add(obj_t *module, obj_t *obj, uint64_t hint,
+                    const char *dsgn);
+
+/*
+ * Function: name_index_add_obj
+ * Add all the designations of an object to the index.
+ *
+ * If hint is zero, the index keeps a reference to the object, otherwise the
+ * object will be found back with <module_list_objs> and the hint.
+ */
+void name_index_add_obj(obj_t *module, obj_t *obj, uint64_t hint);
+
+/*
+ * Function: name_index_search
+ * Find an object from one of its designations.
+ *
+ * Return:
+ *   The object, or NULL if not found.  The object needs to be released
+ *   with <obj_release>.
+ */
+obj_t *name_index_search(const char *query);
+
+/*
+ * Function: name_index_list_prefix
+ * List the designations starting with a given prefix, in alphabetical
+ * order.
+ *
+ * Parameters:
+ *   prefix - The designations prefix.
+ *   user   - User data passed to the callback.
+ *   f      - Callback called for each designation.  Return a non zero
+ *            value to stop the listing.
+ *
+ * Return:
+ *   The number of designations listed.
+ */
+int name_index_list_prefix(const char *prefix, void *user,
+                           int (*f)(void *user, const char *dsgn));
+
+/*
+ * Function: name_index_clear
+ * Remove all the designations and registered modules.
+ */
+void name_index_clear(void);
+
+#endif // NAME_INDEX_H
@@ -15,6 +15,42 @@
 
 static bool g_debug = false;
 
+// Bounding caps of all the healpix pixels up to this order are precomputed.
+#define CAPS_TABLE_MAX_ORDER 3
+// Size of the healpix clip cache.  Must be a power of two.
+#define CLIP_CACHE_SIZE 4096
+
+/*
+ * Per frame cache of the healpix clip tests.
+ *
+ * Several modules test the same tiles each frame, so we keep the results
+ * in a direct mapped table.  Entries are only valid for the painter clip id
+ * they were computed with, so that we can invalidate the whole cache by
+ * just bumping the id.
+ */
+static struct {
+    struct {
+        unsigned int id;
+        int order;
+        int pix;
+        uint8_t frame;
+        uint8_t flags;
+        bool clipped;
+    } entries[CLIP_CACHE_SIZE];
+    unsigned int id;
+    struct {
+        int nb_tests;
+        int nb_saved;
+    } stats, last_stats;
+} g_clip_cache = {};
+
+// Start a new clip cache session for the painter.
+static void clip_cache_invalidate(painter_t *painter)
+{
+    g_clip_cache.id = g_clip_cache.id + 1 ?: 1;
+    painter->clip_id = g_clip_cache.id;
+}
+
 // Test if a shape in clipping coordinates is clipped or not.
 static bool is_clipped(int n, double (*pos)[4])
 {
@@ -123,6 +159,7 @@ void painter_update_clip_info(painter_t *painter)
         compute_viewport_cap(painter, i);
         compute_sky_cap(painter->obs, i, painter->clip_info[i].sky_cap);
     }
+    clip_cache_invalidate(painter);
 }
 
 int paint_prepare(painter_t *painter, double win_w, double win_h,
@@ -135,6 +172,10 @@ int paint_prepare(painter_t *painter, double win_w, double win_h,
         mat3_set_identity(painter->textures[i].mat);
     areas_clear_all(core->areas);
 
+    g_clip_cache.last_stats = g_clip_cache.stats;
+    memset(&g_clip_cache.stats, 0, sizeof(g_clip_cache.stats));
+    clip_cache_invalidate(painter);
+
     cull_flipped = (bool)(painter->proj->flags & PROJ_FLIP_HORIZONTAL) !=
                    (bool)(painter->proj->flags & PROJ_FLIP_VERTICAL);
     render_prepare(painter->rend, painter->proj,
@@ -192,6 +233,10 @@ int paint_quad(const painter_t *painter,
     }
     if (painter->color[3] == 0.0) return 0;
 
+    if ((painter->flags & PAINTER_STATIC) &&
+            render_static_quad(painter->rend, painter, frame, grid_size, map))
+        return 0;
+
     // XXX: need to check if we intersect discontinuity, and if so split
     // the painter projection.
     render_quad(painter->rend, painter, frame, grid_size, map);
@@ -291,15 +336,38 @@ static bool cap_intersects_discontinuity_line(
 }
 
 
+/*
+ * Buffer reused by all the lines tesselations, so that we don't allocate
+ * memory for each line at each frame.  Only used from the rendering
+ * thread.  The paint_line_tesselate callbacks must not paint other lines
+ * while they use it.
+ */
+static line_buffer_t g_line_buffer = {};
+
+static void on_line(void *user, const double (*pos)[3],
+                    const double (*win)[3], int size)
+{
+    paint_tesselated_line(user, size, pos, win);
+}
+
 int paint_line(const painter_t *painter,
                int frame,
                const double line[2][4], const uv_map_t *map,
                int split, int flags)
+{
+    return paint_line_tesselate(painter, frame, line, map, split, flags,
+                                (void*)painter, on_line);
+}
+
+int paint_line_tesselate(const painter_t *painter,
+                         int frame,
+                         const double line[2][4], const uv_map_t *map,
+                         int split, int flags, void *user,
+                         void (*f)(void *user, const double (*pos)[3],
+                                   const double (*win)[3], int size))
 {
     int i, size;
     double view_pos[2][4];
-    double (*win_line)[3] = NULL;
-    double (*pos_line)[3] = NULL;
     bool discontinuous = false;
     double splits[2][2][4];
 
@@ -324,11 +392,10 @@ int paint_line(const painter_t *painter,
 
     size = line_tesselate(line_func, painter->proj,
                           USER_PASS(painter, &frame, line, map),
-                          split, &pos_line, &win_line);
+                          split, &g_line_buffer);
     if (size < 0) goto split;
-    render_line(painter->rend, painter, pos_line, win_line, size);
-    free(win_line);
-    free(pos_line);
+    f(user, (const double (*)[3])g_line_buffer.pos,
+      (const double (*)[3])g_line_buffer.win, size);
     return 0;
 
 split:
@@ -339,27 +406,33 @@ split:
     vec4_mix(line[0], line[1], 0.5, splits[0][1]);
     vec4_copy(splits[0][1], splits[1][0]);
     vec4_copy(line[1], splits[1][1]);
-    paint_line(painter, frame, splits[0], map, split / 2, flags);
-    paint_line(painter, frame, splits[1], map, split / 2, flags);
+    paint_line_tesselate(painter, frame, splits[0], map, split / 2, flags,
+                         user, f);
+    paint_line_tesselate(painter, frame, splits[1], map, split / 2, flags,
+                         user, f);
+    return 0;
+}
+
+int paint_tesselated_line(const painter_t *painter, int size,
+                          const double (*pos)[3], const double (*win)[3])
+{
+    render_line(painter->rend, painter, pos, win, size);
     return 0;
 }
 
 int paint_linestring(const painter_t *painter, int frame,
                      int size, const double (*points)[3])
 {
-    double (*win_line)[3];
-    double (*pos_line)[3];
+    line_buffer_t *buf = &g_line_buffer;
     int i;
-    win_line = calloc(size, sizeof(*win_line));
-    pos_line = calloc(size, sizeof(*pos_line));
+    line_buffer_reserve(buf, size);
     for (i = 0; i < size; i++) {
         convert_frame(painter->obs, frame, FRAME_VIEW, true,
-                      points[i], pos_line[i]);
-        project_to_win(painter->proj, pos_line[i], win_line[i]);
+                      points[i], buf->pos[i]);
+        project_to_win(painter->proj, buf->pos[i], buf->win[i]);
     }
-    render_line(painter->rend, painter, pos_line, win_line, size);
-    free(win_line);
-    free(pos_line);
+    render_line(painter->rend, painter, (const double (*)[3])buf->pos,
+                (const double (*)[3])buf->win, size);
     return 0;
 }
 
@@ -396,6 +469,10 @@ int paint_mesh(const painter_t *painter_, int frame, int mode,
         }
     }
 
+    if (render_static_mesh(painter.rend, &painter, frame, mode, mesh,
+                           use_stencil))
+        return 0;
+
     switch (mode) {
     case MODE_TRIANGLES:
         render_mesh(painter.rend, &painter, frame, mode,
@@ -514,8 +591,38 @@ bool painter_is_2d_circle_clipped(const painter_t *painter, const double p[2],
     return !intersect_circle_rect(rect, p, radius);
 }
 
-bool painter_is_quad_clipped(const painter_t *painter, int frame,
-                             const uv_map_t *map)
+/*
+ * Get the bounding cap of a healpix uv map, using the precomputed table
+ * for low orders.
+ */
+static void get_healpix_bounding_cap(const uv_map_t *map, double cap[4])
+{
+    static double (*table)[4] = NULL;
+    uv_map_t m;
+    int order, pix, ofs;
+
+    if (map->order > CAPS_TABLE_MAX_ORDER) {
+        uv_map_get_bounding_cap(map, cap);
+        return;
+    }
+    // Offset of the first pixel of the order in the table is
+    // 12 * (4^order - 1) / 3.
+    if (!table) {
+        table = calloc(4 * (1 << (2 * CAPS_TABLE_MAX_ORDER + 2)),
+                       sizeof(*table));
+        for (order = 0, ofs = 0; order <= CAPS_TABLE_MAX_ORDER; order++) {
+            for (pix = 0; pix < 12 * (1 << (2 * order)); pix++) {
+                uv_map_init_healpix(&m, order, pix, false, false);
+                uv_map_get_bounding_cap(&m, table[ofs++]);
+            }
+        }
+    }
+    ofs = 4 * ((1 << (2 * map->order)) - 1) + map->pix;
+    vec4_copy(table[ofs], cap);
+}
+
+static bool painter_is_quad_clipped_(const painter_t *painter, int frame,
+                                     const uv_map_t *map)
 {
     double corners[4][4];
     double quad[4][4], normals[4][3];
@@ -524,7 +631,11 @@ bool painter_is_quad_clipped(const painter_t *painter, int frame,
     int i;
     int order = map->order;
 
-    uv_map_get_bounding_cap(map, bounding_cap);
+    // The bounding cap doesn't depend on the swap and infinity flags.
+    if (map->type == UV_MAP_HEALPIX && !map->transf)
+        get_healpix_bounding_cap(map, bounding_cap);
+    else
+        uv_map_get_bounding_cap(map, bounding_cap);
     assert(vec3_is_normalized(bounding_cap));
     if (painter_is_cap_clipped(painter, frame, bounding_cap))
         return true;
@@ -542,6 +653,47 @@ bool painter_is_quad_clipped(const painter_t *painter, int frame,
     return is_clipped(4, p);
 }
 
+bool painter_is_quad_clipped(const painter_t *painter, int frame,
+                             const uv_map_t *map)
+{
+    unsigned int h;
+    int flags;
+    typeof(g_clip_cache.entries[0]) *entry;
+
+    // Only healpix maps without transformation can be cached, since they
+    // are fully defined by their order and pix.
+    if (!painter->clip_id || map->type != UV_MAP_HEALPIX || map->transf)
+        return painter_is_quad_clipped_(painter, frame, map);
+
+    flags = (painter->flags & PAINTER_HIDE_BELOW_HORIZON ? 1 : 0) |
+            (map->at_infinity ? 2 : 0);
+    h = (unsigned int)map->pix * 2654435761U;
+    h ^= (unsigned int)(map->order * FRAMES_NB + frame) * 40503U;
+    entry = &g_clip_cache.entries[h & (CLIP_CACHE_SIZE - 1)];
+
+    g_clip_cache.stats.nb_tests++;
+    if (    entry->id == painter->clip_id && entry->order == map->order &&
+            entry->pix == map->pix && entry->frame == frame &&
+            entry->flags == flags) {
+        g_clip_cache.stats.nb_saved++;
+        return entry->clipped;
+    }
+
+    entry->id = painter->clip_id;
+    entry->order = map->order;
+    entry->pix = map->pix;
+    entry->frame = frame;
+    entry->flags = flags;
+    entry->clipped = painter_is_quad_clipped_(painter, frame, map);
+    return entry->clipped;
+}
+
+void painter_get_clip_stats(int *nb_tests, int *nb_saved)
+{
+    if (nb_tests) *nb_tests = g_clip_cache.last_stats.nb_tests;
+    if (nb_saved) *nb_saved = g_clip_cache.last_stats.nb_saved;
+}
+
 static bool painter_is_planet_quad_clipped(const painter_t *painter, int frame,
                                            const uv_map_t *map)
 {
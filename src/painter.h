@@ -95,6 +95,8 @@ enum {
     PAINTER_ATMOSPHERE_SHADER   = 1 << 8,
     PAINTER_FOG_SHADER          = 1 << 9,
     PAINTER_ENABLE_DEPTH        = 1 << 10,
+    // Passed to paint_quad: keep the quads buffers in GPU memory.
+    PAINTER_STATIC              = 1 << 11,
 
     // Passed to paint_lines.
     PAINTER_SKIP_DISCONTINUOUS  = 1 << 14,
@@ -107,6 +109,8 @@ enum {
     PAINTER_TEX_NORMAL = 1,
 };
 
+typedef struct point_lut point_lut_t;
+
 struct painter
 {
     renderer_t      *rend;          // The render used.
@@ -131,6 +135,10 @@ struct painter
     // Point halo / core ratio (zero for no halo).
     double          points_halo;
 
+    // Points radius and luminance for mag of the current frame, see
+    // <point_lut_get>.  NULL outside of the core rendering.
+    const point_lut_t *point_lut;
+
     struct {
         int type;
         texture_t *tex;
@@ -151,6 +159,10 @@ struct painter
         double sky_cap[4];
     } clip_info[FRAMES_NB];
 
+    // Id of the clip info setup, used to key the per frame healpix clip
+    // cache.  Zero means no caching.
+    unsigned int    clip_id;
+
     union {
         // For planet rendering only.
         struct {
@@ -290,6 +302,35 @@ int paint_line(const painter_t *painter,
                const double line[2][4], const uv_map_t *map,
                int split, int flags);
 
+/*
+ * Function: paint_line_tesselate
+ * Compute the same polylines as <paint_line>, without rendering them.
+ *
+ * This can be used to keep the geometry of lines that don't change from
+ * one frame to the next.
+ *
+ * Parameters:
+ *   user   - User data passed to the callback.
+ *   f      - Callback called for each polyline, with the view and window
+ *            coordinates of the points.  The line can be split in several
+ *            polylines if it crosses the projection discontinuity.
+ *
+ * See <paint_line> for the other parameters.
+ */
+int paint_line_tesselate(const painter_t *painter,
+                         int frame,
+                         const double line[2][4], const uv_map_t *map,
+                         int split, int flags, void *user,
+                         void (*f)(void *user, const double (*pos)[3],
+                                   const double (*win)[3], int size));
+
+/*
+ * Function: paint_tesselated_line
+ * Render a polyline computed by <paint_line_tesselate>.
+ */
+int paint_tesselated_line(const painter_t *painter, int size,
+                          const double (*pos)[3], const double (*win)[3]);
+
 int paint_linestring(const painter_t *painter, int frame,
                      int size, const double (*points)[3]);
 
@@ -302,6 +343,9 @@ int paint_linestring(const painter_t *painter, int frame,
  *   frame          - Frame of the vertex coordinates.
  *   mode           - MODE_TRIANGLES or MODE_LINES.
  *   mesh           - A 3d triangle mesh.
+ *
+ * The renderer keeps the mesh buffers in GPU memory, using the mesh id, so
+ * the mesh should only be modified with the mesh functions.
  */
 int paint_mesh(const painter_t *painter, int frame, int mode,
                const mesh_t *mesh);
@@ -474,6 +518,16 @@ bool painter_is_2d_circle_clipped(const painter_t *painter, const double p[2],
 bool painter_is_cap_clipped(const painter_t *painter, int frame,
                             const double cap[4]);
 
+/*
+ * Function: painter_get_clip_stats
+ * Return the healpix clip cache counters of the last rendered frame.
+ *
+ * Parameters:
+ *   nb_tests   - Number of healpix clip tests requested.
+ *   nb_saved   - Number of tests served from the cache.
+ */
+void painter_get_clip_stats(int *nb_tests, int *nb_saved);
+
 // Function: painter_update_caps
 //
 // Update the bounding caps for each reference frames.
@@ -23,6 +23,7 @@ typedef struct uv_map uv_map_t;
 typedef struct texture texture_t;
 typedef struct projection projection_t;
 typedef struct obj obj_t;
+typedef struct mesh mesh_t;
 
 // TODO: document those functions.
 
@@ -44,6 +45,16 @@ void render_points_3d(renderer_t *rend, const painter_t *painter,
 void render_quad(renderer_t *rend, const painter_t *painter,
                  int frame, int grid_size, const uv_map_t *map);
 
+/*
+ * The grids of the healpix uv maps, and of the uv maps with a key, are kept
+ * in a cache shared by all the quads.  Its maximum size is in bytes.
+ */
+void render_set_grid_cache_size(renderer_t *rend, int size);
+
+void render_get_grid_cache_stats(const renderer_t *rend,
+                                 int *size, int *max_size,
+                                 int *hits, int *misses);
+
 void render_texture(renderer_t *rend, texture_t *tex,
                     const double uv[4][2], const double pos[2], double size,
                     const double color[4], double angle);
@@ -63,6 +74,25 @@ void render_mesh(renderer_t *rend, const painter_t *painter,
                  const double verts[][3], int indices_count,
                  const uint16_t indices[], bool use_stencil);
 
+/*
+ * Render a mesh whose vertices don't change between frames.  The mesh
+ * buffers are kept in GPU memory, and the frame conversion is done in the
+ * shader.  Return false if the frame is not supported, in which case the
+ * caller should use render_mesh instead.
+ */
+bool render_static_mesh(renderer_t *rend, const painter_t *painter,
+                        int frame, int mode, const mesh_t *mesh,
+                        bool use_stencil);
+
+/*
+ * Render a quad whose vertices don't change between frames, like
+ * <render_static_mesh>.  Only supported for the uv maps at infinity whose
+ * grid can be cached.  Return false if the quad is not supported, in which
+ * case the caller should use render_quad instead.
+ */
+bool render_static_quad(renderer_t *rend, const painter_t *painter,
+                        int frame, int grid_size, const uv_map_t *map);
+
 void render_ellipse_2d(renderer_t *rend, const painter_t *painter,
                        const double pos[2], const double size[2],
                        double angle, double dashes);
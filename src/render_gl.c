@@ -25,6 +25,7 @@
 #include <float.h>
 
 #define GRID_CACHE_SIZE (2 * (1 << 20))
+#define MESH_CACHE_SIZE (16 * (1 << 20))
 
 // Fix GL_PROGRAM_POINT_SIZE support on Mac.
 #ifdef __APPLE__
@@ -82,12 +83,15 @@ struct tex_cache {
 enum {
     ITEM_LINES = 1,
     ITEM_MESH,
+    ITEM_STATIC_MESH,
     ITEM_POINTS,
     ITEM_POINTS_3D,
     ITEM_TEXTURE,
     ITEM_TEXTURE_2D,
     ITEM_ATMOSPHERE,
     ITEM_FOG,
+    ITEM_STATIC_TEXTURE,
+    ITEM_STATIC_FOG,
     ITEM_PLANET,
     ITEM_VG_ELLIPSE,
     ITEM_VG_RECT,
@@ -96,6 +100,22 @@ enum {
     ITEM_GLTF,
 };
 
+typedef struct {
+    void (*map)(const uv_map_t *t, const double v[2], double out[4]);
+    uint64_t key;
+    int order;
+    int pix;
+    int split;
+    int flags;
+} grid_key_t;
+
+// Key of the GL buffers of a static quad.
+typedef struct {
+    grid_key_t  grid;
+    double      transf[4][4]; // Map transformation, or zero.
+    double      uv[3][3]; // Texture coordinates matrix, in texels ratio.
+} quad_key_t;
+
 typedef struct item item_t;
 struct item
 {
@@ -166,8 +186,27 @@ struct item
             int proj;
             float proj_scaling[2];
             bool use_stencil;
+            // Static meshes only.  Each mesh has its own buffers in the
+            // mesh cache, only filled at flush time if they are not
+            // already there.
+            double rot[3][3];  // Frame to observed (before refraction).
+            double rot2[3][3]; // Observed to view.
+            float refraction[2]; // Pressure and temperature, or zero.
+            const mesh_t **meshes;
+            uint8_t (*colors)[4];
+            int meshes_count;
+            int meshes_allocated;
         } mesh;
 
+        // Static quads only.  The buffers are only filled if they are not
+        // already in the mesh cache.
+        struct {
+            quad_key_t key;
+            double rot[3][3];  // Map frame to observed.
+            double rot2[3][3]; // Observed to view.
+            int indices_count;
+        } quad;
+
         struct {
             const char *model;
             double model_mat[4][4];
@@ -196,6 +235,14 @@ static const gl_buf_info_t MESH_BUF = {
     },
 };
 
+// The static meshes colors are passed as an uniform.
+static const gl_buf_info_t STATIC_MESH_BUF = {
+    .size = 12,
+    .attrs = {
+        [ATTR_POS]      = {GL_FLOAT, 3, false, 0},
+    },
+};
+
 static const gl_buf_info_t LINES_BUF = {
     .size = 28,
     .attrs = {
@@ -291,6 +338,8 @@ struct renderer {
 
     item_t  *items;
     cache_t *grid_cache;
+    cache_t *mesh_cache; // GL buffers of the static meshes.
+    line_mesh_t *line_mesh; // Reused by render_line.
 
 };
 
@@ -512,43 +561,115 @@ void render_points_3d(renderer_t *rend, const painter_t *painter,
     }
 }
 
+static int grid_del(void *data)
+{
+    free(data);
+    return 0;
+}
+
+/*
+ * Set the cache key of an uv_map grid, before the map transformation.
+ * Return false if the map grids cannot be cached.
+ */
+static bool grid_get_key(const uv_map_t *map, int split, grid_key_t *key)
+{
+    if (map->type != UV_MAP_HEALPIX && !map->key) return false;
+    // Make sure the padding bytes are set, since we hash the key.
+    memset(key, 0, sizeof(*key));
+    key->map = map->map;
+    key->key = map->key;
+    key->order = map->order;
+    key->pix = map->pix;
+    key->split = split;
+    key->flags = (map->swapped ? 1 : 0) | (map->at_infinity ? 2 : 0);
+    return true;
+}
+
 /*
  * Function: get_grid
  * Compute an uv_map grid, and cache it if possible.
+ *
+ * We cache the grids of the healpix maps, and of the maps that have a key.
+ * The cached values are the outputs of the map function, before the map
+ * transformation, so that the maps that only differ by their transformation
+ * (like the planets tiles) can still use the cache.
+ *
+ * Parameters:
+ *   rend       - The renderer.
+ *   map        - The uv map.
+ *   split      - Size of the side of the grid.
+ *   normals    - If set, output of the mapped vertices normals, as returned
+ *                by <uv_map>.
+ *   should_delete - Set to true if the returned grid needs to be freed.
  */
 static const double (*get_grid(renderer_t *rend,
                                const uv_map_t *map, int split,
+                               double (*normals)[3],
                                bool *should_delete))[4]
 {
-    int n = split + 1;
-    double (*grid)[4];
-    struct {
-        int order;
-        int pix;
-        int split;
-        int swapped;
-    } key = { map->order, map->pix, split, map->swapped };
-    _Static_assert(sizeof(key) == 16, "");
-    bool can_cache = map->type == UV_MAP_HEALPIX && map->at_infinity;
-
-    *should_delete = !can_cache;
+    int i, n = split + 1;
+    double (*grid)[4], (*ret)[4];
+    uv_map_t raw_map;
+    grid_key_t key;
+    bool can_cache = grid_get_key(map, split, &key);
+
+    grid = NULL;
     if (can_cache) {
         if (!rend->grid_cache)
             rend->grid_cache = cache_create(GRID_CACHE_SIZE, 1);
         grid = cache_get(rend->grid_cache, &key, sizeof(key));
-        if (grid)
-            return grid;
     }
 
-    grid = malloc(n * n * sizeof(*grid));
-    uv_map_grid(map, split, grid, NULL);
+    if (!grid) {
+        raw_map = *map;
+        raw_map.transf = NULL;
+        grid = malloc(n * n * sizeof(*grid));
+        uv_map_grid(&raw_map, split, grid, NULL);
+        if (can_cache) {
+            cache_add(rend->grid_cache, &key, sizeof(key),
+                      grid, sizeof(*grid) * n * n, grid_del);
+        }
+    }
 
-    if (can_cache) {
-        cache_add(rend->grid_cache, &key, sizeof(key),
-                  grid, sizeof(*grid) * n * n, NULL);
+    // Apply the transformation the same way as uv_map.
+    *should_delete = !can_cache || map->transf;
+    ret = *should_delete && can_cache ?
+            malloc(n * n * sizeof(*grid)) : grid;
+    for (i = 0; i < n * n && (map->transf || normals); i++) {
+        if (normals) vec3_copy(grid[i], normals[i]);
+        if (map->transf) {
+            mat4_mul_vec4(*map->transf, grid[i], ret[i]);
+            if (normals) mat4_mul_dir3(*map->transf, normals[i], normals[i]);
+        }
+        if (normals) vec3_normalize(normals[i], normals[i]);
     }
+    return ret;
+}
+
+/*
+ * Function: render_set_grid_cache_size
+ * Set the maximum size in bytes of the uv map grids cache.
+ */
+void render_set_grid_cache_size(renderer_t *rend, int size)
+{
+    if (!rend->grid_cache)
+        rend->grid_cache = cache_create(size, 1);
+    cache_set_max_size(rend->grid_cache, size);
+}
 
-    return grid;
+/*
+ * Function: render_get_grid_cache_stats
+ * Return the size and usage statistics of the uv map grids cache.
+ */
+void render_get_grid_cache_stats(const renderer_t *rend,
+                                 int *size, int *max_size,
+                                 int *hits, int *misses)
+{
+    const cache_t *cache = rend->grid_cache;
+    *size = cache ? cache_get_current_size(cache) : 0;
+    *max_size = cache ? cache_get_max_size(cache) : GRID_CACHE_SIZE;
+    *hits = *misses = 0;
+    if (cache) cache_get_stats(cache, hits, misses);
 }
 
 static void compute_tangent(const double uv[2], const uv_map_t *map,
@@ -582,7 +703,10 @@ static void quad_planet(
 {
     item_t *item;
     int n, i, j, k;
-    double p[4], mpos[4], normal[4] = {0}, tangent[4] = {0}, mv[4][4], depth;
+    double p[4], mpos[4], tangent[4] = {0}, mv[4][4], depth;
+    const double (*grid)[4];
+    double (*normals)[3];
+    bool should_delete_grid;
 
     // Positions of the triangles in the quads.
     const int INDICES[6][2] = { {0, 0}, {0, 1}, {1, 0},
@@ -638,6 +762,8 @@ static void quad_planet(
     assert(item->tex->w == item->tex->tex_w &&
            item->tex->h == item->tex->tex_h);
 
+    normals = malloc(n * n * sizeof(*normals));
+    grid = get_grid(rend, map, grid_size, normals, &should_delete_grid);
     for (i = 0; i < n; i++)
     for (j = 0; j < n; j++) {
         vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
@@ -647,11 +773,11 @@ static void quad_planet(
             gl_buf_3f(&item->buf, -1, ATTR_TANGENT, VEC3_SPLIT(tangent));
         }
 
-        vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
-        uv_map(map, p, p, normal);
+        vec4_copy(grid[i * n + j], p);
         assert(p[3] == 1.0); // Planet can never be at infinity.
 
-        gl_buf_3f(&item->buf, -1, ATTR_NORMAL, VEC3_SPLIT(normal));
+        gl_buf_3f(&item->buf, -1, ATTR_NORMAL,
+                  VEC3_SPLIT(normals[i * n + j]));
 
         // Model position (without scaling applied).
         vec4_copy(p, mpos);
@@ -673,6 +799,9 @@ static void quad_planet(
         gl_buf_next(&item->buf);
     }
 
+    if (should_delete_grid) free((void*)grid);
+    free(normals);
+
     for (i = 0; i < grid_size; i++)
     for (j = 0; j < grid_size; j++) {
         for (k = 0; k < 6; k++) {
@@ -741,7 +870,7 @@ void render_quad(renderer_t *rend, const painter_t *painter,
     vec4_to_float(painter->color, item->color);
     item->flags = painter->flags;
 
-    grid = get_grid(rend, map, grid_size, &should_delete_grid);
+    grid = get_grid(rend, map, grid_size, NULL, &should_delete_grid);
     for (i = 0; i < n; i++)
     for (j = 0; j < n; j++) {
         vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
@@ -1254,6 +1383,172 @@ static void draw_buffer(const gl_buf_t *buf, const gl_buf_t *indices,
     GL(glDeleteBuffers(1, &index_buffer));
 }
 
+typedef struct {
+    GLuint  array_buffer;
+    GLuint  index_buffer;
+    // Static meshes only: offset and count of the triangles, lines and
+    // points indices in the index buffer.
+    int     ranges[3][2];
+} mesh_buffers_t;
+
+static int mesh_buffers_delete(void *data)
+{
+    mesh_buffers_t *bufs = data;
+    GL(glDeleteBuffers(1, &bufs->array_buffer));
+    GL(glDeleteBuffers(1, &bufs->index_buffer));
+    free(bufs);
+    return 0;
+}
+
+static int get_mesh_indices(const mesh_t *mesh, int mode,
+                            const uint16_t **indices)
+{
+    switch (mode) {
+    case MODE_TRIANGLES:
+        *indices = mesh->triangles;
+        return mesh->triangles_count;
+    case MODE_LINES:
+        *indices = mesh->lines;
+        return mesh->lines_count;
+    case MODE_POINTS:
+        *indices = mesh->points;
+        return mesh->points_count;
+    default:
+        assert(false);
+        return 0;
+    }
+}
+
+/*
+ * Get the GL buffers of a static mesh from the cache, or create them.
+ * Since the vertices stay in the mesh frame, and the color is an uniform,
+ * we only upload a mesh once, until its id changes.  The index buffer
+ * contains the triangles, lines and points indices one after the other.
+ */
+static const mesh_buffers_t *get_mesh_buffers(renderer_t *rend,
+                                              const mesh_t *mesh)
+{
+    mesh_buffers_t *bufs;
+    gl_buf_t buf = {}, indices = {};
+    const uint16_t *mesh_indices;
+    int i, mode, n;
+    double pos[3];
+
+    if (!rend->mesh_cache)
+        rend->mesh_cache = cache_create(MESH_CACHE_SIZE, 1);
+    bufs = cache_get(rend->mesh_cache, &mesh->id, sizeof(mesh->id));
+    if (bufs) return bufs;
+
+    bufs = calloc(1, sizeof(*bufs));
+    gl_buf_alloc(&buf, &STATIC_MESH_BUF, mesh->vertices_count);
+    gl_buf_alloc(&indices, &INDICES_BUF, mesh->triangles_count +
+                 mesh->lines_count + mesh->points_count);
+    for (i = 0; i < mesh->vertices_count; i++) {
+        vec3_normalize(mesh->vertices[i], pos);
+        gl_buf_3f(&buf, -1, ATTR_POS, VEC3_SPLIT(pos));
+        gl_buf_next(&buf);
+    }
+    for (mode = MODE_TRIANGLES; mode <= MODE_POINTS; mode++) {
+        n = get_mesh_indices(mesh, mode, &mesh_indices);
+        bufs->ranges[mode][0] = indices.nb;
+        bufs->ranges[mode][1] = n;
+        for (i = 0; i < n; i++) {
+            gl_buf_1i(&indices, -1, 0, mesh_indices[i]);
+            gl_buf_next(&indices);
+        }
+    }
+
+    GL(glGenBuffers(1, &bufs->index_buffer));
+    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs->index_buffer));
+    GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                    indices.nb * indices.info->size,
+                    indices.data, GL_STATIC_DRAW));
+    GL(glGenBuffers(1, &bufs->array_buffer));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, bufs->array_buffer));
+    GL(glBufferData(GL_ARRAY_BUFFER, buf.nb * buf.info->size,
+                    buf.data, GL_STATIC_DRAW));
+    cache_add(rend->mesh_cache, &mesh->id, sizeof(mesh->id), bufs,
+              buf.nb * buf.info->size + indices.nb * indices.info->size,
+              mesh_buffers_delete);
+    gl_buf_release(&buf);
+    gl_buf_release(&indices);
+    return bufs;
+}
+
+/*
+ * Draw a static quad item, using the GL buffers from the cache, or the ones
+ * computed when the item was created.
+ */
+static void draw_static_quad(renderer_t *rend, const item_t *item)
+{
+    mesh_buffers_t *bufs;
+    const gl_buf_t buf = {.info = &TEXTURE_BUF};
+
+    if (!rend->mesh_cache)
+        rend->mesh_cache = cache_create(MESH_CACHE_SIZE, 1);
+    bufs = cache_get(rend->mesh_cache, &item->quad.key,
+                     sizeof(item->quad.key));
+    if (!bufs) {
+        // Can only happen if the buffers got removed from the cache since
+        // we created the item.
+        if (!item->buf.nb) return;
+        bufs = calloc(1, sizeof(*bufs));
+        GL(glGenBuffers(1, &bufs->index_buffer));
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs->index_buffer));
+        GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                        item->indices.nb * item->indices.info->size,
+                        item->indices.data, GL_STATIC_DRAW));
+        GL(glGenBuffers(1, &bufs->array_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, bufs->array_buffer));
+        GL(glBufferData(GL_ARRAY_BUFFER,
+                        item->buf.nb * item->buf.info->size,
+                        item->buf.data, GL_STATIC_DRAW));
+        cache_add(rend->mesh_cache, &item->quad.key,
+                  sizeof(item->quad.key), bufs,
+                  item->buf.nb * item->buf.info->size +
+                  item->indices.nb * item->indices.info->size,
+                  mesh_buffers_delete);
+    }
+    GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs->index_buffer));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, bufs->array_buffer));
+    gl_buf_enable(&buf);
+    GL(glDrawElements(GL_TRIANGLES, item->quad.indices_count,
+                      GL_UNSIGNED_SHORT, 0));
+    gl_buf_disable(&buf);
+}
+
+// Draw the range of indices of each mesh for the item mode.
+static void draw_static_meshes(renderer_t *rend, gl_shader_t *shader,
+                               const item_t *item, GLuint gl_mode)
+{
+    const mesh_buffers_t *bufs;
+    const gl_buf_t buf = {.info = &STATIC_MESH_BUF};
+    const int *range;
+    const uint8_t *c;
+    float color[4];
+    int i;
+
+    for (i = 0; i < item->mesh.meshes_count; i++) {
+        bufs = get_mesh_buffers(rend, item->mesh.meshes[i]);
+        range = bufs->ranges[item->mesh.mode];
+        if (!range[1]) continue;
+        c = item->mesh.colors[i];
+        if (i == 0 || memcmp(c, item->mesh.colors[i - 1], 4)) {
+            color[0] = c[0] / 255.f;
+            color[1] = c[1] / 255.f;
+            color[2] = c[2] / 255.f;
+            color[3] = c[3] / 255.f;
+            gl_update_uniform(shader, "u_color", color);
+        }
+        GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs->index_buffer));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, bufs->array_buffer));
+        gl_buf_enable(&buf);
+        GL(glDrawElements(gl_mode, range[1], GL_UNSIGNED_SHORT,
+                          (void*)(intptr_t)(range[0] * INDICES_BUF.size)));
+        gl_buf_disable(&buf);
+    }
+}
+
 static void item_mesh_render(renderer_t *rend, const item_t *item)
 {
     // XXX: almost the same as item_lines_render.
@@ -1269,6 +1564,8 @@ static void item_mesh_render(renderer_t *rend, const item_t *item)
 
     shader_define_t defines[] = {
         {"PROJ", rend->proj.klass->id},
+        {"STATIC", item->type == ITEM_STATIC_MESH},
+        {"REFRACTION", item->mesh.refraction[0] != 0},
         {}
     };
     shader = shader_get("mesh", defines, ATTR_NAMES, init_shader);
@@ -1300,7 +1597,14 @@ static void item_mesh_render(renderer_t *rend, const item_t *item)
     proj = rend_get_proj(rend, item->flags);
     gl_update_uniform_mat4(shader, "u_proj_mat", proj.mat);
 
-    draw_buffer(&item->buf, &item->indices, gl_mode);
+    if (item->type == ITEM_STATIC_MESH) {
+        gl_update_uniform_mat3(shader, "u_rot", item->mesh.rot);
+        gl_update_uniform_mat3(shader, "u_rot2", item->mesh.rot2);
+        gl_update_uniform(shader, "u_refraction", item->mesh.refraction);
+        draw_static_meshes(rend, shader, item, gl_mode);
+    } else {
+        draw_buffer(&item->buf, &item->indices, gl_mode);
+    }
 
     if (item->mesh.use_stencil) {
         GL(glDisable(GL_STENCIL_TEST));
@@ -1455,6 +1759,7 @@ static void item_fog_render(renderer_t *rend, const item_t *item)
 
     shader_define_t defines[] = {
         {"PROJ", rend->proj.klass->id},
+        {"STATIC", item->type == ITEM_STATIC_FOG},
         {}
     };
     shader = shader_get("fog", defines, ATTR_NAMES, init_shader);
@@ -1470,7 +1775,13 @@ static void item_fog_render(renderer_t *rend, const item_t *item)
     gl_update_uniform_mat4(shader, "u_proj_mat", proj.mat);
     gl_update_uniform(shader, "u_color", item->color);
 
-    draw_buffer(&item->buf, &item->indices, GL_TRIANGLES);
+    if (item->type == ITEM_STATIC_FOG) {
+        gl_update_uniform_mat3(shader, "u_rot", item->quad.rot);
+        gl_update_uniform_mat3(shader, "u_rot2", item->quad.rot2);
+        draw_static_quad(rend, item);
+    } else {
+        draw_buffer(&item->buf, &item->indices, GL_TRIANGLES);
+    }
     GL(glCullFace(GL_BACK));
 }
 
@@ -1527,7 +1838,8 @@ static void item_texture_render(renderer_t *rend, const item_t *item)
     shader_define_t defines[] = {
         {"TEXTURE_LUMINANCE", item->tex->format == GL_LUMINANCE &&
                               !(item->flags & PAINTER_ADD)},
-        {"PROJ", item->type == ITEM_TEXTURE ? rend->proj.klass->id : 0},
+        {"PROJ", item->type != ITEM_TEXTURE_2D ? rend->proj.klass->id : 0},
+        {"STATIC", item->type == ITEM_STATIC_TEXTURE},
         {}
     };
     shader = shader_get("blit", defines, ATTR_NAMES, init_shader);
@@ -1565,7 +1877,13 @@ static void item_texture_render(renderer_t *rend, const item_t *item)
     proj = rend_get_proj(rend, item->flags);
     gl_update_uniform_mat4(shader, "u_proj_mat", proj.mat);
 
-    draw_buffer(&item->buf, &item->indices, GL_TRIANGLES);
+    if (item->type == ITEM_STATIC_TEXTURE) {
+        gl_update_uniform_mat3(shader, "u_rot", item->quad.rot);
+        gl_update_uniform_mat3(shader, "u_rot2", item->quad.rot2);
+        draw_static_quad(rend, item);
+    } else {
+        draw_buffer(&item->buf, &item->indices, GL_TRIANGLES);
+    }
     GL(glCullFace(GL_BACK));
 }
 
@@ -1694,6 +2012,22 @@ static void item_gltf_render(renderer_t *rend, const item_t *item)
                 proj, item->gltf.light_dir, item->gltf.args);
 }
 
+static void item_delete(item_t *item)
+{
+    if (item->type == ITEM_STATIC_MESH) {
+        free(item->mesh.meshes);
+        free(item->mesh.colors);
+    }
+    texture_release(item->tex);
+    if (item->type == ITEM_PLANET)
+        texture_release(item->planet.normalmap);
+    if (item->type == ITEM_GLTF)
+        json_builder_free(item->gltf.args);
+    gl_buf_release(&item->buf);
+    gl_buf_release(&item->indices);
+    free(item);
+}
+
 static void rend_flush(renderer_t *rend)
 {
     item_t *item, *tmp;
@@ -1740,6 +2074,7 @@ static void rend_flush(renderer_t *rend)
             item_lines_render(rend, item);
             break;
         case ITEM_MESH:
+        case ITEM_STATIC_MESH:
             item_mesh_render(rend, item);
             break;
         case ITEM_POINTS:
@@ -1749,6 +2084,7 @@ static void rend_flush(renderer_t *rend)
             item_points_3d_render(rend, item);
             break;
         case ITEM_TEXTURE:
+        case ITEM_STATIC_TEXTURE:
             item_texture_render(rend, item);
             break;
         case ITEM_TEXTURE_2D:
@@ -1758,6 +2094,7 @@ static void rend_flush(renderer_t *rend)
             item_atmosphere_render(rend, item);
             break;
         case ITEM_FOG:
+        case ITEM_STATIC_FOG:
             item_fog_render(rend, item);
             break;
         case ITEM_PLANET:
@@ -1779,14 +2116,7 @@ static void rend_flush(renderer_t *rend)
         }
 
         DL_DELETE(rend->items, item);
-        texture_release(item->tex);
-        if (item->type == ITEM_PLANET)
-            texture_release(item->planet.normalmap);
-        if (item->type == ITEM_GLTF)
-            json_builder_free(item->gltf.args);
-        gl_buf_release(&item->buf);
-        gl_buf_release(&item->indices);
-        free(item);
+        item_delete(item);
     }
     // Reset to default OpenGL settings.
     GL(glDepthMask(GL_TRUE));
@@ -1811,11 +2141,13 @@ void render_line(renderer_t *rend, const painter_t *painter,
     if (size <= 1) return;
     assert(painter->lines.glow); // Only glowing lines supported for now.
     vec4_to_float(painter->color, color);
-    mesh = line_to_mesh(line, win, size, fmax(10, painter->lines.width + 2));
+    mesh = rend->line_mesh = line_to_mesh(
+            line, win, size, fmax(10, painter->lines.width + 2),
+            rend->line_mesh);
 
     if (mesh->indices_count >= SIZE || mesh->verts_count >= SIZE) {
         LOG_W("Too many points in lines! (size: %d)", size);
-        goto end;
+        return;
     }
 
     // Get the item.
@@ -1872,9 +2204,6 @@ void render_line(renderer_t *rend, const painter_t *painter,
         gl_buf_1i(&item->indices, -1, 0, mesh->indices[i] + ofs);
         gl_buf_next(&item->indices);
     }
-
-end:
-    line_mesh_delete(mesh);
 }
 
 void render_mesh(renderer_t *rend, const painter_t *painter,
@@ -1928,6 +2257,172 @@ void render_mesh(renderer_t *rend, const painter_t *painter,
     }
 }
 
+/*
+ * Compute the transformations from a frame to the view frame, as done in
+ * the mesh shader: a rotation to the observed frame, the refraction, and
+ * a rotation to the view frame.  Return false if the frame is not
+ * supported.
+ */
+static bool get_frame_to_view(const observer_t *obs, int frame,
+                              double rot[3][3], double rot2[3][3],
+                              float refraction[2])
+{
+    refraction[0] = refraction[1] = 0;
+    mat3_copy(obs->ro2v, rot2);
+    switch (frame) {
+    case FRAME_ICRF:
+        mat3_transpose(obs->astrom.bpn, rot);
+        mat3_mul(obs->ri2h, rot, rot);
+        if (obs->pressure) {
+            refraction[0] = obs->refa;
+            refraction[1] = obs->refb;
+        }
+        return true;
+    case FRAME_OBSERVED:
+        mat3_set_identity(rot);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool render_static_mesh(renderer_t *rend, const painter_t *painter,
+                        int frame, int mode, const mesh_t *mesh,
+                        bool use_stencil)
+{
+    double rot[3][3], rot2[3][3];
+    float refraction[2];
+    uint8_t color[4];
+    int n;
+    item_t *item;
+
+    if (!mesh->id || mesh->vertices_count > 65536) return false;
+    if (!get_frame_to_view(painter->obs, frame, rot, rot2, refraction))
+        return false;
+
+    color[0] = painter->color[0] * 255;
+    color[1] = painter->color[1] * 255;
+    color[2] = painter->color[2] * 255;
+    color[3] = painter->color[3] * 255;
+    if (!color[3]) return true;
+
+    // Try to merge with the previous item, so that we only setup the
+    // shader once for all the meshes.
+    item = rend->items ? rend->items->prev : NULL;
+    if (item && item->type != ITEM_STATIC_MESH) item = NULL;
+    if (item && item->mesh.mode != mode) item = NULL;
+    if (item && item->mesh.use_stencil != use_stencil) item = NULL;
+    if (item && item->mesh.stroke_width != painter->lines.width) item = NULL;
+    if (item && item->flags != painter->flags) item = NULL;
+    if (item && memcmp(item->mesh.rot, rot, sizeof(rot))) item = NULL;
+    if (item && memcmp(item->mesh.refraction, refraction, sizeof(refraction)))
+        item = NULL;
+
+    if (!item) {
+        item = calloc(1, sizeof(*item));
+        item->type = ITEM_STATIC_MESH;
+        item->flags = painter->flags;
+        item->mesh.mode = mode;
+        item->mesh.stroke_width = painter->lines.width;
+        item->mesh.use_stencil = use_stencil;
+        mat3_copy(rot, item->mesh.rot);
+        mat3_copy(rot2, item->mesh.rot2);
+        memcpy(item->mesh.refraction, refraction, sizeof(refraction));
+        DL_APPEND(rend->items, item);
+    }
+
+    n = item->mesh.meshes_count;
+    if (n >= item->mesh.meshes_allocated) {
+        item->mesh.meshes_allocated = item->mesh.meshes_allocated * 2 ?: 64;
+        item->mesh.meshes = realloc(item->mesh.meshes,
+                item->mesh.meshes_allocated * sizeof(*item->mesh.meshes));
+        item->mesh.colors = realloc(item->mesh.colors,
+                item->mesh.meshes_allocated * sizeof(*item->mesh.colors));
+    }
+    item->mesh.meshes[n] = mesh;
+    memcpy(item->mesh.colors[n], color, sizeof(color));
+    item->mesh.meshes_count++;
+    return true;
+}
+
+bool render_static_quad(renderer_t *rend, const painter_t *painter,
+                        int frame, int grid_size, const uv_map_t *map)
+{
+    const int INDICES[6][2] = {
+        {0, 0}, {0, 1}, {1, 0}, {1, 1}, {1, 0}, {0, 1} };
+    double rot[3][3], rot2[3][3], p[3], pos[3], tex_pos[2];
+    float refraction[2];
+    int n = grid_size + 1, i, j, k;
+    const double (*grid)[4];
+    bool should_delete_grid;
+    quad_key_t key;
+    item_t *item;
+    texture_t *tex = painter->textures[PAINTER_TEX_COLOR].tex;
+
+    if (painter->flags & (PAINTER_PLANET_SHADER | PAINTER_RING_SHADER |
+                          PAINTER_ATMOSPHERE_SHADER))
+        return false;
+    if (!map->at_infinity || n * n > 65536) return false;
+    if (!get_frame_to_view(painter->obs, frame, rot, rot2, refraction))
+        return false;
+    // The blit and fog shaders don't support the refraction.
+    if (refraction[0]) return false;
+    memset(&key, 0, sizeof(key));
+    if (!grid_get_key(map, grid_size, &key.grid)) return false;
+
+    if (!tex) tex = rend->white_tex;
+    if (map->transf)
+        memcpy(key.transf, *map->transf, sizeof(key.transf));
+    mat3_copy(painter->textures[PAINTER_TEX_COLOR].mat, key.uv);
+    for (i = 0; i < 3; i++) {
+        key.uv[i][0] *= (double)tex->w / tex->tex_w;
+        key.uv[i][1] *= (double)tex->h / tex->tex_h;
+    }
+
+    item = calloc(1, sizeof(*item));
+    item->type = (painter->flags & PAINTER_FOG_SHADER) ?
+                 ITEM_STATIC_FOG : ITEM_STATIC_TEXTURE;
+    item->tex = tex;
+    item->tex->ref++;
+    vec4_to_float(painter->color, item->color);
+    item->flags = painter->flags;
+    item->quad.key = key;
+    item->quad.indices_count = grid_size * grid_size * 6;
+    mat3_copy(rot, item->quad.rot);
+    mat3_copy(rot2, item->quad.rot2);
+    DL_APPEND(rend->items, item);
+
+    if (rend->mesh_cache &&
+            cache_get(rend->mesh_cache, &key, sizeof(key)))
+        return true;
+
+    // Not in the cache yet: compute the buffers, they will be uploaded
+    // when we flush the item.
+    gl_buf_alloc(&item->buf, &TEXTURE_BUF, n * n);
+    gl_buf_alloc(&item->indices, &INDICES_BUF, item->quad.indices_count);
+    grid = get_grid(rend, map, grid_size, NULL, &should_delete_grid);
+    for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++) {
+        vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
+        mat3_mul_vec3(key.uv, p, p);
+        vec2_copy(p, tex_pos);
+        gl_buf_2f(&item->buf, -1, ATTR_TEX_POS, tex_pos[0], tex_pos[1]);
+        vec3_normalize(grid[i * n + j], pos);
+        gl_buf_3f(&item->buf, -1, ATTR_POS, VEC3_SPLIT(pos));
+        gl_buf_next(&item->buf);
+    }
+    if (should_delete_grid) free((void*)grid);
+    for (i = 0; i < grid_size; i++)
+    for (j = 0; j < grid_size; j++) {
+        for (k = 0; k < 6; k++) {
+            gl_buf_1i(&item->indices, -1, 0,
+                      (INDICES[k][1] + i) * n + (INDICES[k][0] + j));
+            gl_buf_next(&item->indices);
+        }
+    }
+    return true;
+}
+
 void render_ellipse_2d(renderer_t *rend, const painter_t *painter,
                        const double pos[2], const double size[2],
                        double angle, double dashes)
@@ -2152,3 +2647,190 @@ renderer_t* render_create(void)
 
     return rend;
 }
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_clear_items(renderer_t *rend)
+{
+    item_t *item, *tmp;
+    DL_FOREACH_SAFE(rend->items, item, tmp) {
+        DL_DELETE(rend->items, item);
+        item_delete(item);
+    }
+}
+
+// Check that the static meshes buffers are only uploaded once per mesh,
+// whatever the color, until the mesh gets modified.
+static void test_static_mesh(void)
+{
+    renderer_t rend = {.fb_size = {100, 100}, .scale = 1};
+    painter_t painter = {.obs = core->observer, .color = {1, 1, 1, 1}};
+    const double verts[4][2] = {{0, 0}, {10, 0}, {10, 10}, {0, 10}};
+    const double (*rings[1])[2] = {verts};
+    mesh_t *mesh = mesh_create();
+    const mesh_buffers_t *bufs;
+    bool r;
+
+    mesh_add_poly_lonlat(mesh, 1, (int[]){4}, rings);
+    r = render_static_mesh(&rend, &painter, FRAME_ICRF, MODE_TRIANGLES,
+                           mesh, false);
+    assert(r);
+    painter.color[0] = 0.5;
+    render_static_mesh(&rend, &painter, FRAME_ICRF, MODE_TRIANGLES,
+                       mesh, false);
+    // Both are merged in a single item.
+    assert(rend.items && rend.items == rend.items->prev);
+    assert(rend.items->mesh.meshes_count == 2);
+    test_clear_items(&rend);
+
+    bufs = get_mesh_buffers(&rend, mesh);
+    assert(bufs->ranges[MODE_TRIANGLES][0] == 0);
+    assert(bufs->ranges[MODE_TRIANGLES][1] == mesh->triangles_count);
+    assert(get_mesh_buffers(&rend, mesh) == bufs);
+    assert(cache_get_current_size(rend.mesh_cache) > 0);
+
+    // Modifying the mesh invalidates the buffers.
+    mesh_add_point_lonlat(mesh, VEC(20, 20));
+    bufs = get_mesh_buffers(&rend, mesh);
+    assert(bufs->ranges[MODE_POINTS][0] ==
+           mesh->triangles_count + mesh->lines_count);
+    assert(bufs->ranges[MODE_POINTS][1] == 1);
+
+    cache_delete(rend.mesh_cache);
+    mesh_delete(mesh);
+}
+
+static void test_static_quad(void)
+{
+    renderer_t rend = {.fb_size = {100, 100}, .scale = 1};
+    texture_t tex = {.ref = 1, .w = 100, .h = 100, .tex_w = 128,
+                     .tex_h = 128};
+    painter_t painter = {.obs = core->observer, .color = {1, 1, 1, 1},
+                         .flags = PAINTER_STATIC};
+    uv_map_t map;
+    quad_key_t key;
+    double transf[4][4];
+
+    rend.white_tex = &tex;
+    mat3_set_identity(painter.textures[PAINTER_TEX_COLOR].mat);
+    uv_map_init_healpix(&map, 1, 10, false, true);
+    assert(render_static_quad(&rend, &painter, FRAME_OBSERVED, 4, &map));
+    assert(rend.items->type == ITEM_STATIC_TEXTURE);
+    assert(rend.items->buf.nb == 25 && rend.items->indices.nb == 96);
+    key = rend.items->quad.key;
+    test_clear_items(&rend);
+
+    // Same key for the next frames, even if the view changed.
+    render_static_quad(&rend, &painter, FRAME_OBSERVED, 4, &map);
+    assert(memcmp(&rend.items->quad.key, &key, sizeof(key)) == 0);
+    test_clear_items(&rend);
+
+    // The texture coordinates are part of the key.
+    mat3_iscale(painter.textures[PAINTER_TEX_COLOR].mat, 0.5, 0.5, 1);
+    render_static_quad(&rend, &painter, FRAME_OBSERVED, 4, &map);
+    assert(memcmp(&rend.items->quad.key, &key, sizeof(key)) != 0);
+    key = rend.items->quad.key;
+    test_clear_items(&rend);
+
+    // And the exact map transformation.
+    mat4_set_identity(transf);
+    map.transf = &transf;
+    render_static_quad(&rend, &painter, FRAME_OBSERVED, 4, &map);
+    assert(memcmp(&rend.items->quad.key, &key, sizeof(key)) != 0);
+    assert(memcmp(rend.items->quad.key.transf, transf, sizeof(transf)) == 0);
+    key = rend.items->quad.key;
+    test_clear_items(&rend);
+    transf[3][0] = 1e-12;
+    render_static_quad(&rend, &painter, FRAME_OBSERVED, 4, &map);
+    assert(memcmp(&rend.items->quad.key, &key, sizeof(key)) != 0);
+    test_clear_items(&rend);
+
+    // Maps not at infinity are not supported.
+    uv_map_init_healpix(&map, 1, 10, false, false);
+    assert(!render_static_quad(&rend, &painter, FRAME_OBSERVED, 4, &map));
+    assert(!rend.items);
+    assert(tex.ref == 1);
+    cache_delete(rend.grid_cache);
+}
+
+static void test_map(const uv_map_t *map, const double v[2], double out[4])
+{
+    const double *z = map->user;
+    vec4_set(out, v[0], v[1], *z, 1.0);
+    vec3_normalize(out, out);
+}
+
+// Check that the cached grids are the same as the computed ones.
+static void test_check_grid(renderer_t *rend, const uv_map_t *map, int split)
+{
+    int i, j, n = split + 1;
+    const double (*grid)[4];
+    double (*normals)[3], p[4], normal[3];
+    bool should_delete;
+
+    normals = malloc(n * n * sizeof(*normals));
+    grid = get_grid(rend, map, split, normals, &should_delete);
+    for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++) {
+        uv_map(map, VEC((double)j / split, (double)i / split), p, normal);
+        assert(vec4_equal(p, grid[i * n + j]));
+        assert(vec3_equal(normal, normals[i * n + j]));
+    }
+    if (should_delete) free((void*)grid);
+    free(normals);
+}
+
+static void test_grid_cache(void)
+{
+    renderer_t rend = {};
+    const double z = 2.0;
+    double transf[4][4];
+    int size, max_size, hits, misses;
+    uv_map_t map = {.map = test_map, .user = &z, .transf = &transf};
+
+    mat4_set_identity(transf);
+    mat4_itranslate(transf, 1, 2, 3);
+
+    // Maps without key are not cached.
+    test_check_grid(&rend, &map, 4);
+    assert(!rend.grid_cache);
+
+    // The cached grid don't depend on the transformation.
+    map.key = 1;
+    test_check_grid(&rend, &map, 4);
+    mat4_rz(1.0, transf, transf);
+    test_check_grid(&rend, &map, 4);
+    render_get_grid_cache_stats(&rend, &size, &max_size, &hits, &misses);
+    assert(hits == 1 && misses == 1);
+    assert(size == 25 * sizeof(double[4]));
+
+    // Changing the key or the split computes a new grid.
+    map.key = 2;
+    test_check_grid(&rend, &map, 4);
+    test_check_grid(&rend, &map, 8);
+    render_get_grid_cache_stats(&rend, &size, &max_size, &hits, &misses);
+    assert(hits == 1 && misses == 3);
+
+    // Healpix maps are always cached.
+    uv_map_init_healpix(&map, 2, 10, true, false);
+    map.transf = &transf;
+    test_check_grid(&rend, &map, 4);
+    map.transf = NULL;
+    test_check_grid(&rend, &map, 4);
+    render_get_grid_cache_stats(&rend, &size, &max_size, &hits, &misses);
+    assert(hits == 2 && misses == 4);
+
+    // The cache budget can be changed.
+    render_set_grid_cache_size(&rend, 1);
+    assert(cache_get_max_size(rend.grid_cache) == 1);
+    cache_delete(rend.grid_cache);
+}
+
+TEST_REGISTER(NULL, test_static_mesh, TEST_AUTO);
+TEST_REGISTER(NULL, test_static_quad, TEST_AUTO);
+TEST_REGISTER(NULL, test_grid_cache, TEST_AUTO);
+
+#endif
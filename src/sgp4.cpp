@@ -53,6 +53,20 @@ sgp4_elsetrec_t *sgp4_twoline2rv(
     return (sgp4_elsetrec*)ret;
 }
 
+sgp4_elsetrec_t *sgp4_init_elements(
+        int satnum, const double epoch[2], double bstar, double ndot,
+        double nddot, double ecco, double argpo, double inclo, double mo,
+        double no_kozai, double nodeo)
+{
+    elsetrec *ret = (elsetrec*)calloc(1, sizeof(*ret));
+    ret->jdsatepoch = epoch[0];
+    ret->jdsatepochF = epoch[1];
+    SGP4Funcs::sgp4init(wgs72, 'i', satnum,
+                        (epoch[0] + epoch[1]) - 2433281.5, bstar, ndot, nddot,
+                        ecco, argpo, inclo, mo, no_kozai, nodeo, *ret);
+    return (sgp4_elsetrec*)ret;
+}
+
 int sgp4(sgp4_elsetrec_t *satrec, double utc_mjd, double r[3], double v[3])
 {
     double tsince;
@@ -65,6 +79,13 @@ int sgp4(sgp4_elsetrec_t *satrec, double utc_mjd, double r[3], double v[3])
     return elrec->error;
 }
 
+int sgp4_const(const sgp4_elsetrec_t *satrec, double utc_mjd,
+               double r[3], double v[3])
+{
+    elsetrec elrec = *(const elsetrec*)satrec;
+    return sgp4((sgp4_elsetrec_t*)&elrec, utc_mjd, r, v);
+}
+
 /*
  * Function: sgp4_get_satepoch
  * Return the reference epoch of a sat (UTC MJD)
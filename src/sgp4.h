@@ -21,6 +21,32 @@ sgp4_elsetrec_t *sgp4_twoline2rv(
         char typerun, char typeinput, char opsmode,
         double *startmfe, double *stopmfe, double *deltamin);
 
+/*
+ * Function: sgp4_init_elements
+ * Create a satellite record from already parsed TLE mean elements.
+ *
+ * This is the same as <sgp4_twoline2rv>, without the parsing of the TLE
+ * strings.
+ *
+ * Parameters:
+ *   satnum     - Satellite number.
+ *   epoch      - Epoch of the elements, as a julian date split in two
+ *                parts (integer + 0.5 and fraction).
+ *   bstar      - Drag coefficient (1/earth radii).
+ *   ndot       - First derivative of the mean motion (rad/min^2).
+ *   nddot      - Second derivative of the mean motion (rad/min^3).
+ *   ecco       - Eccentricity.
+ *   argpo      - Argument of perigee (rad).
+ *   inclo      - Inclination (rad).
+ *   mo         - Mean anomaly (rad).
+ *   no_kozai   - Mean motion (rad/min).
+ *   nodeo      - Right ascension of the ascending node (rad).
+ */
+sgp4_elsetrec_t *sgp4_init_elements(
+        int satnum, const double epoch[2], double bstar, double ndot,
+        double nddot, double ecco, double argpo, double inclo, double mo,
+        double no_kozai, double nodeo);
+
 /*
  * Returns same error codes as defined in ext_src/sgp4/SGP4.cpp:
  *   0 - no error
@@ -33,6 +59,17 @@ sgp4_elsetrec_t *sgp4_twoline2rv(
  */
 int sgp4(sgp4_elsetrec_t *satrec, double utc_mjd, double r[3], double v[3]);
 
+/*
+ * Function: sgp4_const
+ * Same as <sgp4>, but doesn't modify the satellite record.
+ *
+ * The SGP4 function updates some state in the record (error code and deep
+ * space integrator values), so this works on a copy, and can be called from
+ * several threads at the same time.
+ */
+int sgp4_const(const sgp4_elsetrec_t *satrec, double utc_mjd,
+               double r[3], double v[3]);
+
 /*
  * Function: sgp4_get_satepoch
  * Return the reference epoch of a sat (UTC MJD)
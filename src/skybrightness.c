@@ -8,9 +8,72 @@
  */
 
 #include <math.h>
+#include <stddef.h>
 #include "skybrightness.h"
 #include "utils/utils.h"
 
+/*
+ * Minimal SIMD abstraction used by skybrightness_get_luminance_batch.
+ * vf_t holds VF_SIZE floats, and vm_t a comparison mask of the same size.
+ */
+#if defined(__AVX__)
+#include <immintrin.h>
+#define VF_SIZE 8
+typedef __m256 vf_t;
+typedef __m256 vm_t;
+#define vf_set1(x)          _mm256_set1_ps(x)
+#define vf_load(p)          _mm256_loadu_ps(p)
+#define vf_store(p, a)      _mm256_storeu_ps(p, a)
+#define vf_add(a, b)        _mm256_add_ps(a, b)
+#define vf_sub(a, b)        _mm256_sub_ps(a, b)
+#define vf_mul(a, b)        _mm256_mul_ps(a, b)
+#define vf_div(a, b)        _mm256_div_ps(a, b)
+#define vf_min(a, b)        _mm256_min_ps(a, b)
+#define vf_max(a, b)        _mm256_max_ps(a, b)
+#define vf_sqrt(a)          _mm256_sqrt_ps(a)
+#define vf_gt(a, b)         _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define vm_and(a, b)        _mm256_and_ps(a, b)
+#define vf_select(m, a, b)  _mm256_blendv_ps(b, a, m)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VF_SIZE 4
+typedef __m128 vf_t;
+typedef __m128 vm_t;
+#define vf_set1(x)          _mm_set1_ps(x)
+#define vf_load(p)          _mm_loadu_ps(p)
+#define vf_store(p, a)      _mm_storeu_ps(p, a)
+#define vf_add(a, b)        _mm_add_ps(a, b)
+#define vf_sub(a, b)        _mm_sub_ps(a, b)
+#define vf_mul(a, b)        _mm_mul_ps(a, b)
+#define vf_div(a, b)        _mm_div_ps(a, b)
+#define vf_min(a, b)        _mm_min_ps(a, b)
+#define vf_max(a, b)        _mm_max_ps(a, b)
+#define vf_sqrt(a)          _mm_sqrt_ps(a)
+#define vf_gt(a, b)         _mm_cmpgt_ps(a, b)
+#define vm_and(a, b)        _mm_and_ps(a, b)
+#define vf_select(m, a, b)  _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define VF_SIZE 4
+typedef v128_t vf_t;
+typedef v128_t vm_t;
+#define vf_set1(x)          wasm_f32x4_splat(x)
+#define vf_load(p)          wasm_v128_load(p)
+#define vf_store(p, a)      wasm_v128_store(p, a)
+#define vf_add(a, b)        wasm_f32x4_add(a, b)
+#define vf_sub(a, b)        wasm_f32x4_sub(a, b)
+#define vf_mul(a, b)        wasm_f32x4_mul(a, b)
+#define vf_div(a, b)        wasm_f32x4_div(a, b)
+#define vf_min(a, b)        wasm_f32x4_min(a, b)
+#define vf_max(a, b)        wasm_f32x4_max(a, b)
+#define vf_sqrt(a)          wasm_f32x4_sqrt(a)
+#define vf_gt(a, b)         wasm_f32x4_gt(a, b)
+#define vm_and(a, b)        wasm_v128_and(a, b)
+#define vf_select(m, a, b)  wasm_v128_bitselect(a, b, m)
+#else
+#define VF_SIZE 1 // Use the scalar function.
+#endif
+
 #define exp10(x) exp((x) * log(10.0))
 #define exp10f(x) expf((x) * logf(10.f))
 
@@ -33,6 +96,46 @@ static inline float fast_acosf(float x)
         (1.f / 6.f + x * x *(3.f / 40.f + 5.f / 112.f * x * x)));
 }
 
+#if VF_SIZE > 1
+
+static inline vf_t vf_fast_expf(vf_t x) {
+    int i;
+    x = vf_add(vf_set1(1.0f), vf_mul(x, vf_set1(1.0f / 1024)));
+    for (i = 0; i < 10; i++) x = vf_mul(x, x);
+    return x;
+}
+
+static inline vf_t vf_fast_exp10f(vf_t x) {
+    return vf_fast_expf(vf_mul(x, vf_set1(logf(10.f))));
+}
+
+static inline vf_t vf_fast_acosf(vf_t x)
+{
+    vf_t x2 = vf_mul(x, x);
+    vf_t p = vf_add(vf_set1(3.f / 40.f), vf_mul(vf_set1(5.f / 112.f), x2));
+    p = vf_add(vf_set1(1.f / 6.f), vf_mul(x2, p));
+    return vf_sub(vf_set1(M_PI_2), vf_add(x, vf_mul(vf_mul(x2, x), p)));
+}
+
+// Accurate acosf, with an absolute error below 1e-7.
+// From Abramowitz and Stegun, formula 4.4.46.
+static inline vf_t vf_acosf(vf_t x)
+{
+    const float c[8] = {1.5707963050f, -0.2145988016f, 0.0889789874f,
+                        -0.0501743046f, 0.0308918810f, -0.0170881256f,
+                        0.0066700901f, -0.0012624911f};
+    int i;
+    vm_t neg = vf_gt(vf_set1(0.f), x);
+    vf_t a = vf_max(x, vf_sub(vf_set1(0.f), x));
+    vf_t p = vf_set1(c[7]);
+    for (i = 6; i >= 0; i--)
+        p = vf_add(vf_set1(c[i]), vf_mul(p, a));
+    p = vf_mul(p, vf_sqrt(vf_sub(vf_set1(1.f), a)));
+    return vf_select(neg, vf_sub(vf_set1(M_PI), p), p);
+}
+
+#endif // VF_SIZE > 1
+
 // Radiant to degree.
 static const float D2R = M_PI / 180.0f;
 
@@ -160,3 +263,215 @@ float skybrightness_get_luminance(
     // Convert to nano lambert then cd/m2
     return b_total / 1.11E-15f * NLAMBERT_TO_CDM2;
 }
+
+void skybrightness_get_luminance_batch(
+        const skybrightness_t *sb, int n,
+        const float *cos_moon_dist, const float *cos_sun_dist,
+        const float *cos_zenith_dist, float *out, float *sum, float *max)
+{
+    int i = 0;
+    float sum_ = 0.f, max_ = 0.f;
+
+#if VF_SIZE > 1
+    int j;
+    float tmp[VF_SIZE];
+    vf_t cm, cs, cz, md, sd, bKX, one_m_bKX, FS, FM, k, b_daylight;
+    vf_t b_twilight, b_moon, b_night, b_total, v_sum, v_max;
+    vm_t mask;
+
+    // All the per direction constants.
+    const vf_t max_cos = vf_set1(cosf(1.f * D2R));
+    const vf_t K = vf_set1(-0.4f * sb->K);
+    const vf_t twilight_k = vf_set1(0.063661977f /
+                                    (sb->K > 0.05f ? sb->K : 0.05f));
+    const vf_t C4 = vf_set1(sb->C4 * 9.289663e-12f);
+    const vf_t C4b = vf_set1(440000.f * (1.f - sb->C4) * 9.289663e-12f);
+    const vf_t C3 = vf_set1(sb->C3);
+    const vf_t C3b = vf_set1(440000.f * (1.f - sb->C3));
+    const vf_t zero = vf_set1(0.f);
+    const vf_t one = vf_set1(1.f);
+
+    v_sum = zero;
+    v_max = zero;
+    for (; i + VF_SIZE <= n; i += VF_SIZE) {
+        // This avoid issues in the algo
+        cm = vf_min(vf_load(cos_moon_dist + i), max_cos);
+        cs = vf_min(vf_load(cos_sun_dist + i), max_cos);
+        cz = vf_load(cos_zenith_dist + i);
+        md = vf_acosf(cm);
+        sd = vf_acosf(cs);
+
+        // Air mass
+        bKX = vf_fast_exp10f(vf_div(K, vf_add(cz, vf_mul(vf_set1(0.025f),
+                vf_fast_expf(vf_mul(vf_set1(-11.f), cz))))));
+        one_m_bKX = vf_sub(one, bKX);
+
+        // Daylight brightness
+        FS = vf_add(vf_add(
+                vf_div(vf_set1(18886.28f), vf_mul(sd, sd)),
+                vf_fast_exp10f(vf_sub(vf_set1(6.15f), vf_mul(
+                    vf_add(sd, vf_set1(0.001f)), vf_set1(1.43239f))))),
+                vf_mul(vf_set1(229086.77f),
+                       vf_add(vf_set1(1.06f), vf_mul(cs, cs))));
+        b_daylight = vf_mul(one_m_bKX, vf_add(vf_mul(FS, C4), C4b));
+
+        // Twilight brightness
+        k = vf_add(vf_set1(sb->b_twilight_term),
+                   vf_mul(twilight_k, vf_fast_acosf(cz)));
+        b_twilight = vf_mul(vf_mul(vf_fast_exp10f(k),
+                                   vf_div(vf_set1(1.7453293f), sd)),
+                            one_m_bKX);
+        b_twilight = vf_select(vf_gt(k, vf_set1(-32.f)), b_twilight, zero);
+
+        // Total sky brightness
+        b_total = vf_min(b_twilight, b_daylight);
+
+        // Moonlight brightness
+        FM = vf_add(vf_add(
+                vf_div(vf_set1(18886.28f), vf_mul(md, md)),
+                vf_fast_exp10f(vf_sub(vf_set1(6.15f),
+                                      vf_mul(md, vf_set1(1.43239f))))),
+                vf_mul(vf_set1(229086.77f),
+                       vf_add(vf_set1(1.06f), vf_mul(cm, cm))));
+        b_moon = vf_mul(vf_mul(vf_set1(sb->b_moon_term), one_m_bKX),
+                        vf_add(vf_mul(FM, C3), C3b));
+        b_total = vf_add(b_total, vf_div(b_moon, vf_set1(1000000.f)));
+
+        // Dark night sky brightness, don't compute if less than 1% daylight
+        b_night = vf_mul(vf_set1(sb->b_night_term), bKX);
+        mask = vm_and(vf_gt(b_total, zero),
+                      vf_gt(b_night, vf_mul(vf_set1(0.01f), b_total)));
+        b_night = vf_mul(b_night, vf_add(vf_set1(0.4f), vf_div(vf_set1(0.6f),
+                vf_sqrt(vf_add(vf_set1(0.04f),
+                               vf_mul(vf_set1(0.96f), vf_mul(cz, cz)))))));
+        // Ad-hoc addition to make the sky slightly more blueish
+        b_night = vf_add(b_night, vf_set1(0.0000000000012f));
+        b_total = vf_select(mask, vf_add(b_total, b_night), b_total);
+        b_total = vf_max(b_total, zero);
+
+        // Convert to nano lambert then cd/m2
+        b_total = vf_mul(vf_div(b_total, vf_set1(1.11E-15f)),
+                         vf_set1(NLAMBERT_TO_CDM2));
+        vf_store(out + i, b_total);
+        v_sum = vf_add(v_sum, b_total);
+        v_max = vf_max(v_max, b_total);
+    }
+
+    vf_store(tmp, v_sum);
+    for (j = 0; j < VF_SIZE; j++) sum_ += tmp[j];
+    vf_store(tmp, v_max);
+    for (j = 0; j < VF_SIZE; j++) max_ = fmaxf(max_, tmp[j]);
+#endif
+
+    // Remaining values.
+    for (; i < n; i++) {
+        out[i] = skybrightness_get_luminance(sb, cos_moon_dist[i],
+                    cos_sun_dist[i], cos_zenith_dist[i]);
+        sum_ += out[i];
+        max_ = fmaxf(max_, out[i]);
+    }
+
+    if (sum) *sum = sum_;
+    if (max) *max = max_;
+}
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "log.h"
+#include "system.h"
+#include "tests.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// Fill the inputs with random directions, for a given sun and moon zenith
+// distance.
+static void test_fill_dirs(int n, float *cm, float *cs, float *cz,
+                           float sun_z, float moon_z)
+{
+    int i;
+    float z, az;
+    for (i = 0; i < n; i++) {
+        z = (float)rand() / RAND_MAX * (float)M_PI_2;
+        az = (float)rand() / RAND_MAX * 2 * (float)M_PI;
+        cz[i] = cosf(z);
+        // Spherical law of cosines, sun and moon at different azimuth.
+        cs[i] = cosf(z) * cosf(sun_z) + sinf(z) * sinf(sun_z) * cosf(az);
+        cm[i] = cosf(z) * cosf(moon_z) + sinf(z) * sinf(moon_z) *
+                cosf(az - 2.f);
+    }
+}
+
+static void test_skybrightness_batch(void)
+{
+    const int n = 1003; // Not a multiple of the SIMD size.
+    const float sun_zs[] = {30, 85, 96, 102, 120};
+    float cm[n], cs[n], cz[n], out[n], ref, sum, max, ref_sum, ref_max;
+    double err, max_err;
+    int i, s;
+    skybrightness_t sb;
+
+    srand(1);
+    for (s = 0; s < sizeof(sun_zs) / sizeof(*sun_zs); s++) {
+        skybrightness_prepare(&sb, 2023, 5, -10, 45 * D2R, 100, 15, 40,
+                              60 * D2R, sun_zs[s] * D2R);
+        test_fill_dirs(n, cm, cs, cz, sun_zs[s] * D2R, 60 * D2R);
+        skybrightness_get_luminance_batch(&sb, n, cm, cs, cz, out,
+                                          &sum, &max);
+        ref_sum = ref_max = 0;
+        max_err = 0;
+        for (i = 0; i < n; i++) {
+            ref = skybrightness_get_luminance(&sb, cm[i], cs[i], cz[i]);
+            err = fabs(out[i] - ref) / fmax(ref, 1e-6);
+            max_err = fmax(max_err, err);
+            ref_sum += ref;
+            ref_max = fmaxf(ref_max, ref);
+        }
+        if (max_err > 1e-3) {
+            LOG_E("Sun zenith dist %.0f°, error: %g", sun_zs[s], max_err);
+            assert(false);
+        }
+        assert(fabs(sum - ref_sum) / ref_sum < 1e-3);
+        assert(fabs(max - ref_max) / ref_max < 1e-3);
+    }
+}
+
+static void bench_skybrightness_batch(void)
+{
+    const int n = 1 << 20;
+    float *cm, *cs, *cz, *out, sum = 0;
+    double t;
+    int i;
+    skybrightness_t sb;
+
+    cm = malloc(n * sizeof(*cm));
+    cs = malloc(n * sizeof(*cs));
+    cz = malloc(n * sizeof(*cz));
+    out = malloc(n * sizeof(*out));
+    skybrightness_prepare(&sb, 2023, 5, -10, 45 * D2R, 100, 15, 40,
+                          60 * D2R, 96 * D2R);
+    test_fill_dirs(n, cm, cs, cz, 96 * D2R, 60 * D2R);
+
+    t = sys_get_unix_time();
+    for (i = 0; i < n; i++)
+        sum += skybrightness_get_luminance(&sb, cm[i], cs[i], cz[i]);
+    LOG_I("Scalar: %.2f Mlum/s", n / (sys_get_unix_time() - t) / 1e6);
+
+    t = sys_get_unix_time();
+    skybrightness_get_luminance_batch(&sb, n, cm, cs, cz, out, &sum, NULL);
+    LOG_I("Batch (%d floats): %.2f Mlum/s", VF_SIZE,
+          n / (sys_get_unix_time() - t) / 1e6);
+
+    free(cm);
+    free(cs);
+    free(cz);
+    free(out);
+}
+
+TEST_REGISTER(NULL, test_skybrightness_batch, TEST_AUTO);
+TEST_REGISTER(NULL, bench_skybrightness_batch, 0);
+
+#endif
@@ -46,4 +46,27 @@ float skybrightness_get_luminance(
         const skybrightness_t *sb,
         float cos_moon_dist, float cos_sun_dist, float cos_zenith_dist);
 
+/*
+ * Function: skybrightness_get_luminance_batch
+ * Compute the luminance of several directions at once.
+ *
+ * Same as <skybrightness_get_luminance>, but using SIMD instructions if
+ * available (AVX, SSE2 or WASM SIMD128).  The results can slightly differ
+ * from the scalar version.
+ *
+ * Parameters:
+ *   sb              - A prepared skybrightness struct.
+ *   n               - Number of directions.
+ *   cos_moon_dist   - Cosine of the distance to the moon of each direction.
+ *   cos_sun_dist    - Cosine of the distance to the sun of each direction.
+ *   cos_zenith_dist - Cosine of the distance to the zenith of each direction.
+ *   out             - Output luminance of each direction (cd/m²).
+ *   sum             - If not NULL, set to the sum of the luminances.
+ *   max             - If not NULL, set to the max of the luminances.
+ */
+void skybrightness_get_luminance_batch(
+        const skybrightness_t *sb, int n,
+        const float *cos_moon_dist, const float *cos_sun_dist,
+        const float *cos_zenith_dist, float *out, float *sum, float *max);
+
 #endif // SKYBRIGHTNESS_H
@@ -0,0 +1,164 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "sweep.h"
+#include "system.h"
+#include "utils/worker.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Max time (sec) spent on a sweep at each frame.
+#define FRAME_BUDGET 0.002
+
+// Number of bodies computed per thread between two time checks.
+#define CHUNK_SIZE 256
+
+static void snapshot_resize(sweep_snapshot_t *s, int nb)
+{
+    if (nb <= s->allocated) return;
+    s->allocated = nb;
+    s->pos = realloc(s->pos, nb * sizeof(*s->pos));
+    s->vmag = realloc(s->vmag, nb * sizeof(*s->vmag));
+}
+
+static void sweep_compute(void *user, int start, int end)
+{
+    sweep_t *sweep = user;
+    sweep->compute(sweep, &sweep->obs, sweep->progress + start,
+                   sweep->progress + end, sweep->back->pos,
+                   sweep->back->vmag);
+}
+
+// Progress the current sweep, return true when it is done.
+static bool sweep_iter(sweep_t *sweep)
+{
+    double start_time = sys_get_unix_time();
+    int nb = sweep->back->nb, step, n;
+
+    step = CHUNK_SIZE * worker_get_nb_threads();
+    while (sweep->progress < nb) {
+        n = nb - sweep->progress < step ? nb - sweep->progress : step;
+        worker_parallel_for(n, sweep, sweep_compute);
+        sweep->progress += n;
+        if (sys_get_unix_time() - start_time > FRAME_BUDGET) break;
+    }
+    return sweep->progress >= nb;
+}
+
+static bool sweep_needed(const sweep_t *sweep, const observer_t *obs, int nb)
+{
+    if (!sweep->front) return nb > 0;
+    return sweep->front->nb != nb ||
+           fabs(sweep->front->tt - obs->tt) >= sweep->max_dt ||
+           sweep->obs.hash_partial != obs->hash_partial;
+}
+
+bool sweep_update(sweep_t *sweep, const observer_t *obs, int nb)
+{
+    if (!sweep->running) {
+        if (!sweep_needed(sweep, obs, nb)) return false;
+        sweep->back = sweep->front == &sweep->snapshots[0] ?
+                      &sweep->snapshots[1] : &sweep->snapshots[0];
+        snapshot_resize(sweep->back, nb);
+        sweep->back->nb = nb;
+        sweep->back->tt = obs->tt;
+        sweep->obs = *obs;
+        sweep->progress = 0;
+        sweep->running = true;
+    }
+    if (!sweep_iter(sweep)) return false;
+    sweep->front = sweep->back;
+    sweep->back = NULL;
+    sweep->running = false;
+    return true;
+}
+
+bool sweep_is_running(const sweep_t *sweep)
+{
+    return sweep->running;
+}
+
+const sweep_snapshot_t *sweep_get(const sweep_t *sweep)
+{
+    return sweep->front;
+}
+
+void sweep_restart(sweep_t *sweep)
+{
+    sweep->front = NULL;
+    sweep->back = NULL;
+    sweep->running = false;
+}
+
+void sweep_release(sweep_t *sweep)
+{
+    int i;
+    for (i = 0; i < 2; i++) {
+        free(sweep->snapshots[i].pos);
+        free(sweep->snapshots[i].vmag);
+    }
+    memset(sweep->snapshots, 0, sizeof(sweep->snapshots));
+    sweep_restart(sweep);
+}
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+
+static void test_compute(const sweep_t *sweep, const observer_t *obs,
+                         int start, int end, float (*pos)[3], float *vmag)
+{
+    int i;
+    for (i = start; i < end; i++) {
+        pos[i][0] = pos[i][1] = pos[i][2] = i;
+        vmag[i] = obs->tt;
+    }
+}
+
+static void test_sweep(void)
+{
+    sweep_t sweep = {.compute = test_compute, .max_dt = 1.0};
+    observer_t obs = {.tt = 50000};
+    const sweep_snapshot_t *s;
+    int i;
+
+    while (!sweep_update(&sweep, &obs, 100000)) {}
+    s = sweep_get(&sweep);
+    assert(s && s->nb == 100000 && s->tt == 50000);
+    for (i = 0; i < s->nb; i++)
+        assert(s->pos[i][2] == i && s->vmag[i] == 50000);
+    // Small time change: no new sweep.
+    obs.tt += 0.5;
+    assert(!sweep_update(&sweep, &obs, 100000));
+    assert(!sweep_is_running(&sweep));
+    // The previous snapshot stays available while we compute the next one.
+    obs.tt += 1;
+    while (!sweep_update(&sweep, &obs, 100000))
+        assert(sweep_get(&sweep) == s);
+    assert(sweep_get(&sweep) != s);
+    assert(sweep_get(&sweep)->vmag[10] == 50001.5);
+    // Restart in the middle of a sweep after the bodies changed.
+    obs.tt += 1;
+    sweep_update(&sweep, &obs, 100000);
+    sweep_restart(&sweep);
+    assert(!sweep_get(&sweep) && !sweep_is_running(&sweep));
+    while (!sweep_update(&sweep, &obs, 10)) {}
+    assert(sweep_get(&sweep)->nb == 10);
+    sweep_release(&sweep);
+}
+
+TEST_REGISTER(NULL, test_sweep, TEST_AUTO);
+
+#endif
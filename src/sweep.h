@@ -0,0 +1,125 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "observer.h"
+
+/*
+ * File: sweep.h
+ * Computation of the positions and magnitudes of all the bodies of a
+ * module.
+ *
+ * The solar system bodies modules only compute the positions of a few
+ * bodies per frame when rendering.  A sweep recomputes all of them each
+ * time the observer time changes, so that we can quickly find the bodies
+ * that are visible, or brighter than a given magnitude.
+ *
+ * The results are double buffered: <sweep_get> returns the last complete
+ * snapshot while the next one is being computed, a bit at each frame.
+ * Each part is split over the <worker_parallel_for> threads if we have
+ * threads support.  Since we only compute from sweep_update, the compute
+ * function can safely read the bodies.
+ */
+
+/*
+ * Type: sweep_snapshot_t
+ * The computed values of all the bodies for a given time.
+ *
+ * Attributes:
+ *   tt     - Time of the snapshot (TT MJD).
+ *   nb     - Number of bodies.
+ *   pos    - Apparent positions from the observer (ICRF, AU).
+ *   vmag   - Visual magnitudes.
+ */
+typedef struct sweep_snapshot {
+    double  tt;
+    int     nb;
+    int     allocated;
+    float   (*pos)[3];
+    float   *vmag;
+} sweep_snapshot_t;
+
+typedef struct sweep sweep_t;
+
+/*
+ * Type: sweep_t
+ * Double buffered computation of all the bodies of a module.
+ *
+ * Attributes:
+ *   compute - Function that computes the positions and magnitudes of the
+ *             bodies [start, end) into pos[i] and vmag[i].  When we have
+ *             threads this is called from several threads at the same
+ *             time, so it should not modify any shared data.
+ *   user    - User data for the compute function.
+ *   max_dt  - Time change (days) that triggers a new sweep.
+ */
+struct sweep {
+    void    (*compute)(const sweep_t *sweep, const observer_t *obs,
+                       int start, int end, float (*pos)[3], float *vmag);
+    void    *user;
+    double  max_dt;
+
+    // Private attributes.
+    sweep_snapshot_t snapshots[2];
+    sweep_snapshot_t *front;    // Last complete snapshot, NULL if none.
+    sweep_snapshot_t *back;     // Snapshot being computed.
+    bool        running;
+    int         progress;   // Number of bodies computed so far.
+    observer_t  obs;        // Copy of the observer for the current sweep.
+};
+
+/*
+ * Function: sweep_update
+ * Start a new sweep if needed, and progress the current one.
+ *
+ * A new sweep starts when the number of bodies changes, when the observer
+ * time changed by more than max_dt, or when the observer location changed.
+ *
+ * Parameters:
+ *   sweep  - A sweep.
+ *   obs    - The observer.
+ *   nb     - Current number of bodies in the module.  The bodies indices
+ *            should stay the same as long as the sweep is running, or
+ *            <sweep_restart> should be called first.
+ *
+ * Return:
+ *   true if a new snapshot just became available.
+ */
+bool sweep_update(sweep_t *sweep, const observer_t *obs, int nb);
+
+/*
+ * Function: sweep_is_running
+ * Return whether a sweep is currently in progress.
+ */
+bool sweep_is_running(const sweep_t *sweep);
+
+/*
+ * Function: sweep_get
+ * Return the last complete snapshot, or NULL if we don't have any yet.
+ */
+const sweep_snapshot_t *sweep_get(const sweep_t *sweep);
+
+/*
+ * Function: sweep_restart
+ * Abort the current sweep and discard the last snapshot.
+ *
+ * To call when the list of bodies of the module changed, since the
+ * snapshots indices don't match the bodies anymore.
+ */
+void sweep_restart(sweep_t *sweep);
+
+/*
+ * Function: sweep_release
+ * Stop the current sweep if any, and release the buffers.
+ */
+void sweep_release(sweep_t *sweep);
+
+#endif // SWEEP_H
@@ -9,7 +9,11 @@
 
 #include "cache.h"
 #include "uthash.h"
+#include "utlist.h"
 #include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
 #include <sys/time.h>
 
 typedef struct item item_t;
@@ -28,6 +32,24 @@ struct cache {
     int size;
     int max_size;
     double grace_period;
+    double (*score)(const void *data);
+    // Buffer reused by cleanup_by_score, and time before which we know that
+    // no item can be evicted.
+    struct candidate *candidates;
+    int candidates_size;
+    double score_retry_time;
+    int hits;
+    int misses;
+    // Shared budget the cache draws from, if any.
+    cache_budget_t *budget;
+    cache_t *budget_next;
+    bool budget_done; // Used by budget_cleanup.
+};
+
+struct cache_budget {
+    int size;
+    int max_size;
+    cache_t *caches;
 };
 
 static double get_unix_time(void)
@@ -45,10 +67,104 @@ cache_t *cache_create(int size, double grace_period_sec)
     return cache;
 }
 
-static void cleanup(cache_t *cache)
+// Change the size of a cache and of its shared budget.
+static void cache_resize(cache_t *cache, int delta)
+{
+    cache->size += delta;
+    if (cache->budget) cache->budget->size += delta;
+}
+
+void cache_delete(cache_t *cache)
+{
+    item_t *item, *tmp;
+    if (!cache) return;
+    cache_set_budget(cache, NULL);
+    HASH_ITER(hh, cache->items, item, tmp) {
+        HASH_DEL(cache->items, item);
+        if (item->delfunc) item->delfunc(item->data);
+        free(item);
+    }
+    free(cache->candidates);
+    free(cache);
+}
+
+void cache_set_evict_score(cache_t *cache,
+                           double (*score)(const void *data))
+{
+    cache->score = score;
+}
+
+typedef struct candidate {
+    item_t *item;
+    double score;
+} candidate_t;
+
+// When evicting by score we go down to this fraction of the max size, so
+// that we don't have to score all the items again for each new item.
+#define SCORE_LOW_WATER 0.9
+
+static int candidate_cmp(const void *a, const void *b)
+{
+    const candidate_t *x = a, *y = b;
+    return (x->score < y->score) - (x->score > y->score);
+}
+
+// Same as cleanup, but evict the items in order of decreasing score.
+static void cleanup_by_score(cache_t *cache, int target)
+{
+    item_t *item, *tmp;
+    double time = get_unix_time(), retry_time = DBL_MAX;
+    int i, nb = 0, count;
+
+    // All the items were still in their grace period last time.
+    if (time < cache->score_retry_time) return;
+    count = HASH_COUNT(cache->items);
+    if (count > cache->candidates_size) {
+        cache->candidates_size = count * 2;
+        cache->candidates = realloc(cache->candidates,
+                cache->candidates_size * sizeof(*cache->candidates));
+    }
+    HASH_ITER(hh, cache->items, item, tmp) {
+        if (!item->grace_time) {
+            item->grace_time = time;
+            retry_time = fmin(retry_time, time + cache->grace_period);
+            continue;
+        }
+        if (time - item->grace_time < cache->grace_period) {
+            retry_time = fmin(retry_time,
+                              item->grace_time + cache->grace_period);
+            continue;
+        }
+        cache->candidates[nb].item = item;
+        cache->candidates[nb].score = cache->score(item->data);
+        nb++;
+    }
+    cache->score_retry_time = nb ? 0 : retry_time;
+    qsort(cache->candidates, nb, sizeof(*cache->candidates), candidate_cmp);
+
+    for (i = 0; i < nb; i++) {
+        if (cache->size < target) break;
+        item = cache->candidates[i].item;
+        if (item->delfunc && item->delfunc(item->data) == CACHE_KEEP) {
+            item->grace_time = 0;
+            continue;
+        }
+        HASH_DEL(cache->items, item);
+        cache_resize(cache, -item->cost);
+        free(item);
+    }
+}
+
+// Evict the items past their grace period until the cache size gets below
+// target.
+static void cleanup(cache_t *cache, int target)
 {
     item_t *item, *tmp;
     double time = get_unix_time();
+    if (cache->score) {
+        cleanup_by_score(cache, target);
+        return;
+    }
     HASH_ITER(hh, cache->items, item, tmp) {
         if (!item->grace_time) {
             item->grace_time = time;
@@ -62,19 +178,54 @@ static void cleanup(cache_t *cache)
         }
         HASH_DEL(cache->items, item);
         assert(item != cache->items);
-        cache->size -= item->cost;
+        cache_resize(cache, -item->cost);
         free(item);
-        if (cache->size < cache->max_size) return;
+        if (cache->size < target) return;
     }
 }
 
+// Size down to which we evict the items once a cache or budget of the
+// given max size is full.
+static int low_water(const cache_t *cache, int max_size)
+{
+    return cache->score ? max_size * SCORE_LOW_WATER : max_size;
+}
+
+// Evict items from the caches sharing a budget, starting with the largest
+// ones, until we get back below the budget.
+static void budget_cleanup(cache_budget_t *budget)
+{
+    cache_t *cache, *largest;
+    while (budget->size >= budget->max_size) {
+        largest = NULL;
+        LL_FOREACH2(budget->caches, cache, budget_next) {
+            if (cache->budget_done) continue;
+            if (!largest || cache->size > largest->size) largest = cache;
+        }
+        if (!largest) break;
+        largest->budget_done = true;
+        cleanup(largest, largest->size -
+                (budget->size - low_water(largest, budget->max_size)));
+    }
+    LL_FOREACH2(budget->caches, cache, budget_next)
+        cache->budget_done = false;
+}
+
+static void check_size(cache_t *cache)
+{
+    if (cache->size >= cache->max_size)
+        cleanup(cache, low_water(cache, cache->max_size));
+    if (cache->budget && cache->budget->size >= cache->budget->max_size)
+        budget_cleanup(cache->budget);
+}
+
 void cache_add(cache_t *cache, const void *key, int len, void *data,
                int cost, int (*delfunc)(void *data))
 {
     item_t *item;
     assert(len <= sizeof(item->key));
-    cache->size += cost;
-    if (cache->size >= cache->max_size) cleanup(cache);
+    cache_resize(cache, cost);
+    check_size(cache);
     item = calloc(1, sizeof(*item));
     memcpy(item->key, key, len);
     item->data = data;
@@ -87,7 +238,11 @@ void *cache_get(cache_t *cache, const void *key, int keylen)
 {
     item_t *item;
     HASH_FIND(hh, cache->items, key, keylen, item);
-    if (!item) return NULL;
+    if (!item) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
     item->grace_time = 0;
     // Reinsert item on top of the hash list so that it stays sorted.
     HASH_DEL(cache->items, item);
@@ -95,15 +250,26 @@ void *cache_get(cache_t *cache, const void *key, int keylen)
     return item->data;
 }
 
+int cache_foreach(cache_t *cache, void *user,
+                  int (*f)(void *user, void *data))
+{
+    item_t *item, *tmp;
+    int r;
+    HASH_ITER(hh, cache->items, item, tmp) {
+        r = f(user, item->data);
+        if (r) return r;
+    }
+    return 0;
+}
+
 void cache_set_cost(cache_t *cache, const void *key, int keylen, int cost)
 {
     item_t *item;
     HASH_FIND(hh, cache->items, key, keylen, item);
     if (!item) return;
-    cache->size -= item->cost;
+    cache_resize(cache, cost - item->cost);
     item->cost = cost;
-    cache->size += cost;
-    if (cache->size >= cache->max_size) cleanup(cache);
+    check_size(cache);
 }
 
 /*
@@ -114,3 +280,47 @@ int cache_get_current_size(const cache_t *cache)
 {
     return cache->size;
 }
+
+int cache_get_max_size(const cache_t *cache)
+{
+    return cache->max_size;
+}
+
+void cache_set_max_size(cache_t *cache, int size)
+{
+    cache->max_size = size;
+    check_size(cache);
+}
+
+cache_budget_t *cache_budget_create(int size)
+{
+    cache_budget_t *budget = calloc(1, sizeof(*budget));
+    budget->max_size = size;
+    return budget;
+}
+
+void cache_budget_delete(cache_budget_t *budget)
+{
+    if (!budget) return;
+    assert(!budget->caches);
+    free(budget);
+}
+
+void cache_set_budget(cache_t *cache, cache_budget_t *budget)
+{
+    if (cache->budget) {
+        LL_DELETE2(cache->budget->caches, cache, budget_next);
+        cache->budget->size -= cache->size;
+    }
+    cache->budget = budget;
+    if (!budget) return;
+    LL_APPEND2(budget->caches, cache, budget_next);
+    budget->size += cache->size;
+    check_size(cache);
+}
+
+void cache_get_stats(const cache_t *cache, int *hits, int *misses)
+{
+    *hits = cache->hits;
+    *misses = cache->misses;
+}
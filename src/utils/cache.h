@@ -26,6 +26,16 @@
  */
 typedef struct cache cache_t;
 
+/*
+ * Type: cache_budget_t
+ * Maximum total size shared by several caches.
+ *
+ * When the sum of the sizes of the caches using a budget gets over its
+ * maximum, the items past their grace period are evicted from the largest
+ * caches first.  Each cache still keeps its own maximum size.
+ */
+typedef struct cache_budget cache_budget_t;
+
 /*
  * Function: cache_create
  * Create a new cache with a given max size.
@@ -42,6 +52,28 @@ typedef struct cache cache_t;
  */
 cache_t *cache_create(int size, double grace_period_sec);
 
+/*
+ * Function: cache_delete
+ * Delete a cache and all its items.
+ *
+ * Items whose delete function returns <CACHE_KEEP> are removed from the
+ * cache without being deleted, so the caller has to make sure that no item
+ * is still used by a running task before deleting the cache.
+ */
+void cache_delete(cache_t *cache);
+
+/*
+ * Function: cache_set_evict_score
+ * Set a function used to decide in what order items are evicted.
+ *
+ * By default the least recently used items are evicted first.  If a score
+ * function is set, the items past their grace period with the highest
+ * score are evicted first instead, until the cache gets back to 90% of its
+ * maximum size.
+ */
+void cache_set_evict_score(cache_t *cache,
+                           double (*score)(const void *data));
+
 /*
  * Function: cache_add
  * Add an item into a cache.
@@ -68,6 +100,16 @@ void cache_add(cache_t *cache, const void *key, int keylen, void *data,
  */
 void *cache_get(cache_t *cache, const void *key, int keylen);
 
+/*
+ * Function: cache_foreach
+ * Call a function on all the items of the cache.
+ *
+ * The iteration stops if the function returns a non zero value, in which
+ * case this value is returned.
+ */
+int cache_foreach(cache_t *cache, void *user,
+                  int (*f)(void *user, void *data));
+
 /*
  * Function: cache_set_cost
  * Change the cost of an item already in the cache.
@@ -82,3 +124,41 @@ void cache_set_cost(cache_t *cache, const void *key, int keylen, int cost);
  */
 int cache_get_current_size(const cache_t *cache);
 
+/*
+ * Function: cache_get_max_size
+ * Return the maximum size of the cache, as passed to <cache_create>.
+ */
+int cache_get_max_size(const cache_t *cache);
+
+/*
+ * Function: cache_set_max_size
+ * Change the maximum size of the cache.
+ *
+ * If the cache is now over its maximum size, the items past their grace
+ * period are evicted.
+ */
+void cache_set_max_size(cache_t *cache, int size);
+
+/*
+ * Function: cache_budget_create
+ * Create a new budget that can be shared by several caches.
+ */
+cache_budget_t *cache_budget_create(int size);
+
+/*
+ * Function: cache_budget_delete
+ * Delete a budget.  No cache should use it anymore.
+ */
+void cache_budget_delete(cache_budget_t *budget);
+
+/*
+ * Function: cache_set_budget
+ * Make a cache draw from a shared budget, or from none if budget is NULL.
+ */
+void cache_set_budget(cache_t *cache, cache_budget_t *budget);
+
+/*
+ * Function: cache_get_stats
+ * Return the number of successful and failed calls to <cache_get>.
+ */
+void cache_get_stats(const cache_t *cache, int *hits, int *misses);
@@ -355,7 +355,7 @@ void gl_update_uniform_mat3(gl_shader_t *shader, const char *name,
     assert(uni->type == GL_FLOAT_MAT3);
     for (i = 0; i < 3; i++) for (j = 0; j < 3; j++)
         vf[i * 3 + j] = v[i][j];
-    GL(glUniformMatrix4fv(uni->loc, 1, 0, vf));
+    GL(glUniformMatrix3fv(uni->loc, 1, 0, vf));
 }
 
 void gl_update_uniform_mat4(gl_shader_t *shader, const char *name,
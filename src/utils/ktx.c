@@ -0,0 +1,331 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "ktx.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t KTX_ID[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+// Size of the header, including the identifier.
+#define HEADER_SIZE 64
+
+// Max width or height of the images we accept.
+#define MAX_SIZE 16384
+
+static inline int clamp255(int x)
+{
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static inline uint32_t read_u32(const uint8_t *p, bool swap)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    if (swap) v = __builtin_bswap32(v);
+    return v;
+}
+
+bool ktx_is_ktx(const void *data, int size)
+{
+    return size >= HEADER_SIZE && memcmp(data, KTX_ID, 12) == 0;
+}
+
+int ktx_parse(const void *data_, int size, ktx_t *ktx)
+{
+    const uint8_t *data = data_;
+    bool swap;
+    uint32_t format, w, h, kv_size, img_size;
+
+    if (!ktx_is_ktx(data, size)) return -1;
+    swap = read_u32(data + 12, false) != 0x04030201;
+    format = read_u32(data + 28, swap);
+    if (    format != KTX_BC1_RGB && format != KTX_ETC1_RGB8 &&
+            format != KTX_ETC2_RGB8)
+        return -1;
+    w = read_u32(data + 36, swap);
+    h = read_u32(data + 40, swap);
+    if (w == 0 || h == 0 || w > MAX_SIZE || h > MAX_SIZE) return -1;
+    // Use 64 bits values so that the sizes checks cannot overflow.
+    kv_size = read_u32(data + 60, swap);
+    if ((uint64_t)HEADER_SIZE + kv_size + 4 > (uint64_t)size) return -1;
+    img_size = read_u32(data + HEADER_SIZE + kv_size, swap);
+    // All the supported formats use 8 bytes per 4x4 block.
+    if (img_size != ((w + 3) / 4) * ((h + 3) / 4) * 8) return -1;
+    if ((uint64_t)HEADER_SIZE + kv_size + 4 + img_size > (uint64_t)size)
+        return -1;
+    ktx->format = format;
+    ktx->w = w;
+    ktx->h = h;
+    ktx->data = data + HEADER_SIZE + kv_size + 4;
+    ktx->size = img_size;
+    return 0;
+}
+
+static void decode_bc1_block(const uint8_t *block, uint8_t out[16][3])
+{
+    int i, j, c[2];
+    uint8_t colors[4][3];
+    uint32_t bits;
+
+    for (i = 0; i < 2; i++) {
+        c[i] = block[i * 2] | (block[i * 2 + 1] << 8);
+        colors[i][0] = ((c[i] >> 11) & 31) * 255 / 31;
+        colors[i][1] = ((c[i] >> 5) & 63) * 255 / 63;
+        colors[i][2] = (c[i] & 31) * 255 / 31;
+    }
+    for (j = 0; j < 3; j++) {
+        if (c[0] > c[1]) {
+            colors[2][j] = (2 * colors[0][j] + colors[1][j]) / 3;
+            colors[3][j] = (colors[0][j] + 2 * colors[1][j]) / 3;
+        } else {
+            colors[2][j] = (colors[0][j] + colors[1][j]) / 2;
+            colors[3][j] = 0;
+        }
+    }
+    bits = block[4] | (block[5] << 8) | (block[6] << 16) |
+           ((uint32_t)block[7] << 24);
+    for (i = 0; i < 16; i++)
+        memcpy(out[i], colors[(bits >> (2 * i)) & 3], 3);
+}
+
+static inline int extend4(int x) { return (x << 4) | x; }
+static inline int extend5(int x) { return (x << 3) | (x >> 2); }
+static inline int extend6(int x) { return (x << 2) | (x >> 4); }
+static inline int extend7(int x) { return (x << 1) | (x >> 6); }
+
+// ETC2 planar mode.
+static void decode_etc2_planar(uint64_t v, uint8_t out[16][3])
+{
+    int o[3], h[3], w[3], x, y, i;
+    o[0] = extend6((v >> 57) & 63);
+    o[1] = extend7((((v >> 56) & 1) << 6) | ((v >> 49) & 63));
+    o[2] = extend6((((v >> 48) & 1) << 5) | (((v >> 43) & 3) << 3) |
+                   ((v >> 39) & 7));
+    h[0] = extend6((((v >> 34) & 31) << 1) | ((v >> 32) & 1));
+    h[1] = extend7((v >> 25) & 127);
+    h[2] = extend6((v >> 19) & 63);
+    w[0] = extend6((v >> 13) & 63);
+    w[1] = extend7((v >> 6) & 127);
+    w[2] = extend6(v & 63);
+    for (y = 0; y < 4; y++)
+    for (x = 0; x < 4; x++)
+    for (i = 0; i < 3; i++) {
+        out[y * 4 + x][i] = clamp255(
+            (x * (h[i] - o[i]) + y * (w[i] - o[i]) + 4 * o[i] + 2) >> 2);
+    }
+}
+
+// ETC2 T and H modes, where the pixels index directly a four colors
+// palette.
+static void decode_etc2_th(uint64_t v, bool t_mode, uint8_t out[16][3])
+{
+    const int DIST[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+    int c[2][3], p[4][3], d, i, x, y, idx;
+
+    if (t_mode) {
+        c[0][0] = (((v >> 59) & 3) << 2) | ((v >> 56) & 3);
+        c[0][1] = (v >> 52) & 15;
+        c[0][2] = (v >> 48) & 15;
+        c[1][0] = (v >> 44) & 15;
+        c[1][1] = (v >> 40) & 15;
+        c[1][2] = (v >> 36) & 15;
+        d = DIST[(((v >> 34) & 3) << 1) | ((v >> 32) & 1)];
+    } else {
+        c[0][0] = (v >> 59) & 15;
+        c[0][1] = (((v >> 56) & 7) << 1) | ((v >> 52) & 1);
+        c[0][2] = (((v >> 51) & 1) << 3) | ((v >> 47) & 7);
+        c[1][0] = (v >> 43) & 15;
+        c[1][1] = (v >> 39) & 15;
+        c[1][2] = (v >> 35) & 15;
+        idx = (((v >> 34) & 1) << 2) | (((v >> 32) & 1) << 1);
+        if (    ((c[0][0] << 8) | (c[0][1] << 4) | c[0][2]) >=
+                ((c[1][0] << 8) | (c[1][1] << 4) | c[1][2]))
+            idx |= 1;
+        d = DIST[idx];
+    }
+    for (i = 0; i < 3; i++) {
+        c[0][i] = extend4(c[0][i]);
+        c[1][i] = extend4(c[1][i]);
+        if (t_mode) {
+            p[0][i] = c[0][i];
+            p[1][i] = clamp255(c[1][i] + d);
+            p[2][i] = c[1][i];
+            p[3][i] = clamp255(c[1][i] - d);
+        } else {
+            p[0][i] = clamp255(c[0][i] + d);
+            p[1][i] = clamp255(c[0][i] - d);
+            p[2][i] = clamp255(c[1][i] + d);
+            p[3][i] = clamp255(c[1][i] - d);
+        }
+    }
+    for (x = 0; x < 4; x++)
+    for (y = 0; y < 4; y++) {
+        i = x * 4 + y;
+        idx = (((v >> (i + 16)) & 1) << 1) | ((v >> i) & 1);
+        for (d = 0; d < 3; d++)
+            out[y * 4 + x][d] = p[idx][d];
+    }
+}
+
+static void decode_etc_block(const uint8_t *block, bool etc2,
+                             uint8_t out[16][3])
+{
+    const int MODIFIERS[8][2] = {
+        {2, 8}, {5, 17}, {9, 29}, {13, 42},
+        {18, 60}, {24, 80}, {33, 106}, {47, 183},
+    };
+    uint64_t v = 0;
+    int i, j, x, y, sub, m, base[2][3], table[2];
+    bool diff, flip;
+
+    for (i = 0; i < 8; i++) v = (v << 8) | block[i];
+    diff = (v >> 33) & 1;
+    flip = (v >> 32) & 1;
+
+    if (!diff) {
+        for (i = 0; i < 3; i++) {
+            base[0][i] = extend4((v >> (60 - i * 8)) & 15);
+            base[1][i] = extend4((v >> (56 - i * 8)) & 15);
+        }
+    } else {
+        for (i = 0; i < 3; i++) {
+            j = (v >> (59 - i * 8)) & 31;
+            // Signed three bits delta.
+            m = (v >> (56 - i * 8)) & 7;
+            if (m >= 4) m -= 8;
+            if (j + m < 0 || j + m > 31) {
+                if (!etc2) {
+                    // Undefined in ETC1, just clamp the value.
+                    m = (j + m < 0) ? -j : 31 - j;
+                } else {
+                    // ETC2 extended modes.
+                    if (i == 0) decode_etc2_th(v, true, out);
+                    if (i == 1) decode_etc2_th(v, false, out);
+                    if (i == 2) decode_etc2_planar(v, out);
+                    return;
+                }
+            }
+            base[0][i] = extend5(j);
+            base[1][i] = extend5(j + m);
+        }
+    }
+    table[0] = (v >> 37) & 7;
+    table[1] = (v >> 34) & 7;
+
+    for (x = 0; x < 4; x++)
+    for (y = 0; y < 4; y++) {
+        i = x * 4 + y;
+        sub = flip ? (y >= 2) : (x >= 2);
+        m = MODIFIERS[table[sub]][(v >> i) & 1];
+        if ((v >> (i + 16)) & 1) m = -m;
+        for (j = 0; j < 3; j++)
+            out[y * 4 + x][j] = clamp255(base[sub][j] + m);
+    }
+}
+
+uint8_t *ktx_decode(int format, const void *data_, int w, int h)
+{
+    const uint8_t *data = data_;
+    uint8_t *img, block[16][3];
+    int bx, by, x, y, nbw = (w + 3) / 4, nbh = (h + 3) / 4;
+
+    img = calloc(w * h, 3);
+    for (by = 0; by < nbh; by++)
+    for (bx = 0; bx < nbw; bx++) {
+        switch (format) {
+        case KTX_BC1_RGB:
+            decode_bc1_block(data, block);
+            break;
+        case KTX_ETC1_RGB8:
+        case KTX_ETC2_RGB8:
+            decode_etc_block(data, format == KTX_ETC2_RGB8, block);
+            break;
+        default:
+            assert(false);
+            free(img);
+            return NULL;
+        }
+        data += 8;
+        for (y = 0; y < 4 && by * 4 + y < h; y++)
+        for (x = 0; x < 4 && bx * 4 + x < w; x++) {
+            memcpy(&img[((by * 4 + y) * w + bx * 4 + x) * 3],
+                   block[y * 4 + x], 3);
+        }
+    }
+    return img;
+}
+
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+
+static void test_ktx_decode(void)
+{
+    uint8_t *img;
+    // ETC1 individual mode block, base colors (0x8, 0x4, 0x2) and
+    // (0x1, 0x2, 0x3), tables 0 and 7, no flip, all indices set to 1 (+8
+    // and +183).
+    const uint8_t etc1[8] = {0x81, 0x42, 0x23, 0x1c, 0x00, 0x00, 0xff, 0xff};
+    // BC1 block with pure red and pure blue, all pixels using color 0.
+    const uint8_t bc1[8] = {0x00, 0xf8, 0x1f, 0x00, 0, 0, 0, 0};
+
+    img = ktx_decode(KTX_ETC1_RGB8, etc1, 4, 4);
+    assert(img[0] == 0x88 + 8 && img[1] == 0x44 + 8 && img[2] == 0x22 + 8);
+    assert(img[(3 * 4 + 3) * 3 + 0] == 0x11 + 183);
+    assert(img[(3 * 4 + 3) * 3 + 2] == 0x33 + 183);
+    free(img);
+
+    img = ktx_decode(KTX_BC1_RGB, bc1, 4, 4);
+    assert(img[0] == 255 && img[1] == 0 && img[2] == 0);
+    free(img);
+}
+
+static void test_ktx_parse(void)
+{
+    uint8_t data[HEADER_SIZE + 4 + 8] = {};
+    uint32_t v;
+    ktx_t ktx;
+
+    // 4x4 BC1 image, with no key values.
+    memcpy(data, KTX_ID, 12);
+    v = 0x04030201; memcpy(data + 12, &v, 4);
+    v = KTX_BC1_RGB; memcpy(data + 28, &v, 4);
+    v = 4; memcpy(data + 36, &v, 4); memcpy(data + 40, &v, 4);
+    v = 8; memcpy(data + HEADER_SIZE, &v, 4);
+    assert(ktx_parse(data, sizeof(data), &ktx) == 0);
+    assert(ktx.w == 4 && ktx.h == 4 && ktx.size == 8);
+    assert(ktx.data == data + HEADER_SIZE + 4);
+
+    // Truncated data.
+    assert(ktx_parse(data, sizeof(data) - 1, &ktx) != 0);
+    // Key values size past the end of the data, or overflowing.
+    v = 1024; memcpy(data + 60, &v, 4);
+    assert(ktx_parse(data, sizeof(data), &ktx) != 0);
+    v = 0xfffffffc; memcpy(data + 60, &v, 4);
+    assert(ktx_parse(data, sizeof(data), &ktx) != 0);
+    v = 0; memcpy(data + 60, &v, 4);
+    // Wrong images sizes.
+    memset(data + 36, 0, 4);
+    assert(ktx_parse(data, sizeof(data), &ktx) != 0);
+    v = 0x40000000; memcpy(data + 36, &v, 4);
+    assert(ktx_parse(data, sizeof(data), &ktx) != 0);
+}
+
+TEST_REGISTER(NULL, test_ktx_decode, TEST_AUTO);
+TEST_REGISTER(NULL, test_ktx_parse, TEST_AUTO);
+
+#endif
@@ -0,0 +1,85 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef KTX_H
+#define KTX_H
+
+/*
+ * File: ktx.h
+ * Minimal support for KTX (version 1) compressed textures.
+ *
+ * We only support the first mipmap level of 2d textures, using one of the
+ * <KTX_FORMATS> block compressed formats.  If the GPU doesn't support the
+ * format, <ktx_decode> can be used to decompress the data on the CPU.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Enum: KTX_FORMATS
+ * The supported compressed formats, same values as the OpenGL enums.
+ */
+enum {
+    KTX_BC1_RGB     = 0x83F0, // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    KTX_ETC1_RGB8   = 0x8D64, // GL_ETC1_RGB8_OES
+    KTX_ETC2_RGB8   = 0x9274, // GL_COMPRESSED_RGB8_ETC2
+};
+
+/*
+ * Type: ktx_t
+ * Information about a parsed ktx file.
+ *
+ * Attributes:
+ *   format - One of the <KTX_FORMATS> values.
+ *   w      - Width of the image.
+ *   h      - Height of the image.
+ *   data   - Pointer to the compressed data of the first level.
+ *   size   - Size of the compressed data.
+ */
+typedef struct {
+    int             format;
+    int             w, h;
+    const uint8_t   *data;
+    int             size;
+} ktx_t;
+
+/*
+ * Function: ktx_is_ktx
+ * Test if some data starts with the ktx file identifier.
+ */
+bool ktx_is_ktx(const void *data, int size);
+
+/*
+ * Function: ktx_parse
+ * Parse the header of a ktx file.
+ *
+ * The returned ktx data points directly into the input buffer.
+ *
+ * Return:
+ *   0 on success, or a negative value if the file is not a supported ktx.
+ */
+int ktx_parse(const void *data, int size, ktx_t *ktx);
+
+/*
+ * Function: ktx_decode
+ * Decompress compressed data into an RGB image on the CPU.
+ *
+ * Parameters:
+ *   format - One of the <KTX_FORMATS> values.
+ *   data   - The compressed data.
+ *   w      - Width of the image.
+ *   h      - Height of the image.
+ *
+ * Return:
+ *   A newly allocated RGB (3 bytes per pixel) image.
+ */
+uint8_t *ktx_decode(int format, const void *data, int w, int h);
+
+#endif // KTX_H
@@ -22,6 +22,8 @@
 
 #define SWAP(a, b) ({typeof(a) tmp_ = a; a = b; b = tmp_;})
 
+static uint32_t g_last_id = 0;
+
 static double min(double x, double y)
 {
     return x < y ? x : y;
@@ -32,9 +34,18 @@ static double max(double x, double y)
     return x > y ? x : y;
 }
 
+// Give a new id to a mesh after it got modified.
+// Atomic since the geojson survey tiles are created in worker threads.
+static void mesh_changed(mesh_t *mesh)
+{
+    mesh->id = __atomic_add_fetch(&g_last_id, 1, __ATOMIC_RELAXED);
+}
+
 mesh_t *mesh_create(void)
 {
-    return calloc(1, sizeof(mesh_t));
+    mesh_t *mesh = calloc(1, sizeof(mesh_t));
+    mesh_changed(mesh);
+    return mesh;
 }
 
 void mesh_delete(mesh_t *mesh)
@@ -61,6 +72,7 @@ mesh_t *mesh_copy(const mesh_t *mesh)
            ret->triangles_count * sizeof(*ret->triangles));
     ret->lines = malloc(ret->lines_count * sizeof(*ret->lines));
     memcpy(ret->lines, mesh->lines, ret->lines_count * sizeof(*ret->lines));
+    mesh_changed(ret);
     return ret;
 }
 
@@ -111,6 +123,7 @@ int mesh_add_vertices(mesh_t *mesh, int count, const double (*verts)[3])
     memcpy(mesh->vertices + mesh->vertices_count, verts,
            count * sizeof(*mesh->vertices));
     mesh->vertices_count += count;
+    mesh_changed(mesh);
     return ofs;
 }
 
@@ -127,6 +140,7 @@ void mesh_add_line_lonlat(mesh_t *mesh, int size, const double (*verts)[2],
         mesh->lines[mesh->lines_count + i * 2 + 1] = ofs + (i + 1) % size;
     }
     mesh->lines_count += nb_lines * 2;
+    mesh_changed(mesh);
 }
 
 void mesh_add_point_lonlat(mesh_t *mesh, const double vert[2])
@@ -137,6 +151,7 @@ void mesh_add_point_lonlat(mesh_t *mesh, const double vert[2])
             (mesh->points_count + 1) * sizeof(*mesh->points));
     mesh->points[mesh->points_count] = ofs;
     mesh->points_count += 1;
+    mesh_changed(mesh);
 }
 
 // Ensure all the triangles culling is correct.
@@ -153,6 +168,18 @@ static void mesh_fix_triangles_culling(mesh_t *mesh)
     }
 }
 
+// Common post processing of the polygons triangles.
+static void mesh_finish_poly(mesh_t *mesh)
+{
+    // For testing.  We want to avoid meshes with too long edges
+    // for the distortion.
+    if (mesh_subdivide(mesh, M_PI / 8)) mesh->subdivided = true;
+
+    // Not sure if we should instead assume the culling is always correct.
+    mesh_fix_triangles_culling(mesh);
+    mesh_changed(mesh);
+}
+
 void mesh_add_poly_lonlat(mesh_t *mesh, int nbrings, const int *rings_size,
                           const double (**verts)[2])
 {
@@ -210,14 +237,40 @@ void mesh_add_poly_lonlat(mesh_t *mesh, int nbrings, const int *rings_size,
     mesh->triangles_count += nb_triangles * 3;
 
     tessDeleteTess(tess);
+    mesh_finish_poly(mesh);
+}
 
-    // For testing.  We want to avoid meshes with too long edges
-    // for the distortion.
-    r = mesh_subdivide(mesh, M_PI / 8);
-    if (r) mesh->subdivided = true;
+void mesh_add_poly_triangles_lonlat(mesh_t *mesh, int nbrings,
+                                    const int *rings_size,
+                                    const double (*verts)[2],
+                                    int triangles_count,
+                                    const uint16_t *triangles)
+{
+    int r, i, ofs, size = 0;
 
-    // Not sure if we should instead assume the culling is always correct.
-    mesh_fix_triangles_culling(mesh);
+    for (r = 0; r < nbrings; r++) size += rings_size[r];
+    ofs = mesh_add_vertices_lonlat(mesh, size, verts);
+
+    mesh->triangles = realloc(mesh->triangles,
+            (mesh->triangles_count + triangles_count) *
+            sizeof(*mesh->triangles));
+    for (i = 0; i < triangles_count; i++) {
+        assert(triangles[i] < size);
+        mesh->triangles[mesh->triangles_count + i] = triangles[i] + ofs;
+    }
+    mesh->triangles_count += triangles_count;
+
+    // The rings edges.
+    mesh->lines = realloc(mesh->lines, (mesh->lines_count + size * 2) *
+                          sizeof(*mesh->lines));
+    for (r = 0; r < nbrings; r++) {
+        for (i = 0; i < rings_size[r]; i++) {
+            mesh->lines[mesh->lines_count++] = ofs + i;
+            mesh->lines[mesh->lines_count++] = ofs + (i + 1) % rings_size[r];
+        }
+        ofs += rings_size[r];
+    }
+    mesh_finish_poly(mesh);
 }
 
 
@@ -350,6 +403,7 @@ void mesh_cut_antimeridian(mesh_t *mesh)
     for (i = 0; i < count; i += 2) {
         mesh_cut_segment_antimeridian(mesh, i);
     }
+    mesh_changed(mesh);
 }
 
 static void mesh_subdivide_edge(mesh_t *mesh, int e1, int e2)
@@ -434,6 +488,7 @@ int mesh_subdivide(mesh_t *mesh, double max_length)
     for (i = 0; i < mesh->triangles_count; i += 3) {
         ret += mesh_subdivide_triangle(mesh, i, max_length);
     }
+    if (ret) mesh_changed(mesh);
     return ret;
 }
 
@@ -34,6 +34,10 @@ struct mesh {
     uint16_t    *points;
 
     bool        subdivided; // Set if the mesh was subdivided.
+
+    // Unique id, updated each time the mesh is modified by the mesh
+    // functions.  Used by the renderer to cache the mesh buffers.
+    uint32_t    id;
 };
 
 mesh_t *mesh_create(void);
@@ -46,6 +50,27 @@ void mesh_add_point_lonlat(mesh_t *mesh, const double vert[2]);
 void mesh_add_poly_lonlat(mesh_t *mesh, int nbrings, const int *rings_size,
                           const double (**verts)[2]);
 
+/*
+ * Function: mesh_add_poly_triangles_lonlat
+ * Add an already triangulated polygon to the mesh.
+ *
+ * Same as mesh_add_poly_lonlat, but without the tessellation.  The lines
+ * are the edges of the rings.
+ *
+ * Parameters:
+ *   mesh            - The mesh.
+ *   nbrings         - Number of rings.
+ *   rings_size      - Number of vertices of each ring.
+ *   verts           - All the rings vertices as lon/lat (deg).
+ *   triangles_count - Number of triangles * 3.
+ *   triangles       - Triangles indices into the vertices.
+ */
+void mesh_add_poly_triangles_lonlat(mesh_t *mesh, int nbrings,
+                                    const int *rings_size,
+                                    const double (*verts)[2],
+                                    int triangles_count,
+                                    const uint16_t *triangles);
+
 /*
  * Function: mesh_update_bounding_cap
  * Recompute the mesh bounding_cap value.
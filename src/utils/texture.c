@@ -9,6 +9,7 @@
 
 #include "texture.h"
 #include "gl.h"
+#include "ktx.h"
 
 #include <assert.h>
 #include <math.h>
@@ -129,6 +130,55 @@ texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
     return tex;
 }
 
+// Check if the GPU supports a given compressed texture format.
+static bool is_compressed_format_supported(int format)
+{
+    static int formats[64];
+    static int nb = -1;
+    int i;
+
+    if (nb == -1) {
+        GL(glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &nb));
+        nb = nb < 0 ? 0 : nb > 64 ? 64 : nb;
+        if (nb) GL(glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats));
+    }
+    for (i = 0; i < nb; i++) {
+        if (formats[i] == format) return true;
+    }
+    return false;
+}
+
+texture_t *texture_from_compressed(int format, const void *data, int size,
+                                   int w, int h)
+{
+    texture_t *tex;
+    uint8_t *img;
+
+    if (!is_compressed_format_supported(format)) {
+        img = ktx_decode(format, data, w, h);
+        if (!img) return NULL;
+        tex = texture_from_data(img, w, h, 3, 0, 0, w, h, 0);
+        free(img);
+        return tex;
+    }
+
+    tex = calloc(1, sizeof(*tex));
+    tex->ref = 1;
+    tex->w = tex->tex_w = w;
+    tex->h = tex->tex_h = h;
+    // All the supported compressed formats are opaque RGB.
+    tex->format = GL_RGB;
+    GL(glGenTextures(1, &tex->id));
+    GL(glActiveTexture(GL_TEXTURE0));
+    GL(glBindTexture(GL_TEXTURE_2D, tex->id));
+    GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL(glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, size, data));
+    return tex;
+}
+
 texture_t *texture_from_url(const char *url, int flags)
 {
     texture_t *tex;
@@ -67,6 +67,23 @@ texture_t *texture_create(int w, int h, int bpp);
 texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
                              int x, int y, int w, int h, int flags);
 texture_t *texture_from_url(const char *url, int flags);
+
+/*
+ * Function: texture_from_compressed
+ * Create a texture from block compressed data.
+ *
+ * If the GPU doesn't support the format, the data is decompressed on the
+ * CPU and uploaded as a normal RGB texture.
+ *
+ * Parameters:
+ *   format - One of the <KTX_FORMATS> values.
+ *   data   - The compressed data.
+ *   size   - Size of the compressed data.
+ *   w      - Width of the image.
+ *   h      - Height of the image.
+ */
+texture_t *texture_from_compressed(int format, const void *data, int size,
+                                   int w, int h);
 bool texture_load(texture_t *tex, int *code);
 void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp);
 void texture_release(texture_t *tex);
@@ -31,4 +31,175 @@ bool worker_is_running(worker_t *w)
     return false;
 }
 
+void worker_parallel_for(int nb, void *user,
+                         void (*f)(void *user, int start, int end))
+{
+    if (nb) f(user, 0, nb);
+}
+
+int worker_get_nb_threads(void)
+{
+    return 1;
+}
+
+#else // HAVE_PTHREAD
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Max number of threads used by worker_parallel_for.
+#define MAX_THREADS 16
+
+enum {
+    STATE_IDLE      = 0,
+    STATE_RUNNING   = 1,
+    STATE_DONE      = 2,
+};
+
+// Pool of threads used by worker_parallel_for.  The threads wait for the
+// generation value to change, and then process chunks of the current job
+// until all the range is done.
+static struct {
+    pthread_once_t  once;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;       // Signaled when a new job starts.
+    pthread_cond_t  done_cond;  // Signaled when all the threads are done.
+    int             nb_threads;
+    int             generation;
+    int             pending;    // Number of threads still working.
+
+    // Current job.
+    void            (*f)(void *user, int start, int end);
+    void            *user;
+    int             nb;
+    int             chunk;
+    int             next;
+} g_pool = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *worker_thread(void *arg)
+{
+    worker_t *w = arg;
+    w->ret = w->fn(w);
+    __atomic_store_n(&w->state, STATE_DONE, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void worker_init(worker_t *w, int (*fn)(worker_t *w))
+{
+    memset(w, 0, sizeof(*w));
+    w->fn = fn;
+}
+
+int worker_iter(worker_t *w)
+{
+    pthread_t thread;
+    int state = __atomic_load_n(&w->state, __ATOMIC_ACQUIRE);
+
+    if (state == STATE_DONE) return 1;
+    if (state == STATE_RUNNING) return 0;
+    w->state = STATE_RUNNING;
+    if (pthread_create(&thread, NULL, worker_thread, w) != 0) {
+        // No thread available: run the function directly.
+        worker_thread(w);
+        return 1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+bool worker_is_running(worker_t *w)
+{
+    return __atomic_load_n(&w->state, __ATOMIC_ACQUIRE) == STATE_RUNNING;
+}
+
+static void pool_run_job(void)
+{
+    int start, end;
+    while (true) {
+        start = __atomic_fetch_add(&g_pool.next, g_pool.chunk,
+                                   __ATOMIC_RELAXED);
+        if (start >= g_pool.nb) break;
+        end = start + g_pool.chunk < g_pool.nb ? start + g_pool.chunk :
+                                                 g_pool.nb;
+        g_pool.f(g_pool.user, start, end);
+    }
+}
+
+static void *pool_thread(void *arg)
+{
+    int generation = 0;
+    pthread_mutex_lock(&g_pool.lock);
+    while (true) {
+        while (g_pool.generation == generation)
+            pthread_cond_wait(&g_pool.cond, &g_pool.lock);
+        generation = g_pool.generation;
+        pthread_mutex_unlock(&g_pool.lock);
+        pool_run_job();
+        pthread_mutex_lock(&g_pool.lock);
+        if (--g_pool.pending == 0)
+            pthread_cond_signal(&g_pool.done_cond);
+    }
+    return NULL;
+}
+
+static void pool_init(void)
+{
+    int i;
+    pthread_t thread;
+    long nb = sysconf(_SC_NPROCESSORS_ONLN);
+
+    nb = nb < 1 ? 1 : nb > MAX_THREADS ? MAX_THREADS : nb;
+    // The calling thread also takes part in the jobs.
+    for (i = 0; i < nb - 1; i++) {
+        if (pthread_create(&thread, NULL, pool_thread, NULL) != 0) break;
+        pthread_detach(thread);
+    }
+    g_pool.nb_threads = i + 1;
+}
+
+void worker_parallel_for(int nb, void *user,
+                         void (*f)(void *user, int start, int end))
+{
+    // Only one job at a time.
+    static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+    if (!nb) return;
+    pthread_once(&g_pool.once, pool_init);
+    if (g_pool.nb_threads == 1) {
+        f(user, 0, nb);
+        return;
+    }
+    pthread_mutex_lock(&job_lock);
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.f = f;
+    g_pool.user = user;
+    g_pool.nb = nb;
+    g_pool.next = 0;
+    // Small enough chunks so that the threads stay busy until the end.
+    g_pool.chunk = nb / (g_pool.nb_threads * 8) ?: 1;
+    g_pool.pending = g_pool.nb_threads - 1;
+    g_pool.generation++;
+    pthread_cond_broadcast(&g_pool.cond);
+    pthread_mutex_unlock(&g_pool.lock);
+
+    pool_run_job();
+
+    pthread_mutex_lock(&g_pool.lock);
+    while (g_pool.pending)
+        pthread_cond_wait(&g_pool.done_cond, &g_pool.lock);
+    pthread_mutex_unlock(&g_pool.lock);
+    pthread_mutex_unlock(&job_lock);
+}
+
+int worker_get_nb_threads(void)
+{
+    pthread_once(&g_pool.once, pool_init);
+    return g_pool.nb_threads;
+}
+
 #endif
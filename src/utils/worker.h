@@ -14,6 +14,10 @@
  * A worker is simply a task that run in a thread pool.  We can create a worker
  * with <worker_init> and then run it by calling <worker_iter> as many times
  * as we want, until it returns a non zero value.
+ *
+ * The threads are only used if HAVE_PTHREAD is defined (scons pthread=1),
+ * otherwise the workers and <worker_parallel_for> run synchronously in the
+ * calling thread.
  */
 
 #ifndef WORKER_H
@@ -59,4 +63,27 @@ int worker_iter(worker_t *worker);
  */
 bool worker_is_running(worker_t *worker);
 
+/*
+ * Function: worker_parallel_for
+ * Call a function on a range of indices, split over all the threads.
+ *
+ * The function is called several times on sub ranges, possibly at the same
+ * time from different threads, and we only return once all the range has
+ * been processed.  Without thread support this just calls the function
+ * once on the whole range.
+ *
+ * Parameters:
+ *   nb     - Number of indices.
+ *   user   - User data passed to the function.
+ *   f      - Function called on the sub ranges [start, end).
+ */
+void worker_parallel_for(int nb, void *user,
+                         void (*f)(void *user, int start, int end));
+
+/*
+ * Function: worker_get_nb_threads
+ * Return the number of threads used by <worker_parallel_for>.
+ */
+int worker_get_nb_threads(void);
+
 #endif // WORKER_H
@@ -24,6 +24,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 enum {
     UV_MAP_HEALPIX = 1,
@@ -38,6 +39,11 @@ struct uv_map
     // If set, will be applied after the map function.
     const double (*transf)[4][4];
     const void *user;
+    // If not zero, identifies the mapping computed by the map function
+    // (not including transf), so that the renderer can cache its grids.
+    // It can be any hash or version of the map parameters, as long as it
+    // changes when they do.  Healpix maps don't need it.
+    uint64_t key;
 
     // Healpix specific attributes.
     int order;
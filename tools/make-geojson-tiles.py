@@ -0,0 +1,249 @@
+#!/usr/bin/python3
+
+# Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+#
+# This program is licensed under the terms of the GNU AGPL v3, or
+# alternatively under a commercial licence.
+#
+# The terms of the AGPL v3 license can be found in the main directory of this
+# repository.
+
+# Convert the tiles of a geojson HiPS survey into the binary tiles format
+# loaded by the geojson-survey module (see src/modules/geojson.c for the
+# format description).
+#
+# Usage: make-geojson-tiles.py SURVEY_DIR
+#
+# A .gjb file is created next to each .geojson tile, and 'gjb' is added to
+# the hips_tile_format property so that the engine loads the binary tiles.
+# Only the Polygon, MultiPolygon, LineString and Point geometries are
+# supported.  The polygons are triangulated here with ear clipping.
+
+import glob
+import json
+import math
+import os
+import struct
+import sys
+import time
+
+VERSION = 1
+HEADER = struct.Struct('<4sIII')
+QUANT = 1e6  # Vertices units per degree.
+
+# Same values as in src/geojson_parser.h
+GEOJSON_POLYGON = 0
+GEOJSON_LINESTRING = 2
+GEOJSON_POINT = 3
+
+
+def varint(v, out):
+    assert v >= 0
+    while True:
+        b = v & 0x7f
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return
+
+
+def vertices(points, out):
+    last = [0, 0]
+    for p in points:
+        for i in range(2):
+            q = int(round(p[i] * QUANT))
+            d = q - last[i]
+            varint((d << 1) ^ (d >> 63), out)
+            last[i] = q
+
+
+def lonlat2c(p):
+    lon, lat = math.radians(p[0]), math.radians(p[1])
+    return (math.cos(lat) * math.cos(lon), math.cos(lat) * math.sin(lon),
+            math.sin(lat))
+
+
+def project_rings(rings):
+    # Gnomonic projection of the rings on the plane tangent to their
+    # center.
+    vs = [[lonlat2c(p) for p in ring] for ring in rings]
+    c = [sum(v[i] for v in vs[0]) for i in range(3)]
+    n = math.sqrt(sum(x * x for x in c))
+    c = [x / n for x in c]
+    a = (0, 0, 1) if abs(c[2]) < 0.9 else (1, 0, 0)
+    e1 = (a[1] * c[2] - a[2] * c[1], a[2] * c[0] - a[0] * c[2],
+          a[0] * c[1] - a[1] * c[0])
+    n = math.sqrt(sum(x * x for x in e1))
+    e1 = [x / n for x in e1]
+    e2 = (c[1] * e1[2] - c[2] * e1[1], c[2] * e1[0] - c[0] * e1[2],
+          c[0] * e1[1] - c[1] * e1[0])
+    ret = []
+    for ring in vs:
+        proj = []
+        for v in ring:
+            d = sum(v[i] * c[i] for i in range(3))
+            if d <= 0:
+                raise ValueError('Polygon larger than a hemisphere')
+            proj.append((sum(v[i] * e1[i] for i in range(3)) / d,
+                         sum(v[i] * e2[i] for i in range(3)) / d))
+        ret.append(proj)
+    return ret
+
+
+def area(pts):
+    return sum(pts[i - 1][0] * pts[i][1] - pts[i][0] * pts[i - 1][1]
+               for i in range(len(pts))) / 2
+
+
+def cross(o, a, b):
+    return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0])
+
+
+def segments_intersect(a, b, c, d):
+    return (cross(a, b, c) * cross(a, b, d) < 0 and
+            cross(c, d, a) * cross(c, d, b) < 0)
+
+
+def bridge_hole(poly, hole, pts):
+    # Connect the hole rightmost vertex to the closest visible vertex of
+    # the polygon, and insert the hole there.
+    m = max(range(len(hole)), key=lambda i: pts[hole[i]][0])
+    hole = hole[m:] + hole[:m]
+    pm = pts[hole[0]]
+    edges = ([(poly[i - 1], poly[i]) for i in range(len(poly))] +
+             [(hole[i - 1], hole[i]) for i in range(len(hole))])
+    best = None
+    for i, v in enumerate(poly):
+        if any(segments_intersect(pm, pts[v], pts[a], pts[b])
+               for a, b in edges if v not in (a, b) and hole[0] not in (a, b)):
+            continue
+        d = (pts[v][0] - pm[0]) ** 2 + (pts[v][1] - pm[1]) ** 2
+        if best is None or d < best[0]:
+            best = (d, i)
+    if best is None:
+        raise ValueError('Cannot bridge polygon hole')
+    i = best[1]
+    return poly[:i + 1] + hole + [hole[0]] + poly[i:]
+
+
+def point_in_triangle(p, a, b, c):
+    return (cross(a, b, p) >= 0 and cross(b, c, p) >= 0 and
+            cross(c, a, p) >= 0)
+
+
+def triangulate(rings):
+    # Ear clipping triangulation.  Return the triangles indices into the
+    # concatenated rings vertices.
+    pts = [p for ring in project_rings(rings) for p in ring]
+    ofs, loops = 0, []
+    for ring in rings:
+        idx = list(range(ofs, ofs + len(ring)))
+        ofs += len(ring)
+        # Outer ring counter clockwise, holes clockwise.
+        if (area([pts[i] for i in idx]) > 0) != (not loops):
+            idx.reverse()
+        loops.append(idx)
+    poly = loops[0]
+    for hole in sorted(loops[1:], key=lambda h: -max(pts[i][0] for i in h)):
+        poly = bridge_hole(poly, hole, pts)
+
+    tris = []
+    while len(poly) > 3:
+        n = len(poly)
+        for i in range(n):
+            a, b, c = poly[i - 1], poly[i], poly[(i + 1) % n]
+            if cross(pts[a], pts[b], pts[c]) <= 0:
+                continue
+            if any(point_in_triangle(pts[v], pts[a], pts[b], pts[c])
+                   for v in poly if pts[v] not in (pts[a], pts[b], pts[c])):
+                continue
+            break
+        else:
+            i = 0  # Degenerated polygon: just cut the first vertex.
+            a, b, c = poly[-1], poly[0], poly[1]
+        tris += [a, b, c]
+        del poly[i]
+    tris += poly
+    return tris
+
+
+def add_polygon(coordinates, out):
+    # Like the engine, we ignore the last point of the rings.
+    rings = [ring[:-1] for ring in coordinates]
+    varint(GEOJSON_POLYGON, out)
+    varint(len(rings), out)
+    for ring in rings:
+        varint(len(ring), out)
+    vertices([p for ring in rings for p in ring], out)
+    tris = triangulate(rings)
+    varint(len(tris), out)
+    for i in tris:
+        varint(i, out)
+
+
+def add_geometry(geo, out):
+    t = geo['type']
+    if t == 'Polygon':
+        varint(1, out)
+        add_polygon(geo['coordinates'], out)
+    elif t == 'MultiPolygon':
+        varint(len(geo['coordinates']), out)
+        for poly in geo['coordinates']:
+            add_polygon(poly, out)
+    elif t == 'LineString':
+        varint(1, out)
+        varint(GEOJSON_LINESTRING, out)
+        varint(len(geo['coordinates']), out)
+        vertices(geo['coordinates'], out)
+    elif t == 'Point':
+        varint(1, out)
+        varint(GEOJSON_POINT, out)
+        vertices([geo['coordinates']], out)
+    else:
+        raise ValueError(f'Unsupported geometry: {t}')
+
+
+def convert_tile(data):
+    mask = data.get('hips', {}).get('children_mask', 15)
+    if 'type' not in data:  # Empty tile.
+        return HEADER.pack(b'GJBT', VERSION, mask, 0)
+    geos = bytearray()
+    features = []
+    for feature in data['features']:
+        add_geometry(feature['geometry'], geos)
+        features.append({k: v for k, v in feature.items() if k != 'geometry'})
+    props = json.dumps({'features': features}, separators=(',', ':'),
+                       ensure_ascii=False).encode() + b'\0'
+    return HEADER.pack(b'GJBT', VERSION, mask, len(props)) + props + geos
+
+
+def update_properties(path):
+    lines = open(path).read().splitlines()
+    for i, line in enumerate(lines):
+        key, _, value = line.partition('=')
+        if key.strip() == 'hips_tile_format' and 'gjb' not in value:
+            lines[i] = line.rstrip() + ' gjb'
+    open(path, 'w').write('\n'.join(lines) + '\n')
+
+
+def run(survey):
+    src_size = dst_size = nb = 0
+    t = time.time()
+    for path in sorted(glob.glob(f'{survey}/Norder*/Dir*/Npix*.geojson')):
+        with open(path, 'rb') as f:
+            src = f.read()
+        dst = convert_tile(json.loads(src))
+        with open(os.path.splitext(path)[0] + '.gjb', 'wb') as f:
+            f.write(dst)
+        src_size += len(src)
+        dst_size += len(dst)
+        nb += 1
+    update_properties(f'{survey}/properties')
+    print(f'{nb} tiles in {time.time() - t:.1f}s, '
+          f'geojson: {src_size // 1024} KB, gjb: {dst_size // 1024} KB')
+
+
+if __name__ == '__main__':
+    run(sys.argv[1])
@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+
+# Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+#
+# This program is licensed under the terms of the GNU AGPL v3, or
+# alternatively under a commercial licence.
+#
+# The terms of the AGPL v3 license can be found in the main directory of this
+# repository.
+
+# Convert a satellites jsonl file (noctuasky server format) into the binary
+# catalogue format loaded by the satellites module with the 'bin/sat' key.
+#
+# Usage: make-sat-catalog.py tle_satellite.jsonl.gz tle_satellite.bin.gz
+#
+# The TLE are parsed and converted to the SGP4 units here, the same way
+# twoline2rv does in ext_src/sgp4/SGP4.cpp, so that the engine can directly
+# initialize the SGP4 records.
+
+import datetime
+import gzip
+import json
+import math
+import struct
+import sys
+
+VERSION = 1
+HEADER = struct.Struct('<4sIII')
+RECORD = struct.Struct('<2d9d2dfiII')
+XPDOTP = 1440.0 / (2.0 * math.pi)
+DEG2RAD = math.pi / 180.0
+MJD0 = datetime.date(1858, 11, 17)
+
+
+def parse_exp(s):
+    # TLE decimal assumed notation, e.g. ' 12345-4' -> 0.12345e-4
+    s = s.replace(' ', '0') if s.strip() else '00000-0'
+    sign = -1 if s[0] == '-' else 1
+    return sign * float('0.' + s[1:6]) * 10 ** int(s[6:8])
+
+
+def jday(year, days):
+    # Julian date of a TLE epoch, split in the integer + 0.5 part and the
+    # fraction.
+    jd = (367.0 * year - math.floor(7 * year * 0.25) + 30 + 1721013.5 +
+          math.floor(days))
+    return jd, days - math.floor(days)
+
+
+def parse_tle(l1, l2):
+    year = int(l1[18:20])
+    year += 2000 if year < 57 else 1900
+    return dict(
+        epoch=jday(year, float(l1[20:32])),
+        bstar=parse_exp(l1[53:61]),
+        ndot=float(l1[33:43]) / (XPDOTP * 1440.0),
+        nddot=parse_exp(l1[44:52]) / (XPDOTP * 1440.0 * 1440.0),
+        inclo=float(l2[8:16]) * DEG2RAD,
+        nodeo=float(l2[17:25]) * DEG2RAD,
+        ecco=float('0.' + l2[26:33].replace(' ', '0')),
+        argpo=float(l2[34:42]) * DEG2RAD,
+        mo=float(l2[43:51]) * DEG2RAD,
+        no_kozai=float(l2[52:63]) / XPDOTP,
+    )
+
+
+def parse_date(s):
+    if not s:
+        return 0
+    d = datetime.datetime.strptime(s, '%Y-%m-%d').date()
+    return float((d - MJD0).days)
+
+
+class Pool:
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets = {}
+
+    def add_list(self, values):
+        data = b''.join(v.encode() + b'\0' for v in values) + b'\0'
+        if data not in self.offsets:
+            self.offsets[data] = len(self.data)
+            self.data += data
+        return self.offsets[data]
+
+
+def run(src, dst):
+    pool = Pool()
+    records = []
+    with (gzip.open if src.endswith('.gz') else open)(src, 'rt') as f:
+        for line in f:
+            sat = json.loads(line)
+            md = sat['model_data']
+            tle = parse_tle(*md['tle'])
+            mag = md.get('mag')
+            records.append(RECORD.pack(
+                tle['epoch'][0], tle['epoch'][1],
+                tle['bstar'], tle['ndot'], tle['nddot'], tle['ecco'],
+                tle['argpo'], tle['inclo'], tle['mo'], tle['no_kozai'],
+                tle['nodeo'],
+                parse_date(md.get('launch_date')),
+                parse_date(md.get('decay_date')),
+                float('nan') if mag is None else mag,
+                md['norad_number'],
+                pool.add_list(sat.get('names', [])),
+                pool.add_list(sat.get('types', []))))
+
+    data = (HEADER.pack(b'SATB', VERSION, len(records), len(pool.data)) +
+            b''.join(records) + pool.data)
+    with (gzip.open if dst.endswith('.gz') else open)(dst, 'wb') as out:
+        out.write(data)
+    print(f'{len(records)} satellites, {len(data) // 1024} KB')
+
+
+if __name__ == '__main__':
+    run(sys.argv[1], sys.argv[2])